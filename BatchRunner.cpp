@@ -0,0 +1,108 @@
+/*
+ *  BatchRunner.cpp
+ *  mindstormssimulation
+ *
+ *  Created by agent on 18.10.26
+ *  Copyright 2026 RWTH Aachen University All rights reserved.
+ *
+ */
+
+#include "BatchRunner.h"
+
+#include <cstdlib>
+#include <stdexcept>
+
+#include "NativeCode.h"
+#include "RXEFileCache.h"
+#include "ThreadPool.h"
+#include "Time.h"
+#include "VMMemory.h"
+
+BatchRunner::BatchRunner(const Environment *anEnvironment)
+: environment(anEnvironment), useNativeCode(false)
+{
+}
+
+BatchRunner::~BatchRunner()
+{
+	for (std::vector<Job>::iterator iter = jobs.begin(); iter != jobs.end(); ++iter)
+		delete iter->run;
+	for (std::map<std::string, Program>::iterator iter = programs.begin(); iter != programs.end(); ++iter)
+	{
+		delete iter->second.initialMemory;
+		RXEFileCache::sharedCache()->release(iter->second.file);
+	}
+}
+
+void BatchRunner::addRun(const char *rxeFilename, unsigned seed)
+{
+	Job job;
+	job.run = NULL;
+	job.result.program = rxeFilename;
+	job.result.seed = seed;
+	job.result.simulatedSeconds = 0.0f;
+	job.result.wallMilliseconds = 0;
+
+	try
+	{
+		std::map<std::string, Program>::iterator found = programs.find(job.result.program);
+		Program program;
+		if (found != programs.end())
+			program = found->second;
+		else
+		{
+			program.file = RXEFileCache::sharedCache()->acquire(rxeFilename);
+			try
+			{
+				program.initialMemory = new VMMemory(program.file);
+			}
+			catch (std::runtime_error &)
+			{
+				RXEFileCache::sharedCache()->release(program.file);
+				throw;
+			}
+			programs[job.result.program] = program;
+		}
+
+		job.run = new HeadlessRun(program.file, environment, program.initialMemory, seed);
+		if (useNativeCode)
+			job.run->loadNativeCode(NativeCode::libraryPathForProgram(job.result.program).c_str());
+	}
+	catch (std::runtime_error &e)
+	{
+		job.result.error = e.what();
+		delete job.run;
+		job.run = NULL;
+	}
+
+	jobs.push_back(job);
+}
+
+void BatchRunner::runJob(Job *job, float seconds)
+{
+	unsigned start = millisecondsSinceStart();
+	std::vector<HeadlessRun::Sample> noTrace;
+	job->run->run(seconds, 0.0f, noTrace);
+	job->result.wallMilliseconds = millisecondsSinceStart() - start;
+	job->result.simulatedSeconds = job->run->getSimulatedTime();
+	job->result.final = job->run->getSample();
+}
+
+std::vector<BatchRunner::Result> BatchRunner::run(float seconds, unsigned threadCount)
+{
+	{
+		ThreadPool pool(threadCount);
+		for (std::vector<Job>::iterator iter = jobs.begin(); iter != jobs.end(); ++iter)
+		{
+			if (!iter->run) continue;
+			Job *job = &*iter;
+			pool.submit([job, seconds]() { runJob(job, seconds); });
+		}
+		pool.waitUntilDone();
+	}
+
+	std::vector<Result> results;
+	for (std::vector<Job>::const_iterator iter = jobs.begin(); iter != jobs.end(); ++iter)
+		results.push_back(iter->result);
+	return results;
+}
@@ -0,0 +1,112 @@
+#pragma once
+/*
+ *  BatchRunner.h
+ *  mindstormssimulation
+ *
+ *  Created by agent on 18.10.26
+ *  Copyright 2026 RWTH Aachen University All rights reserved.
+ *
+ */
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "HeadlessRun.h"
+
+class Environment;
+class RXEFile;
+class VMMemory;
+
+/*!
+ * @abstract Runs many headless simulations in parallel.
+ * @discussion Used to evaluate a set of programs, or one program from many
+ * start positions. Every program file is loaded only once and shared by all
+ * runs of it, as is the arena; only the VM memory, the robot and the
+ * simulation state exist once per run, and that starts as a copy of a
+ * snapshot taken when the program was loaded. The runs are independent of
+ * each other and are spread over a ThreadPool.
+ *
+ * The results do not depend on the number of threads: Each run uses its own
+ * simulated clock and its own random numbers, seeded from the seed of the
+ * run, so nothing a run does depends on the others.
+ */
+class BatchRunner
+{
+public:
+	/*!
+	 * @abstract Outcome of one run.
+	 */
+	struct Result
+	{
+		/*! The program file, as passed to addRun. */
+		std::string program;
+		/*! Seed for the start position. */
+		unsigned seed;
+		/*! Empty if the run worked, otherwise why not. */
+		std::string error;
+		/*! State of the robot at the end. Undefined if error is set. */
+		HeadlessRun::Sample final;
+		/*! Simulated and real time the run took. */
+		float simulatedSeconds;
+		unsigned wallMilliseconds;
+	};
+
+private:
+	struct Job
+	{
+		HeadlessRun *run;
+		Result result;
+	};
+
+	struct Program
+	{
+		const RXEFile *file;
+		VMMemory *initialMemory;
+	};
+
+	const Environment *environment;
+	bool useNativeCode;
+	std::map<std::string, Program> programs;
+	std::vector<Job> jobs;
+
+	BatchRunner(const BatchRunner &);
+	BatchRunner &operator=(const BatchRunner &);
+
+	static void runJob(Job *job, float seconds);
+
+public:
+	/*!
+	 * @abstract Creates an empty batch.
+	 * @param environment The arena for all runs. Not owned, must not change
+	 * while the batch runs.
+	 */
+	BatchRunner(const Environment *environment);
+	~BatchRunner();
+
+	/*!
+	 * @abstract Whether runs added from now on use native code.
+	 * @discussion The translation of each program is expected where
+	 * NativeCode::libraryPathForProgram says. Runs for which it can not be
+	 * loaded fail.
+	 */
+	void setUsesNativeCode(bool useNative) { useNativeCode = useNative; }
+	
+	/*!
+	 * @abstract Adds a run.
+	 * @discussion Problems loading the program do not throw, but are
+	 * reported in the run's result.
+	 * @param rxeFilename The program to run.
+	 * @param seed Seed for the random start position and all other random
+	 * values of the run.
+	 */
+	void addRun(const char *rxeFilename, unsigned seed);
+
+	/*!
+	 * @abstract Runs everything that was added.
+	 * @param seconds Simulated time for each run.
+	 * @param threadCount Number of threads, or 0 for one per hardware thread.
+	 * @result The results, in the order the runs were added.
+	 */
+	std::vector<Result> run(float seconds, unsigned threadCount = 0);
+};
@@ -7,31 +7,262 @@
  *
  */
 
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <vector>
 
-#include "Interpreter.h"
-#include "System.h"
-#include "RXEFile.h"
+#include "BatchRunner.h"
+#include "Environment.h"
+#include "ExecutionContext.h"
+#include "HeadlessRun.h"
+#include "NativeCode.h"
+#include "SelfTest.h"
+#include "Time.h"
+#include "VMMemory.h"
 
 void printUsageAndExit()
 {
-	std::cout << "Crude Simulator for RXE files." << std::endl;
-	std::cout << "Usage: RXEAnalyzer inputfile" << std::endl;
+	std::cout << "Headless simulator for RXE files." << std::endl;
+	std::cout << "Usage: clisimulator [options] program.rxe [arena]" << std::endl;
+	std::cout << "       clisimulator --batch [options] program.rxe [program.rxe ...]" << std::endl;
+	std::cout << "       clisimulator --compare-native [options] program.rxe [program.rxe ...]" << std::endl;
+	std::cout << "Runs the program on simulated time, as fast as possible, and prints" << std::endl;
+	std::cout << "a trace of the robot's position, motors and sensors." << std::endl;
+	std::cout << "The arena file is the one the simulator saves on exit (current_map.bin)." << std::endl;
+	std::cout << "Options:" << std::endl;
+	std::cout << "\t-t=, --time=\tSimulated seconds to run for (default 60)" << std::endl;
+	std::cout << "\t-i=, --interval=\tSimulated seconds between trace lines (default 0.1, 0 for no trace)" << std::endl;
+	std::cout << "\t--seed=\tSeed for the random start position and values (default 0)" << std::endl;
+	std::cout << "\t--native\tRun the translation of the program (see RXEAnalyzer --translate)," << std::endl;
+	std::cout << "\t\tcompiled into a shared library next to it (program.so, .dylib or .dll)" << std::endl;
+	std::cout << "Batch mode runs all programs in parallel and prints only the final state:" << std::endl;
+	std::cout << "\t--batch\tRun in batch mode" << std::endl;
+	std::cout << "\t--arena=\tArena file for all runs (default: empty arena)" << std::endl;
+	std::cout << "\t--runs=\tRuns per program, with seeds counting up from --seed (default 1)" << std::endl;
+	std::cout << "\t--jobs=\tNumber of threads (default: one per processor)" << std::endl;
+	std::cout << "--compare-native runs each program both interpreted and as native code" << std::endl;
+	std::cout << "and checks that the memory is the same after every interval." << std::endl;
+	std::cout << "--self-test runs the simulator's own checks and prints those that fail." << std::endl;
 	exit(0);
 }
 
+int runBatch(const std::vector<const char *> &programs, const char *arenaFilename, float simulatedSeconds, unsigned seed, unsigned runsPerProgram, unsigned threadCount, bool useNativeCode)
+{
+	Environment *environment = NULL;
+	try
+	{
+		environment = arenaFilename ? HeadlessRun::loadArena(arenaFilename) : HeadlessRun::createDefaultArena();
+	}
+	catch (std::runtime_error &e)
+	{
+		std::cerr << "Could not load arena: " << e.what() << std::endl;
+		return 1;
+	}
+
+	BatchRunner batch(environment);
+	batch.setUsesNativeCode(useNativeCode);
+	for (std::vector<const char *>::const_iterator iter = programs.begin(); iter != programs.end(); ++iter)
+		for (unsigned i = 0; i < runsPerProgram; i++)
+			batch.addRun(*iter, seed + i);
+
+	unsigned start = millisecondsSinceStart();
+	std::vector<BatchRunner::Result> results = batch.run(simulatedSeconds, threadCount);
+	unsigned elapsed = millisecondsSinceStart() - start;
+
+	int status = 0;
+	float totalSimulated = 0.0f;
+	printf("program\tseed\tx\tz\theading\tsimulated\tms\n");
+	for (std::vector<BatchRunner::Result>::const_iterator iter = results.begin(); iter != results.end(); ++iter)
+	{
+		if (!iter->error.empty())
+		{
+			printf("%s\t%u\terror: %s\n", iter->program.c_str(), iter->seed, iter->error.c_str());
+			status = 1;
+			continue;
+		}
+		printf("%s\t%u\t%.4f\t%.4f\t%.2f\t%.2f\t%u\n", iter->program.c_str(), iter->seed, iter->final.x, iter->final.z, iter->final.heading, iter->simulatedSeconds, iter->wallMilliseconds);
+		totalSimulated += iter->simulatedSeconds;
+	}
+
+	fprintf(stderr, "%u runs, %.2f simulated s in %u ms", unsigned(results.size()), totalSimulated, elapsed);
+	if (elapsed > 0)
+		fprintf(stderr, " (%.1f simulated s per s)", totalSimulated * 1000.0f / float(elapsed));
+	fprintf(stderr, "\n");
+
+	delete environment;
+	return status;
+}
+
+int compareNative(const std::vector<const char *> &programs, const char *arenaFilename, float simulatedSeconds, float sampleInterval, unsigned seed)
+{
+	Environment *environment = NULL;
+	try
+	{
+		environment = arenaFilename ? HeadlessRun::loadArena(arenaFilename) : HeadlessRun::createDefaultArena();
+	}
+	catch (std::runtime_error &e)
+	{
+		std::cerr << "Could not load arena: " << e.what() << std::endl;
+		return 1;
+	}
+
+	unsigned sampleCount = 1;
+	float interval = simulatedSeconds;
+	if (sampleInterval > 0.0f && sampleInterval < simulatedSeconds)
+	{
+		sampleCount = unsigned(simulatedSeconds / sampleInterval + 0.5f);
+		interval = sampleInterval;
+	}
+
+	int status = 0;
+	printf("program\tresult\n");
+	for (std::vector<const char *>::const_iterator iter = programs.begin(); iter != programs.end(); ++iter)
+	{
+		HeadlessRun *interpreted = NULL;
+		HeadlessRun *native = NULL;
+		try
+		{
+			interpreted = new HeadlessRun(*iter, environment, seed);
+			native = new HeadlessRun(*iter, environment, seed);
+			native->loadNativeCode(NativeCode::libraryPathForProgram(*iter).c_str());
+		}
+		catch (std::runtime_error &e)
+		{
+			printf("%s\terror: %s\n", *iter, e.what());
+			status = 1;
+			delete interpreted;
+			delete native;
+			continue;
+		}
+
+		std::vector<HeadlessRun::Sample> noTrace;
+		unsigned difference = ~0u;
+		unsigned sample;
+		for (sample = 0; sample < sampleCount && difference == ~0u; sample++)
+		{
+			interpreted->run(interval, 0.0f, noTrace);
+			native->run(interval, 0.0f, noTrace);
+			difference = interpreted->getContext()->getMemory()->findDifference(*native->getContext()->getMemory());
+		}
+
+		if (difference == ~0u)
+			printf("%s\tsame memory at all %u samples\n", *iter, sampleCount);
+		else
+		{
+			printf("%s\tmemory differs at %.2f s in DSTOC entry %u\n", *iter, interpreted->getSimulatedTime(), difference);
+			status = 1;
+		}
+
+		delete interpreted;
+		delete native;
+	}
+
+	delete environment;
+	return status;
+}
+
 int main(int argc, char *argv[])
 {
-	if (argc != 2) printUsageAndExit();
-	
-	System *system = new System;
-	RXEFile *file = new RXEFile(argv[1]);
-	Interpreter *interp = new Interpreter(file, system);
-	
-	while (true)
+	const char *programFilename = NULL;
+	const char *arenaFilename = NULL;
+	float simulatedSeconds = 60.0f;
+	float sampleInterval = 0.1f;
+	unsigned seed = 0;
+	bool batchMode = false;
+	bool compareMode = false;
+	bool useNativeCode = false;
+	unsigned runsPerProgram = 1;
+	unsigned threadCount = 0;
+	std::vector<const char *> batchPrograms;
+
+	for (int i = 1; i < argc; i++)
+	{
+		float value;
+		unsigned intValue;
+		if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0)
+			printUsageAndExit();
+		else if (strcmp(argv[i], "--self-test") == 0)
+			return runSelfTests() == 0 ? 0 : 1;
+		else if (sscanf(argv[i], "--time=%f", &value) == 1 || sscanf(argv[i], "-t=%f", &value) == 1)
+			simulatedSeconds = value;
+		else if (sscanf(argv[i], "--interval=%f", &value) == 1 || sscanf(argv[i], "-i=%f", &value) == 1)
+			sampleInterval = value;
+		else if (sscanf(argv[i], "--seed=%u", &intValue) == 1)
+			seed = intValue;
+		else if (strcmp(argv[i], "--batch") == 0)
+			batchMode = true;
+		else if (strcmp(argv[i], "--compare-native") == 0)
+			compareMode = batchMode = true;
+		else if (strcmp(argv[i], "--native") == 0)
+			useNativeCode = true;
+		else if (strncmp(argv[i], "--arena=", 8) == 0)
+			arenaFilename = argv[i] + 8;
+		else if (sscanf(argv[i], "--runs=%u", &intValue) == 1 && intValue > 0)
+			runsPerProgram = intValue;
+		else if (sscanf(argv[i], "--jobs=%u", &intValue) == 1)
+			threadCount = intValue;
+		else if (batchMode)
+			batchPrograms.push_back(argv[i]);
+		else if (!programFilename)
+			programFilename = argv[i];
+		else if (!arenaFilename)
+			arenaFilename = argv[i];
+		else
+			printUsageAndExit();
+	}
+	if (simulatedSeconds < 0.0f) printUsageAndExit();
+
+	startTimeCount();
+
+	if (batchMode)
+	{
+		if (batchPrograms.empty()) printUsageAndExit();
+		if (compareMode)
+			return compareNative(batchPrograms, arenaFilename, simulatedSeconds, sampleInterval, seed);
+		return runBatch(batchPrograms, arenaFilename, simulatedSeconds, seed, runsPerProgram, threadCount, useNativeCode);
+	}
+	if (!programFilename) printUsageAndExit();
+
+	Environment *environment = NULL;
+	HeadlessRun *run = NULL;
+	try
+	{
+		environment = arenaFilename ? HeadlessRun::loadArena(arenaFilename) : HeadlessRun::createDefaultArena();
+		run = new HeadlessRun(programFilename, environment, seed);
+		if (useNativeCode)
+			run->loadNativeCode(NativeCode::libraryPathForProgram(programFilename).c_str());
+	}
+	catch (std::runtime_error &e)
+	{
+		std::cerr << "Could not start: " << e.what() << std::endl;
+		delete run;
+		delete environment;
+		return 1;
+	}
+
+	std::vector<HeadlessRun::Sample> trace;
+	unsigned start = millisecondsSinceStart();
+	run->run(simulatedSeconds, sampleInterval, trace);
+	unsigned elapsed = millisecondsSinceStart() - start;
+
+	if (!trace.empty())
 	{
-		interp->step();
+		HeadlessRun::printSampleHeader(stdout);
+		for (std::vector<HeadlessRun::Sample>::const_iterator iter = trace.begin(); iter != trace.end(); ++iter)
+			HeadlessRun::printSample(stdout, *iter);
 	}
-	
+
+	HeadlessRun::Sample last = run->getSample();
+	printf("final\tx=%.4f\tz=%.4f\theading=%.2f\n", last.x, last.z, last.heading);
+	fprintf(stderr, "Simulated %.2f s in %u ms\n", run->getSimulatedTime(), elapsed);
+
+	VMMemory::PoolStatistics pool = run->getContext()->getMemory()->getPoolStatistics();
+	fprintf(stderr, "Array memory: %u of %u bytes used, %u fragmented, peak %u, %u compactions\n", pool.usedBytes, pool.poolSize, pool.fragmentedBytes, pool.highWaterMark, pool.compactionCount);
+
+	delete run;
+	delete environment;
+
 	return 0;
 }
@@ -161,7 +161,7 @@ void Client::setCell(const NetworkPacket *packet)
 		editor->setCellIsWall(packet->setCell.x, packet->setCell.z, packet->setCell.cell & 0x80);
 		editor->setCellShade(packet->setCell.x, packet->setCell.z, float(packet->setCell.cell & 0x7F) / 127.0f);
 	}
-	catch (std::runtime_error e)
+	catch (std::runtime_error &e)
 	{
 		closeConnection();
 	}
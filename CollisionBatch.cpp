@@ -0,0 +1,269 @@
+/*
+ *  CollisionBatch.cpp
+ *  mindstormssimulation
+ *
+ *  Created by agent on 18.10.26
+ *  Copyright 2026 RWTH Aachen University All rights reserved.
+ *
+ */
+
+#include "CollisionBatch.h"
+
+#include <limits>
+
+namespace
+{
+	// Larger than any overlap, so that the first axis always sets the
+	// resolution.
+	const float noOverlap = 20000000.0f;
+
+	// Codes for the axis that gives the resolution. The first two are the
+	// axes of a, the others those of b.
+	const float firstAxisOfA = 0.0f;
+	const float firstAxisOfB = 2.0f;
+
+	inline float4 absolute(const float4 &value)
+	{
+		return value.max(-value);
+	}
+
+	/*
+	 * One axis of the separating axis test, for four pairs of boxes at once,
+	 * given the ranges of the projections of a and b onto the axis, as
+	 * described for BoxCollision. Pairs that are separated along this axis
+	 * are cleared in collides. For the others, this axis becomes the one to
+	 * resolve along if it needs a shorter move than the ones before.
+	 */
+	inline void testAxis(const float4 &minA, const float4 &maxA, const float4 &minB, const float4 &maxB, float axis, uint4 &collides, float4 &overlap, float4 &resolutionAxis)
+	{
+		float4 overlapLeft = maxB - minA;
+		float4 overlapRight = maxA - minB;
+		float4 newOverlap = (overlapLeft < overlapRight).select(-overlapLeft, overlapRight);
+		collides = collides && (overlapLeft.min(overlapRight) > float4(0.0f));
+
+		uint4 isShorter = absolute(newOverlap) < absolute(overlap);
+		overlap = isShorter.select(newOverlap, overlap);
+		resolutionAxis = isShorter.select(float4(axis), resolutionAxis);
+	}
+
+	// Lanes of a group that hold a box in [first, end).
+	inline uint4 lanesInRange(unsigned group, unsigned first, unsigned end)
+	{
+		unsigned base = group * 4;
+		return uint4(base >= first && base < end, base + 1 >= first && base + 1 < end, base + 2 >= first && base + 2 < end, base + 3 >= first && base + 3 < end);
+	}
+}
+
+void OrientedBox::set(const float4 *newCorners) throw()
+{
+	for (unsigned i = 0; i < 4; i++)
+		corners[i] = newCorners[i];
+
+	axes[0] = (corners[0] - corners[1]).normalized();
+	axes[1] = (corners[1] - corners[2]).normalized();
+
+	for (unsigned axis = 0; axis < 2; axis++)
+	{
+		minOnAxis[axis] = std::numeric_limits<float>::infinity();
+		maxOnAxis[axis] = -std::numeric_limits<float>::infinity();
+		for (unsigned i = 0; i < 4; i++)
+		{
+			float dot = corners[i] * axes[axis];
+			minOnAxis[axis] = fminf(dot, minOnAxis[axis]);
+			maxOnAxis[axis] = fmaxf(dot, maxOnAxis[axis]);
+		}
+	}
+
+	float4 min = corners[0].min(corners[1].min(corners[2].min(corners[3])));
+	float4 max = corners[0].max(corners[1].max(corners[2].max(corners[3])));
+	minX = min.x;
+	maxX = max.x;
+	minZ = min.z;
+	maxZ = max.z;
+}
+
+AxisAlignedBoxBatch::AxisAlignedBoxBatch()
+: count(0)
+{
+}
+
+void AxisAlignedBoxBatch::clear() throw()
+{
+	groups.clear();
+	count = 0;
+}
+
+void AxisAlignedBoxBatch::add(const float4 &min, const float4 &max)
+{
+	unsigned lane = count % 4;
+	if (lane == 0)
+	{
+		Group empty = { float4(0.0f), float4(0.0f), float4(0.0f), float4(0.0f) };
+		groups.push_back(empty);
+	}
+
+	Group &group = groups.back();
+	group.minX[lane] = min.x;
+	group.maxX[lane] = max.x;
+	group.minZ[lane] = min.z;
+	group.maxZ[lane] = max.z;
+	count++;
+}
+
+unsigned AxisAlignedBoxBatch::collideWithOrientedBox(const OrientedBox &box, std::vector<BoxCollision> &collisions) const
+{
+	unsigned found = 0;
+	for (unsigned i = 0; i < groups.size(); i++)
+	{
+		const Group &group = groups[i];
+		uint4 collides = lanesInRange(i, 0, count);
+		float4 overlap(noOverlap);
+		float4 resolutionAxis(0.0f);
+
+		// The axes of the axis aligned boxes, pointing to decreasing x and z.
+		// Projecting onto them only needs the coordinates.
+		testAxis(-group.maxX, -group.minX, float4(-box.maxX), float4(-box.minX), 0.0f, collides, overlap, resolutionAxis);
+		testAxis(-group.maxZ, -group.minZ, float4(-box.maxZ), float4(-box.minZ), 1.0f, collides, overlap, resolutionAxis);
+		if (!collides.any()) continue;
+
+		// The axes of the oriented box. The corners of the axis aligned boxes
+		// that are furthest along them follow from the signs of the axis.
+		for (unsigned axis = 0; axis < 2; axis++)
+		{
+			const float4 &direction = box.axes[axis];
+			float4 lowest = (direction.x < 0.0f ? group.maxX : group.minX) * direction.x + (direction.z < 0.0f ? group.maxZ : group.minZ) * direction.z;
+			float4 highest = (direction.x < 0.0f ? group.minX : group.maxX) * direction.x + (direction.z < 0.0f ? group.minZ : group.maxZ) * direction.z;
+			testAxis(lowest, highest, float4(box.minOnAxis[axis]), float4(box.maxOnAxis[axis]), firstAxisOfB + float(axis), collides, overlap, resolutionAxis);
+		}
+		if (!collides.any()) continue;
+
+		float4 hits = collides.select(float4(1.0f), float4(0.0f));
+		for (unsigned lane = 0; lane < 4; lane++)
+		{
+			if (hits[lane] == 0.0f) continue;
+
+			BoxCollision collision;
+			collision.index = i * 4 + lane;
+			if (resolutionAxis[lane] == 0.0f) collision.resolutionVector = float4(-1.0f, 0.0f, 0.0f, 0.0f) * overlap[lane];
+			else if (resolutionAxis[lane] == 1.0f) collision.resolutionVector = float4(0.0f, 0.0f, -1.0f, 0.0f) * overlap[lane];
+			else collision.resolutionVector = box.axes[unsigned(resolutionAxis[lane] - firstAxisOfB)] * overlap[lane];
+			collisions.push_back(collision);
+			found++;
+		}
+	}
+	return found;
+}
+
+void OrientedBoxBatch::clear() throw()
+{
+	groups.clear();
+	boxes.clear();
+}
+
+void OrientedBoxBatch::add(const OrientedBox &box)
+{
+	unsigned lane = unsigned(boxes.size() % 4);
+	if (lane == 0)
+	{
+		Group empty;
+		for (unsigned i = 0; i < 4; i++)
+		{
+			empty.cornerX[i] = float4(0.0f);
+			empty.cornerZ[i] = float4(0.0f);
+		}
+		for (unsigned axis = 0; axis < 2; axis++)
+		{
+			empty.axisX[axis] = float4(0.0f);
+			empty.axisZ[axis] = float4(0.0f);
+			empty.minOnAxis[axis] = float4(0.0f);
+			empty.maxOnAxis[axis] = float4(0.0f);
+		}
+		empty.minX = empty.maxX = empty.minZ = empty.maxZ = float4(0.0f);
+		groups.push_back(empty);
+	}
+
+	Group &group = groups.back();
+	for (unsigned i = 0; i < 4; i++)
+	{
+		group.cornerX[i][lane] = box.corners[i].x;
+		group.cornerZ[i][lane] = box.corners[i].z;
+	}
+	for (unsigned axis = 0; axis < 2; axis++)
+	{
+		group.axisX[axis][lane] = box.axes[axis].x;
+		group.axisZ[axis][lane] = box.axes[axis].z;
+		group.minOnAxis[axis][lane] = box.minOnAxis[axis];
+		group.maxOnAxis[axis][lane] = box.maxOnAxis[axis];
+	}
+	group.minX[lane] = box.minX;
+	group.maxX[lane] = box.maxX;
+	group.minZ[lane] = box.minZ;
+	group.maxZ[lane] = box.maxZ;
+	boxes.push_back(box);
+}
+
+unsigned OrientedBoxBatch::collideWithOrientedBox(const OrientedBox &box, unsigned first, std::vector<BoxCollision> &collisions) const
+{
+	unsigned found = 0;
+	for (unsigned i = first / 4; i < groups.size(); i++)
+	{
+		const Group &group = groups[i];
+		uint4 collides = lanesInRange(i, first, unsigned(boxes.size()));
+
+		// Bounding boxes first; most pairs fail here.
+		collides = collides && (float4(box.maxX) >= group.minX);
+		collides = collides && (group.maxX >= float4(box.minX));
+		collides = collides && (float4(box.maxZ) >= group.minZ);
+		collides = collides && (group.maxZ >= float4(box.minZ));
+		if (!collides.any()) continue;
+
+		float4 overlap(noOverlap);
+		float4 resolutionAxis(0.0f);
+
+		// The axes of a, the box that is tested.
+		for (unsigned axis = 0; axis < 2; axis++)
+		{
+			const float4 &direction = box.axes[axis];
+			float4 minB(std::numeric_limits<float>::infinity());
+			float4 maxB(-std::numeric_limits<float>::infinity());
+			for (unsigned corner = 0; corner < 4; corner++)
+			{
+				float4 dot = group.cornerX[corner] * direction.x + group.cornerZ[corner] * direction.z;
+				minB = minB.min(dot);
+				maxB = maxB.max(dot);
+			}
+			testAxis(float4(box.minOnAxis[axis]), float4(box.maxOnAxis[axis]), minB, maxB, firstAxisOfA + float(axis), collides, overlap, resolutionAxis);
+		}
+		if (!collides.any()) continue;
+
+		// The axes of the boxes in the batch.
+		for (unsigned axis = 0; axis < 2; axis++)
+		{
+			float4 minA(std::numeric_limits<float>::infinity());
+			float4 maxA(-std::numeric_limits<float>::infinity());
+			for (unsigned corner = 0; corner < 4; corner++)
+			{
+				float4 dot = group.axisX[axis] * box.corners[corner].x + group.axisZ[axis] * box.corners[corner].z;
+				minA = minA.min(dot);
+				maxA = maxA.max(dot);
+			}
+			testAxis(minA, maxA, group.minOnAxis[axis], group.maxOnAxis[axis], firstAxisOfB + float(axis), collides, overlap, resolutionAxis);
+		}
+		if (!collides.any()) continue;
+
+		float4 hits = collides.select(float4(1.0f), float4(0.0f));
+		for (unsigned lane = 0; lane < 4; lane++)
+		{
+			if (hits[lane] == 0.0f) continue;
+
+			BoxCollision collision;
+			collision.index = i * 4 + lane;
+			unsigned axis = unsigned(resolutionAxis[lane]);
+			if (axis < unsigned(firstAxisOfB)) collision.resolutionVector = box.axes[axis] * overlap[lane];
+			else collision.resolutionVector = boxes[collision.index].axes[axis - unsigned(firstAxisOfB)] * overlap[lane];
+			collisions.push_back(collision);
+			found++;
+		}
+	}
+	return found;
+}
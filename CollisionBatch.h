@@ -0,0 +1,143 @@
+#pragma once
+/*
+ *  CollisionBatch.h
+ *  mindstormssimulation
+ *
+ *  Created by agent on 18.10.26
+ *  Copyright 2026 RWTH Aachen University All rights reserved.
+ *
+ */
+
+#include <vector>
+
+#include "Vec4.h"
+
+/*!
+ * @abstract An oriented bounding box in the xz plane, with everything about it
+ * that the separating axis test needs.
+ * @discussion Working this out once lets the box be tested against many
+ * others without doing it again for each of them.
+ */
+struct OrientedBox
+{
+	float4 corners[4];
+	/*! The directions of the edges from corner 1 to 0 and from 2 to 1. */
+	float4 axes[2];
+	/*! Projections of the corners onto the axes. */
+	float minOnAxis[2];
+	float maxOnAxis[2];
+	/*! The axis aligned bounding box. */
+	float minX;
+	float maxX;
+	float minZ;
+	float maxZ;
+
+	/*!
+	 * @abstract Sets the box from its corners.
+	 * @param corners Four corners, in order around the box.
+	 */
+	void set(const float4 *corners) throw();
+};
+
+/*!
+ * @abstract A collision found by one of the batches.
+ * @discussion The batches use the separating axis test on two boxes a and
+ * b: They collide if their corners, projected onto each of the four axes
+ * (those of a first, along its edges from corner 1 to 0 and from 2 to 1,
+ * then those of b), give ranges that overlap by more than 0. Along each
+ * axis, the overlap is the shorter way of pushing b out, to either side. The
+ * resolution is along the axis with the smallest overlap; of axes with the
+ * same overlap, the first one.
+ */
+struct BoxCollision
+{
+	/*! The index of the box in the batch, in the order they were added. */
+	unsigned index;
+	/*! The shortest vector along which to move the box that is called b in
+	 * the description of the test, so that the two no longer collide. */
+	float4 resolutionVector;
+};
+
+/*!
+ * @abstract Many axis aligned boxes, such as walls, to test one oriented box
+ * against.
+ * @discussion The boxes are stored four to a group, each coordinate of the
+ * four in one float4, so that all four are tested with the same
+ * instructions. Each box is tested as a, with its corners starting at its
+ * minimum and going to increasing x first, and the oriented box as b.
+ */
+class AxisAlignedBoxBatch
+{
+	struct Group
+	{
+		float4 minX;
+		float4 maxX;
+		float4 minZ;
+		float4 maxZ;
+	};
+
+	std::vector<Group> groups;
+	unsigned count;
+
+public:
+	AxisAlignedBoxBatch();
+
+	/*! Removes all boxes, keeping the memory for them. */
+	void clear() throw();
+	/*! Adds a box, given by its minimum and maximum. */
+	void add(const float4 &min, const float4 &max);
+	unsigned size() const throw() { return count; }
+
+	/*!
+	 * @abstract Tests an oriented box against all boxes in the batch.
+	 * @param box The oriented box.
+	 * @param collisions The boxes that collide with it are added to this, in
+	 * order.
+	 * @result The number of boxes that collide.
+	 */
+	unsigned collideWithOrientedBox(const OrientedBox &box, std::vector<BoxCollision> &collisions) const;
+};
+
+/*!
+ * @abstract Many oriented boxes, such as robots, to test one other oriented
+ * box against.
+ * @discussion Stored just like AxisAlignedBoxBatch. The box that is tested
+ * is a and each box in the batch is b, except that boxes whose axis aligned
+ * bounding boxes do not touch never collide.
+ */
+class OrientedBoxBatch
+{
+	struct Group
+	{
+		float4 cornerX[4];
+		float4 cornerZ[4];
+		float4 axisX[2];
+		float4 axisZ[2];
+		float4 minOnAxis[2];
+		float4 maxOnAxis[2];
+		float4 minX;
+		float4 maxX;
+		float4 minZ;
+		float4 maxZ;
+	};
+
+	std::vector<Group> groups;
+	std::vector<OrientedBox> boxes;
+
+public:
+	/*! Removes all boxes, keeping the memory for them. */
+	void clear() throw();
+	void add(const OrientedBox &box);
+	unsigned size() const throw() { return unsigned(boxes.size()); }
+
+	/*!
+	 * @abstract Tests an oriented box against the boxes in the batch.
+	 * @param box The oriented box.
+	 * @param first Index of the first box in the batch to test. Lets callers
+	 * that move the box after a collision test the rest again.
+	 * @param collisions The boxes that collide with it are added to this, in
+	 * order.
+	 * @result The number of boxes that collide.
+	 */
+	unsigned collideWithOrientedBox(const OrientedBox &box, unsigned first, std::vector<BoxCollision> &collisions) const;
+};
@@ -0,0 +1,447 @@
+/*
+ *  ControlFlowGraph.cpp
+ *  mindstormssimulation
+ *
+ *  Created by agent on 18.10.26
+ *  Copyright 2026 RWTH Aachen University All rights reserved.
+ *
+ */
+
+#include "ControlFlowGraph.h"
+
+#include <algorithm>
+#include <ostream>
+#include <utility>
+
+#include "DecodedProgram.h"
+#include "InterpreterOpcodes.h"
+#include "RXEFile.h"
+
+namespace
+{
+	// How often a loop is assumed to run for the weighted cost, and how many
+	// levels of nesting are counted at most, so that the result stays in
+	// range.
+	const uint64_t loopWeight = 10;
+	const unsigned maxWeightedDepth = 6;
+
+	// Rough cost of each kind of instruction, relative to OP_ADD. Anything
+	// that works on arrays or strings depends on their length, which is not
+	// known here, so it is just counted as expensive.
+	const unsigned costOfArithmetic = 1;
+	const unsigned costOfDivision = 2;
+	const unsigned costOfAccess = 2;
+	const unsigned costOfArrayOperation = 4;
+	const unsigned costOfStringOperation = 8;
+	const unsigned costOfScheduling = 4;
+	const unsigned costOfSyscall = 16;
+
+	bool endsClump(unsigned handler)
+	{
+		switch (handler)
+		{
+			case HANDLER_OP_STOP:
+			case HANDLER_OP_FINCLUMP:
+			case HANDLER_OP_FINCLUMPIMMED:
+			case HANDLER_OP_SUBRET:
+			case HANDLER_INVALID:
+				return true;
+			default:
+				return false;
+		}
+	}
+
+	// Sorts clumps by the start of their code.
+	struct ByStart
+	{
+		const DecodedProgram *program;
+		ByStart(const DecodedProgram *aProgram) : program(aProgram) {}
+		bool operator()(unsigned a, unsigned b) const { return program->getStartForClump(a) < program->getStartForClump(b); }
+	};
+}
+
+ControlFlowGraph::ControlFlowGraph(const RXEFile *aFile, const DecodedProgram *aProgram)
+: file(aFile), program(aProgram), pollingLoops(aFile, aProgram), entryBlocks(aFile->getClumpCount(), noBlock)
+{
+	findBlocks();
+	findEdges();
+
+	std::vector<std::vector<unsigned> > loopBodies;
+	for (unsigned i = 0; i < entryBlocks.size(); i++)
+		if (entryBlocks[i] != noBlock && blocks[entryBlocks[i]].clump == i)
+			findBackEdges(i, loopBodies);
+
+	// Loops with the same header are one loop for the depth of the blocks in
+	// them, even if there are several ways back.
+	std::vector<bool> inLoop(blocks.size());
+	for (unsigned i = 0; i < loops.size(); i++)
+	{
+		bool isFirstWithHeader = true;
+		for (unsigned j = 0; j < i; j++)
+			if (loops[j].header == loops[i].header) isFirstWithHeader = false;
+		if (!isFirstWithHeader) continue;
+
+		inLoop.assign(blocks.size(), false);
+		for (unsigned j = i; j < loops.size(); j++)
+		{
+			if (loops[j].header != loops[i].header) continue;
+			for (unsigned k = 0; k < loopBodies[j].size(); k++)
+				inLoop[loopBodies[j][k]] = true;
+		}
+		for (unsigned j = 0; j < blocks.size(); j++)
+			if (inLoop[j]) blocks[j].loopDepth++;
+	}
+}
+
+void ControlFlowGraph::findBlocks()
+{
+	const unsigned count = program->getInstructionCount();
+
+	// Each clump owns the code up to the start of the next one.
+	std::vector<unsigned> clumpsByStart;
+	for (unsigned i = 0; i < file->getClumpCount(); i++)
+		clumpsByStart.push_back(i);
+	std::stable_sort(clumpsByStart.begin(), clumpsByStart.end(), ByStart(program));
+
+	std::vector<unsigned> clumpForInstruction(count, clumpsByStart.empty() ? 0 : clumpsByStart[0]);
+	for (unsigned i = 0; i < clumpsByStart.size(); i++)
+	{
+		unsigned clump = clumpsByStart[i];
+		unsigned end = i + 1 < clumpsByStart.size() ? program->getStartForClump(clumpsByStart[i + 1]) : count;
+		for (unsigned j = program->getStartForClump(clump); j < end && j < count; j++)
+			clumpForInstruction[j] = clump;
+	}
+
+	std::vector<bool> isLeader(count + 1, false);
+	isLeader[0] = true;
+	for (unsigned i = 0; i < file->getClumpCount(); i++)
+		if (program->getStartForClump(i) < count) isLeader[program->getStartForClump(i)] = true;
+	for (unsigned i = 0; i < count; i++)
+	{
+		const DecodedProgram::Instruction &instruction = program->getInstruction(i);
+		bool isBranch = DecodedProgram::isBranch(instruction.opcode) && instruction.operandCount > 0;
+		if (isBranch && instruction.operands[0] < count)
+			isLeader[instruction.operands[0]] = true;
+		if (isBranch || endsClump(instruction.handler))
+			isLeader[i + 1] = true;
+	}
+
+	blockForInstruction.assign(count, noBlock);
+	for (unsigned i = 0; i < count; i++)
+	{
+		if (isLeader[i])
+		{
+			Block block;
+			block.clump = clumpForInstruction[i];
+			block.first = i;
+			block.end = i;
+			block.cost = 0;
+			block.loopDepth = 0;
+			block.isReachable = false;
+			blocks.push_back(block);
+		}
+		Block &block = blocks.back();
+		block.end = i + 1;
+		block.cost += costOfInstruction(i);
+		blockForInstruction[i] = unsigned(blocks.size() - 1);
+	}
+
+	for (unsigned i = 0; i < file->getClumpCount(); i++)
+		if (program->getStartForClump(i) < count) entryBlocks[i] = blockForInstruction[program->getStartForClump(i)];
+}
+
+void ControlFlowGraph::findEdges()
+{
+	const unsigned count = program->getInstructionCount();
+
+	predecessors.assign(blocks.size(), std::vector<unsigned>());
+	for (unsigned i = 0; i < blocks.size(); i++)
+	{
+		Block &block = blocks[i];
+		const DecodedProgram::Instruction &last = program->getInstruction(block.end - 1);
+
+		std::vector<unsigned> targets;
+		if (DecodedProgram::isBranch(last.opcode) && last.operandCount > 0 && last.operands[0] < count)
+			targets.push_back(blockForInstruction[last.operands[0]]);
+		bool fallsThrough = last.handler != HANDLER_OP_JMP && !endsClump(last.handler);
+		if (fallsThrough && block.end < count && blocks[blockForInstruction[block.end]].clump == block.clump)
+			targets.push_back(blockForInstruction[block.end]);
+
+		for (unsigned j = 0; j < targets.size(); j++)
+		{
+			if (j > 0 && targets[j] == targets[0]) continue;
+
+			Edge edge;
+			edge.block = targets[j];
+			edge.isBackEdge = false;
+			block.successors.push_back(edge);
+			predecessors[targets[j]].push_back(i);
+		}
+	}
+}
+
+void ControlFlowGraph::findBackEdges(unsigned clump, std::vector<std::vector<unsigned> > &loopBodies)
+{
+	// Depth first, without recursion, since programs can have thousands of
+	// blocks in a row. Each entry on the stack is a block and the next of
+	// its successors to look at.
+	enum { Unvisited, Visiting, Done };
+	std::vector<uint8_t> state(blocks.size(), Unvisited);
+	std::vector<std::pair<unsigned, unsigned> > stack;
+	std::vector<std::pair<unsigned, unsigned> > backEdges;
+
+	unsigned entry = entryBlocks[clump];
+	stack.push_back(std::make_pair(entry, 0u));
+	state[entry] = Visiting;
+	blocks[entry].isReachable = true;
+	while (!stack.empty())
+	{
+		unsigned current = stack.back().first;
+		unsigned successor = stack.back().second;
+		if (successor == blocks[current].successors.size())
+		{
+			state[current] = Done;
+			stack.pop_back();
+			continue;
+		}
+		stack.back().second++;
+
+		Edge &edge = blocks[current].successors[successor];
+		if (blocks[edge.block].clump != clump) continue;
+		if (state[edge.block] == Visiting)
+		{
+			edge.isBackEdge = true;
+			backEdges.push_back(std::make_pair(current, edge.block));
+		}
+		else if (state[edge.block] == Unvisited)
+		{
+			state[edge.block] = Visiting;
+			blocks[edge.block].isReachable = true;
+			stack.push_back(std::make_pair(edge.block, 0u));
+		}
+	}
+
+	// In the order of the code, not of the search.
+	std::sort(backEdges.begin(), backEdges.end());
+	for (unsigned i = 0; i < backEdges.size(); i++)
+		addLoop(backEdges[i].first, backEdges[i].second, loopBodies);
+}
+
+void ControlFlowGraph::addLoop(unsigned latch, unsigned header, std::vector<std::vector<unsigned> > &loopBodies)
+{
+	// Everything that reaches the latch without going through the header.
+	std::vector<bool> inLoop(blocks.size(), false);
+	std::vector<unsigned> body;
+	std::vector<unsigned> work;
+	inLoop[header] = true;
+	body.push_back(header);
+	work.push_back(latch);
+	while (!work.empty())
+	{
+		unsigned block = work.back();
+		work.pop_back();
+		if (inLoop[block] || !blocks[block].isReachable || blocks[block].clump != blocks[header].clump) continue;
+		inLoop[block] = true;
+		body.push_back(block);
+		work.insert(work.end(), predecessors[block].begin(), predecessors[block].end());
+	}
+
+	unsigned branch = blocks[latch].end - 1;
+
+	Loop loop;
+	loop.header = header;
+	loop.latch = latch;
+	loop.blockCount = unsigned(body.size());
+	loop.cost = 0;
+	for (unsigned i = 0; i < body.size(); i++)
+		loop.cost += blocks[body[i]].cost;
+	loop.isPolling = pollingLoops.closesLoop(branch) && program->getInstruction(branch).operands[0] == blocks[header].first;
+	loops.push_back(loop);
+	loopBodies.push_back(body);
+}
+
+unsigned ControlFlowGraph::costOfInstruction(unsigned index) const
+{
+	const DecodedProgram::Instruction &instruction = program->getInstruction(index);
+	switch (instruction.handler)
+	{
+		case HANDLER_OP_DIV:
+		case HANDLER_OP_MOD:
+		case HANDLER_OP_SQRT:
+			return costOfDivision;
+		case HANDLER_OP_MOV:
+		{
+			// Copies whole arrays and clusters as well.
+			unsigned destination = instruction.operandCount > 0 ? instruction.operands[0] : 0;
+			if (destination < file->getDSTOCCount())
+			{
+				RXEFile::dstocType type = file->getTypeAtDSTOCIndex(destination);
+				if (type == RXEFile::TC_ARRAY || type == RXEFile::TC_CLUSTER) return costOfArrayOperation;
+			}
+			return costOfArithmetic;
+		}
+		case HANDLER_OP_INDEX:
+		case HANDLER_OP_ARRSIZE:
+		case HANDLER_OP_ACQUIRE:
+		case HANDLER_OP_RELEASE:
+		case HANDLER_OP_GETIN:
+		case HANDLER_OP_GETOUT:
+		case HANDLER_OP_SETIN:
+			return costOfAccess;
+		case HANDLER_OP_REPLACE:
+		case HANDLER_OP_ARRSUBSET:
+		case HANDLER_OP_ARRINIT:
+			return costOfArrayOperation;
+		case HANDLER_OP_ARRBUILD:
+		case HANDLER_OP_SETOUT:
+			// One more for every value they take.
+			return costOfArrayOperation + instruction.operandCount;
+		case HANDLER_OP_FLATTEN:
+		case HANDLER_OP_UNFLATTEN:
+		case HANDLER_OP_NUMTOSTRING:
+		case HANDLER_OP_STRINGTONUM:
+		case HANDLER_OP_STRCAT:
+		case HANDLER_OP_STRSUBSET:
+		case HANDLER_OP_STRTOBYTEARR:
+		case HANDLER_OP_BYTEARRTOSTR:
+			return costOfStringOperation;
+		case HANDLER_OP_FINCLUMP:
+		case HANDLER_OP_FINCLUMPIMMED:
+		case HANDLER_OP_SUBCALL:
+		case HANDLER_OP_SUBRET:
+		case HANDLER_OP_WAIT:
+			return costOfScheduling;
+		case HANDLER_OP_SYSCALL:
+			return costOfSyscall;
+		default:
+			return costOfArithmetic;
+	}
+}
+
+unsigned ControlFlowGraph::getUnreachableCount() const
+{
+	unsigned count = 0;
+	for (unsigned i = 0; i < blocks.size(); i++)
+		if (!blocks[i].isReachable) count++;
+	return count;
+}
+
+uint64_t ControlFlowGraph::getCostForClump(unsigned clump) const
+{
+	uint64_t cost = 0;
+	for (unsigned i = 0; i < blocks.size(); i++)
+		if (blocks[i].clump == clump && blocks[i].isReachable) cost += blocks[i].cost;
+	return cost;
+}
+
+uint64_t ControlFlowGraph::getWeightedCostForClump(unsigned clump) const
+{
+	uint64_t cost = 0;
+	for (unsigned i = 0; i < blocks.size(); i++)
+	{
+		if (blocks[i].clump != clump || !blocks[i].isReachable) continue;
+		uint64_t weight = 1;
+		for (unsigned j = 0; j < blocks[i].loopDepth && j < maxWeightedDepth; j++)
+			weight *= loopWeight;
+		cost += blocks[i].cost * weight;
+	}
+	return cost;
+}
+
+void ControlFlowGraph::writeText(std::ostream &stream) const
+{
+	stream << "-- Control flow --" << std::endl;
+	stream << "clump\tentry\tcost\tweighted" << std::endl;
+	for (unsigned i = 0; i < entryBlocks.size(); i++)
+	{
+		stream << i << "\t";
+		if (entryBlocks[i] == noBlock) stream << "-";
+		else stream << entryBlocks[i];
+		stream << "\t" << getCostForClump(i) << "\t" << getWeightedCostForClump(i) << std::endl;
+	}
+
+	stream << std::endl;
+	stream << "-- Blocks --" << std::endl;
+	stream << "block\tclump\tpc\tend\tcost\tdepth\tsuccessors" << std::endl;
+	for (unsigned i = 0; i < blocks.size(); i++)
+	{
+		const Block &block = blocks[i];
+		stream << i << "\t" << block.clump << "\t" << block.first << "\t" << block.end << "\t";
+		stream << block.cost << "\t" << block.loopDepth << "\t";
+		for (unsigned j = 0; j < block.successors.size(); j++)
+			stream << (j > 0 ? " " : "") << block.successors[j].block << (block.successors[j].isBackEdge ? " (back)" : "");
+		if (!block.isReachable) stream << "\tunreachable";
+		stream << std::endl;
+	}
+
+	stream << std::endl;
+	stream << "-- Loops --" << std::endl;
+	stream << "clump\theader\tlatch\tfrom\tto\tblocks\tcost\tpolling" << std::endl;
+	for (unsigned i = 0; i < loops.size(); i++)
+	{
+		const Loop &loop = loops[i];
+		stream << blocks[loop.header].clump << "\t" << loop.header << "\t" << loop.latch << "\t";
+		stream << blocks[loop.header].first << "\t" << blocks[loop.latch].end - 1 << "\t";
+		stream << loop.blockCount << "\t" << loop.cost << "\t" << (loop.isPolling ? "yes" : "no") << std::endl;
+	}
+}
+
+void ControlFlowGraph::writeJSON(std::ostream &stream) const
+{
+	stream << "{" << std::endl;
+
+	stream << "\t\"clumps\": [";
+	for (unsigned i = 0; i < entryBlocks.size(); i++)
+	{
+		stream << (i > 0 ? "," : "") << std::endl;
+		stream << "\t\t{ \"clump\": " << i << ", ";
+		stream << "\"entryBlock\": ";
+		if (entryBlocks[i] == noBlock) stream << "null";
+		else stream << entryBlocks[i];
+		stream << ", \"cost\": " << getCostForClump(i) << ", ";
+		stream << "\"weightedCost\": " << getWeightedCostForClump(i) << " }";
+	}
+	stream << std::endl << "\t]," << std::endl;
+
+	stream << "\t\"blocks\": [";
+	for (unsigned i = 0; i < blocks.size(); i++)
+	{
+		const Block &block = blocks[i];
+		stream << (i > 0 ? "," : "") << std::endl;
+		stream << "\t\t{ \"block\": " << i << ", ";
+		stream << "\"clump\": " << block.clump << ", ";
+		stream << "\"first\": " << block.first << ", ";
+		stream << "\"end\": " << block.end << ", ";
+		stream << "\"cost\": " << block.cost << ", ";
+		stream << "\"loopDepth\": " << block.loopDepth << ", ";
+		stream << "\"reachable\": " << (block.isReachable ? "true" : "false") << ", ";
+		stream << "\"successors\": [";
+		for (unsigned j = 0; j < block.successors.size(); j++)
+			stream << (j > 0 ? ", " : "") << block.successors[j].block;
+		stream << "], \"backEdges\": [";
+		bool isFirst = true;
+		for (unsigned j = 0; j < block.successors.size(); j++)
+		{
+			if (!block.successors[j].isBackEdge) continue;
+			stream << (isFirst ? "" : ", ") << block.successors[j].block;
+			isFirst = false;
+		}
+		stream << "] }";
+	}
+	stream << std::endl << "\t]," << std::endl;
+
+	stream << "\t\"loops\": [";
+	for (unsigned i = 0; i < loops.size(); i++)
+	{
+		const Loop &loop = loops[i];
+		stream << (i > 0 ? "," : "") << std::endl;
+		stream << "\t\t{ \"clump\": " << blocks[loop.header].clump << ", ";
+		stream << "\"header\": " << loop.header << ", ";
+		stream << "\"latch\": " << loop.latch << ", ";
+		stream << "\"blocks\": " << loop.blockCount << ", ";
+		stream << "\"cost\": " << loop.cost << ", ";
+		stream << "\"polling\": " << (loop.isPolling ? "true" : "false") << " }";
+	}
+	stream << std::endl << "\t]" << std::endl;
+	stream << "}" << std::endl;
+}
@@ -0,0 +1,147 @@
+#pragma once
+/*
+ *  ControlFlowGraph.h
+ *  mindstormssimulation
+ *
+ *  Created by agent on 18.10.26
+ *  Copyright 2026 RWTH Aachen University All rights reserved.
+ *
+ */
+
+#include <iosfwd>
+#include <vector>
+#include <stdint.h>
+
+#include "PollingLoops.h"
+
+class DecodedProgram;
+class RXEFile;
+
+/*!
+ * @abstract The basic blocks of a program and how they are connected.
+ * @discussion Each clump's code runs from its start to the start of the next
+ * clump in the code. It is split into basic blocks: straight runs of
+ * instructions that start at the clump's start, at the target of a branch or
+ * after a branch or an instruction that ends the clump, and end before the
+ * next such start. OP_SUBCALL does not end a block; the subroutine returns
+ * to the next instruction.
+ *
+ * Edges are only followed within a clump. Going depth first from the clump's
+ * start, an edge to a block that is still being visited is a back edge; the
+ * blocks it closes a loop over are those that can reach it without going
+ * through the loop's header. Blocks that are never visited are unreachable.
+ *
+ * Every block gets a static cost estimate, which is the sum of the cost of
+ * its instructions in units of roughly one OP_ADD. Since nothing is known
+ * about the length of arrays and strings or about how often loops run, this
+ * is only good for comparing programs and finding their hot spots; the
+ * InterpreterProfile of a real run is better where one is available. The
+ * weighted cost counts every block as if each loop around it ran ten times.
+ */
+class ControlFlowGraph
+{
+public:
+	/*! Block index used for no block at all. */
+	static const unsigned noBlock = 0xFFFFFFFF;
+
+	struct Edge
+	{
+		/*! The block the edge goes to. */
+		unsigned block;
+		/*! Whether the edge goes back to the header of a loop. */
+		bool isBackEdge;
+	};
+
+	struct Block
+	{
+		/*! The clump the block belongs to. */
+		unsigned clump;
+		/*! Index of the first instruction. */
+		unsigned first;
+		/*! Index of the instruction after the last one. */
+		unsigned end;
+		/*! Static cost of running the block once. */
+		unsigned cost;
+		/*! Number of loops that contain the block. */
+		unsigned loopDepth;
+		/*! Whether the block can be reached from the start of its clump. */
+		bool isReachable;
+		/*! The blocks that can run next. */
+		std::vector<Edge> successors;
+	};
+
+	struct Loop
+	{
+		/*! The block the back edge goes to. */
+		unsigned header;
+		/*! The block the back edge comes from. */
+		unsigned latch;
+		/*! Number of blocks in the loop. */
+		unsigned blockCount;
+		/*! Static cost of all blocks in the loop together. */
+		unsigned cost;
+		/*! Whether the back edge closes a polling loop, see PollingLoops. */
+		bool isPolling;
+	};
+
+private:
+	const RXEFile *file;
+	const DecodedProgram *program;
+	PollingLoops pollingLoops;
+	std::vector<Block> blocks;
+	std::vector<Loop> loops;
+	std::vector<unsigned> entryBlocks;
+	std::vector<unsigned> blockForInstruction;
+	std::vector<std::vector<unsigned> > predecessors;
+
+	ControlFlowGraph(const ControlFlowGraph &);
+	ControlFlowGraph &operator=(const ControlFlowGraph &);
+
+	void findBlocks();
+	void findEdges();
+	void findBackEdges(unsigned clump, std::vector<std::vector<unsigned> > &loopBodies);
+	void addLoop(unsigned latch, unsigned header, std::vector<std::vector<unsigned> > &loopBodies);
+
+	unsigned costOfInstruction(unsigned index) const;
+
+public:
+	/*!
+	 * @abstract Builds the graph of a program.
+	 * @param file The RXE file.
+	 * @param program The program decoded from that file.
+	 */
+	ControlFlowGraph(const RXEFile *file, const DecodedProgram *program);
+
+	/*! Number of blocks in the program. They are ordered by their code. */
+	unsigned getBlockCount() const { return unsigned(blocks.size()); }
+
+	/*! The block with the given index. No bounds checking. */
+	const Block &getBlock(unsigned index) const { return blocks[index]; }
+
+	/*! The block a clump starts with, or noBlock if the clump has no code. */
+	unsigned getEntryBlockForClump(unsigned clump) const { return entryBlocks.at(clump); }
+
+	/*! All loops, in the order of their back edges in the code. */
+	const std::vector<Loop> &getLoops() const { return loops; }
+
+	/*! Number of blocks that can not be reached. */
+	unsigned getUnreachableCount() const;
+
+	/*! Static cost of all reachable blocks of a clump, each run once. */
+	uint64_t getCostForClump(unsigned clump) const;
+
+	/*! Static cost of a clump with every loop counted ten times. */
+	uint64_t getWeightedCostForClump(unsigned clump) const;
+
+	/*!
+	 * @abstract Writes all blocks and loops for people.
+	 * @param stream Where to write it.
+	 */
+	void writeText(std::ostream &stream) const;
+
+	/*!
+	 * @abstract Writes the clumps, blocks and loops as a JSON object.
+	 * @param stream Where to write it.
+	 */
+	void writeJSON(std::ostream &stream) const;
+};
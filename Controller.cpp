@@ -20,13 +20,17 @@
 #include <netdb.h>
 #endif
 
+#include <algorithm>
+#include <fstream>
 #include <iostream>
+#include <string>
 
 #include "Client.h"
 #include "Drawer.h"
 #include "Environment.h"
 #include "EnvironmentEditor.h"
 #include "ExecutionContext.h"
+#include "InterpreterProfile.h"
 #include "NetworkConstants.h"
 #include "NetworkPacket.h"
 #include "Robot.h"
@@ -39,6 +43,7 @@
 #include "Time.h"
 #include "TouchesRecognizer.h"
 #include "SoundController.h"
+#include "TickSource.h"
 #include "UserDefaults.h"
 #include "UserInterface.h"
 
@@ -49,10 +54,19 @@ namespace
 	//const float cameraPitch = -0.75f;
 	const float cameraPitch = -0.6f;
 	const float robotCPUTimeFraction = 0.04f;
+	const float robotWakeSliceTime = robotCPUTimeFraction / 60.0f;
 	const float robotTurnSpeed = float(M_PI) * 0.5f;
 	
 	const float scrollWheelTurnFactor = float(M_PI) * 2.0f;
 	const float scrollFadeoutTime = 0.5f;
+	
+	// Largest step for motors and physics on simulated time.
+	const float simulatedStepTime = 1.0f / 60.0f;
+	// Real time spent simulating per frame when running as fast as possible.
+	const unsigned fastModeFrameMilliseconds = 15;
+	// If frames come in slower than this, the robots slow down instead of
+	// trying to catch up all at once.
+	const float maximumPhysicsCatchUpTime = 0.5f;
 }
 
 const Robot *Controller::getLocalRobot() const throw()
@@ -98,6 +112,9 @@ Controller::Controller(
 	xDown = false;
 	cDown = false;
 	wheelScrollDirection = 0.0f;
+	timeWarp = 1.0f;
+	asFastAsPossible = false;
+	simulationClock = NULL;
 	
 	if (aFile)
 	{
@@ -119,7 +136,8 @@ Controller::Controller(
 	}
 	// environment properties
 	environment = new Environment(25, 25, 1.0f, 0.75f);
-	simulation = new Simulation(environment);
+	simulation = new Simulation(environment, unsigned(rand()));
+	simulation->setMaximumCatchUpTime(maximumPhysicsCatchUpTime);
 	editor = new EnvironmentEditor(environment);
 	editor->setMode(EnvironmentEditor::None);
 	drawer = 0;
@@ -180,6 +198,7 @@ Controller::~Controller()
 	delete simulation;
 	delete soundController;
 	delete touchRecognizer;
+	delete simulationClock;
 }
 
 void Controller::setCameraSpeedFromButtons()
@@ -249,7 +268,7 @@ void Controller::initAudio()
 		if (networkInterface)
 			networkInterface->setSoundController(soundController);
 	}
-	catch (std::exception e)
+	catch (std::exception &e)
 	{
 		ShowErrorAndExit(L"Fehler beim Starten des Sound-Systems: \"%s\"", L"Error when starting sound system: \"%s\"", e.what());
 	}
@@ -315,6 +334,27 @@ void Controller::reload()
 {
 	executionContext->reload();
 }
+void Controller::writeProfile()
+{
+	if (!executionContext || !filename) return;
+	
+	const InterpreterProfile *profile = executionContext->getProfile();
+	if (!profile)
+	{
+		std::cout << "No profile: the interpreter was compiled without INTERPRETER_PROFILING." << std::endl;
+		return;
+	}
+	
+	std::string base(filename);
+	std::ofstream text((base + ".profile.txt").c_str());
+	profile->writeText(text);
+	std::ofstream json((base + ".profile.json").c_str());
+	profile->writeJSON(json);
+	if (text && json)
+		std::cout << "Wrote profile to " << base << ".profile.txt and .profile.json" << std::endl;
+	else
+		std::cout << "Could not write profile next to " << base << std::endl;
+}
 void Controller::chooseFile()
 {
 	FileChooser *chooser = FileChooser::sharedFileChooser();
@@ -326,6 +366,7 @@ void Controller::fileChooserFoundFile(const char *path)
 	{
 		executionContext = new ExecutionContext(path);
 		if (networkInterface) executionContext->setNetworkInterface(networkInterface);
+		executionContext->setTickSource(simulationClock);
 		
 		delete [] filename;
 		filename = new char[strlen(path) + 1];
@@ -480,6 +521,9 @@ void Controller::keyDown(int character, bool isPrintable)
 			case 'c':
 				cDown = true;
 				break;
+			case 'p':
+				writeProfile();
+				break;
 				
 			case '0':
 				if (!this->getEnvironmentEditor()->getChallenge()) editor->setMode(EnvironmentEditor::None);
@@ -753,6 +797,73 @@ void Controller::startAsClient(const struct sockaddr *networkAddress, bool ipv6,
 	setNetworkInterface(new Client(networkAddress, ipv6, editor, uiOnServer));
 }
 
+unsigned Controller::getMillisecondsUntilRobotWakes() const
+{
+	if (!executionContext || !networkInterface) return ~0u;
+	// Simulated time does not pass while sleeping.
+	if (simulationClock) return ~0u;
+	
+	unsigned wakeTick = executionContext->getWakeTick();
+	unsigned now = millisecondsSinceStart();
+	if (wakeTick <= now) return 0;
+	return wakeTick - now;
+}
+
+void Controller::runRobotProgramSlice()
+{
+	if (!executionContext || !networkInterface) return;
+	
+	executionContext->runForTime(robotWakeSliceTime);
+}
+
+void Controller::setTimeWarp(float factor, bool fast)
+{
+	timeWarp = factor;
+	asFastAsPossible = fast;
+	
+	if (timeWarp == 1.0f && !asFastAsPossible)
+	{
+		if (executionContext) executionContext->setTickSource(NULL);
+		delete simulationClock;
+		simulationClock = NULL;
+	}
+	else if (!simulationClock)
+	{
+		// Continue from the current time, so programs see no jump.
+		simulationClock = new SimulationClock(millisecondsSinceStart());
+		if (executionContext) executionContext->setTickSource(simulationClock);
+	}
+}
+
+void Controller::stepSimulatedTime(float step)
+{
+	simulationClock->advance(step);
+	if (executionContext) executionContext->runForSimulatedTime(step);
+	simulation->update(step);
+}
+
+void Controller::advanceSimulatedTime(float delta)
+{
+	if (asFastAsPossible)
+	{
+		// As many steps as fit into one frame, then let it get drawn.
+		unsigned start = millisecondsSinceStart();
+		do
+			stepSimulatedTime(simulatedStepTime);
+		while (millisecondsSinceStart() - start < fastModeFrameMilliseconds);
+	}
+	else
+	{
+		float remaining = delta * timeWarp;
+		while (remaining > 0.0f)
+		{
+			float step = std::min(remaining, simulatedStepTime);
+			stepSimulatedTime(step);
+			remaining -= step;
+		}
+	}
+}
+
 void Controller::update(float delta)
 {
 	if (!networkInterface)
@@ -761,7 +872,7 @@ void Controller::update(float delta)
 		{
 			serverBrowser->update();
 		}
-		catch (std::runtime_error e)
+		catch (std::runtime_error &e)
 		{
 			std::cerr << "Error updating server browser: " << e.what() << std::endl;
 		}
@@ -783,9 +894,17 @@ void Controller::update(float delta)
 		updateTurnSpeed();
 	}
 	
-	if (executionContext) executionContext->runForTime(delta * robotCPUTimeFraction);
-	drawer->updateCamera(delta);
-	simulation->update(delta);
+	if (simulationClock)
+	{
+		drawer->updateCamera(delta);
+		advanceSimulatedTime(delta);
+	}
+	else
+	{
+		if (executionContext) executionContext->runForTime(delta * robotCPUTimeFraction);
+		drawer->updateCamera(delta);
+		simulation->update(delta);
+	}
 	soundController->update();
 	networkInterface->update();
 }
@@ -27,6 +27,7 @@ class Robot;
 class RobotTouchHandler;
 class ServerBrowser;
 class Simulation;
+class SimulationClock;
 class SoundController;
 class TouchesRecognizer;
 class UserInterface;
@@ -42,6 +43,7 @@ class Controller : public FileChooserDelegate
 	ExecutionContext *executionContext;
 	NetworkInterface *networkInterface;
 	Simulation *simulation;
+	SimulationClock *simulationClock;
 	SoundController *soundController;
 	ServerBrowser *serverBrowser;
 	UserInterface *userinterface;
@@ -69,7 +71,12 @@ class Controller : public FileChooserDelegate
 	float timeSinceStartedScroll;
 	float wheelScrollDirection;
 	
+	float timeWarp;
+	bool asFastAsPossible;
+	
 	void setCameraSpeedFromButtons();
+	void advanceSimulatedTime(float delta);
+	void stepSimulatedTime(float step);
 	void updateTurnSpeed();
 		
 	void setNetworkInterface(NetworkInterface *interface);
@@ -124,6 +131,9 @@ public:
 	bool getIsPaused() const;
 	void reload();
 	void chooseFile();
+	// Writes the program's InterpreterProfile next to the program, as text
+	// and JSON. Bound to the P key.
+	void writeProfile();
 	
 	// Mouse events
 	void mouseDown(float x, float y, unsigned button);
@@ -164,6 +174,16 @@ public:
 	void update(float delta);
 	void draw();
 	
+	// Robot program timing, for sleeping between frames
+	unsigned getMillisecondsUntilRobotWakes() const;
+	void runRobotProgramSlice();
+	
+	// Simulated time. With a factor other than 1 or asFastAsPossible set, the
+	// robot program, motors and physics all run in lockstep on a simulated
+	// clock instead of the wall clock.
+	void setTimeWarp(float factor, bool asFastAsPossible);
+	bool getRunsAsFastAsPossible() const { return asFastAsPossible; }
+	
 	const float4 &getCameraLocation(void) const throw();
 	const matrix &getCameraMatrix(void) const throw();
 	float4 getCameraVelocity() const throw();
@@ -0,0 +1,182 @@
+/*
+ *  DecodedProgram.cpp
+ *  mindstormssimulation
+ *
+ *  Created by agent on 18.10.26
+ *  Copyright 2026 RWTH Aachen University All rights reserved.
+ *
+ */
+
+#include "DecodedProgram.h"
+
+#include "InterpreterOpcodes.h"
+#include "RXEFile.h"
+
+namespace
+{
+	const unsigned notAnInstruction = ~0u;
+
+	// Long-format equivalents of the short opcodes
+	const uint8_t opcodeForShortOpcode[8] = {
+		0x1B, // SHORT_OP_MOV -> OP_MOV
+		0x2C, // SHORT_OP_ACQUIRE -> OP_ACQUIRE
+		0x2D, // SHORT_OP_RELEASE -> OP_RELEASE
+		0x2E, // SHORT_OP_SUBCALL -> OP_SUBCALL
+		DecodedProgram::invalidOpcode,
+		DecodedProgram::invalidOpcode,
+		DecodedProgram::invalidOpcode,
+		DecodedProgram::invalidOpcode
+	};
+}
+
+bool DecodedProgram::isBranch(unsigned opcode)
+{
+	switch (handlerForOpcode(opcode))
+	{
+		case HANDLER_OP_JMP:
+		case HANDLER_OP_BRCMP:
+		case HANDLER_OP_BRTST:
+			return true;
+		default:
+			return false;
+	}
+}
+
+DecodedProgram::DecodedProgram(const RXEFile *file)
+{
+	const uint16_t *code = file->getCode();
+	const unsigned codeWordCount = file->getCodeWordCount();
+
+	// Index of the instruction that starts at a given word, if any. The extra
+	// entry at the end stands for "end of program".
+	std::vector<unsigned> indexForCodeWord(codeWordCount + 1, notAnInstruction);
+	std::vector<unsigned> operandStarts;
+
+	unsigned word = 0;
+	while (word < codeWordCount)
+	{
+		Instruction instruction;
+		instruction.codeOffset = word;
+		instruction.operands = 0;
+		unsigned length;
+		unsigned operandStart = unsigned(operands.size());
+
+		if (code[word] & (1 << 11))
+		{
+			// Short format. The lower byte is an argument, and for two-word
+			// instructions, a difference to the argument in the second word.
+			unsigned shortOpcode = (code[word] & 0x0700) >> 8;
+			int argDiff = (int8_t) (code[word] & 0xFF);
+			instruction.opcode = opcodeForShortOpcode[shortOpcode];
+			instruction.flags = 0;
+
+			switch (shortOpcode)
+			{
+				case 0: // SHORT_OP_MOV
+				case 3: // SHORT_OP_SUBCALL
+					length = 2;
+					if (word + 1 >= codeWordCount)
+					{
+						instruction.opcode = invalidOpcode;
+						length = 1;
+						break;
+					}
+					// MOV: Destination, Source
+					// SUBCALL: Subroutine, Caller ID
+					operands.push_back(uint16_t(argDiff + code[word + 1]));
+					operands.push_back(code[word + 1]);
+					break;
+				case 1: // SHORT_OP_ACQUIRE
+				case 2: // SHORT_OP_RELEASE
+					length = 1;
+					operands.push_back(uint16_t(argDiff));
+					break;
+				default:
+					length = 1;
+					break;
+			}
+		}
+		else
+		{
+			// Long format
+			// You’d think it’d be the other way around, but Lego’s documentation
+			// tries to account for endianess and gets it all wrong.
+			unsigned size = (code[word] & 0xF000) >> 12;
+			if (size == 0xE && word + 1 < codeWordCount) size = code[word+1];
+
+			instruction.opcode = uint8_t(code[word] & 0x00FF);
+			instruction.flags = uint8_t((code[word] & 0x0F00) >> 8);
+			length = size / 2;
+
+			if (length == 0 || word + length > codeWordCount)
+			{
+				// Would never advance or run past the end of the code.
+				instruction.opcode = invalidOpcode;
+				length = 1;
+			}
+			else
+				operands.insert(operands.end(), code + word + 1, code + word + length);
+		}
+
+		instruction.handler = uint8_t(handlerForOpcode(instruction.opcode));
+		instruction.operandCount = uint16_t(operands.size() - operandStart);
+		operandStarts.push_back(operandStart);
+		indexForCodeWord[word] = unsigned(instructions.size());
+		instructions.push_back(instruction);
+
+		word += length;
+	}
+
+	const unsigned count = unsigned(instructions.size());
+	indexForCodeWord[codeWordCount] = count;
+
+	// Now that the operands no longer move, link everything up.
+	for (unsigned i = 0; i < count; i++)
+	{
+		Instruction &instruction = instructions[i];
+		instruction.next = i + 1;
+		if (instruction.operandCount > 0)
+			instruction.operands = &operands[operandStarts[i]];
+
+		if (isBranch(instruction.opcode) && instruction.operandCount > 0)
+		{
+			// Offsets are relative to the start of the branch instruction.
+			int target = int(instruction.codeOffset) + int16_t(instruction.operands[0]);
+			unsigned targetIndex = count;
+			if (target >= 0 && unsigned(target) <= codeWordCount)
+			{
+				if (indexForCodeWord[target] != notAnInstruction)
+					targetIndex = indexForCodeWord[target];
+				else
+					misalignedBranches.push_back(i);
+			}
+
+			operands[operandStarts[i]] = uint16_t(targetIndex);
+		}
+	}
+
+	clumpStarts.resize(file->getClumpCount());
+	for (unsigned i = 0; i < file->getClumpCount(); i++)
+	{
+		unsigned start = file->getCodeStartForClump(i);
+		if (start <= codeWordCount && indexForCodeWord[start] != notAnInstruction)
+			clumpStarts[i] = indexForCodeWord[start];
+		else
+			clumpStarts[i] = count;
+	}
+}
+
+unsigned DecodedProgram::getClumpForInstruction(unsigned index) const
+{
+	unsigned clump = 0;
+	unsigned bestStart = 0;
+	for (unsigned i = 0; i < clumpStarts.size(); i++)
+	{
+		if (clumpStarts[i] <= index && clumpStarts[i] >= bestStart)
+		{
+			clump = i;
+			bestStart = clumpStarts[i];
+		}
+	}
+	return clump;
+}
@@ -0,0 +1,117 @@
+#pragma once
+/*
+ *  DecodedProgram.h
+ *  mindstormssimulation
+ *
+ *  Created by agent on 18.10.26
+ *  Copyright 2026 RWTH Aachen University All rights reserved.
+ *
+ */
+
+#include <vector>
+#include <stdint.h>
+
+class RXEFile;
+
+/*!
+ * @abstract The code of an RXE file, decoded once for execution.
+ * @discussion The bytecode in an RXE file packs opcode, flags and instruction
+ * size into a single word and has a special short format for some common
+ * instructions. Taking that apart again for every executed instruction is
+ * wasteful, so this class does it once, when the program is loaded, and
+ * stores the result as a compact array of instructions.
+ *
+ * Each decoded instruction has a long-format opcode (short instructions are
+ * mapped to their long equivalents), the handler from InterpreterOpcodes.h
+ * that executes it, its flags, the index of the next
+ * instruction and a list of operands. The operands are the same as in the
+ * file, with two exceptions: Short instructions get their arguments expanded,
+ * so that they look exactly like the long form, and the offset of OP_JMP,
+ * OP_BRCMP and OP_BRTST is replaced by the index of the target instruction.
+ *
+ * Instructions that can not be decoded, for example because their size is
+ * wrong, are not rejected here; they get the opcode invalidOpcode and, like
+ * unknown opcodes, the handler HANDLER_INVALID. They report the error once
+ * they get executed, just like they always did. Branches into the middle of
+ * an instruction have no target to execute; they are listed, so that the
+ * interpreter can report them as soon as it loads the program.
+ *
+ * Like the RXEFile it is created from, an object of this class is immutable.
+ */
+class DecodedProgram
+{
+public:
+	/*! Opcode used for instructions that could not be decoded. */
+	static const uint8_t invalidOpcode = 0xFF;
+
+	struct Instruction
+	{
+		/*! Long-format opcode, or invalidOpcode. */
+		uint8_t opcode;
+		/*! The InterpreterHandler for the opcode. */
+		uint8_t handler;
+		/*! Flags, e.g. the comparison mode for OP_CMP. */
+		uint8_t flags;
+		/*! Number of operands. */
+		uint16_t operandCount;
+		/*! Index of the instruction that follows this one. */
+		uint32_t next;
+		/*! Offset of the instruction in the original code, in words. */
+		uint32_t codeOffset;
+		/*! The resolved operands. */
+		const uint16_t *operands;
+	};
+
+private:
+	std::vector<Instruction> instructions;
+	std::vector<uint16_t> operands;
+	std::vector<unsigned> clumpStarts;
+	std::vector<unsigned> misalignedBranches;
+
+	// Not copyable, as the instructions point into the operands.
+	DecodedProgram(const DecodedProgram &);
+	DecodedProgram &operator=(const DecodedProgram &);
+
+public:
+	/*!
+	 * @abstract Decodes the code of an RXE file.
+	 * @discussion The program does not keep a reference to the file; it can be
+	 * deleted afterwards.
+	 * @param file The file whose code should be decoded.
+	 */
+	DecodedProgram(const RXEFile *file);
+
+	/*!
+	 * @abstract Number of instructions in the program.
+	 * @discussion Any index equal to or larger than this is the end of the
+	 * program. Branches to locations that are not the start of an instruction
+	 * resolve to this value as well.
+	 */
+	unsigned getInstructionCount() const { return unsigned(instructions.size()); }
+
+	/*! The instruction with the given index. No bounds checking. */
+	const Instruction &getInstruction(unsigned index) const { return instructions[index]; }
+
+	/*! Index of the first instruction of a clump. */
+	unsigned getStartForClump(unsigned clump) const { return clumpStarts.at(clump); }
+
+	/*!
+	 * @abstract The clump an instruction belongs to.
+	 * @discussion That is the one that starts closest before it.
+	 */
+	unsigned getClumpForInstruction(unsigned index) const;
+
+	/*!
+	 * @abstract The branches whose target is inside another instruction.
+	 * @discussion Indices of the branch instructions, in order. Their target
+	 * is the end of the program, like for all invalid targets.
+	 */
+	const std::vector<unsigned> &getMisalignedBranches() const { return misalignedBranches; }
+
+	/*!
+	 * @abstract Checks whether an opcode is one of the branch instructions.
+	 * @discussion For these, the first operand is an instruction index instead
+	 * of a relative offset.
+	 */
+	static bool isBranch(unsigned opcode);
+};
@@ -11,6 +11,8 @@
 
 #include "Vec4.h"
 
+#include <algorithm>
+#include <limits>
 #include <math.h>
 
 Environment::Environment(unsigned sX, unsigned sZ, float cS, float cH) : cells(0)
@@ -37,6 +39,8 @@ void Environment::setDimensions(unsigned sX, unsigned sZ, float cS, float cH)
 			cells[x*sizeZ+z].shade = 0.5f;
 		}
 	}
+	
+	rebuildWallBoxes();
 }
 
 Environment::~Environment()
@@ -73,7 +77,121 @@ float Environment::getCellShade(unsigned x, unsigned z) const throw()
 void Environment::setCellIsWall(unsigned x, unsigned z, bool isWall) throw(std::range_error)
 {
 	throwIfOutOfRange(x, z);
+	if (cells[x * sizeZ + z].isWall == isWall) return;
 	cells[x * sizeZ + z].isWall = isWall;
+	
+	// Split the boxes of this column's runs, so that they end next to it,
+	// then find the runs again and merge them with their neighbours. Boxes
+	// of runs that did not change end up just as before.
+	for (std::vector<WallBox>::const_iterator iter = wallRuns[x].begin(); iter != wallRuns[x].end(); ++iter)
+	{
+		if (iter->minX < x) setWallBoxColumns(iter->minX, x - 1, iter->minZ, iter->maxZ, iter->minX, x - 1);
+		if (iter->maxX > x) setWallBoxColumns(x + 1, iter->maxX, iter->minZ, iter->maxZ, x + 1, iter->maxX);
+	}
+	findWallRunsInColumn(x);
+	mergeWallRunsInColumn(x);
+}
+
+void Environment::findWallRunsInColumn(unsigned x)
+{
+	std::vector<WallBox> &runs = wallRuns[x];
+	runs.clear();
+	for (unsigned z = 0; z < sizeZ; z++)
+	{
+		if (!cells[x * sizeZ + z].isWall) continue;
+		
+		WallBox run;
+		run.minX = x;
+		run.maxX = x;
+		run.minZ = z;
+		while (z + 1 < sizeZ && cells[x * sizeZ + z + 1].isWall)
+			z++;
+		run.maxZ = z;
+		runs.push_back(run);
+	}
+}
+
+Environment::WallBox *Environment::findWallRun(unsigned x, unsigned minZ, unsigned maxZ)
+{
+	std::vector<WallBox> &runs = wallRuns[x];
+	for (std::vector<WallBox>::iterator iter = runs.begin(); iter != runs.end() && iter->minZ <= minZ; ++iter)
+	{
+		if (iter->minZ == minZ && iter->maxZ == maxZ) return &*iter;
+	}
+	return 0;
+}
+
+void Environment::setWallBoxColumns(unsigned fromX, unsigned toX, unsigned minZ, unsigned maxZ, unsigned minX, unsigned maxX)
+{
+	for (unsigned x = fromX; x <= toX; x++)
+	{
+		WallBox *run = findWallRun(x, minZ, maxZ);
+		run->minX = minX;
+		run->maxX = maxX;
+	}
+}
+
+void Environment::mergeWallRunsInColumn(unsigned x)
+{
+	for (std::vector<WallBox>::iterator iter = wallRuns[x].begin(); iter != wallRuns[x].end(); ++iter)
+	{
+		unsigned minX = x;
+		unsigned maxX = x;
+		const WallBox *left = x > 0 ? findWallRun(x - 1, iter->minZ, iter->maxZ) : 0;
+		const WallBox *right = x + 1 < sizeX ? findWallRun(x + 1, iter->minZ, iter->maxZ) : 0;
+		if (left) minX = left->minX;
+		if (right) maxX = right->maxX;
+		setWallBoxColumns(minX, maxX, iter->minZ, iter->maxZ, minX, maxX);
+	}
+}
+
+void Environment::rebuildWallBoxes()
+{
+	wallRuns.clear();
+	wallRuns.resize(sizeX);
+	for (unsigned x = 0; x < sizeX; x++)
+	{
+		findWallRunsInColumn(x);
+		
+		// Extend the boxes from the left. Their ends are only known once all
+		// columns are done.
+		if (x == 0) continue;
+		for (std::vector<WallBox>::iterator iter = wallRuns[x].begin(); iter != wallRuns[x].end(); ++iter)
+		{
+			const WallBox *left = findWallRun(x - 1, iter->minZ, iter->maxZ);
+			if (left) iter->minX = left->minX;
+		}
+	}
+	for (unsigned x = sizeX; x-- > 1; )
+	{
+		for (std::vector<WallBox>::iterator iter = wallRuns[x - 1].begin(); iter != wallRuns[x - 1].end(); ++iter)
+		{
+			const WallBox *right = findWallRun(x, iter->minZ, iter->maxZ);
+			if (right) iter->maxX = right->maxX;
+		}
+	}
+}
+
+void Environment::getWallBoxesInArea(int minX, int maxX, int minZ, int maxZ, std::vector<WallBox> &result) const throw()
+{
+	result.clear();
+	minX = std::max(minX, 0);
+	maxX = std::min(maxX, int(sizeX) - 1);
+	minZ = std::max(minZ, 0);
+	maxZ = std::min(maxZ, int(sizeZ) - 1);
+	
+	for (int x = minX; x <= maxX; x++)
+	{
+		const std::vector<WallBox> &runs = wallRuns[x];
+		for (std::vector<WallBox>::const_iterator iter = runs.begin(); iter != runs.end() && int(iter->minZ) <= maxZ; ++iter)
+		{
+			if (int(iter->maxZ) < minZ) continue;
+			
+			// Only once, in the first column of the area that has it.
+			if (int(iter->minX) < x && x > minX) continue;
+			result.push_back(*iter);
+		}
+	}
 }
 
 bool Environment::getCellIsWall(unsigned x, unsigned z) const throw()
@@ -121,6 +239,9 @@ bool Environment::getFirstCellOnRay(const ray4 &ray, int &x, int &z, float &leng
 	int lastX = unsigned(clippedEnd.x);
 	int lastZ = unsigned(clippedEnd.z);
 	
+	// The steps are along the normalized direction, but length is a
+	// fraction of the ray, like tStart and tEnd.
+	const float rayLength = relDirection.length();
 	relDirection = relDirection.normalized();
 	
 	while(true)
@@ -155,9 +276,12 @@ bool Environment::getFirstCellOnRay(const ray4 &ray, int &x, int &z, float &leng
 		
 		float4 toNextCell = (relDirection > float4(0)).select(float4(1) - relativePoint, -relativePoint);
 		float4 tToNext = toNextCell / relDirection;
+		// A ray along an axis never gets to the next cell across it.
+		if (relDirection.x == 0.0f) tToNext.x = std::numeric_limits<float>::infinity();
+		if (relDirection.z == 0.0f) tToNext.z = std::numeric_limits<float>::infinity();
 		float t = fminf(tToNext.x, tToNext.z) + 0.01f;
 		point += t * relDirection;
-		length += t;
+		length += t / rayLength;
 	}
 	
 	return false;
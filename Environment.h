@@ -1,3 +1,4 @@
+#pragma once
 /*
  *  Environment.h
  *  mindstormssimulation
@@ -9,6 +10,7 @@
  */
 
 #include <stdexcept>
+#include <vector>
 
 union float4;
 class ray4;
@@ -23,6 +25,24 @@ struct EnvironmentCell
 
 class Environment
 {
+public:
+	/*!
+	 * @abstract A rectangle of wall cells.
+	 * @discussion The walls are kept as the runs of wall cells in each column
+	 * of cells (with the same x), merged with the runs that start and end in
+	 * the same rows in the columns next to them. A straight wall or a block
+	 * of walls is then one rectangle, however many cells it has.
+	 */
+	struct WallBox
+	{
+		/*! First and last column, inclusive. */
+		unsigned minX;
+		unsigned maxX;
+		/*! First and last row, inclusive. */
+		unsigned minZ;
+		unsigned maxZ;
+	};
+	
 private:
 	EnvironmentCell *cells;
 	unsigned sizeX;
@@ -31,9 +51,20 @@ private:
 	float cellHeight;
 	bool challenge=false;
 	
+	// For each column, its runs of wall cells ordered by z, each with the
+	// columns of the WallBox it is part of. Changing a cell only changes the
+	// runs of its column, and the columns of the boxes they are part of.
+	std::vector<std::vector<WallBox> > wallRuns;
+	
 	void throwIfOutOfRange(unsigned x, unsigned z) const throw(std::range_error);
 	void clampToRange(unsigned &x, unsigned &z) const throw();
 	
+	void findWallRunsInColumn(unsigned x);
+	WallBox *findWallRun(unsigned x, unsigned minZ, unsigned maxZ);
+	void setWallBoxColumns(unsigned fromX, unsigned toX, unsigned minZ, unsigned maxZ, unsigned minX, unsigned maxX);
+	void mergeWallRunsInColumn(unsigned x);
+	void rebuildWallBoxes();
+	
 public:
 	Environment(unsigned sizeX, unsigned sizeZ, float cellSize, float cellHeight);
 	~Environment();
@@ -47,6 +78,21 @@ public:
 	void setCellIsWall(unsigned x, unsigned z, bool isWall) throw(std::range_error);
 	float getCellShade(unsigned x, unsigned z) const throw();
 	void setCellShade(unsigned x, unsigned z, float shade) throw(std::range_error);
+	
+	/*!
+	 * @abstract Finds the walls in an area.
+	 * @discussion Each WallBox that has a cell in the area is reported once,
+	 * with all of its cells, including those outside the area.
+	 * @param minX First column of the area. May be outside of the
+	 * environment, like all other limits.
+	 * @param maxX Last column of the area, inclusive.
+	 * @param minZ First row of the area.
+	 * @param maxZ Last row of the area, inclusive.
+	 * @param result Set to the boxes, ordered by their first column in the
+	 * area, then by row.
+	 */
+	void getWallBoxesInArea(int minX, int maxX, int minZ, int maxZ, std::vector<WallBox> &result) const throw();
+	
 	bool getChallenge(){ return challenge; }
 	void setChallenge(bool mode) throw(std::range_error);
 	
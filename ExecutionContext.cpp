@@ -13,85 +13,212 @@
 
 #include "NetworkInterface.h"
 #include "Interpreter.h"
+#include "NativeCode.h"
 #include "RXEFile.h"
+#include "RXEFileCache.h"
 #include "System.h"
 #include "Time.h"
 #include "VMMemory.h"
 
+namespace
+{
+	// Initial guess for the speed of the interpreter, used until the first
+	// calibration is complete.
+	const float initialInstructionsPerSecond = 5000000.0f;
+	
+	// Budgets are never smaller than this, so that slices do not get useless
+	// on slow machines or with very short frames.
+	const unsigned minimumInstructionBudget = 100;
+	
+	// Timing is measured in milliseconds, so calibration waits until enough
+	// time has accumulated to give a meaningful value.
+	const unsigned calibrationIntervalMilliseconds = 250;
+	
+	// A slice may overrun its time by this factor before the interpreter is
+	// stopped, in case the calibration is off.
+	const float sliceDeadlineFactor = 4.0f;
+	
+	// On simulated time, the robot gets a fixed number of instructions per
+	// simulated second instead of a share of the CPU, so that results do not
+	// depend on the machine. This is about what the usual CPU share in the
+	// GUI gives on a typical machine in real time.
+	const float instructionsPerSimulatedSecond = 200000.0f;
+}
+
 ExecutionContext::ExecutionContext(const char *aFilename) throw (std::runtime_error)
-: filename(aFilename), file(0), memory(0), system(0), interpreter(0), networkInterface(0)
+: filename(aFilename), file(0), ownsFile(true), initialMemory(0), ownsInitialMemory(true), memory(0), system(0), interpreter(0), nativeCode(0), networkInterface(0), tickSource(0), randomSeed(0)
 {
 	if (!aFilename) throw std::runtime_error("Filename is NULL");
 	
 	isPaused = false;
 	
+	instructionsPerSecond = initialInstructionsPerSecond;
+	calibrationInstructions = 0;
+	calibrationMilliseconds = 0;
+	
+	load();
+}
+
+ExecutionContext::ExecutionContext(const RXEFile *sharedFile, const VMMemory *sharedInitialMemory) throw (std::runtime_error)
+: file(sharedFile), ownsFile(false), initialMemory(sharedInitialMemory), ownsInitialMemory(sharedInitialMemory == 0), memory(0), system(0), interpreter(0), nativeCode(0), networkInterface(0), tickSource(0), randomSeed(0)
+{
+	if (!sharedFile) throw std::runtime_error("File is NULL");
+	
+	isPaused = false;
+	
+	instructionsPerSecond = initialInstructionsPerSecond;
+	calibrationInstructions = 0;
+	calibrationMilliseconds = 0;
+	
 	load();
 }
 
 ExecutionContext::~ExecutionContext()
 {
 	delete interpreter;
+	delete nativeCode;
 	delete system;
 	delete memory;
-	delete file;
+	if (ownsInitialMemory) delete initialMemory;
+	if (ownsFile) RXEFileCache::sharedCache()->release(file);
 }
 
 void ExecutionContext::load()
 {
 	try {
-		file = new RXEFile(filename.c_str());
-		memory = new VMMemory(file);
+		if (ownsFile) file = RXEFileCache::sharedCache()->acquire(filename.c_str());
+		if (ownsInitialMemory) initialMemory = new VMMemory(file);
+		memory = new VMMemory(*initialMemory);
 		system = new System(memory);
+		system->setTickSource(tickSource);
+		system->setRandomSeed(randomSeed);
 		interpreter = new Interpreter(file, memory, system);		
+		
+		if (!interpreter->isVerified())
+		{
+			std::cout << "Program did not pass verification, running with checks:" << std::endl;
+			const std::vector<std::string> &errors = interpreter->getVerificationErrors();
+			for (std::vector<std::string>::const_iterator iter = errors.begin(); iter != errors.end(); ++iter)
+				std::cout << "\t" << *iter << std::endl;
+		}
 	}
-	catch (std::runtime_error e)
+	catch (std::runtime_error &)
 	{
 		delete interpreter;
 		delete system;
 		delete memory;
-		delete file;
+		if (ownsInitialMemory) delete initialMemory;
+		if (ownsFile) RXEFileCache::sharedCache()->release(file);
 		
-		throw e;
+		throw;
 	}
 	
 }
 
+void ExecutionContext::loadNativeCode(const char *libraryPath) throw(std::runtime_error)
+{
+	if (!interpreter->isVerified()) throw std::runtime_error("Only verified programs can run as native code.");
+	
+	NativeCode *code = new NativeCode(libraryPath, file);
+	interpreter->setNativeCode(code->getExecuteFunction());
+	delete nativeCode;
+	nativeCode = code;
+}
+
 void ExecutionContext::reload()
 {
 	if (!this) return;
 	
-	delete interpreter;
-	delete system;
-	delete memory;
-	delete file;
-	
-	load();
-	
-	if (networkInterface) system->setNetworkInterface(networkInterface);
+	memory->restore(*initialMemory);
+	system->reset();
+	interpreter->reset();
+}
+
+unsigned ExecutionContext::getInstructionBudgetForTime(float seconds) const
+{
+	float budget = seconds * instructionsPerSecond;
+	if (budget < float(minimumInstructionBudget)) return minimumInstructionBudget;
+	if (budget > 1e9f) return 1000000000;
+	return unsigned(budget);
+}
+
+unsigned ExecutionContext::getWakeTick() const
+{
+	if (isPaused || interpreter->isStopped()) return ~0u;
+	return interpreter->waitingUntilTick();
 }
 
 void ExecutionContext::runForTime(float mintime)
 {
 	if (isPaused) return;
 	
-	unsigned long start = millisecondsSinceStart();
-	
-	if (interpreter->waitingUntilTick() > start)
+	// Parked until the wake tick; nothing to do.
+	unsigned tick = system->getTick();
+	if (getWakeTick() > tick)
 		return;
 	
-	while ((float(millisecondsSinceStart()-start)/1000.0f) < mintime)
+	unsigned start = millisecondsSinceStart();
+	unsigned deadline = tick + 1 + unsigned(mintime * sliceDeadlineFactor * 1000.0f);
+	unsigned executed = 0;
+	Interpreter::RunResult result = interpreter->run(getInstructionBudgetForTime(mintime), deadline, &executed);
+	writeDiagnostics();
+	
+	// Only slices that ran for their full budget tell anything about speed.
+	if (result == Interpreter::BudgetExhausted)
 	{
-		try
-		{
-			interpreter->step();
-		}
-		catch (std::exception e)
+		calibrationInstructions += executed;
+		calibrationMilliseconds += millisecondsSinceStart() - start;
+		if (calibrationMilliseconds >= calibrationIntervalMilliseconds)
 		{
-			std::cout << "Exception during execution of code: " << e.what() << std::endl;
+			instructionsPerSecond = float(calibrationInstructions) * 1000.0f / float(calibrationMilliseconds);
+			calibrationInstructions = 0;
+			calibrationMilliseconds = 0;
 		}
 	}
 }
 
+void ExecutionContext::runInstructions(unsigned budget)
+{
+	if (isPaused) return;
+	
+	if (getWakeTick() > system->getTick())
+		return;
+	
+	interpreter->run(budget);
+	writeDiagnostics();
+}
+
+void ExecutionContext::writeDiagnostics()
+{
+	VMDiagnostics *diagnostics = interpreter->getDiagnostics();
+	if (!diagnostics->hasEvents()) return;
+	
+	std::string prefix = filename.empty() ? std::string() : filename + ": ";
+	diagnostics->writeEvents(std::cout, prefix);
+}
+
+void ExecutionContext::runForSimulatedTime(float seconds)
+{
+	runInstructions(unsigned(seconds * instructionsPerSimulatedSecond));
+}
+
+const InterpreterProfile *ExecutionContext::getProfile() const
+{
+	return interpreter->getProfile();
+}
+
+void ExecutionContext::setTickSource(TickSource *aSource)
+{
+	tickSource = aSource;
+	system->setTickSource(tickSource);
+}
+
+void ExecutionContext::setRandomSeed(unsigned seed)
+{
+	randomSeed = seed;
+	system->setRandomSeed(randomSeed);
+}
+
 void ExecutionContext::setIsPaused(bool pause) throw()
 {
 	isPaused = pause;
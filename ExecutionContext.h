@@ -11,9 +11,12 @@
 #include <string>
 
 class Interpreter;
+class InterpreterProfile;
+class NativeCode;
 class NetworkInterface;
 class RXEFile;
 class System;
+class TickSource;
 class VMMemory;
 
 class ExecutionContext
@@ -21,42 +24,138 @@ class ExecutionContext
 private:
 	std::string filename;
 	
-	RXEFile *file;
+	// Comes from the RXEFileCache, unless passed in by the creator.
+	const RXEFile *file;
+	bool ownsFile;
+	// The memory as it was right after loading, for restarting.
+	const VMMemory *initialMemory;
+	bool ownsInitialMemory;
 	VMMemory *memory;
 	System *system;
 	Interpreter *interpreter;
+	NativeCode *nativeCode;
 
 	NetworkInterface *networkInterface;
+	TickSource *tickSource;
+	unsigned randomSeed;
 	
 	bool isPaused;
 	
+	// Calibration: How many instructions the interpreter manages per second
+	// on this machine, and the measurements for the next update of that.
+	float instructionsPerSecond;
+	unsigned long calibrationInstructions;
+	unsigned calibrationMilliseconds;
+	
 	void load();
 	
+	// Writes what the interpreter reported since the last time.
+	void writeDiagnostics();
+	
 public:
 	/*!
 	 * @abstract Creates the system objects for the robot.
 	 * @discussion This creates all the files necessary for running the robot.
 	 * In particular, it initializes the RXEFile, VMMemory, System and Interpreter
+	 * The RXEFile comes from the RXEFileCache, so contexts for the same
+	 * program share it.
 	 * @param filename The name of the RXE file. Must not be NULL.
 	 * @throws std::runtime_error For the reasons given in the classes RXEFile,
 	 * VMMemory, System and Interpreter, or if a NULL filename is passed.
 	 */
 	ExecutionContext(const char *filename) throw (std::runtime_error);
 	
+	/*!
+	 * @abstract Creates the system objects for a program that is already loaded.
+	 * @discussion The file is not owned by the context and is only read, so
+	 * several contexts, even on different threads, can share the same file.
+	 * It has to stay around until all of them are deleted.
+	 *
+	 * The same goes for the initial memory. Passing one saves building the
+	 * memory from the file again, so starting many copies of a program only
+	 * costs a copy of its memory each.
+	 * @param file The loaded RXE file. Must not be NULL.
+	 * @param initialMemory A memory for the file, as it is right after
+	 * creating it. If NULL, one is created.
+	 * @throws std::runtime_error For the reasons given in the classes
+	 * VMMemory, System and Interpreter, or if a NULL file is passed.
+	 */
+	ExecutionContext(const RXEFile *file, const VMMemory *initialMemory = 0) throw (std::runtime_error);
+	
 	/*! Destructor. */
 	virtual ~ExecutionContext();	
 	
+	/*!
+	 * @abstract Runs the program as native code from now on.
+	 * @discussion Loads a translation of the program, made with
+	 * RXEAnalyzer --translate and compiled into a shared library. The
+	 * program behaves exactly as when interpreted, only faster. The code
+	 * stays in use after a reload.
+	 * @param libraryPath The shared library.
+	 * @throws std::runtime_error If the library can not be loaded or does not
+	 * belong to this program, or the program did not pass verification.
+	 */
+	void loadNativeCode(const char *libraryPath) throw(std::runtime_error);
+	
 	/*!
 	 * @abstract Executes code for the specified number of seconds.
-	 * @discussion Executes Lego bytecode until at least the time specified here
-	 * has run out. If no interpreter exists, it exits immediately, while for
-	 * lengthy operations, it can return after significantly more than the
-	 * minimal time. On the other hand, if the context is paused, this method
-	 * returns immediately.
+	 * @discussion Executes roughly as much Lego bytecode as fits in the time
+	 * specified here. The time is not measured while running; instead, it is
+	 * turned into an instruction budget with getInstructionBudgetForTime, and
+	 * the speed used for that is recalibrated continuously from the slices
+	 * that ran. This method returns early if the program is waiting or has
+	 * stopped, and immediately if the context is paused.
 	 * @param mintime The time to execute for.
 	 */
 	void runForTime(float mintime);
 	
+	/*!
+	 * @abstract Number of instructions that can be executed in the given time.
+	 * @discussion Based on the measured speed of the interpreter on this
+	 * machine. Before enough has been measured, a conservative default is
+	 * used.
+	 * @param seconds The CPU time to spend.
+	 */
+	unsigned getInstructionBudgetForTime(float seconds) const;
+	
+	/*!
+	 * @abstract Tick at which the program next needs to run.
+	 * @discussion While the program is waiting, runForTime does nothing, so
+	 * callers can sleep until this tick instead of calling it. The value is
+	 * in the same units as millisecondsSinceStart(). If the program can run
+	 * right now, the result is a tick in the past (usually 0). If it will never
+	 * run again, because it has stopped or the context is paused, the result
+	 * is ~0u. If a tick source has been set, the tick is in its units instead.
+	 */
+	unsigned getWakeTick() const;
+	
+	/*!
+	 * @abstract Executes a fixed number of instructions.
+	 * @discussion Used when running on simulated time, where the amount of
+	 * code executed must not depend on the speed of the machine. Like
+	 * runForTime, this does nothing while the program is parked or the
+	 * context is paused.
+	 * @param budget The maximum number of instructions to execute.
+	 */
+	void runInstructions(unsigned budget);
+	
+	/*!
+	 * @abstract Executes code for a step of simulated time.
+	 * @discussion Runs the number of instructions the robot gets for that much
+	 * simulated time, which is fixed and does not depend on the machine.
+	 * Meant to be used together with a SimulationClock as tick source.
+	 * @param seconds The simulated time to execute for.
+	 */
+	void runForSimulatedTime(float seconds);
+	
+	/*!
+	 * @abstract Sets where the program gets its tick from.
+	 * @discussion By default, and if NULL is passed, this is the wall clock.
+	 * The context does not take ownership of the source, and keeps using it
+	 * after a reload. Wake ticks are in the units of this source.
+	 */
+	void setTickSource(TickSource *aSource);
+	
 	/*!
 	 * @abstract Sets the interface necessary for communicating with the outside
 	 * world.
@@ -66,6 +165,14 @@ public:
 	 */
 	void setNetworkInterface(NetworkInterface *anInterface);
 	
+	/*!
+	 * @abstract Sets the seed for random values the program gets.
+	 * @discussion Used for input properties the simulation does not support.
+	 * The default is 0. Stays in use after a reload, which starts the values
+	 * over.
+	 */
+	void setRandomSeed(unsigned seed);
+	
 	/*!
 	 * @abstract Sets the context to paused.
 	 * @discussion If the context is paused, the runForTime method does nothing.
@@ -78,8 +185,9 @@ public:
 	bool getIsPaused() const throw() { return isPaused; }	
 	
 	/*!
-	 * @abstract Reloads the file contents and starts execution from the
-	 * beginning.
+	 * @abstract Starts execution from the beginning.
+	 * @discussion The memory is reset to a copy taken when the program was
+	 * loaded, so this does not read the file again.
 	 */
 	void reload();
 	
@@ -87,4 +195,16 @@ public:
 	 * @abstract Returns the current interface.
 	 */
 	NetworkInterface *getNetworkInterface() { return networkInterface; }
+	
+	/*!
+	 * @abstract Returns the memory of the running program.
+	 */
+	const VMMemory *getMemory() const { return memory; }
+	
+	/*!
+	 * @abstract Returns what the program spent its time on since loading.
+	 * @discussion NULL unless the interpreter was compiled with
+	 * INTERPRETER_PROFILING.
+	 */
+	const InterpreterProfile *getProfile() const;
 };
@@ -0,0 +1,180 @@
+/*
+ *  HeadlessRun.cpp
+ *  mindstormssimulation
+ *
+ *  Created by agent on 18.10.26
+ *  Copyright 2026 RWTH Aachen University All rights reserved.
+ *
+ */
+
+#include "HeadlessRun.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "Environment.h"
+#include "ExecutionContext.h"
+#include "NetworkPacket.h"
+#include "Robot.h"
+#include "Simulation.h"
+#include "Single.h"
+
+namespace
+{
+	// Length of one simulation step. Shorter than a frame in the GUI, which
+	// makes the physics a bit more precise, and gives round sample times.
+	const float stepTime = 0.01f;
+}
+
+HeadlessRun::HeadlessRun(const char *rxeFilename, const Environment *environment, unsigned seed) throw(std::runtime_error)
+: simulation(0), single(0), context(0), clock(0), simulatedTime(0.0f)
+{
+	context = new ExecutionContext(rxeFilename);
+	setUp(environment, seed);
+}
+
+HeadlessRun::HeadlessRun(const RXEFile *file, const Environment *environment, const VMMemory *initialMemory, unsigned seed) throw(std::runtime_error)
+: simulation(0), single(0), context(0), clock(0), simulatedTime(0.0f)
+{
+	context = new ExecutionContext(file, initialMemory);
+	setUp(environment, seed);
+}
+
+void HeadlessRun::setUp(const Environment *environment, unsigned seed)
+{
+	simulation = new Simulation(environment, seed);
+	single = new Single(simulation);
+	context->setRandomSeed(seed);
+	context->setTickSource(&clock);
+	context->setNetworkInterface(single);
+}
+
+HeadlessRun::~HeadlessRun()
+{
+	delete context;
+	delete single;
+	delete simulation;
+}
+
+void HeadlessRun::loadNativeCode(const char *libraryPath) throw(std::runtime_error)
+{
+	context->loadNativeCode(libraryPath);
+}
+
+const Robot *HeadlessRun::getRobot() const
+{
+	return single->getLocalRobot();
+}
+
+void HeadlessRun::step(float seconds)
+{
+	clock.advance(seconds);
+	context->runForSimulatedTime(seconds);
+	simulation->update(seconds);
+	single->update();
+	simulatedTime += seconds;
+}
+
+void HeadlessRun::run(float seconds, float sampleInterval, std::vector<Sample> &trace)
+{
+	// Count in steps, not in seconds, so that rounding errors do not add up.
+	unsigned steps = unsigned(ceilf(seconds / stepTime - 0.001f));
+	unsigned stepsPerSample = 0;
+	if (sampleInterval > 0.0f)
+	{
+		stepsPerSample = unsigned(sampleInterval / stepTime + 0.5f);
+		if (stepsPerSample == 0) stepsPerSample = 1;
+	}
+
+	for (unsigned i = 0; i < steps; i++)
+	{
+		if (stepsPerSample && i % stepsPerSample == 0)
+			trace.push_back(getSample());
+
+		// Only the last step can be shorter. Taking what remains from the
+		// total each time keeps the others at exactly stepTime.
+		step(std::min(stepTime, seconds - float(i) * stepTime));
+	}
+
+	if (stepsPerSample)
+		trace.push_back(getSample());
+}
+
+HeadlessRun::Sample HeadlessRun::getSample() const
+{
+	const Robot *robot = getRobot();
+	const matrix &position = robot->getPosition();
+
+	Sample sample;
+	sample.time = simulatedTime;
+	sample.x = position.w.x;
+	sample.z = position.w.z;
+	sample.heading = atan2f(position.x.z, position.x.x) * 180.0f / float(M_PI);
+	for (unsigned i = 0; i < 3; i++)
+	{
+		sample.motorPower[i] = robot->getMotor(i)->getPower();
+		sample.motorRotation[i] = robot->getMotor(i)->getRotationCounterValue();
+	}
+	for (unsigned i = 0; i < 4; i++)
+		sample.sensors[i] = robot->getSensorValue(i);
+
+	return sample;
+}
+
+Environment *HeadlessRun::createDefaultArena()
+{
+	return new Environment(25, 25, 1.0f, 0.75f);
+}
+
+Environment *HeadlessRun::loadArena(const char *filename) throw(std::runtime_error)
+{
+	FILE *file = fopen(filename, "rb");
+	if (!file) throw std::runtime_error("Could not open arena file.");
+
+	std::vector<uint8_t> data;
+	uint8_t buffer[4096];
+	size_t read;
+	while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		data.insert(data.end(), buffer, buffer + read);
+	fclose(file);
+
+	if (data.size() < sizeof(GridOverviewPacket))
+		throw std::runtime_error("Arena file is too short.");
+
+	const GridOverviewPacket *grid = reinterpret_cast<const GridOverviewPacket *>(&data[0]);
+	if (grid->packetType != NetworkPacket::GridOverview)
+		throw std::runtime_error("Not an arena file.");
+	if (data.size() < sizeof(GridOverviewPacket) + grid->sizeX * grid->sizeZ)
+		throw std::runtime_error("Arena file is too short for its size.");
+
+	Environment *environment = new Environment(grid->sizeX, grid->sizeZ, grid->cellSize, grid->cellHeight);
+	environment->setChallenge(grid->challengeMode);
+	for (unsigned x = 0, i = 0; x < grid->sizeX; x++)
+	{
+		for (unsigned z = 0; z < grid->sizeZ; z++, i++)
+		{
+			environment->setCellIsWall(x, z, grid->cells[i] & 0x80);
+			environment->setCellShade(x, z, float(grid->cells[i] & 0x7F) / 127.0f);
+		}
+	}
+
+	return environment;
+}
+
+void HeadlessRun::printSampleHeader(FILE *file)
+{
+	fprintf(file, "time\tx\tz\theading\tpowerA\tpowerB\tpowerC\trotationA\trotationB\trotationC\tsensor1\tsensor2\tsensor3\tsensor4\n");
+}
+
+void HeadlessRun::printSample(FILE *file, const Sample &sample)
+{
+	fprintf(file, "%.2f\t%.4f\t%.4f\t%.2f", sample.time, sample.x, sample.z, sample.heading);
+	for (unsigned i = 0; i < 3; i++)
+		fprintf(file, "\t%.1f", sample.motorPower[i]);
+	for (unsigned i = 0; i < 3; i++)
+		fprintf(file, "\t%.1f", sample.motorRotation[i]);
+	for (unsigned i = 0; i < 4; i++)
+		fprintf(file, "\t%.3f", sample.sensors[i]);
+	fprintf(file, "\n");
+}
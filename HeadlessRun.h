@@ -0,0 +1,156 @@
+#pragma once
+/*
+ *  HeadlessRun.h
+ *  mindstormssimulation
+ *
+ *  Created by agent on 18.10.26
+ *  Copyright 2026 RWTH Aachen University All rights reserved.
+ *
+ */
+
+#include <cstdio>
+#include <stdexcept>
+#include <vector>
+
+#include "TickSource.h"
+
+class Environment;
+class ExecutionContext;
+class Robot;
+class RXEFile;
+class VMMemory;
+class Simulation;
+class Single;
+
+/*!
+ * @abstract One robot program running in an arena, without graphics or sound.
+ * @discussion This is what the Controller does in the GUI, minus everything
+ * that needs a screen: A Simulation with one robot, connected to the
+ * program through a Single network interface. Everything runs on a
+ * SimulationClock, so a run takes as long as the machine needs, not as long
+ * as the simulated time, and gives the same result on every machine.
+ *
+ * The environment is not owned by the run and is not changed by it, so it
+ * can be shared between several runs, also on different threads. The same
+ * goes for the program file if it is passed in already loaded.
+ */
+class HeadlessRun
+{
+public:
+	/*!
+	 * @abstract State of the robot at one point in time.
+	 */
+	struct Sample
+	{
+		/*! Simulated time in seconds since the start of the run. */
+		float time;
+		/*! Position of the robot in the arena. */
+		float x;
+		float z;
+		/*! Direction the robot is facing, in degrees. */
+		float heading;
+		/*! Power and rotation counter of the three motors. */
+		float motorPower[3];
+		float motorRotation[3];
+		/*! Values of the four sensors. */
+		float sensors[4];
+	};
+
+private:
+	Simulation *simulation;
+	Single *single;
+	ExecutionContext *context;
+	SimulationClock clock;
+	float simulatedTime;
+
+	HeadlessRun(const HeadlessRun &);
+	HeadlessRun &operator=(const HeadlessRun &);
+	
+	void setUp(const Environment *environment, unsigned seed);
+
+public:
+	/*!
+	 * @abstract Sets up a run.
+	 * @param rxeFilename The program to run.
+	 * @param environment The arena to run it in. Not owned.
+	 * @param seed Picks the start position and all other random values of
+	 * the run. Runs with the same seed give the same result.
+	 * @throws std::runtime_error If the program can not be loaded.
+	 */
+	HeadlessRun(const char *rxeFilename, const Environment *environment, unsigned seed = 0) throw(std::runtime_error);
+	
+	/*!
+	 * @abstract Sets up a run of a program that is already loaded.
+	 * @discussion Each run has its own random numbers, so runs can be
+	 * created and run on any thread.
+	 * @param file The program to run. Not owned and not changed.
+	 * @param environment The arena to run it in. Not owned.
+	 * @param initialMemory Snapshot of the program's memory right after
+	 * loading, to start from. Not owned. If NULL, it is created from the file.
+	 * @param seed Picks the start position and all other random values of
+	 * the run. Runs with the same seed give the same result.
+	 * @throws std::runtime_error If the program can not be set up.
+	 */
+	HeadlessRun(const RXEFile *file, const Environment *environment, const VMMemory *initialMemory = 0, unsigned seed = 0) throw(std::runtime_error);
+	~HeadlessRun();
+	
+	/*!
+	 * @abstract Runs the program as native code.
+	 * @discussion See ExecutionContext::loadNativeCode.
+	 * @param libraryPath The translated program, as a shared library.
+	 * @throws std::runtime_error If the library can not be used.
+	 */
+	void loadNativeCode(const char *libraryPath) throw(std::runtime_error);
+
+	/*!
+	 * @abstract Advances program, motors and physics by one step.
+	 * @param seconds The simulated time for this step. Should be small, at most
+	 * the length of a frame in the GUI.
+	 */
+	void step(float seconds);
+
+	/*!
+	 * @abstract Runs for the given simulated time.
+	 * @param seconds How long to run.
+	 * @param sampleInterval Simulated time between two trace samples. No trace
+	 * is recorded if this is 0.
+	 * @param trace Samples get appended here.
+	 */
+	void run(float seconds, float sampleInterval, std::vector<Sample> &trace);
+
+	/*! The current state of the robot. */
+	Sample getSample() const;
+
+	/*! Simulated time that has passed in this run, in seconds. */
+	float getSimulatedTime() const { return simulatedTime; }
+
+	/*! The robot that the program controls. */
+	const Robot *getRobot() const;
+	
+	/*! The program that controls the robot. */
+	const ExecutionContext *getContext() const { return context; }
+	
+	/*! The simulation the robot is in. */
+	const Simulation *getSimulation() const { return simulation; }
+
+	/*!
+	 * @abstract Loads an arena.
+	 * @discussion An arena file contains the arena as the GUI saves it when
+	 * closing (on Windows as current_map.bin): A GridOverview network packet
+	 * in host byte order.
+	 * @param filename The name of the file.
+	 * @result A new environment, owned by the caller.
+	 * @throws std::runtime_error If the file can not be read or is not an
+	 * arena.
+	 */
+	static Environment *loadArena(const char *filename) throw(std::runtime_error);
+
+	/*! Creates the default arena that the GUI uses if nothing was saved. */
+	static Environment *createDefaultArena();
+
+	/*! Writes a header line matching printSample. */
+	static void printSampleHeader(FILE *file);
+
+	/*! Writes a sample as one tab-separated line. */
+	static void printSample(FILE *file, const Sample &sample);
+};
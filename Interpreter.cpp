@@ -9,188 +9,503 @@
 
 #include "Interpreter.h"
 
+#include <cstdio>
+
+#include "DecodedProgram.h"
+#include "InterpreterOpcodes.h"
+#include "InterpreterProfile.h"
+#include "PollingLoops.h"
 #include "RXEFile.h"
+#include "RXEVerifier.h"
 #include "System.h"
 #include "VMMemory.h"
 
-Interpreter::Interpreter(const RXEFile *aFile, VMMemory *aMemory, System *aSystem)
+namespace
+{
+	// The tick is only read between batches of this many instructions.
+	const unsigned instructionsBetweenTickChecks = 1024;
+	
+	// Instructions a clump may execute before the next ready one gets its
+	// turn. The firmware uses the same number.
+	const unsigned clumpQuantum = 20;
+}
+
+Interpreter::Interpreter(const RXEFile *aFile, VMMemory *aMemory, System *aSystem) throw(std::runtime_error)
 : file(aFile), memory(aMemory), system(aSystem)
 {
-	instruction = 0;
-	currentClump = 0;
-	waitUntil = 0;
+	if (file->getClumpCount() > maxClumpCount) throw std::runtime_error("Program has too many clumps");
+	
+	program = new DecodedProgram(file);
+	
+	RXEVerifier verifier(file, program);
+	verified = verifier.isValid();
+	verificationErrors = verifier.getErrors();
+	nativeCode = 0;
+	
+	// Other programs could fail inside a loop, which has to happen every
+	// time.
+	pollingLoops = verified ? new PollingLoops(file, program) : 0;
+	
+#ifdef INTERPRETER_PROFILING
+	profile = new InterpreterProfile(file, program);
+#else
+	profile = 0;
+#endif
+	
+	diagnostics = new VMDiagnostics;
+	
+	reset();
+	
+	// These would otherwise just end their clump once taken.
+	const std::vector<unsigned> &misalignedBranches = program->getMisalignedBranches();
+	for (unsigned i = 0; i < misalignedBranches.size(); i++)
+		diagnostics->reportFault(program->getInstruction(misalignedBranches[i]).codeOffset, program->getClumpForInstruction(misalignedBranches[i]), "branch into middle of instruction");
+}
+
+void Interpreter::reset()
+{
+	const unsigned clumpCount = file->getClumpCount();
+	clumps.resize(clumpCount);
+	for (unsigned i = 0; i < clumpCount; i++)
+	{
+		clumps[i].instruction = program->getStartForClump(i);
+		clumps[i].fireCount = file->getFireCountForClump(i);
+		clumps[i].wakeTick = 0;
+		clumps[i].link = noClump;
+		clumps[i].state = ClumpIdle;
+	}
+	
+	currentClump = noClump;
+	readyTail = noClump;
+	restingHead = noClump;
+	pollingHead = noClump;
+	pollingTail = noClump;
+	parkedLoopLength = 0;
+	loadCurrentClump();
+	for (unsigned i = 0; i < clumpCount; i++)
+		if (clumps[i].fireCount == 0) enqueueClump(i);
+	
+	for (unsigned i = 0; i < file->getDSTOCCount(); i++)
+		if (file->getTypeAtDSTOCIndex(i) == RXEFile::TC_MUTEX)
+			memory->setScalarValue(i, int32_t(freeMutex));
+	
+	batchLimit = 0;
+	lastFault.clear();
+	diagnostics->resetCounts();
+}
+
+void Interpreter::loadCurrentClump()
+{
+	instruction = currentClump != noClump ? clumps[currentClump].instruction : program->getInstructionCount();
+	quantumLeft = clumpQuantum;
+	clumpChanged = true;
+}
+
+void Interpreter::enqueueClump(unsigned clump)
+{
+	clumps[clump].state = ClumpReady;
+	clumps[clump].link = noClump;
+	if (currentClump == noClump)
+	{
+		currentClump = readyTail = clump;
+		loadCurrentClump();
+	}
+	else
+	{
+		clumps[readyTail].link = clump;
+		readyTail = clump;
+	}
+}
+
+void Interpreter::removeCurrentClump(ClumpState newState)
+{
+	unsigned clump = currentClump;
+	clumps[clump].instruction = instruction;
+	clumps[clump].state = newState;
+	currentClump = clumps[clump].link;
+	if (currentClump == noClump) readyTail = noClump;
+	clumps[clump].link = noClump;
+	loadCurrentClump();
+}
+
+void Interpreter::replaceCurrentClump(unsigned clump)
+{
+	// Takes over the place in the queue and the quantum; the program counter
+	// is up to the caller.
+	clumps[clump].state = ClumpReady;
+	clumps[clump].link = clumps[currentClump].link;
+	clumps[currentClump].link = noClump;
+	if (readyTail == currentClump) readyTail = clump;
+	currentClump = clump;
+}
+
+void Interpreter::rotateClumps()
+{
+	if (currentClump == readyTail)
+	{
+		quantumLeft = clumpQuantum;
+		return;
+	}
+	
+	unsigned clump = currentClump;
+	clumps[clump].instruction = instruction;
+	currentClump = clumps[clump].link;
+	clumps[clump].link = noClump;
+	clumps[readyTail].link = clump;
+	readyTail = clump;
+	loadCurrentClump();
+}
+
+void Interpreter::fireClump(unsigned clump) throw(std::runtime_error)
+{
+	if (clump >= clumps.size()) throw std::runtime_error("Scheduled clump does not exist");
+	
+	if (clumps[clump].fireCount > 0) clumps[clump].fireCount--;
+	if (clumps[clump].fireCount > 0) return;
+	
+	// Like in the firmware, a clump that is still busy is not started a
+	// second time.
+	clumps[clump].fireCount = file->getFireCountForClump(clump);
+	if (clumps[clump].state == ClumpIdle)
+		enqueueClump(clump);
+}
+
+void Interpreter::finishCurrentClump()
+{
+	unsigned clump = currentClump;
+	removeCurrentClump(ClumpIdle);
+	clumps[clump].instruction = program->getStartForClump(clump);
+}
+
+void Interpreter::restCurrentClump(unsigned wakeTick)
+{
+	unsigned clump = currentClump;
+	removeCurrentClump(ClumpResting);
+	clumps[clump].wakeTick = wakeTick;
+	
+	// Sorted by wake tick, and first come first served for the same tick.
+	if (restingHead == noClump || wakeTick < clumps[restingHead].wakeTick)
+	{
+		clumps[clump].link = restingHead;
+		restingHead = clump;
+		return;
+	}
+	unsigned before = restingHead;
+	while (clumps[before].link != noClump && clumps[clumps[before].link].wakeTick <= wakeTick)
+		before = clumps[before].link;
+	clumps[clump].link = clumps[before].link;
+	clumps[before].link = clump;
+}
+
+void Interpreter::wakeClumps(unsigned tick)
+{
+	while (restingHead != noClump && clumps[restingHead].wakeTick <= tick)
+	{
+		unsigned clump = restingHead;
+		restingHead = clumps[clump].link;
+		enqueueClump(clump);
+	}
+}
+
+void Interpreter::useQuantum(unsigned executed)
+{
+	// A clump that only just got to run starts with a full quantum.
+	if (clumpChanged) return;
+	
+	quantumLeft = executed < quantumLeft ? quantumLeft - executed : 0;
+	if (quantumLeft == 0) rotateClumps();
+}
+
+void Interpreter::parkPollingClump(unsigned loopStart, unsigned loopLength)
+{
+	unsigned clump = currentClump;
+	instruction = loopStart;
+	removeCurrentClump(ClumpPolling);
+	if (pollingHead == noClump) pollingHead = clump;
+	else clumps[pollingTail].link = clump;
+	pollingTail = clump;
+	parkedLoopLength = loopLength;
+}
+
+void Interpreter::wakePollingClumps(unsigned exceptClump)
+{
+	unsigned clump = pollingHead;
+	pollingHead = noClump;
+	pollingTail = noClump;
+	while (clump != noClump)
+	{
+		unsigned next = clumps[clump].link;
+		if (clump == exceptClump)
+		{
+			clumps[clump].link = noClump;
+			pollingHead = pollingTail = clump;
+		}
+		else
+			enqueueClump(clump);
+		clump = next;
+	}
+}
+
+Interpreter::~Interpreter()
+{
+	delete diagnostics;
+	delete profile;
+	delete pollingLoops;
+	delete program;
 }
 
 const char *Interpreter::nameForOpcode(unsigned opcode)
 {
 	switch (opcode)
 	{
-		case 0x00: return "OP_ADD";
-		case 0x01: return "OP_SUB";
-		case 0x02: return "OP_NEG";
-		case 0x03: return "OP_MUL";
-		case 0x04: return "OP_DIV";
-		case 0x05: return "OP_MOD";
-		case 0x36: return "OP_SQRT";
-		case 0x37: return "OP_ABS";
-		case 0x06: return "OP_AND";
-		case 0x07: return "OP_OR";
-		case 0x08: return "OP_XOR";
-		case 0x09: return "OP_NOT";
-		case 0x11: return "OP_CMP";
-		case 0x12: return "OP_TST";
-		case 0x15: return "OP_INDEX";
-		case 0x16: return "OP_REPLACE";
-		case 0x17: return "OP_ARRSIZE";
-		case 0x18: return "OP_ARRBUILD";
-		case 0x19: return "OP_ARRSUBSET";
-		case 0x1A: return "OP_ARRINIT";
-		case 0x1B: return "OP_MOV";
-		case 0x1C: return "OP_SET";
-		case 0x1D: return "OP_FLATTEN";
-		case 0x1E: return "OP_UNFLATTEN";
-		case 0x1F: return "OP_NUMTOSTRING";
-		case 0x20: return "OP_STRINGTONUM";
-		case 0x21: return "OP_STRCAT";
-		case 0x22: return "OP_STRSUBSET";
-		case 0x23: return "OP_STRTOBYTEARR";
-		case 0x24: return "OP_BYTEARRTOSTR";
-		case 0x25: return "OP_JMP";
-		case 0x26: return "OP_BRCMP";
-		case 0x27: return "OP_BRTST";
-		case 0x29: return "OP_STOP";
-		case 0x2A: return "OP_FINCLUMP";
-		case 0x2B: return "OP_FINCLUMPIMMED";
-		case 0x2C: return "OP_ACQUIRE";
-		case 0x2D: return "OP_RELEASE";
-		case 0x2E: return "OP_SUBCALL";
-		case 0x2F: return "OP_SUBRET";
-		case 0x28: return "OP_SYSCALL";
-		case 0x30: return "OP_SETIN";
-		case 0x31: return "OP_SETOUT";
-		case 0x32: return "OP_GETIN";
-		case 0x33: return "OP_GETOUT";
-		case 0x34: return "OP_WAIT";
-		case 0x35: return "OP_GETTICK";
+#define INTERPRETER_NAME_CASE(name, opcode, handler, operands) case opcode: return #name;
+		INTERPRETER_OPCODES(INTERPRETER_NAME_CASE)
+#undef INTERPRETER_NAME_CASE
 		default: return "OP_UNKNOWN";
 	}
 }
 
+void Interpreter::invalidInstruction(unsigned opcode, unsigned codeOffset)
+{
+	char opcodeString[255];
+	sprintf(opcodeString, "Invalid opcode 0x%x at word %u", opcode, codeOffset);
+	throw std::invalid_argument(opcodeString);
+}
+
+void Interpreter::reportForCurrentInstruction(VMDiagnostics::Code code, unsigned argument, int32_t value)
+{
+	// The instruction being executed is the one before instruction.
+	diagnostics->report(code, program->getInstruction(instruction - 1).codeOffset, currentClump, argument, value);
+}
+
+void Interpreter::ignoreCurrentInstruction()
+{
+	reportForCurrentInstruction(VMDiagnostics::IgnoredInstruction, program->getInstruction(instruction - 1).opcode);
+}
+
+bool Interpreter::isStopped() const
+{
+	return currentClump == noClump && restingHead == noClump && pollingHead == noClump;
+}
+
+unsigned Interpreter::waitingUntilTick() const
+{
+	if (currentClump != noClump || pollingHead != noClump) return 0;
+	if (restingHead != noClump) return clumps[restingHead].wakeTick;
+	return ~0u;
+}
+
 void Interpreter::step()
 {
-	if (instruction >= file->getCodeWordCount()) return;
+	wakePollingClumps(noClump);
+	wakeClumps(system->getTick());
 	
-	if (system->getTick() < waitUntil)
+	// A clump that ran past the last instruction is done.
+	if (currentClump != noClump && instruction >= program->getInstructionCount())
+		finishCurrentClump();
+	if (currentClump == noClump)
 		return;
 	
-	const uint16_t *code = file->getCode();
+	clumpChanged = false;
+	useQuantum(execute(1));
+}
+
+Interpreter::RunResult Interpreter::run(unsigned maxInstructions, unsigned untilTick, unsigned *executedInstructions)
+{
+	RunResult result;
+	unsigned executed = 0;
 	
-	if (code[instruction] & (1 << 11))
+	try
 	{
-		// Short format	
-		unsigned opcode = (code[instruction] & 0x0700) >> 8;
-		int argDiff = (int8_t) (code[instruction] & 0xFF);
-		uint16_t arguments[2];
-		switch(opcode)
+		// The simulation may have changed anything since the last call.
+		wakePollingClumps(noClump);
+		
+		unsigned tick = system->getTick();
+		while (true)
 		{
-			case 0: // SHORT_OP_MOV
-				arguments[0] = argDiff + code[instruction + 1];
-				arguments[1] = code[instruction + 1];
-				instruction += 2;
-				op_mov(0, arguments);
-				break;
-			case 1: // SHORT_OP_ACQUIRE
-				arguments[0] = argDiff;
-				instruction += 1;
-				op_acquire(0, arguments);
-				break;
-			case 2: // SHORT_OP_RELEASE
-				arguments[0] = argDiff;
-				instruction += 1;
-				op_release(0, arguments);
+			wakeClumps(tick);
+			
+			// A clump that ran past the last instruction is done.
+			if (currentClump != noClump && instruction >= program->getInstructionCount())
+			{
+				finishCurrentClump();
+				continue;
+			}
+			if (currentClump == noClump)
+			{
+				result = restingHead != noClump || pollingHead != noClump ? Waiting : Stopped;
 				break;
-			case 3: // SHORT_OP_SUBCALL
-				arguments[0] = argDiff + code[instruction + 1]; // Subroutine
-				arguments[1] = code[instruction + 1]; // Caller ID
-				instruction += 2; // Instruction has to be on the next before
-				// branching to subroutine so it can be used as return inst.
-				op_subcall(0, arguments);
+			}
+			if (executed >= maxInstructions || tick >= untilTick)
+			{
+				result = BudgetExhausted;
 				break;
-			default:
-				throw std::runtime_error("Invalid short opcode.");
-		}		
+			}
+			
+			unsigned batch = maxInstructions - executed;
+			if (batch > instructionsBetweenTickChecks) batch = instructionsBetweenTickChecks;
+			if (currentClump != readyTail && batch > quantumLeft) batch = quantumLeft;
+			
+			unsigned batchClump = currentClump;
+			unsigned batchStart = instruction;
+			parkedLoopLength = 0;
+			clumpChanged = false;
+			unsigned batchExecuted = nativeCode ? executeNative(batch) : execute(batch);
+			executed += batchExecuted;
+			
+			// Anything but one more round of a polling loop may have changed
+			// what the parked clumps read.
+			bool onlyPolled = clumps[batchClump].state == ClumpPolling && clumps[batchClump].instruction == batchStart && parkedLoopLength == batchExecuted;
+			if (!onlyPolled) wakePollingClumps(batchClump);
+			useQuantum(batchExecuted);
+			
+			unsigned newTick = system->getTick();
+			if (newTick != tick) wakePollingClumps(noClump);
+			tick = newTick;
+		}
 	}
-	else
+	catch (std::exception &e)
 	{
-		// Normal format
-		unsigned opcode = code[instruction] & 0x00FF;
-		// You’d think it’d be the other way around, but Lego’s documentation
-		// tries to account for endianess and gets it all wrong.
-		unsigned size = (code[instruction] & 0xF000) >> 12;	
-		if (size == 0xE) size = code[instruction+1];
-		unsigned flags = (code[instruction] & 0x0F00) >> 8;
-		
-		const uint16_t *params = &code[instruction + 1];
-		
-		instruction += size/2;
-		
-		switch(opcode)
-		{	
-			case 0x00: op_add(flags, params); break;
-			case 0x01: op_sub(flags, params); break;
-			case 0x02: op_neg(flags, params); break;
-			case 0x03: op_mul(flags, params); break;
-			case 0x04: op_div(flags, params); break;
-			case 0x05: op_mod(flags, params); break;
-			case 0x36: op_sqrt(flags, params); break;
-			case 0x37: op_abs(flags, params); break;
-			case 0x06: op_and(flags, params); break;
-			case 0x07: op_or(flags, params); break;
-			case 0x08: op_xor(flags, params); break;
-			case 0x09: op_not(flags, params); break;
-			case 0x11: op_cmp(flags, params); break;
-			case 0x12: op_tst(flags, params); break;
-			case 0x15: op_index(flags, params); break;
-			case 0x16: op_replace(flags, params); break;
-			case 0x17: op_arrsize(flags, params); break;
-			case 0x18: op_arrbuild(flags, params); break;
-			case 0x19: op_arrsubset(flags, params); break;
-			case 0x1A: op_arrinit(flags, params); break;
-			case 0x1B: op_mov(flags, params); break;
-			case 0x1C: op_set(flags, params); break;
-			case 0x1D: op_flatten(flags, params); break;
-			case 0x1E: op_unflatten(flags, params); break;
-			case 0x1F: op_numtostring(flags, params); break;
-			case 0x20: op_stringtonum(flags, params); break;
-			case 0x21: op_strcat(flags, params); break;
-			case 0x22: op_strsubset(flags, params); break;
-			case 0x23: op_strtobytearr(flags, params); break;
-			case 0x24: op_bytearrtostr(flags, params); break;
-			case 0x25: op_jmp(flags, params); break;
-			case 0x26: op_brcmp(flags, params); break;
-			case 0x27: op_brtst(flags, params); break;
-			case 0x29: op_stop(flags, params); break;
-			case 0x2A: op_finclump(flags, params); break;
-			case 0x2B: op_finclumpimmed(flags, params); break;
-			case 0x2C: op_acquire(flags, params); break;
-			case 0x2D: op_release(flags, params); break;
-			case 0x2E: op_subcall(flags, params); break;
-			case 0x2F: op_subret(flags, params); break;
-			case 0x28: op_syscall(flags, params); break;
-			case 0x30: op_setin(flags, params); break;
-			case 0x31: op_setout(flags, params); break;
-			case 0x32: op_getin(flags, params); break;
-			case 0x33: op_getout(flags, params); break;
-			case 0x34: op_wait(flags, params); break;
-			case 0x35: op_gettick(flags, params); break;
+		// The instruction that failed has already been skipped, so execution
+		// can resume after it.
+		lastFault = e.what();
+		unsigned word = instruction > 0 && instruction <= program->getInstructionCount() ? program->getInstruction(instruction - 1).codeOffset : 0;
+		diagnostics->reportFault(word, currentClump, e.what());
+		result = Fault;
+	}
+	
+	if (executedInstructions) *executedInstructions = executed;
+	return result;
+}
+
+void Interpreter::setNativeCode(RXENativeExecuteFunction code)
+{
+	nativeCode = verified ? code : 0;
+#ifdef INTERPRETER_PROFILING
+	// Translated code would not be counted.
+	nativeCode = 0;
+#endif
+}
+
+int Interpreter::executeInInterpreter(void *anInterpreter, uint32_t index, uint32_t *next)
+{
+	Interpreter *self = static_cast<Interpreter *>(anInterpreter);
+	self->instruction = index;
+	try
+	{
+		self->execute(1);
+	}
+	catch (std::exception &e)
+	{
+		self->hasNativeFault = true;
+		self->nativeFault = e.what();
+		*next = self->instruction;
+		return 1;
+	}
+	*next = self->instruction;
+	
+	// Ops that end the batch set the limit to zero.
+	return self->batchLimit == 0;
+}
+
+unsigned Interpreter::executeNative(unsigned maxInstructions)
+{
+	RXENativeState state;
+	state.slots = memory->getSlots();
+	state.instruction = instruction;
+	state.interpreter = this;
+	state.executeInInterpreter = executeInInterpreter;
+	
+	hasNativeFault = false;
+	unsigned executed = nativeCode(&state, maxInstructions);
+	instruction = state.instruction;
+	
+	if (hasNativeFault) throw std::runtime_error(nativeFault);
+	return executed;
+}
 
+unsigned Interpreter::execute(unsigned maxInstructions)
+{
+	if (verified) return executeDecoded<false>(maxInstructions);
+	return executeDecoded<true>(maxInstructions);
+}
+
+template<bool Checked>
+unsigned Interpreter::executeDecoded(unsigned maxInstructions)
+{
+	const unsigned end = program->getInstructionCount();
+	const DecodedProgram::Instruction *current;
+	unsigned flags;
+	const uint16_t *params;
+	unsigned executed = 0;
+	
+	// Ops that make the program wait or stop end the batch by setting this to
+	// zero.
+	batchLimit = maxInstructions;
+	
+#ifdef INTERPRETER_PROFILING
+	InterpreterProfile::Timer profileTimer(profile);
+#define INTERPRETER_PROFILE_INSTRUCTION() \
+	profile->countInstruction(instruction, currentClump); \
+	profileTimer.next(current->handler);
+#else
+#define INTERPRETER_PROFILE_INSTRUCTION()
+#endif
+	
+	// Instruction has to be on the next before executing, so that branches and
+	// subroutine calls can change it and it can be used as return address.
+#define INTERPRETER_FETCH() \
+	if (executed >= batchLimit || instruction >= end) return executed; \
+	current = &program->getInstruction(instruction); \
+	INTERPRETER_PROFILE_INSTRUCTION(); \
+	instruction = current->next; \
+	flags = current->flags; \
+	params = current->operands; \
+	executed++;
+	
+#if defined(__GNUC__)
+	// Direct threading: Every handler jumps straight to the next one, which
+	// gives the branch predictor one indirect jump per opcode to work with.
+	static void *const dispatchTable[HANDLER_COUNT] = {
+#define INTERPRETER_LABEL_ADDRESS(name, opcode, handler, operands) &&execute_##name,
+		INTERPRETER_OPCODES(INTERPRETER_LABEL_ADDRESS)
+#undef INTERPRETER_LABEL_ADDRESS
+		&&execute_INVALID
+	};
+	
+#define INTERPRETER_DISPATCH() \
+	INTERPRETER_FETCH(); \
+	goto *dispatchTable[current->handler];
+	
+	INTERPRETER_DISPATCH();
+	
+#define INTERPRETER_LABEL(name, opcode, handler, operands) \
+	execute_##name: \
+		handler<Checked>(flags, params); \
+		INTERPRETER_DISPATCH();
+	INTERPRETER_OPCODES(INTERPRETER_LABEL)
+#undef INTERPRETER_LABEL
+	
+execute_INVALID:
+	invalidInstruction(current->opcode, current->codeOffset);
+	return executed;
+	
+#undef INTERPRETER_DISPATCH
+#else
+	// Portable version for compilers without labels as values.
+	while (true)
+	{
+		INTERPRETER_FETCH();
+		switch (current->handler)
+		{
+#define INTERPRETER_CASE(name, opcode, handler, operands) case HANDLER_##name: handler<Checked>(flags, params); break;
+			INTERPRETER_OPCODES(INTERPRETER_CASE)
+#undef INTERPRETER_CASE
 			default:
-				{
-					char opcodeString[255];
-					sprintf(opcodeString, "Invalid opcode 0x%x size %d", opcode, size);
-					throw std::invalid_argument(opcodeString);	
-				}
+				invalidInstruction(current->opcode, current->codeOffset);
 		}
 	}
-
-}
\ No newline at end of file
+#endif
+#undef INTERPRETER_FETCH
+#undef INTERPRETER_PROFILE_INSTRUCTION
+}
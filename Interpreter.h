@@ -7,9 +7,17 @@
  *
  */
 
+#include <string>
 #include <vector>
 #include <stdint.h>
 
+#include "NativeCodeInterface.h"
+#include "VMDiagnostics.h"
+#include "VMMemory.h"
+
+class DecodedProgram;
+class InterpreterProfile;
+class PollingLoops;
 class RXEFile;
 class System;
 class VMMemory;
@@ -21,89 +29,244 @@ class VMMemory;
  * @coclass System Calls into system for IO and communicating with the robot that
  * this program is running on.
  * @coclass VMMemory Manages the data the program is operating on.
- * @discussion The Interpreter ultimately executes all bytecode. It has only one
- * interesting public method, step, which executes a single operation. However,
+ * @discussion The Interpreter ultimately executes all bytecode. It has only two
+ * interesting public methods, step, which executes a single operation, and
+ * run, which executes a whole budget of them. However,
  * it has a large number of private methods, one for each operation that exists.
- * Not all of these are implemented, many simply print out their name and that
- * they are not yet supported.
+ * Not all of these are implemented; those that are not, as well as unknown
+ * syscalls and faults, are reported to the interpreter's VMDiagnostics.
+ *
+ * The code is not executed directly from the RXE file. Instead, it gets
+ * decoded once into a DecodedProgram when the interpreter is created.
+ *
+ * The clumps of a program (tasks and subroutines in NXC) are scheduled like
+ * in the firmware: Clumps whose fire count is zero start right away; the
+ * others start once the clumps they depend on have finished often enough.
+ * The clumps that can run take turns, a fixed number of instructions each.
+ *
+ * Clumps that go round a loop which only polls inputs (see PollingLoops) are
+ * parked after one round, until something the loop reads could have changed:
+ * the next call to run or step, which is when the simulation has updated the
+ * sensors and motors, a new tick, or other code running.
+ *
+ * Compiled with INTERPRETER_PROFILING defined, the interpreter records an
+ * InterpreterProfile of everything it executes.
  */
 class Interpreter
 {
 	const RXEFile *file;
+	DecodedProgram *program;
 	VMMemory *memory;
 	System *system;
 	
-	std::vector<unsigned> stack;
-	unsigned instruction;
+	// Every clump has its own program counter and fire count, the number of
+	// clumps it depends on that still have to finish before it starts.
+	// Clumps that can run are in the ready queue; its head is the one that is
+	// running and gets a quantum of instructions before the next one's turn.
+	// Clumps waiting for a tick rest in a list sorted by wake tick, clumps
+	// waiting for a mutex are in the mutex's queue, so that neither costs
+	// anything. All queues are linked through the clump records, so moving a
+	// clump from one to another is O(1).
+	//
+	// A clump that calls a subroutine leaves all queues, with its program
+	// counter at the return address, and the subroutine takes its place. The
+	// subroutine knows where to return to from the variable OP_SUBCALL stores
+	// the caller in, just like in the firmware, so no separate call stack is
+	// needed.
+	//
+	// Clumps parked in a polling loop are in a list of their own, in the
+	// order they were parked, with the program counter at the start of the
+	// loop.
+	enum ClumpState
+	{
+		ClumpIdle,
+		ClumpReady,
+		ClumpResting,
+		ClumpBlocked,
+		ClumpCalling,
+		ClumpPolling
+	};
+	struct Clump
+	{
+		// Index into program of the next instruction. Not up to date for
+		// the running clump, whose program counter is instruction.
+		unsigned instruction;
+		unsigned fireCount;
+		unsigned wakeTick;
+		// The next clump in the queue that this one is in.
+		uint8_t link;
+		uint8_t state;
+	};
+	std::vector<Clump> clumps;
+	static const unsigned noClump = 0xFF;
 	unsigned currentClump;
+	unsigned readyTail;
+	unsigned restingHead;
+	unsigned pollingHead;
+	unsigned pollingTail;
+	unsigned quantumLeft;
+	// Set whenever a different clump becomes the running one.
+	bool clumpChanged;
+	
+	// The polling loops of verified programs, or NULL. When a clump gets
+	// parked, the length of its loop is stored, so that run can tell whether
+	// a batch did nothing but go round it once more.
+	PollingLoops *pollingLoops;
+	unsigned parkedLoopLength;
+	
+	// The next instruction of the running clump, as index into program.
+	unsigned instruction;
+	
+	// Number of instructions the current call to execute may execute
+	unsigned batchLimit;
+	
+	// Message of the last exception caught by run
+	std::string lastFault;
+	
+	// Whether the program passed the RXEVerifier. If so, it runs in the
+	// instances of executeDecoded and the handlers that access operands
+	// without checks.
+	bool verified;
+	std::vector<std::string> verificationErrors;
+	
+	// Translated code to run instead of execute, if any, and the error it
+	// ran into, since exceptions can not be thrown through it.
+	RXENativeExecuteFunction nativeCode;
+	bool hasNativeFault;
+	std::string nativeFault;
+	
+	// Only created with INTERPRETER_PROFILING, NULL otherwise.
+	InterpreterProfile *profile;
 	
-	// Required for waiting
-	unsigned waitUntil;
+	VMDiagnostics *diagnostics;
+	
+	// Access to the scalar operands of instructions, as described in
+	// InterpreterOpcodes.h. Checked is a template parameter, so that the
+	// handlers for verified programs contain no test for it at all.
+	template<bool Checked> int32_t readOperand(unsigned entry) const
+	{
+		if (Checked) return memory->getScalarValue(entry);
+		return memory->getScalarValueUnchecked(entry);
+	}
+	template<bool Checked> void writeOperand(unsigned entry, int32_t value)
+	{
+		if (Checked) memory->setScalarValue(entry, value);
+		else memory->setScalarValueUnchecked(entry, value);
+	}
+	
+	// Executes up to maxInstructions without looking at the tick. Stops early
+	// if the program ends or starts waiting. Returns the number of executed
+	// instructions. Picks the unchecked dispatch loop for verified programs
+	// once per call.
+	unsigned execute(unsigned maxInstructions);
+	
+	// The dispatch loop of execute, with handlers that check their operands
+	// or not.
+	template<bool Checked> unsigned executeDecoded(unsigned maxInstructions);
+	
+	// Like execute, but with the translated code.
+	unsigned executeNative(unsigned maxInstructions);
+	
+	// Used by translated code for everything it does not do itself.
+	static int executeInInterpreter(void *interpreter, uint32_t instruction, uint32_t *next);
+	
+	// Scheduling
+	void loadCurrentClump();
+	void enqueueClump(unsigned clump);
+	void removeCurrentClump(ClumpState newState);
+	void replaceCurrentClump(unsigned clump);
+	void rotateClumps();
+	void fireClump(unsigned clump) throw(std::runtime_error);
+	void finishCurrentClump();
+	void restCurrentClump(unsigned wakeTick);
+	void wakeClumps(unsigned tick);
+	void useQuantum(unsigned executed);
+	void parkPollingClump(unsigned loopStart, unsigned loopLength);
+	void wakePollingClumps(unsigned exceptClump);
+	
+	// Continues at target, parking the clump if that closes a polling loop.
+	void branchTo(unsigned target);
+	
+	// A mutex is a ULONG that holds its owner and the first and last clump
+	// waiting for it, one byte each, like in the firmware. The waiting
+	// clumps are linked through their records.
+	static const uint32_t freeMutex = 0xFFFFFFFF;
+	unsigned clumpInMutex(uint32_t mutex, unsigned shift) const throw(std::runtime_error);
 	
 	// Helpers used internally by other ops
+	void invalidInstruction(unsigned opcode, unsigned codeOffset);
+	void reportForCurrentInstruction(VMDiagnostics::Code code, unsigned argument, int32_t value = 0);
+	void ignoreCurrentInstruction();
 	bool compare(unsigned mode, int a, int b);
-	void configureOutputForPort(unsigned port, unsigned numParams, const uint16_t *params);
+	template<bool Checked> void configureOutputForPort(unsigned port, unsigned numParams, const uint16_t *params);
 	
 	// Math Instructions
-	void op_add(unsigned flags, const uint16_t *params);
-	void op_sub(unsigned flags, const uint16_t *params);
-	void op_neg(unsigned flags, const uint16_t *params);
-	void op_mul(unsigned flags, const uint16_t *params);
-	void op_div(unsigned flags, const uint16_t *params);
-	void op_mod(unsigned flags, const uint16_t *params);
-	void op_sqrt(unsigned flags, const uint16_t *params);
-	void op_abs(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_add(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_sub(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_neg(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_mul(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_div(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_mod(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_sqrt(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_abs(unsigned flags, const uint16_t *params);
 	
 	// Logical Instructions
-	void op_and(unsigned flags, const uint16_t *params);
-	void op_or(unsigned flags, const uint16_t *params);
-	void op_xor(unsigned flags, const uint16_t *params);
-	void op_not(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_and(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_or(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_xor(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_not(unsigned flags, const uint16_t *params);
 	
 	// Compare Instructions
-	void op_cmp(unsigned flags, const uint16_t *params);
-	void op_tst(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_cmp(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_tst(unsigned flags, const uint16_t *params);
 	
 	// Data manipulation Instructions
-	void op_index(unsigned flags, const uint16_t *params);
-	void op_replace(unsigned flags, const uint16_t *params);
-	void op_arrsize(unsigned flags, const uint16_t *params);
-	void op_arrbuild(unsigned flags, const uint16_t *params);
-	void op_arrsubset(unsigned flags, const uint16_t *params);
-	void op_arrinit(unsigned flags, const uint16_t *params);
-	void op_mov(unsigned flags, const uint16_t *params);
-	void op_set(unsigned flags, const uint16_t *params);
-	void op_flatten(unsigned flags, const uint16_t *params);
-	void op_unflatten(unsigned flags, const uint16_t *params);
-	void op_numtostring(unsigned flags, const uint16_t *params);
-	void op_stringtonum(unsigned flags, const uint16_t *params);
-	void op_strcat(unsigned flags, const uint16_t *params);
-	void op_strsubset(unsigned flags, const uint16_t *params);
-	void op_strtobytearr(unsigned flags, const uint16_t *params);
-	void op_bytearrtostr(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_index(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_replace(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_arrsize(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_arrbuild(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_arrsubset(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_arrinit(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_mov(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_set(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_flatten(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_unflatten(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_numtostring(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_stringtonum(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_strcat(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_strsubset(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_strtobytearr(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_bytearrtostr(unsigned flags, const uint16_t *params);
 	
 	// Control flow Instructions
-	void op_jmp(unsigned flags, const uint16_t *params);
-	void op_brcmp(unsigned flags, const uint16_t *params);
-	void op_brtst(unsigned flags, const uint16_t *params);
-	void op_stop(unsigned flags, const uint16_t *params);
-	void op_finclump(unsigned flags, const uint16_t *params);
-	void op_finclumpimmed(unsigned flags, const uint16_t *params);
-	void op_acquire(unsigned flags, const uint16_t *params);
-	void op_release(unsigned flags, const uint16_t *params);
-	void op_subcall(unsigned flags, const uint16_t *params);
-	void op_subret(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_jmp(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_brcmp(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_brtst(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_stop(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_finclump(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_finclumpimmed(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_acquire(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_release(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_subcall(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_subret(unsigned flags, const uint16_t *params);
 	
 	// System I/O instructions
-	void op_syscall(unsigned flags, const uint16_t *params);
-	void op_setin(unsigned flags, const uint16_t *params);
-	void op_setout(unsigned flags, const uint16_t *params);
-	void op_getin(unsigned flags, const uint16_t *params);
-	void op_getout(unsigned flags, const uint16_t *params);
-	void op_wait(unsigned flags, const uint16_t *params);
-	void op_gettick(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_syscall(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_setin(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_setout(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_getin(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_getout(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_wait(unsigned flags, const uint16_t *params);
+	template<bool Checked> void op_gettick(unsigned flags, const uint16_t *params);
+	
+	// Not copyable, as the interpreter owns its decoded program.
+	Interpreter(const Interpreter &);
+	Interpreter &operator=(const Interpreter &);
 	
 public:
+	/*! The most clumps a program can have, as in the firmware. */
+	static const unsigned maxClumpCount = 255;
+	
 	/*!
 	 * @abstract Constructs an Interpreter.
 	 * @discussion Execution always starts at the first clump, based on the
@@ -114,14 +277,105 @@ public:
 	 * @param memory A memory object, which has to have been created with the
 	 * same RXE file.
 	 * @param system The System interface used for IO and syscalls.
+	 * @throws std::runtime_error If the program has more than maxClumpCount
+	 * clumps.
 	 */
-	Interpreter(const RXEFile *file, VMMemory *memory, System *system);
+	Interpreter(const RXEFile *file, VMMemory *memory, System *system) throw(std::runtime_error);
+	~Interpreter();
+	
+	/*!
+	 * @abstract Whether the program passed verification.
+	 * @discussion Programs that did not are run with all checks. See
+	 * RXEVerifier.
+	 */
+	bool isVerified() const { return verified; }
+	
+	/*!
+	 * @abstract What the RXEVerifier found wrong with the program.
+	 */
+	const std::vector<std::string> &getVerificationErrors() const { return verificationErrors; }
+	
+	/*!
+	 * @abstract Runs translated code instead of interpreting.
+	 * @discussion The code has to come from a translation of the same
+	 * program, see NativeCode. Only verified programs can be translated, so
+	 * this is ignored for programs that did not pass verification. run
+	 * behaves exactly the same either way; step always interprets.
+	 * @param code The translated code, or NULL to interpret again. Has to
+	 * stay loaded while it is set.
+	 */
+	void setNativeCode(RXENativeExecuteFunction code);
+	
+	/*!
+	 * @abstract What the program spent its time on so far.
+	 * @discussion Only recorded if the interpreter was compiled with
+	 * INTERPRETER_PROFILING defined. Translated code is not used then.
+	 * @result The profile, or NULL if profiling is not compiled in.
+	 */
+	InterpreterProfile *getProfile() { return profile; }
+	const InterpreterProfile *getProfile() const { return profile; }
+	
+	/*!
+	 * @abstract Where the program's problems are reported.
+	 * @discussion The interpreter only adds to it; whoever runs the program
+	 * should take the events out from time to time.
+	 */
+	VMDiagnostics *getDiagnostics() { return diagnostics; }
+	
+	/*!
+	 * @abstract Starts the program again from the beginning.
+	 * @discussion Resets the interpreter's own state, that is the clumps,
+	 * their program counters and queues, and the mutexes in memory. The rest
+	 * of the memory has to be reset separately, before this. The decoded
+	 * program is kept.
+	 */
+	void reset();
 	
 	/*!
 	 * @abstract Executes a single operation.
 	 */
 	void step();
 	
+	/*!
+	 * @abstract Why a call to run returned.
+	 */
+	enum RunResult
+	{
+		/*! The instruction budget or the tick limit was used up. */
+		BudgetExhausted,
+		/*! All clumps are waiting and none will run before waitingUntilTick(),
+		 * or, if they are polling, before the next call. */
+		Waiting,
+		/*! The program has ended, see isStopped(). */
+		Stopped,
+		/*! An instruction raised an error. Its message is available through
+		 * getLastFault(). Execution continues after that instruction on the
+		 * next call. */
+		Fault
+	};
+	
+	/*!
+	 * @abstract Executes a number of operations.
+	 * @discussion This is equivalent to calling step() repeatedly, but
+	 * considerably faster, as everything happens in one tight dispatch loop
+	 * and the tick is only read every few thousand instructions instead of
+	 * before every single one. Errors are not thrown, but reported through the
+	 * result.
+	 * @param maxInstructions The maximum number of operations to execute.
+	 * @param untilTick Tick at which to stop, even if there is budget left.
+	 * Since the tick is not checked after every instruction, this is only
+	 * approximate; it is meant as a safety net, not as a time source.
+	 * @param executedInstructions If not NULL, the number of operations that
+	 * were executed is stored here.
+	 * @result Why execution stopped.
+	 */
+	RunResult run(unsigned maxInstructions, unsigned untilTick = ~0u, unsigned *executedInstructions = 0);
+	
+	/*!
+	 * @abstract Message of the error that caused the last Fault result.
+	 */
+	const std::string &getLastFault() const { return lastFault; }
+	
 	/*!
 	 * @abstract Debug method: Returns the name for an opcode.
 	 * @discussion The returned name is taken directly from the official
@@ -135,9 +389,25 @@ public:
 	
 	/*!
 	 * @abstract Tick at which the robot will next do something.
-	 * @discussion If the robot is in wait mode, it will do nothing and no
-	 * operation will be executed. With this, users can find out how long it
-	 * will be until it operates again.
+	 * @discussion If all clumps of the program are waiting, it will do
+	 * nothing and no operation will be executed. With this, users can find
+	 * out how long it will be until it operates again. If a clump can run
+	 * right now or is polling, the result is 0.
+	 */
+	unsigned waitingUntilTick() const;
+	
+	/*!
+	 * @abstract Whether the program has ended.
+	 * @discussion A program ends when it executes OP_STOP, or when no clump
+	 * is running, polling or waiting for a tick any more, because they all finished
+	 * (or ran past the last instruction) or wait for mutexes that will never
+	 * be released. After that, step and run do nothing.
 	 */
-	unsigned waitingUntilTick() const { return waitUntil; }
+	bool isStopped() const;
 };
+
+// The handlers are defined in the Interpreter_*Instructions.cpp files, so each
+// of them instantiates its own handlers for both kinds of operand access.
+#define INTERPRETER_INSTANTIATE_HANDLER(handler) \
+	template void Interpreter::handler<true>(unsigned flags, const uint16_t *params); \
+	template void Interpreter::handler<false>(unsigned flags, const uint16_t *params);
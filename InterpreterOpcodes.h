@@ -0,0 +1,119 @@
+#pragma once
+/*
+ *  InterpreterOpcodes.h
+ *  mindstormssimulation
+ *
+ *  Created by agent on 18.10.26
+ *  Copyright 2026 RWTH Aachen University All rights reserved.
+ *
+ */
+
+/*!
+ * @abstract The list of all opcodes the interpreter knows.
+ * @discussion Each entry has the form X(name, opcode, handler, operands),
+ * where name is the name from the programming manual, opcode the value used
+ * in the long instruction format and handler the Interpreter method that
+ * executes it.
+ *
+ * operands describes how the handler uses its operands, one character per
+ * operand, for the RXEVerifier:
+ * - r: Scalar that is read. Any DSTOC entry that is not void or a cluster.
+ * - w: Scalar that is written. Also not an array.
+ * - o: Like r, or NOT_A_DS_ID (0xFFFF) if left out.
+ * - a: Array.
+ * - d: Any DSTOC entry; the handler checks the type itself.
+ * - i: Immediate value.
+ * - n: Immediate size of the instruction in bytes.
+ * - b: Branch target.
+ * - c: Clump number.
+ * - m: Mutex.
+ * - p: The rest are pairs of an immediate and a scalar that is read.
+ * - *: The rest are like the operand before.
+ * - .: The rest are not checked. Used by handlers that do not look at their
+ *   operands or only pass them to checked code.
+ * Handlers of verified programs access the operands they read and write
+ * without checks, so this has to match what the handler does.
+ *
+ * Everything that has to know about all opcodes — the dispatch tables in
+ * Interpreter::run, Interpreter::nameForOpcode, the decoding in
+ * DecodedProgram and the RXEVerifier — is generated from this list, so that
+ * they can not disagree. New opcodes only have to be added here (and
+ * implemented).
+ */
+#define INTERPRETER_OPCODES(X) \
+	X(OP_ADD, 0x00, op_add, "wrr") \
+	X(OP_SUB, 0x01, op_sub, "wrr") \
+	X(OP_NEG, 0x02, op_neg, "wr") \
+	X(OP_MUL, 0x03, op_mul, "wrr") \
+	X(OP_DIV, 0x04, op_div, "wrr") \
+	X(OP_MOD, 0x05, op_mod, "wrr") \
+	X(OP_SQRT, 0x36, op_sqrt, ".") \
+	X(OP_ABS, 0x37, op_abs, ".") \
+	X(OP_AND, 0x06, op_and, ".") \
+	X(OP_OR, 0x07, op_or, ".") \
+	X(OP_XOR, 0x08, op_xor, ".") \
+	X(OP_NOT, 0x09, op_not, "wr") \
+	X(OP_CMP, 0x11, op_cmp, "wrr") \
+	X(OP_TST, 0x12, op_tst, "wr") \
+	X(OP_INDEX, 0x15, op_index, "wao") \
+	X(OP_REPLACE, 0x16, op_replace, ".") \
+	X(OP_ARRSIZE, 0x17, op_arrsize, "wa") \
+	X(OP_ARRBUILD, 0x18, op_arrbuild, "nar*") \
+	X(OP_ARRSUBSET, 0x19, op_arrsubset, "aaoo") \
+	X(OP_ARRINIT, 0x1A, op_arrinit, "aro") \
+	X(OP_MOV, 0x1B, op_mov, "dd") \
+	X(OP_SET, 0x1C, op_set, "wi") \
+	X(OP_FLATTEN, 0x1D, op_flatten, ".") \
+	X(OP_UNFLATTEN, 0x1E, op_unflatten, ".") \
+	X(OP_NUMTOSTRING, 0x1F, op_numtostring, "ar") \
+	X(OP_STRINGTONUM, 0x20, op_stringtonum, "wwaoo") \
+	X(OP_STRCAT, 0x21, op_strcat, "naa*") \
+	X(OP_STRSUBSET, 0x22, op_strsubset, "aaoo") \
+	X(OP_STRTOBYTEARR, 0x23, op_strtobytearr, "aa") \
+	X(OP_BYTEARRTOSTR, 0x24, op_bytearrtostr, "aa") \
+	X(OP_JMP, 0x25, op_jmp, "b") \
+	X(OP_BRCMP, 0x26, op_brcmp, "brr") \
+	X(OP_BRTST, 0x27, op_brtst, "br") \
+	X(OP_STOP, 0x29, op_stop, ".") \
+	X(OP_FINCLUMP, 0x2A, op_finclump, "ii") \
+	X(OP_FINCLUMPIMMED, 0x2B, op_finclumpimmed, "c") \
+	X(OP_ACQUIRE, 0x2C, op_acquire, "m") \
+	X(OP_RELEASE, 0x2D, op_release, "m") \
+	X(OP_SUBCALL, 0x2E, op_subcall, "cw") \
+	X(OP_SUBRET, 0x2F, op_subret, "r") \
+	X(OP_SYSCALL, 0x28, op_syscall, "ii") \
+	X(OP_SETIN, 0x30, op_setin, "rri") \
+	X(OP_SETOUT, 0x31, op_setout, "ndp") \
+	X(OP_GETIN, 0x32, op_getin, "wri") \
+	X(OP_GETOUT, 0x33, op_getout, "wri") \
+	X(OP_WAIT, 0x34, op_wait, "ir") \
+	X(OP_GETTICK, 0x35, op_gettick, "w")
+
+/*!
+ * @abstract Dense numbering of the opcodes, in the order of the list above.
+ * @discussion The opcodes themselves have gaps, so the decoded program uses
+ * these values instead, which can index small tables directly.
+ */
+enum InterpreterHandler
+{
+#define INTERPRETER_HANDLER_ENUM(name, opcode, handler, operands) HANDLER_##name,
+	INTERPRETER_OPCODES(INTERPRETER_HANDLER_ENUM)
+#undef INTERPRETER_HANDLER_ENUM
+	HANDLER_INVALID,
+	HANDLER_COUNT
+};
+
+/*!
+ * @abstract Returns the handler for a long-format opcode.
+ * @result The handler, or HANDLER_INVALID if the opcode does not exist.
+ */
+inline InterpreterHandler handlerForOpcode(unsigned opcode)
+{
+	switch (opcode)
+	{
+#define INTERPRETER_HANDLER_CASE(name, opcode, handler, operands) case opcode: return HANDLER_##name;
+		INTERPRETER_OPCODES(INTERPRETER_HANDLER_CASE)
+#undef INTERPRETER_HANDLER_CASE
+		default: return HANDLER_INVALID;
+	}
+}
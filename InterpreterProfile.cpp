@@ -0,0 +1,271 @@
+/*
+ *  InterpreterProfile.cpp
+ *  mindstormssimulation
+ *
+ *  Created by agent on 18.10.26
+ *  Copyright 2026 RWTH Aachen University All rights reserved.
+ *
+ */
+
+#include "InterpreterProfile.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <ostream>
+
+#include "DecodedProgram.h"
+#include "Interpreter.h"
+#include "InterpreterOpcodes.h"
+#include "PollingLoops.h"
+#include "RXEFile.h"
+#include "System.h"
+
+namespace
+{
+	const unsigned syscallCount = 256;
+
+	const uint8_t opcodeForHandler[HANDLER_COUNT] = {
+#define INTERPRETER_OPCODE_VALUE(name, opcode, handler, operands) opcode,
+		INTERPRETER_OPCODES(INTERPRETER_OPCODE_VALUE)
+#undef INTERPRETER_OPCODE_VALUE
+		DecodedProgram::invalidOpcode
+	};
+
+	double share(uint64_t part, uint64_t total)
+	{
+		return total > 0 ? 100.0 * double(part) / double(total) : 0.0;
+	}
+
+	// Sorts indices by a count, largest first.
+	struct ByCount
+	{
+		const std::vector<uint64_t> &counts;
+		ByCount(const std::vector<uint64_t> &someCounts) : counts(someCounts) {}
+		bool operator()(unsigned a, unsigned b) const { return counts[a] > counts[b]; }
+	};
+
+	std::vector<unsigned> sortedByCount(const std::vector<uint64_t> &counts)
+	{
+		std::vector<unsigned> indices;
+		for (unsigned i = 0; i < counts.size(); i++)
+			if (counts[i] > 0) indices.push_back(i);
+		std::stable_sort(indices.begin(), indices.end(), ByCount(counts));
+		return indices;
+	}
+}
+
+InterpreterProfile::InterpreterProfile(const RXEFile *aFile, const DecodedProgram *aProgram)
+: file(aFile), program(aProgram)
+{
+	clear();
+}
+
+void InterpreterProfile::clear()
+{
+	instructionHits.assign(program->getInstructionCount(), 0);
+	backEdgeCounts.assign(program->getInstructionCount(), 0);
+	clumpInstructions.assign(file->getClumpCount(), 0);
+	handlerNanoseconds.assign(HANDLER_COUNT, 0);
+	syscallCounts.assign(syscallCount, 0);
+}
+
+std::vector<uint64_t> InterpreterProfile::getHandlerCounts() const
+{
+	std::vector<uint64_t> counts(HANDLER_COUNT, 0);
+	for (unsigned i = 0; i < instructionHits.size(); i++)
+		counts[program->getInstruction(i).handler] += instructionHits[i];
+	return counts;
+}
+
+std::vector<InterpreterProfile::Loop> InterpreterProfile::getLoops() const
+{
+	// Every branch back is a loop, and everything from its target to it is
+	// what the loop executes. Loops that contain other loops get their
+	// instructions counted as well.
+	std::vector<Loop> loops;
+	for (unsigned i = 0; i < backEdgeCounts.size(); i++)
+	{
+		if (backEdgeCounts[i] == 0) continue;
+
+		Loop loop;
+		loop.start = program->getInstruction(i).operands[0];
+		loop.branch = i;
+		loop.iterations = backEdgeCounts[i];
+		loop.instructions = 0;
+		for (unsigned j = loop.start; j <= i; j++)
+			loop.instructions += instructionHits[j];
+		loops.push_back(loop);
+	}
+
+	std::vector<uint64_t> instructions;
+	for (unsigned i = 0; i < loops.size(); i++)
+		instructions.push_back(loops[i].instructions);
+	std::vector<unsigned> order = sortedByCount(instructions);
+	std::vector<Loop> sorted;
+	for (unsigned i = 0; i < order.size(); i++)
+		sorted.push_back(loops[order[i]]);
+	return sorted;
+}
+
+unsigned InterpreterProfile::clumpForInstruction(unsigned index) const
+{
+	return program->getClumpForInstruction(index);
+}
+
+uint64_t InterpreterProfile::getTotalInstructions() const
+{
+	uint64_t total = 0;
+	for (unsigned i = 0; i < instructionHits.size(); i++)
+		total += instructionHits[i];
+	return total;
+}
+
+uint64_t InterpreterProfile::getTotalNanoseconds() const
+{
+	uint64_t total = 0;
+	for (unsigned i = 0; i < handlerNanoseconds.size(); i++)
+		total += handlerNanoseconds[i];
+	return total;
+}
+
+void InterpreterProfile::writeText(std::ostream &stream, unsigned maxEntries) const
+{
+	const uint64_t totalInstructions = getTotalInstructions();
+	const uint64_t totalNanoseconds = getTotalNanoseconds();
+	const std::vector<uint64_t> handlerCounts = getHandlerCounts();
+	PollingLoops pollingLoops(file, program);
+
+	std::ios::fmtflags oldFlags = stream.flags();
+	stream << std::fixed << std::setprecision(1);
+
+	stream << "-- Profile --" << std::endl;
+	stream << "Instructions:           " << totalInstructions << std::endl;
+	stream << "Time:                   " << double(totalNanoseconds) / 1e6 << " ms" << std::endl;
+
+	stream << std::endl;
+	stream << "-- Opcodes --" << std::endl;
+	stream << "opcode\t\t\tcount\t\tshare\ttime (us)\tns each" << std::endl;
+	std::vector<unsigned> handlers = sortedByCount(handlerCounts);
+	for (unsigned i = 0; i < handlers.size(); i++)
+	{
+		unsigned handler = handlers[i];
+		stream << std::left << std::setw(24) << Interpreter::nameForOpcode(opcodeForHandler[handler]) << std::right;
+		stream << handlerCounts[handler] << "\t\t" << share(handlerCounts[handler], totalInstructions) << "%\t";
+		stream << double(handlerNanoseconds[handler]) / 1e3 << "\t\t" << double(handlerNanoseconds[handler]) / double(handlerCounts[handler]) << std::endl;
+	}
+
+	stream << std::endl;
+	stream << "-- Clumps --" << std::endl;
+	stream << "clump\tinstructions\tshare" << std::endl;
+	for (unsigned i = 0; i < clumpInstructions.size(); i++)
+		stream << i << "\t" << clumpInstructions[i] << "\t\t" << share(clumpInstructions[i], totalInstructions) << "%" << std::endl;
+
+	stream << std::endl;
+	stream << "-- Hot loops --" << std::endl;
+	stream << "clump\tfrom\tto\titerations\tinstructions\tshare\tpolling" << std::endl;
+	std::vector<Loop> loops = getLoops();
+	for (unsigned i = 0; i < loops.size() && i < maxEntries; i++)
+	{
+		const Loop &loop = loops[i];
+		stream << clumpForInstruction(loop.start) << "\t";
+		stream << program->getInstruction(loop.start).codeOffset << "\t" << program->getInstruction(loop.branch).codeOffset << "\t";
+		stream << loop.iterations << "\t\t" << loop.instructions << "\t\t" << share(loop.instructions, totalInstructions) << "%\t";
+		stream << (pollingLoops.closesLoop(loop.branch) ? "yes" : "no") << std::endl;
+	}
+
+	stream << std::endl;
+	stream << "-- Hot instructions --" << std::endl;
+	stream << "pc\tword\topcode\t\t\thits\t\tshare" << std::endl;
+	std::vector<unsigned> instructions = sortedByCount(instructionHits);
+	for (unsigned i = 0; i < instructions.size() && i < maxEntries; i++)
+	{
+		unsigned index = instructions[i];
+		stream << index << "\t" << program->getInstruction(index).codeOffset << "\t";
+		stream << std::left << std::setw(24) << Interpreter::nameForOpcode(program->getInstruction(index).opcode) << std::right;
+		stream << instructionHits[index] << "\t\t" << share(instructionHits[index], totalInstructions) << "%" << std::endl;
+	}
+
+	stream << std::endl;
+	stream << "-- Syscalls --" << std::endl;
+	stream << "id\tname\t\t\tcount" << std::endl;
+	std::vector<unsigned> syscalls = sortedByCount(syscallCounts);
+	for (unsigned i = 0; i < syscalls.size(); i++)
+	{
+		stream << syscalls[i] << "\t" << std::left << std::setw(24) << System::nameForSyscall(syscalls[i]) << std::right;
+		stream << syscallCounts[syscalls[i]] << std::endl;
+	}
+
+	stream.flags(oldFlags);
+}
+
+void InterpreterProfile::writeJSON(std::ostream &stream) const
+{
+	// All names are identifiers, so nothing needs escaping.
+	const std::vector<uint64_t> handlerCounts = getHandlerCounts();
+	PollingLoops pollingLoops(file, program);
+
+	stream << "{" << std::endl;
+	stream << "\t\"totalInstructions\": " << getTotalInstructions() << "," << std::endl;
+	stream << "\t\"totalNanoseconds\": " << getTotalNanoseconds() << "," << std::endl;
+
+	stream << "\t\"opcodes\": [";
+	std::vector<unsigned> handlers = sortedByCount(handlerCounts);
+	for (unsigned i = 0; i < handlers.size(); i++)
+	{
+		unsigned handler = handlers[i];
+		stream << (i > 0 ? "," : "") << std::endl;
+		stream << "\t\t{ \"name\": \"" << Interpreter::nameForOpcode(opcodeForHandler[handler]) << "\", ";
+		stream << "\"opcode\": " << unsigned(opcodeForHandler[handler]) << ", ";
+		stream << "\"count\": " << handlerCounts[handler] << ", ";
+		stream << "\"nanoseconds\": " << handlerNanoseconds[handler] << " }";
+	}
+	stream << std::endl << "\t]," << std::endl;
+
+	stream << "\t\"clumps\": [";
+	for (unsigned i = 0; i < clumpInstructions.size(); i++)
+	{
+		stream << (i > 0 ? "," : "") << std::endl;
+		stream << "\t\t{ \"clump\": " << i << ", \"instructions\": " << clumpInstructions[i] << " }";
+	}
+	stream << std::endl << "\t]," << std::endl;
+
+	stream << "\t\"loops\": [";
+	std::vector<Loop> loops = getLoops();
+	for (unsigned i = 0; i < loops.size(); i++)
+	{
+		const Loop &loop = loops[i];
+		stream << (i > 0 ? "," : "") << std::endl;
+		stream << "\t\t{ \"clump\": " << clumpForInstruction(loop.start) << ", ";
+		stream << "\"fromWord\": " << program->getInstruction(loop.start).codeOffset << ", ";
+		stream << "\"toWord\": " << program->getInstruction(loop.branch).codeOffset << ", ";
+		stream << "\"iterations\": " << loop.iterations << ", ";
+		stream << "\"instructions\": " << loop.instructions << ", ";
+		stream << "\"polling\": " << (pollingLoops.closesLoop(loop.branch) ? "true" : "false") << " }";
+	}
+	stream << std::endl << "\t]," << std::endl;
+
+	stream << "\t\"instructions\": [";
+	std::vector<unsigned> instructions = sortedByCount(instructionHits);
+	for (unsigned i = 0; i < instructions.size(); i++)
+	{
+		unsigned index = instructions[i];
+		stream << (i > 0 ? "," : "") << std::endl;
+		stream << "\t\t{ \"pc\": " << index << ", ";
+		stream << "\"word\": " << program->getInstruction(index).codeOffset << ", ";
+		stream << "\"opcode\": \"" << Interpreter::nameForOpcode(program->getInstruction(index).opcode) << "\", ";
+		stream << "\"hits\": " << instructionHits[index] << " }";
+	}
+	stream << std::endl << "\t]," << std::endl;
+
+	stream << "\t\"syscalls\": [";
+	std::vector<unsigned> syscalls = sortedByCount(syscallCounts);
+	for (unsigned i = 0; i < syscalls.size(); i++)
+	{
+		stream << (i > 0 ? "," : "") << std::endl;
+		stream << "\t\t{ \"id\": " << syscalls[i] << ", ";
+		stream << "\"name\": \"" << System::nameForSyscall(syscalls[i]) << "\", ";
+		stream << "\"count\": " << syscallCounts[syscalls[i]] << " }";
+	}
+	stream << std::endl << "\t]" << std::endl;
+	stream << "}" << std::endl;
+}
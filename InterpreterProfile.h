@@ -0,0 +1,135 @@
+#pragma once
+/*
+ *  InterpreterProfile.h
+ *  mindstormssimulation
+ *
+ *  Created by agent on 18.10.26
+ *  Copyright 2026 RWTH Aachen University All rights reserved.
+ *
+ */
+
+#include <chrono>
+#include <iosfwd>
+#include <vector>
+#include <stdint.h>
+
+class DecodedProgram;
+class RXEFile;
+
+/*!
+ * @abstract What a program spent its time on.
+ * @discussion Collected by the Interpreter if it is compiled with
+ * INTERPRETER_PROFILING defined; without it, the interpreter does not record
+ * anything and costs nothing extra. The profile counts how often every
+ * instruction ran, which clump ran it and how long each opcode took, as well
+ * as every branch back to an earlier instruction, which is how loops show
+ * up, and every syscall.
+ *
+ * Time is measured from one instruction to the next, so it includes the
+ * dispatch. While profiling, translated code is not used, since it would
+ * bypass the counting.
+ *
+ * The results can be written as text, for people, or as JSON, for tools.
+ */
+class InterpreterProfile
+{
+	const RXEFile *file;
+	const DecodedProgram *program;
+
+	std::vector<uint64_t> instructionHits;
+	std::vector<uint64_t> clumpInstructions;
+	std::vector<uint64_t> backEdgeCounts;
+	std::vector<uint64_t> handlerNanoseconds;
+	std::vector<uint64_t> syscallCounts;
+
+	InterpreterProfile(const InterpreterProfile &);
+	InterpreterProfile &operator=(const InterpreterProfile &);
+
+	struct Loop
+	{
+		unsigned start;
+		unsigned branch;
+		uint64_t iterations;
+		uint64_t instructions;
+	};
+	std::vector<Loop> getLoops() const;
+	std::vector<uint64_t> getHandlerCounts() const;
+	unsigned clumpForInstruction(unsigned index) const;
+	uint64_t getTotalInstructions() const;
+	uint64_t getTotalNanoseconds() const;
+
+public:
+	/*!
+	 * @abstract Measures the time between instructions.
+	 * @discussion Created on the stack for each batch; the time of the last
+	 * instruction is added when it goes away.
+	 */
+	class Timer
+	{
+		typedef std::chrono::steady_clock Clock;
+
+		InterpreterProfile *profile;
+		Clock::time_point start;
+		unsigned handler;
+		bool running;
+
+	public:
+		Timer(InterpreterProfile *aProfile) : profile(aProfile), running(false) {}
+		~Timer() { if (running) profile->handlerNanoseconds[handler] += elapsedSinceStart(Clock::now()); }
+
+		uint64_t elapsedSinceStart(Clock::time_point now) const
+		{
+			return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(now - start).count());
+		}
+
+		/*! Ends the time of the last instruction and starts that of the next. */
+		void next(unsigned nextHandler)
+		{
+			Clock::time_point now = Clock::now();
+			if (running) profile->handlerNanoseconds[handler] += elapsedSinceStart(now);
+			start = now;
+			handler = nextHandler;
+			running = true;
+		}
+	};
+
+	/*!
+	 * @abstract Creates an empty profile.
+	 * @param file The program that will be profiled.
+	 * @param program The program decoded from that file.
+	 */
+	InterpreterProfile(const RXEFile *file, const DecodedProgram *program);
+
+	/*! Forgets everything recorded so far. */
+	void clear();
+
+	/*! Records that an instruction is executed by a clump. */
+	void countInstruction(unsigned index, unsigned clump)
+	{
+		instructionHits[index]++;
+		if (clump < clumpInstructions.size()) clumpInstructions[clump]++;
+	}
+
+	/*! Records that a branch went back to an earlier instruction. */
+	void countBackEdge(unsigned branch) { backEdgeCounts[branch]++; }
+
+	/*! Records a syscall. */
+	void countSyscall(unsigned syscall) { syscallCounts[syscall & 0xFF]++; }
+
+	/*!
+	 * @abstract Writes a summary for people.
+	 * @discussion Lists the opcodes by count, the clumps, the loops that
+	 * executed the most instructions, the most executed instructions and the
+	 * syscalls.
+	 * @param stream Where to write it.
+	 * @param maxEntries How many loops and instructions to list at most.
+	 */
+	void writeText(std::ostream &stream, unsigned maxEntries = 20) const;
+
+	/*!
+	 * @abstract Writes everything that was recorded as a JSON object.
+	 * @discussion Contains the same lists as writeText, with all loops and
+	 * all instructions that ran at least once.
+	 */
+	void writeJSON(std::ostream &stream) const;
+};
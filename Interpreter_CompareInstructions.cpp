@@ -35,22 +35,27 @@ bool Interpreter::compare(unsigned mode, int a, int b)
 	}
 }
 
+template<bool Checked>
 void Interpreter::op_cmp(unsigned flags, const uint16_t *params)
 {
 	// Params:
 	// 0: Destination, memory location - store result here
 	// 1: Source1, memory location
 	// 2: Source2, memory location
-	int a = memory->getScalarValue(params[1]);
-	int b = memory->getScalarValue(params[2]);
-	memory->setScalarValue(params[0], compare(flags, a, b));
+	int a = readOperand<Checked>(params[1]);
+	int b = readOperand<Checked>(params[2]);
+	writeOperand<Checked>(params[0], compare(flags, a, b));
 }
 
+template<bool Checked>
 void Interpreter::op_tst(unsigned flags, const uint16_t *params)
 {
 	// Params:
 	// 0: Destination, memory location - store result here
 	// 1: Source, memory location
-	int a = memory->getScalarValue(params[1]);
-	memory->setScalarValue(params[0], compare(flags, a, 0));
+	int a = readOperand<Checked>(params[1]);
+	writeOperand<Checked>(params[0], compare(flags, a, 0));
 }
+
+INTERPRETER_INSTANTIATE_HANDLER(op_cmp)
+INTERPRETER_INSTANTIATE_HANDLER(op_tst)
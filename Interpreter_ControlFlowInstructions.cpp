@@ -9,101 +9,224 @@
 
 #include "Interpreter.h"
 
-#include <iostream>
-
+#include "DecodedProgram.h"
+#include "InterpreterProfile.h"
+#include "PollingLoops.h"
 #include "RXEFile.h"
 #include "VMMemory.h"
 
+void Interpreter::branchTo(unsigned target)
+{
+	// The branch is the instruction before the one in instruction. Going
+	// back from the end of a polling loop means the next round would do the
+	// same as this one, unless an input changes, so the clump waits for that.
+	unsigned branch = instruction - 1;
+#ifdef INTERPRETER_PROFILING
+	if (target <= branch) profile->countBackEdge(branch);
+#endif
+	if (target <= branch && pollingLoops && pollingLoops->closesLoop(branch))
+	{
+		parkPollingClump(target, branch - target + 1);
+		batchLimit = 0;
+		return;
+	}
+	instruction = target;
+}
+
+template<bool Checked>
 void Interpreter::op_jmp(unsigned flags, const uint16_t *params)
 {
 	// Parameters:
 	// 0: offset (immediate, signed): Alter PC by this much.
+	// The offset has already been resolved to an instruction index by
+	// DecodedProgram.
 	
-	int16_t offset = int16_t(params[0]);
-	instruction += (offset - 2);
-	// Account for size of jmp instruction, as otherwise we will go right past it.
+	branchTo(params[0]);
 }
 
+template<bool Checked>
 void Interpreter::op_brcmp(unsigned flags, const uint16_t *params)
 {
 	// Parameters:
 	// 0: offset (immediate, signed): Alter PC by this much if comparison is true
+	//    (already resolved to an instruction index)
 	// 1: Source1, memory location
 	// 2: Source2, memory location
 	
-	int a = memory->getScalarValue(params[1]);
-	int b = memory->getScalarValue(params[2]);
+	int a = readOperand<Checked>(params[1]);
+	int b = readOperand<Checked>(params[2]);
 	if (compare(flags, a, b))
-	{
-		int16_t offset = int16_t(params[0]);
-		instruction += (offset - 4);
-		// Account for size of instruction, as otherwise we will go right past it.
-	}
+		branchTo(params[0]);
 }
 
+template<bool Checked>
 void Interpreter::op_brtst(unsigned flags, const uint16_t *params)
 {
 	// Parameters:
 	// 0: offset (immediate, signed): Alter PC by this much if comparison is true
+	//    (already resolved to an instruction index)
 	// 1: Source, memory location
 	
-	int a = memory->getScalarValue(params[1]);
+	int a = readOperand<Checked>(params[1]);
 	if (compare(flags, a, 0))
-	{
-		int16_t offset = int16_t(params[0]);
-		instruction += (offset - 3);
-		// Account for size of instruction, as otherwise we will go right past it.
-	}
+		branchTo(params[0]);
 }
 
+template<bool Checked>
 void Interpreter::op_stop(unsigned flags, const uint16_t *params)
 {
-	throw std::runtime_error("op_stop");
+	// Parameters:
+	// 0: Source, memory location. Ignored, the program always stops.
+	
+	// All clumps, no matter what they are doing.
+	currentClump = noClump;
+	readyTail = noClump;
+	restingHead = noClump;
+	pollingHead = noClump;
+	pollingTail = noClump;
+	instruction = program->getInstructionCount();
+	batchLimit = 0;
 }
 
+template<bool Checked>
 void Interpreter::op_finclump(unsigned flags, const uint16_t *params)
 {
-	std::cout << "ignored finclump" << std::endl;
+	// Parameters:
+	// 0: Start, immediate (signed). First of the clump's dependents to
+	//    schedule, or -1 for none.
+	// 1: End, immediate (signed). Last of the clump's dependents to schedule.
+	
+	unsigned clump = currentClump;
+	finishCurrentClump();
+	
+	int start = int16_t(params[0]);
+	int end = int16_t(params[1]);
+	int dependentCount = int(file->getDependentCountForClump(clump));
+	if (end >= dependentCount) end = dependentCount - 1;
+	for (int i = start; start >= 0 && i <= end; i++)
+		fireClump(file->getDependentsForClump(clump)[i]);
+	
+	batchLimit = 0;
 }
 
+template<bool Checked>
 void Interpreter::op_finclumpimmed(unsigned flags, const uint16_t *params)
 {
-	std::cout << "ignored finclumpimmed" << std::endl;
+	// Parameters:
+	// 0: Clump ID, immediate. Clump to schedule.
+	
+	finishCurrentClump();
+	fireClump(params[0]);
+	
+	batchLimit = 0;
+}
+
+unsigned Interpreter::clumpInMutex(uint32_t mutex, unsigned shift) const throw(std::runtime_error)
+{
+	unsigned clump = (mutex >> shift) & 0xFF;
+	if (clump != noClump && clump >= clumps.size()) throw std::runtime_error("Mutex contains a clump that does not exist");
+	return clump;
 }
 
+template<bool Checked>
 void Interpreter::op_acquire(unsigned flags, const uint16_t *params)
 {
-	std::cout << "ignored acquire" << std::endl;
+	// Parameters:
+	// 0: Mutex, memory location.
+	
+	uint32_t mutex = uint32_t(readOperand<Checked>(params[0]));
+	unsigned owner = clumpInMutex(mutex, 0);
+	unsigned tail = clumpInMutex(mutex, 16);
+	
+	if (owner == noClump)
+	{
+		owner = currentClump;
+	}
+	else
+	{
+		// Wait at the end of the mutex's queue. The instruction has already
+		// been executed when the clump gets the mutex from OP_RELEASE.
+		unsigned clump = currentClump;
+		removeCurrentClump(ClumpBlocked);
+		if (tail == noClump) mutex = (mutex & 0xFFFF00FF) | (clump << 8);
+		else clumps[tail].link = clump;
+		tail = clump;
+		batchLimit = 0;
+	}
+	
+	writeOperand<Checked>(params[0], int32_t((mutex & 0xFF00FF00) | (tail << 16) | owner));
 }
 
+template<bool Checked>
 void Interpreter::op_release(unsigned flags, const uint16_t *params)
 {
-	std::cout << "ignored release" << std::endl;
+	// Parameters:
+	// 0: Mutex, memory location.
+	
+	uint32_t mutex = uint32_t(readOperand<Checked>(params[0]));
+	unsigned head = clumpInMutex(mutex, 8);
+	unsigned tail = clumpInMutex(mutex, 16);
+	
+	// The first waiting clump gets the mutex and can run again.
+	unsigned owner = head;
+	if (head != noClump)
+	{
+		head = clumps[owner].link;
+		if (head == noClump) tail = noClump;
+		enqueueClump(owner);
+	}
+	
+	writeOperand<Checked>(params[0], int32_t((mutex & 0xFF000000) | (tail << 16) | (head << 8) | owner));
 }
 
+template<bool Checked>
 void Interpreter::op_subcall(unsigned flags, const uint16_t *params)
 {
 	// Parameters:
 	// 0: Subroutine, immediate. Clump to branch to.
 	// 1: CallerID, memory. Store ID of this clump there.
 	
-	// Store clump to jump back to.
-	memory->setScalarValue(params[1], currentClump);
-	// Store instruction to jump back to
-	stack.push_back(instruction);
+	unsigned subroutine = params[0];
+	if (subroutine >= clumps.size()) throw std::runtime_error("Called clump does not exist");
+	if (clumps[subroutine].state != ClumpIdle) throw std::runtime_error("Called clump is already running");
+	
+	// Store clump to jump back to. It waits with its program counter at the
+	// next instruction.
+	writeOperand<Checked>(params[1], currentClump);
+	clumps[currentClump].instruction = instruction;
+	clumps[currentClump].state = ClumpCalling;
 	
-	// Branch into new clump
-	currentClump = params[0];
-	instruction = file->getCodeStartForClump(currentClump);
+	// Branch into new clump, which takes the place of the caller.
+	replaceCurrentClump(subroutine);
+	instruction = program->getStartForClump(subroutine);
 }
 
+template<bool Checked>
 void Interpreter::op_subret(unsigned flags, const uint16_t *params)
 {
 	// Parameters:
 	// 0: CallerID, memory. Jump back to clump with this ID.
 	
+	unsigned caller = unsigned(readOperand<Checked>(params[0]));
+	if (caller >= clumps.size() || clumps[caller].state != ClumpCalling) throw std::runtime_error("Return to a clump that did not call");
+	
+	// The subroutine starts at the beginning next time.
+	unsigned subroutine = currentClump;
+	clumps[subroutine].instruction = program->getStartForClump(subroutine);
+	clumps[subroutine].state = ClumpIdle;
+	
 	// Find old clump and restore operation there.
-	currentClump = memory->getScalarValue(params[0]);
-	instruction = stack.back();
-	stack.pop_back();
+	replaceCurrentClump(caller);
+	instruction = clumps[caller].instruction;
 }
+
+INTERPRETER_INSTANTIATE_HANDLER(op_jmp)
+INTERPRETER_INSTANTIATE_HANDLER(op_brcmp)
+INTERPRETER_INSTANTIATE_HANDLER(op_brtst)
+INTERPRETER_INSTANTIATE_HANDLER(op_stop)
+INTERPRETER_INSTANTIATE_HANDLER(op_finclump)
+INTERPRETER_INSTANTIATE_HANDLER(op_finclumpimmed)
+INTERPRETER_INSTANTIATE_HANDLER(op_acquire)
+INTERPRETER_INSTANTIATE_HANDLER(op_release)
+INTERPRETER_INSTANTIATE_HANDLER(op_subcall)
+INTERPRETER_INSTANTIATE_HANDLER(op_subret)
@@ -9,11 +9,10 @@
 
 #include "Interpreter.h"
 
-#include <iostream>
-
 #include "RXEFile.h"
 #include "VMMemory.h"
 
+template<bool Checked>
 void Interpreter::op_index(unsigned flags, const uint16_t *params)
 {
 	// Store element of array in scalar
@@ -23,16 +22,18 @@ void Interpreter::op_index(unsigned flags, const uint16_t *params)
 	// 2: Index, scalar, memory location or NOT_DS_ID (then it defaults to 0)
 	
 	unsigned index = 0;
-	if (params[2] != 0xFFFF) index = memory->getScalarValue(params[2]);
+	if (params[2] != 0xFFFF) index = readOperand<Checked>(params[2]);
 	
-	memory->setScalarValue(params[0], memory->getArrayElement(params[1], index));
+	writeOperand<Checked>(params[0], memory->getArrayElement(params[1], index));
 }
 
+template<bool Checked>
 void Interpreter::op_replace(unsigned flags, const uint16_t *params)
 {
-	std::cout << "ignored replace" << std::endl;
+	ignoreCurrentInstruction();
 }
 
+template<bool Checked>
 void Interpreter::op_arrsize(unsigned flags, const uint16_t *params)
 {
 	// Stores size of array in scalar
@@ -40,29 +41,41 @@ void Interpreter::op_arrsize(unsigned flags, const uint16_t *params)
 	// 0: Destination, scalar, memory location
 	// 1: Source, array, memory location
 
-	memory->setScalarValue(params[0], memory->getArrayLength(params[1]));
+	writeOperand<Checked>(params[0], memory->getArrayLength(params[1]));
 }
 
+template<bool Checked>
 void Interpreter::op_arrbuild(unsigned flags, const uint16_t *params)
 {
 	// Builds an array out of its parameters
 	// 0: Total size of instruction, immediate
 	// 1: destination
-	// n: Data
+	// n: Data, scalars or arrays whose elements are appended
 	
 	// params[0] is in bytes. Subtract word for instruction, inst.size and destination
 	unsigned numElements = (params[0] / 2) - 3;
 	
-	memory->setArrayLength(params[1], numElements);
-	for (unsigned i = 0; i < numElements; i++)
-		memory->setArrayElement(params[1], i, memory->getScalarValue(params[2 + i]));
+	memory->buildArray(params[1], params + 2, numElements);
 }
 
+template<bool Checked>
 void Interpreter::op_arrsubset(unsigned flags, const uint16_t *params)
 {
-	std::cout << "ignored arrsubset" << std::endl;
+	// Params:
+	// 0: Destination array, memory location
+	// 1: Source array, memory location
+	// 2: Index of the first element, memory location or NOT_DS_ID (then 0)
+	// 3: Count, memory location or NOT_DS_ID (then the rest of the array)
+	
+	unsigned start = 0;
+	if (params[2] != 0xFFFF) start = readOperand<Checked>(params[2]);
+	unsigned count = ~0u;
+	if (params[3] != 0xFFFF) count = readOperand<Checked>(params[3]);
+	
+	memory->copyRange(params[0], params[1], start, count);
 }
 
+template<bool Checked>
 void Interpreter::op_arrinit(unsigned flags, const uint16_t *params)
 {
 	// Params:
@@ -70,15 +83,14 @@ void Interpreter::op_arrinit(unsigned flags, const uint16_t *params)
 	// 1: New value, memory location
 	// 2: Count, memory location
 	
-	int32_t newVal = memory->getScalarValue(params[1]);
+	int32_t newVal = readOperand<Checked>(params[1]);
 	unsigned count = 0;
-	if (params[2] != 0xFFFF) count = memory->getScalarValue(params[2]);
+	if (params[2] != 0xFFFF) count = readOperand<Checked>(params[2]);
 	
-	memory->setArrayLength(params[0], count);
-	for (unsigned i = 0; i < count; i++)
-		memory->setArrayElement(params[0], i, newVal);
+	memory->fillArray(params[0], count, newVal);
 }
 
+template<bool Checked>
 void Interpreter::op_mov(unsigned flags, const uint16_t *params)
 {
 	// Params:
@@ -91,66 +103,139 @@ void Interpreter::op_mov(unsigned flags, const uint16_t *params)
 	if (destType == RXEFile::TC_ARRAY && srcType == RXEFile::TC_ARRAY)
 	{
 		// Array move
-		unsigned newLength = memory->getArrayLength(params[1]);
-		memory->setArrayLength(params[0], newLength);
-		for (unsigned i = 0; i < newLength; i++)
-			memory->setArrayElement(params[0], i, memory->getArrayElement(params[1], i));
+		memory->copyArray(params[0], params[1]);
 	}
 	else if ((destType == RXEFile::TC_VOID || destType == RXEFile::TC_CLUSTER || destType == RXEFile::TC_ARRAY) || (srcType == RXEFile::TC_VOID || srcType == RXEFile::TC_ARRAY || srcType == RXEFile::TC_CLUSTER || srcType == RXEFile::TC_ARRAY))
 	{
-		std::cout << "ignored complex mov from type " << file->nameForType(srcType) << " to type " << file->nameForType(destType) << std::endl;
+		reportForCurrentInstruction(VMDiagnostics::IgnoredMove, (unsigned(srcType) << 8) | unsigned(destType));
 		return;
 	}
 	else // Scalar move
-		memory->setScalarValue(params[0], memory->getScalarValue(params[1]));
+		writeOperand<Checked>(params[0], readOperand<Checked>(params[1]));
 }
 
+template<bool Checked>
 void Interpreter::op_set(unsigned flags, const uint16_t *params)
 {
 	// Params:
 	// 0: location (memory location)
 	// 1: value (immediate)
 	
-	memory->setScalarValue(params[0], params[1]);
+	writeOperand<Checked>(params[0], params[1]);
 }
 
+template<bool Checked>
 void Interpreter::op_flatten(unsigned flags, const uint16_t *params)
 {
-	std::cout << "ignored flatten" << std::endl;
+	ignoreCurrentInstruction();
 }
 
+template<bool Checked>
 void Interpreter::op_unflatten(unsigned flags, const uint16_t *params)
 {
-	std::cout << "ignored unflatten" << std::endl;
+	ignoreCurrentInstruction();
 }
 
+template<bool Checked>
 void Interpreter::op_numtostring(unsigned flags, const uint16_t *params)
 {
-	std::cout << "ignored numtostring" << std::endl;
+	// Params:
+	// 0: Destination string, memory location
+	// 1: Number, memory location
+	
+	bool isUnsigned = file->getTypeAtDSTOCIndex(params[1]) == RXEFile::TC_ULONG;
+	memory->setStringToNumber(params[0], readOperand<Checked>(params[1]), isUnsigned);
 }
 
+template<bool Checked>
 void Interpreter::op_stringtonum(unsigned flags, const uint16_t *params)
 {
-	std::cout << "ignored stringtonum" << std::endl;
+	// Params:
+	// 0: Destination, scalar, memory location
+	// 1: Index after the number, scalar, memory location
+	// 2: Source string, memory location
+	// 3: Offset, memory location or NOT_DS_ID (then it defaults to 0)
+	// 4: Default, memory location or NOT_DS_ID (then it defaults to 0)
+	
+	unsigned offset = 0;
+	if (params[3] != 0xFFFF) offset = readOperand<Checked>(params[3]);
+	
+	int32_t value;
+	unsigned indexPast;
+	if (!memory->parseNumber(params[2], offset, value, indexPast))
+	{
+		value = 0;
+		if (params[4] != 0xFFFF) value = readOperand<Checked>(params[4]);
+	}
+	
+	writeOperand<Checked>(params[0], value);
+	writeOperand<Checked>(params[1], indexPast);
 }
 
+template<bool Checked>
 void Interpreter::op_strcat(unsigned flags, const uint16_t *params)
 {
-	std::cout << "ignored strcat" << std::endl;
+	// Params:
+	// 0: Total size of instruction, immediate
+	// 1: Destination string
+	// n: Strings to join
+	
+	// params[0] is in bytes. Subtract word for instruction, inst.size and destination
+	unsigned numStrings = (params[0] / 2) - 3;
+	
+	memory->concatenateStrings(params[1], params + 2, numStrings);
 }
 
+template<bool Checked>
 void Interpreter::op_strsubset(unsigned flags, const uint16_t *params)
 {
-	std::cout << "ignored strsubset" << std::endl;
+	// Params:
+	// 0: Destination string, memory location
+	// 1: Source string, memory location
+	// 2: Index, memory location or NOT_DS_ID (then it defaults to 0)
+	// 3: Length, memory location or NOT_DS_ID (then the rest of the string)
+	
+	unsigned index = 0;
+	if (params[2] != 0xFFFF) index = readOperand<Checked>(params[2]);
+	unsigned length = ~0u;
+	if (params[3] != 0xFFFF) length = readOperand<Checked>(params[3]);
+	
+	memory->copySubstring(params[0], params[1], index, length);
 }
 
+template<bool Checked>
 void Interpreter::op_strtobytearr(unsigned flags, const uint16_t *params)
 {
-	std::cout << "ignored strtobytearr" << std::endl;
+	// Params:
+	// 0: Destination byte array, memory location
+	// 1: Source string, memory location
+	
+	memory->copyStringToBytes(params[0], params[1]);
 }
 
+template<bool Checked>
 void Interpreter::op_bytearrtostr(unsigned flags, const uint16_t *params)
 {
-	std::cout << "ignored bytearrtostr" << std::endl;
-}
-
+	// Params:
+	// 0: Destination string, memory location
+	// 1: Source byte array, memory location
+	
+	memory->copyBytesToString(params[0], params[1]);
+}
+
+INTERPRETER_INSTANTIATE_HANDLER(op_index)
+INTERPRETER_INSTANTIATE_HANDLER(op_replace)
+INTERPRETER_INSTANTIATE_HANDLER(op_arrsize)
+INTERPRETER_INSTANTIATE_HANDLER(op_arrbuild)
+INTERPRETER_INSTANTIATE_HANDLER(op_arrsubset)
+INTERPRETER_INSTANTIATE_HANDLER(op_arrinit)
+INTERPRETER_INSTANTIATE_HANDLER(op_mov)
+INTERPRETER_INSTANTIATE_HANDLER(op_set)
+INTERPRETER_INSTANTIATE_HANDLER(op_flatten)
+INTERPRETER_INSTANTIATE_HANDLER(op_unflatten)
+INTERPRETER_INSTANTIATE_HANDLER(op_numtostring)
+INTERPRETER_INSTANTIATE_HANDLER(op_stringtonum)
+INTERPRETER_INSTANTIATE_HANDLER(op_strcat)
+INTERPRETER_INSTANTIATE_HANDLER(op_strsubset)
+INTERPRETER_INSTANTIATE_HANDLER(op_strtobytearr)
+INTERPRETER_INSTANTIATE_HANDLER(op_bytearrtostr)
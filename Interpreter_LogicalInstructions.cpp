@@ -9,34 +9,41 @@
 
 #include "Interpreter.h"
 
-#include <iostream>
-
 #include "RXEFile.h"
 #include "VMMemory.h"
 
+template<bool Checked>
 void Interpreter::op_and(unsigned flags, const uint16_t *params)
 {
-	std::cout << "ignored and" << std::endl;
+	ignoreCurrentInstruction();
 }
 
+template<bool Checked>
 void Interpreter::op_or(unsigned flags, const uint16_t *params)
 {
-	std::cout << "ignored or" << std::endl;
+	ignoreCurrentInstruction();
 }
 
+template<bool Checked>
 void Interpreter::op_xor(unsigned flags, const uint16_t *params)
 {
-	std::cout << "ignored xor" << std::endl;
+	ignoreCurrentInstruction();
 }
 
+template<bool Checked>
 void Interpreter::op_not(unsigned flags, const uint16_t *params)
 {
 	// Params:
 	// 0: Destination, memory location
 	// 1: A, memory location
 	
-	int a = memory->getScalarValue(params[1]);
+	int a = readOperand<Checked>(params[1]);
 	
 	// Notice: This is logical, not bitwise, per Lego documentation
-	memory->setScalarValue(params[0], !a);
+	writeOperand<Checked>(params[0], !a);
 }
+
+INTERPRETER_INSTANTIATE_HANDLER(op_and)
+INTERPRETER_INSTANTIATE_HANDLER(op_or)
+INTERPRETER_INSTANTIATE_HANDLER(op_xor)
+INTERPRETER_INSTANTIATE_HANDLER(op_not)
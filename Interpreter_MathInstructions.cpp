@@ -9,11 +9,10 @@
 
 #include "Interpreter.h"
 
-#include <iostream>
-
 #include "RXEFile.h"
 #include "VMMemory.h"
 
+template<bool Checked>
 void Interpreter::op_add(unsigned flags, const uint16_t *params)
 {
 	// Params:
@@ -21,12 +20,13 @@ void Interpreter::op_add(unsigned flags, const uint16_t *params)
 	// 1: A, memory location
 	// 2: B, memory location
 	
-	int a = memory->getScalarValue(params[1]);
-	int b = memory->getScalarValue(params[2]);
+	int a = readOperand<Checked>(params[1]);
+	int b = readOperand<Checked>(params[2]);
 	
-	memory->setScalarValue(params[0], a + b);
+	writeOperand<Checked>(params[0], a + b);
 }
 
+template<bool Checked>
 void Interpreter::op_sub(unsigned flags, const uint16_t *params)
 {
 	// Params:
@@ -34,23 +34,25 @@ void Interpreter::op_sub(unsigned flags, const uint16_t *params)
 	// 1: A, memory location
 	// 2: B, memory location
 	
-	int a = memory->getScalarValue(params[1]);
-	int b = memory->getScalarValue(params[2]);
+	int a = readOperand<Checked>(params[1]);
+	int b = readOperand<Checked>(params[2]);
 	
-	memory->setScalarValue(params[0], a - b);
+	writeOperand<Checked>(params[0], a - b);
 }
 
+template<bool Checked>
 void Interpreter::op_neg(unsigned flags, const uint16_t *params)
 {
 	// Params:
 	// 0: Destination, memory location
 	// 1: A, memory location
 	
-	int a = memory->getScalarValue(params[1]);
+	int a = readOperand<Checked>(params[1]);
 	
-	memory->setScalarValue(params[0], -a);
+	writeOperand<Checked>(params[0], -a);
 }
 
+template<bool Checked>
 void Interpreter::op_mul(unsigned flags, const uint16_t *params)
 {
 	// Params:
@@ -58,12 +60,13 @@ void Interpreter::op_mul(unsigned flags, const uint16_t *params)
 	// 1: A, memory location
 	// 2: B, memory location
 	
-	int a = memory->getScalarValue(params[1]);
-	int b = memory->getScalarValue(params[2]);
+	int a = readOperand<Checked>(params[1]);
+	int b = readOperand<Checked>(params[2]);
 	
-	memory->setScalarValue(params[0], a * b);
+	writeOperand<Checked>(params[0], a * b);
 }
 
+template<bool Checked>
 void Interpreter::op_div(unsigned flags, const uint16_t *params)
 {
 	// Params:
@@ -71,13 +74,17 @@ void Interpreter::op_div(unsigned flags, const uint16_t *params)
 	// 1: A, memory location
 	// 2: B, memory location
 	
-	int a = memory->getScalarValue(params[1]);
-	int b = memory->getScalarValue(params[2]);
+	int a = readOperand<Checked>(params[1]);
+	int b = readOperand<Checked>(params[2]);
 	
-	if (b == 0) memory->setScalarValue(params[0], 0);
-	else memory->setScalarValue(params[0], a / b);
+	// Dividing the smallest int by -1 overflows, so -1 is negation, which
+	// wraps around.
+	if (b == 0) writeOperand<Checked>(params[0], 0);
+	else if (b == -1) writeOperand<Checked>(params[0], int32_t(0u - uint32_t(a)));
+	else writeOperand<Checked>(params[0], a / b);
 }
 
+template<bool Checked>
 void Interpreter::op_mod(unsigned flags, const uint16_t *params)
 {
 	// Params:
@@ -85,19 +92,31 @@ void Interpreter::op_mod(unsigned flags, const uint16_t *params)
 	// 1: A, memory location
 	// 2: B, memory location
 	
-	int a = memory->getScalarValue(params[1]);
-	int b = memory->getScalarValue(params[2]);
+	int a = readOperand<Checked>(params[1]);
+	int b = readOperand<Checked>(params[2]);
 	
-	if (b == 0) memory->setScalarValue(params[0], 0);
-	else memory->setScalarValue(params[0], a % b);
+	// The remainder for -1 is always 0, but computing it can overflow.
+	if (b == 0 || b == -1) writeOperand<Checked>(params[0], 0);
+	else writeOperand<Checked>(params[0], a % b);
 }
 
+template<bool Checked>
 void Interpreter::op_sqrt(unsigned flags, const uint16_t *params)
 {
-	std::cout << "ignored sqrt" << std::endl;
+	ignoreCurrentInstruction();
 }
 
+template<bool Checked>
 void Interpreter::op_abs(unsigned flags, const uint16_t *params)
 {
-	std::cout << "ignored abs for now." << std::endl;
+	ignoreCurrentInstruction();
 }
+
+INTERPRETER_INSTANTIATE_HANDLER(op_add)
+INTERPRETER_INSTANTIATE_HANDLER(op_sub)
+INTERPRETER_INSTANTIATE_HANDLER(op_neg)
+INTERPRETER_INSTANTIATE_HANDLER(op_mul)
+INTERPRETER_INSTANTIATE_HANDLER(op_div)
+INTERPRETER_INSTANTIATE_HANDLER(op_mod)
+INTERPRETER_INSTANTIATE_HANDLER(op_sqrt)
+INTERPRETER_INSTANTIATE_HANDLER(op_abs)
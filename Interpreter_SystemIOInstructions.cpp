@@ -10,12 +10,13 @@
 #include "Interpreter.h"
 
 #include <ctime>
-#include <iostream>
 
+#include "InterpreterProfile.h"
 #include "RXEFile.h"
 #include "System.h"
 #include "VMMemory.h"
 
+template<bool Checked>
 void Interpreter::op_syscall(unsigned flags, const uint16_t *params)
 {
 	// Params:
@@ -25,9 +26,14 @@ void Interpreter::op_syscall(unsigned flags, const uint16_t *params)
 	unsigned syscallID = params[0];
 	unsigned paramCluster = params[1];
 	
-	system->syscall(syscallID, paramCluster);
+#ifdef INTERPRETER_PROFILING
+	profile->countSyscall(syscallID);
+#endif
+	if (!system->syscall(syscallID, paramCluster))
+		reportForCurrentInstruction(VMDiagnostics::UnknownSyscall, syscallID);
 }
 
+template<bool Checked>
 void Interpreter::op_setin(unsigned flags, const uint16_t *params)
 {
 	// Params:
@@ -35,19 +41,22 @@ void Interpreter::op_setin(unsigned flags, const uint16_t *params)
 	// 1: Port, memory location
 	// 2: PropID, immediate value
 	
-	unsigned source = memory->getScalarValue(params[0]);
-	unsigned port = memory->getScalarValue(params[1]);
+	unsigned source = readOperand<Checked>(params[0]);
+	unsigned port = readOperand<Checked>(params[1]);
 	unsigned propID = params[2];
 	
-	system->setInputConfiguration(port, propID, source);
+	if (!system->setInputConfiguration(port, propID, source))
+		reportForCurrentInstruction(VMDiagnostics::IgnoredInputConfiguration, ((port & 0xFF) << 8) | (propID & 0xFF), int32_t(source));
 }
 
+template<bool Checked>
 void Interpreter::configureOutputForPort(unsigned port, unsigned numParams, const uint16_t *params)
 {
 	for (unsigned i = 0; i < numParams; i += 2)
-		system->setOutputConfiguration(port, params[i], memory->getScalarValue(params[i+1]));
+		system->setOutputConfiguration(port, params[i], readOperand<Checked>(params[i+1]));
 }
 
+template<bool Checked>
 void Interpreter::op_setout(unsigned flags, const uint16_t *params)
 {
 	// Params:
@@ -65,16 +74,17 @@ void Interpreter::op_setout(unsigned flags, const uint16_t *params)
 		for (unsigned i = 0; i < memory->getArrayLength(params[1]); i++)
 		{
 			unsigned port = memory->getArrayElement(params[1], i);
-			configureOutputForPort(port, numParams, &params[2]);
+			configureOutputForPort<Checked>(port, numParams, &params[2]);
 		}
 	}
 	else
 	{
 		unsigned port = memory->getScalarValue(params[1]);
-		configureOutputForPort(port, numParams, &params[2]);
+		configureOutputForPort<Checked>(port, numParams, &params[2]);
 	}
 }
 
+template<bool Checked>
 void Interpreter::op_getin(unsigned flags, const uint16_t *params)
 {
 	// Params:
@@ -82,13 +92,16 @@ void Interpreter::op_getin(unsigned flags, const uint16_t *params)
 	// 1: Port, memory location
 	// 2: PropID, immediate value
 	
-	unsigned port = memory->getScalarValue(params[1]);
+	unsigned port = readOperand<Checked>(params[1]);
 	unsigned property = params[2];
 	
-	unsigned result = system->getInputConfiguration(port, property);
-	memory->setScalarValue(params[0], result);
+	unsigned result;
+	if (!system->getInputConfiguration(port, property, result))
+		reportForCurrentInstruction(VMDiagnostics::UnknownInputConfiguration, ((port & 0xFF) << 8) | (property & 0xFF));
+	writeOperand<Checked>(params[0], result);
 }
 
+template<bool Checked>
 void Interpreter::op_getout(unsigned flags, const uint16_t *params)
 {
 	// Params:
@@ -96,13 +109,14 @@ void Interpreter::op_getout(unsigned flags, const uint16_t *params)
 	// 1: Port, memory location
 	// 2: PropID, immediate value
 	
-	unsigned port = memory->getScalarValue(params[1]);
+	unsigned port = readOperand<Checked>(params[1]);
 	unsigned property = params[2];
 	
 	unsigned result = system->getOutputConfiguration(port, property);
-	memory->setScalarValue(params[0], result);
+	writeOperand<Checked>(params[0], result);
 }
 
+template<bool Checked>
 void Interpreter::op_wait(unsigned flags, const uint16_t *params)
 {
 	// This operation is not specified by the newest firmware description
@@ -113,13 +127,29 @@ void Interpreter::op_wait(unsigned flags, const uint16_t *params)
 	// 0: Unknown. Seems to be NOT_A_DS_ID usually.
 	// 1: Time to wait for, memory location
 	
-	waitUntil = system->getTick() + memory->getScalarValue(params[1]);
+	// The clump rests until then; others can run in the meantime.
+	unsigned tick = system->getTick();
+	unsigned wakeTick = tick + readOperand<Checked>(params[1]);
+	if (tick < wakeTick)
+	{
+		restCurrentClump(wakeTick);
+		batchLimit = 0;
+	}
 }
 
+template<bool Checked>
 void Interpreter::op_gettick(unsigned flags, const uint16_t *params)
 {
 	// Params:
 	// 0: Destination, memory location
 	
-	memory->setScalarValue(params[0], system->getTick());
+	writeOperand<Checked>(params[0], system->getTick());
 }
+
+INTERPRETER_INSTANTIATE_HANDLER(op_syscall)
+INTERPRETER_INSTANTIATE_HANDLER(op_setin)
+INTERPRETER_INSTANTIATE_HANDLER(op_setout)
+INTERPRETER_INSTANTIATE_HANDLER(op_getin)
+INTERPRETER_INSTANTIATE_HANDLER(op_getout)
+INTERPRETER_INSTANTIATE_HANDLER(op_wait)
+INTERPRETER_INSTANTIATE_HANDLER(op_gettick)
@@ -0,0 +1,126 @@
+/*
+ *  NativeCode.cpp
+ *  mindstormssimulation
+ *
+ *  Created by agent on 18.10.26
+ *  Copyright 2026 RWTH Aachen University All rights reserved.
+ *
+ */
+
+#include "NativeCode.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+#include "RXEFile.h"
+
+namespace
+{
+	const char *const versionSymbol = "rxe_native_version";
+	const char *const hashSymbol = "rxe_native_program_hash";
+	const char *const executeSymbol = "rxe_native_execute";
+
+	// FNV-1a, 64 bit, continued over several pieces of data.
+	const uint64_t hashStart = 14695981039346656037ULL;
+	uint64_t hashContinue(uint64_t hash, uint32_t value)
+	{
+		for (unsigned i = 0; i < 4; i++)
+		{
+			hash ^= (value >> (8 * i)) & 0xFF;
+			hash *= 1099511628211ULL;
+		}
+		return hash;
+	}
+}
+
+NativeCode::NativeCode(const char *libraryPath, const RXEFile *file) throw(std::runtime_error)
+: executeFunction(0)
+{
+#ifdef _WIN32
+	library = LoadLibraryA(libraryPath);
+#else
+	// Without a slash, dlopen would search the system's library paths.
+	std::string path(libraryPath);
+	if (path.find('/') == std::string::npos) path = "./" + path;
+	library = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+#endif
+	if (!library) throw std::runtime_error("Could not load native code library.");
+
+	const uint32_t *version = reinterpret_cast<const uint32_t *>(findSymbol(versionSymbol));
+	const uint64_t *hash = reinterpret_cast<const uint64_t *>(findSymbol(hashSymbol));
+	RXENativeExecuteFunction execute = reinterpret_cast<RXENativeExecuteFunction>(findSymbol(executeSymbol));
+
+	const char *problem = 0;
+	if (!version || !hash || !execute) problem = "Library does not contain native code.";
+	else if (*version != RXE_NATIVE_VERSION) problem = "Native code was made by a different version.";
+	else if (*hash != hashForProgram(file)) problem = "Native code was made for a different program.";
+	if (problem)
+	{
+#ifdef _WIN32
+		FreeLibrary(static_cast<HMODULE>(library));
+#else
+		dlclose(library);
+#endif
+		throw std::runtime_error(problem);
+	}
+
+	executeFunction = execute;
+}
+
+NativeCode::~NativeCode()
+{
+#ifdef _WIN32
+	FreeLibrary(static_cast<HMODULE>(library));
+#else
+	dlclose(library);
+#endif
+}
+
+void *NativeCode::findSymbol(const char *name) const
+{
+#ifdef _WIN32
+	return reinterpret_cast<void *>(GetProcAddress(static_cast<HMODULE>(library), name));
+#else
+	return dlsym(library, name);
+#endif
+}
+
+uint64_t NativeCode::hashForProgram(const RXEFile *file)
+{
+	uint64_t hash = hashStart;
+
+	hash = hashContinue(hash, file->getDSTOCCount());
+	for (unsigned i = 0; i < file->getDSTOCCount(); i++)
+		hash = hashContinue(hash, file->getTypeAtDSTOCIndex(i));
+
+	hash = hashContinue(hash, file->getClumpCount());
+	for (unsigned i = 0; i < file->getClumpCount(); i++)
+		hash = hashContinue(hash, file->getCodeStartForClump(i));
+
+	hash = hashContinue(hash, file->getCodeWordCount());
+	const uint16_t *code = file->getCode();
+	for (unsigned i = 0; i < file->getCodeWordCount(); i++)
+		hash = hashContinue(hash, code[i]);
+
+	return hash;
+}
+
+std::string NativeCode::libraryPathForProgram(const std::string &rxeFilename)
+{
+#if defined(_WIN32)
+	const char *extension = ".dll";
+#elif defined(__APPLE__)
+	const char *extension = ".dylib";
+#else
+	const char *extension = ".so";
+#endif
+
+	std::string::size_type dot = rxeFilename.find_last_of('.');
+	std::string::size_type slash = rxeFilename.find_last_of("/\\");
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+		return rxeFilename + extension;
+	return rxeFilename.substr(0, dot) + extension;
+}
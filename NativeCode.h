@@ -0,0 +1,67 @@
+#pragma once
+/*
+ *  NativeCode.h
+ *  mindstormssimulation
+ *
+ *  Created by agent on 18.10.26
+ *  Copyright 2026 RWTH Aachen University All rights reserved.
+ *
+ */
+
+#include <stdexcept>
+#include <stdint.h>
+#include <string>
+
+#include "NativeCodeInterface.h"
+
+class RXEFile;
+
+/*!
+ * @abstract A program translated to native code, loaded from a shared library.
+ * @discussion RXEAnalyzer --translate turns a program into C++ source, which
+ * is compiled into a shared library (see RXETranslator). This class loads such
+ * a library and makes sure that it really is a translation of the program
+ * it is supposed to run, using a hash of the program's code and DSTOC. The
+ * Interpreter then runs the library's code instead of its own dispatch loop;
+ * see Interpreter::setNativeCode.
+ *
+ * The library stays loaded for as long as the object exists.
+ */
+class NativeCode
+{
+	void *library;
+	RXENativeExecuteFunction executeFunction;
+
+	NativeCode(const NativeCode &);
+	NativeCode &operator=(const NativeCode &);
+
+	void *findSymbol(const char *name) const;
+
+public:
+	/*!
+	 * @abstract Loads a translated program.
+	 * @param libraryPath The shared library.
+	 * @param file The program that the library should be a translation of.
+	 * @throws std::runtime_error If the library can not be loaded, was made
+	 * by a different version or for a different program.
+	 */
+	NativeCode(const char *libraryPath, const RXEFile *file) throw(std::runtime_error);
+	~NativeCode();
+
+	/*! The translated code. */
+	RXENativeExecuteFunction getExecuteFunction() const { return executeFunction; }
+
+	/*!
+	 * @abstract Identifies a program for its translation.
+	 * @discussion Covers everything the translated code depends on, that is
+	 * the code and the types in the DSTOC.
+	 */
+	static uint64_t hashForProgram(const RXEFile *file);
+
+	/*!
+	 * @abstract Where the translation of a program is expected by default.
+	 * @discussion The name of the program file with the extension replaced by
+	 * the one for shared libraries on this platform.
+	 */
+	static std::string libraryPathForProgram(const std::string &rxeFilename);
+};
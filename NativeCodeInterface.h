@@ -0,0 +1,56 @@
+#pragma once
+/*
+ *  NativeCodeInterface.h
+ *  mindstormssimulation
+ *
+ *  Created by agent on 18.10.26
+ *  Copyright 2026 RWTH Aachen University All rights reserved.
+ *
+ */
+
+#include <stdint.h>
+
+/*!
+ * @abstract What a translated program and the Interpreter exchange.
+ * @discussion Programs translated with RXEAnalyzer --translate are compiled
+ * into a shared library on their own, so this header is all they include and
+ * everything in it is plain C. A library exports three symbols:
+ * rxe_native_version, which has to be RXE_NATIVE_VERSION;
+ * rxe_native_program_hash, the NativeCode::hashForProgram of the program it
+ * was translated from; and rxe_native_execute, an RXENativeExecuteFunction.
+ *
+ * Instructions are numbered as in the DecodedProgram. Everything the
+ * translated code does not do itself is handed back to the interpreter one
+ * instruction at a time.
+ */
+struct RXENativeState
+{
+	/*! The scalar slots of the VMMemory. */
+	int32_t *slots;
+	/*! Index of the next instruction. Updated when the function returns. */
+	uint32_t instruction;
+	/*! Passed back to executeInInterpreter. */
+	void *interpreter;
+	/*!
+	 * Executes one instruction in the interpreter and stores the index of the
+	 * instruction to continue with in next. Returns non-zero if execution has
+	 * to stop after it, because the program waits, stopped or failed.
+	 */
+	int (*executeInInterpreter)(void *interpreter, uint32_t instruction, uint32_t *next);
+};
+
+/*!
+ * @abstract Executes up to maxInstructions, starting at state->instruction.
+ * @discussion Has the same behaviour as the Interpreter's own dispatch loop.
+ * Returns the number of instructions executed.
+ */
+typedef uint32_t (*RXENativeExecuteFunction)(struct RXENativeState *state, uint32_t maxInstructions);
+
+/*! Changes whenever RXENativeState or the translation change. */
+#define RXE_NATIVE_VERSION 3
+
+#ifdef _WIN32
+#define RXE_NATIVE_EXPORT extern "C" __declspec(dllexport)
+#else
+#define RXE_NATIVE_EXPORT extern "C" __attribute__((visibility("default")))
+#endif
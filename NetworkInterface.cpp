@@ -9,9 +9,13 @@
 
 #include "NetworkInterface.h"
 
-#include "Drawer.h"
 #include "Robot.h"
+
+// Headless builds have neither graphics nor sound.
+#ifndef SIMULATOR_HEADLESS
+#include "Drawer.h"
 #include "SoundController.h"
+#endif
 
 NetworkInterface::NetworkInterface()
 : drawer(0), soundController(0)
@@ -20,14 +24,18 @@ NetworkInterface::NetworkInterface()
 
 void NetworkInterface::registerNewRobot(Robot *aRobot)
 {
+#ifndef SIMULATOR_HEADLESS
 	if (drawer) drawer->addRobot(aRobot);
 	if (soundController) soundController->addRobot(aRobot);
+#endif
 }
 
 void NetworkInterface::removeRobot(Robot *aRobot)
 {
+#ifndef SIMULATOR_HEADLESS
 	if (drawer) drawer->removeRobot(aRobot);
 	if (soundController) soundController->removeRobot(aRobot);
+#endif
 }
 
 void NetworkInterface::setDrawer(Drawer *aDrawer)
@@ -36,11 +44,13 @@ void NetworkInterface::setDrawer(Drawer *aDrawer)
 	
 	drawer = aDrawer;
 	
+#ifndef SIMULATOR_HEADLESS
 	if (drawer)
 	{
 		while (Robot *aRobot = getNextRobot())
 			drawer->addRobot(aRobot);
 	}
+#endif
 }
 
 void NetworkInterface::setSoundController(SoundController *aController)
@@ -49,11 +59,13 @@ void NetworkInterface::setSoundController(SoundController *aController)
 	
 	soundController = aController;
 	
+#ifndef SIMULATOR_HEADLESS
 	if (soundController)
 	{
 		while (Robot *aRobot = getNextRobot())
 			soundController->addRobot(aRobot);
 	}
+#endif
 }
 
 void NetworkInterface::setIsPaused(bool pause) throw()
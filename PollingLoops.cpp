@@ -0,0 +1,135 @@
+/*
+ *  PollingLoops.cpp
+ *  mindstormssimulation
+ *
+ *  Created by agent on 18.10.26
+ *  Copyright 2026 RWTH Aachen University All rights reserved.
+ *
+ */
+
+#include "PollingLoops.h"
+
+#include "DecodedProgram.h"
+#include "InterpreterOpcodes.h"
+#include "RXEFile.h"
+
+namespace
+{
+	// Input properties whose value only changes with the simulation. Anything
+	// else is answered with a random value.
+	const unsigned inputScaledValue = 0x4;
+	const unsigned inputInvalidData = 0x5;
+}
+
+PollingLoops::PollingLoops(const RXEFile *aFile, const DecodedProgram *aProgram)
+: file(aFile), program(aProgram), backEdges(aProgram->getInstructionCount(), 0), count(0)
+{
+	for (unsigned i = 0; i < program->getInstructionCount(); i++)
+	{
+		const DecodedProgram::Instruction &instruction = program->getInstruction(i);
+		if (!DecodedProgram::isBranch(instruction.opcode) || instruction.operandCount == 0)
+			continue;
+
+		unsigned target = instruction.operands[0];
+		if (target <= i && isPollingLoop(target, i))
+		{
+			backEdges[i] = 1;
+			count++;
+		}
+	}
+}
+
+bool PollingLoops::isScalar(unsigned entry) const
+{
+	if (entry >= file->getDSTOCCount()) return false;
+	RXEFile::dstocType type = file->getTypeAtDSTOCIndex(entry);
+	return type != RXEFile::TC_VOID && type != RXEFile::TC_CLUSTER && type != RXEFile::TC_ARRAY;
+}
+
+bool PollingLoops::isPollingLoop(unsigned head, unsigned branch) const
+{
+	// Everything the loop writes. Reading any of these before writing them
+	// in the same round would carry values over from the last one.
+	std::vector<bool> writtenInLoop(file->getDSTOCCount(), false);
+	std::vector<bool> writtenSoFar(file->getDSTOCCount(), false);
+
+	for (unsigned pass = 0; pass < 2; pass++)
+	{
+		for (unsigned i = head; i <= branch; i++)
+		{
+			const DecodedProgram::Instruction &instruction = program->getInstruction(i);
+			const uint16_t *params = instruction.operands;
+
+			// Operands that are read, and the one that is written, if any.
+			unsigned reads[2];
+			unsigned readCount = 0;
+			bool writes = true;
+			unsigned requiredOperands;
+			switch (instruction.handler)
+			{
+				case HANDLER_OP_ADD:
+				case HANDLER_OP_SUB:
+				case HANDLER_OP_MUL:
+				case HANDLER_OP_DIV:
+				case HANDLER_OP_MOD:
+				case HANDLER_OP_CMP:
+					requiredOperands = 3;
+					readCount = 2;
+					break;
+				case HANDLER_OP_NEG:
+				case HANDLER_OP_NOT:
+				case HANDLER_OP_TST:
+				case HANDLER_OP_MOV:
+				case HANDLER_OP_GETOUT:
+					requiredOperands = 2;
+					readCount = 1;
+					break;
+				case HANDLER_OP_GETIN:
+					requiredOperands = 3;
+					readCount = 1;
+					if (instruction.operandCount >= requiredOperands && params[2] != inputScaledValue && params[2] != inputInvalidData)
+						return false;
+					break;
+				case HANDLER_OP_SET:
+					requiredOperands = 2;
+					break;
+				case HANDLER_OP_GETTICK:
+					requiredOperands = 1;
+					break;
+				case HANDLER_OP_JMP:
+				case HANDLER_OP_BRCMP:
+				case HANDLER_OP_BRTST:
+					// The only way back is the branch that closes the loop;
+					// everything else has to leave it.
+					if (instruction.operandCount > 0 && i != branch && params[0] >= head && params[0] <= branch)
+						return false;
+					requiredOperands = 1 + (instruction.handler == HANDLER_OP_BRCMP ? 2 : instruction.handler == HANDLER_OP_BRTST ? 1 : 0);
+					readCount = requiredOperands - 1;
+					writes = false;
+					break;
+				default:
+					return false;
+			}
+			if (instruction.operandCount < requiredOperands) return false;
+
+			// Branches read from the second operand on, everything else
+			// writes the first and reads the ones after it.
+			for (unsigned j = 0; j < readCount; j++)
+				reads[j] = params[1 + j];
+
+			for (unsigned j = 0; j < readCount; j++)
+			{
+				if (!isScalar(reads[j])) return false;
+				if (pass == 1 && writtenInLoop[reads[j]] && !writtenSoFar[reads[j]]) return false;
+			}
+			if (writes)
+			{
+				if (!isScalar(params[0])) return false;
+				if (pass == 0) writtenInLoop[params[0]] = true;
+				else writtenSoFar[params[0]] = true;
+			}
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,59 @@
+#pragma once
+/*
+ *  PollingLoops.h
+ *  mindstormssimulation
+ *
+ *  Created by agent on 18.10.26
+ *  Copyright 2026 RWTH Aachen University All rights reserved.
+ *
+ */
+
+#include <vector>
+#include <stdint.h>
+
+class DecodedProgram;
+class RXEFile;
+
+/*!
+ * @abstract Finds the loops in a program that only wait for an input.
+ * @discussion Programs spend most of their time in loops like
+ * while (SENSOR_1 == 0); or until (CurrentTick() > end);, which read a
+ * sensor, motor or the tick, compare it and branch back. If nothing they read
+ * has changed, another round does exactly the same as the last one, so
+ * there is no point in running it.
+ *
+ * A loop is a branch back to an earlier instruction. It counts as a polling
+ * loop if everything from the target to the branch runs in a straight line,
+ * except for branches out of the loop, and only does arithmetic, comparisons
+ * and moves on scalars, OP_GETIN of the scaled value or invalid data flag,
+ * OP_GETOUT and OP_GETTICK. Also, anything the loop writes has to be written
+ * before it is read in the same round, so the values it leaves behind only
+ * depend on the inputs and on memory that it does not change itself.
+ *
+ * The Interpreter parks a clump once it takes the branch back of such a loop,
+ * until something the loop reads could have changed.
+ */
+class PollingLoops
+{
+	const RXEFile *file;
+	const DecodedProgram *program;
+	std::vector<uint8_t> backEdges;
+	unsigned count;
+
+	bool isScalar(unsigned entry) const;
+	bool isPollingLoop(unsigned head, unsigned branch) const;
+
+public:
+	/*!
+	 * @abstract Finds the polling loops of a program.
+	 * @param file The RXE file.
+	 * @param program The program decoded from that file.
+	 */
+	PollingLoops(const RXEFile *file, const DecodedProgram *program);
+
+	/*! Whether the instruction at index is the branch back of a polling loop. */
+	bool closesLoop(unsigned index) const { return backEdges[index] != 0; }
+
+	/*! Number of polling loops in the program. */
+	unsigned getCount() const { return count; }
+};
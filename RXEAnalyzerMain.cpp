@@ -7,77 +7,531 @@
  *
  */
 
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <string>
+#include <vector>
 
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#include "ControlFlowGraph.h"
+#include "DecodedProgram.h"
+#include "Environment.h"
+#include "ExecutionContext.h"
+#include "HeadlessRun.h"
 #include "Interpreter.h"
+#include "InterpreterOpcodes.h"
+#include "InterpreterProfile.h"
+#include "PollingLoops.h"
 #include "RXEFile.h"
+#include "RXETranslator.h"
+#include "RXEVerifier.h"
+#include "ThreadPool.h"
 #include "VMMemory.h"
 
+/*!
+ * @abstract The numbers that matter for deciding what to do with a program.
+ */
+struct Summary
+{
+	std::string filename;
+	/*! Empty if the program could be analysed, otherwise why not. */
+	std::string error;
+	unsigned instructions;
+	unsigned clumps;
+	unsigned blocks;
+	unsigned unreachableBlocks;
+	unsigned loops;
+	unsigned pollingLoops;
+	unsigned verifierErrors;
+	uint64_t cost;
+	uint64_t weightedCost;
+	/*! Cost of the most expensive loop that is not a polling loop. */
+	unsigned busiestLoopCost;
+};
+
 void printUsageAndExit()
 {
 	std::cout << "Generates statistics from RXE files." << std::endl;
-	std::cout << "Usage: RXEAnalyzer inputfile" << std::endl;
+	std::cout << "Usage: RXEAnalyzer [--json] inputfile" << std::endl;
+	std::cout << "       RXEAnalyzer --scan [--json] [--jobs=n] file-or-directory ..." << std::endl;
+	std::cout << "       RXEAnalyzer --translate inputfile output.cpp" << std::endl;
+	std::cout << "       RXEAnalyzer --profile [--json] [--time=seconds] inputfile" << std::endl;
+	std::cout << "The first form lists the data, the code and the control flow of a program." << std::endl;
+	std::cout << "The second form summarises many programs, one line each. Directories are" << std::endl;
+	std::cout << "searched for .rxe files, including all subdirectories. The programs are" << std::endl;
+	std::cout << "analysed on n threads, by default one per hardware thread." << std::endl;
+	std::cout << "The third form translates the program to C++ instead, to be compiled" << std::endl;
+	std::cout << "into a shared library and run with clisimulator --native." << std::endl;
+	std::cout << "The fourth form runs the program in the default arena for the given" << std::endl;
+	std::cout << "simulated time (default 60 s) and prints where it spent its time." << std::endl;
 	exit(0);
 }
 
-void printComp(unsigned code)
+void printComp(std::ostream &stream, unsigned code)
 {
 	switch(code)
 	{
 		case 0:
-			std::cout << "(<) ";
+			stream << "(<) ";
 			break;
 		case 1:
-			std::cout << "(>) ";
+			stream << "(>) ";
 			break;
 		case 2:
-			std::cout << "(<=) ";
+			stream << "(<=) ";
 			break;
 		case 3:
-			std::cout << "(>=) ";
+			stream << "(>=) ";
 			break;
 		case 4:
-			std::cout << "(==) ";
+			stream << "(==) ";
 			break;
 		case 5:
-			std::cout << "(!=) ";
+			stream << "(!=) ";
 			break;
 		default:
-			std::cout << "(?) ";
+			stream << "(?) ";
 			break;
 	}
 }
 
-void printArgument(unsigned arg, RXEFile *file, bool isImmediate=false)
+void printArgument(std::ostream &stream, unsigned arg, const RXEFile *file, bool isImmediate=false)
 {
-	std::cout << arg << " ";
-	
+	stream << arg << " ";
+
 	if (!isImmediate)
 	{
-		std::cout << "(";
-		if (arg == 0xFFFF) std::cout << "NOT_A_DS_ID";
-		else std::cout << file->nameForType(file->getTypeAtDSTOCIndex(arg));
-		std::cout << ") ";
+		stream << "(";
+		if (arg == 0xFFFF) stream << "NOT_A_DS_ID";
+		else if (arg >= file->getDSTOCCount()) stream << "INVALID";
+		else stream << file->nameForType(file->getTypeAtDSTOCIndex(arg));
+		stream << ") ";
+	}
+	stream << " ";
+}
+
+void printInstruction(std::ostream &stream, const RXEFile *file, const DecodedProgram &program, unsigned index)
+{
+	const DecodedProgram::Instruction &instruction = program.getInstruction(index);
+	const uint16_t *params = instruction.operands;
+	const uint16_t firstWord = file->getCode()[instruction.codeOffset];
+
+	stream << index << "\t" << instruction.codeOffset << "\t\t";
+	if (instruction.opcode == DecodedProgram::invalidOpcode)
+	{
+		stream << "INVALID " << firstWord;
+		return;
+	}
+
+	if (firstWord & (1 << 11))
+	{
+		// Short format. The operands have already been expanded to those of
+		// the long format.
+		switch ((firstWord & 0x0700) >> 8)
+		{
+			case 0:
+				stream << "SHORT_OP_MOV ";
+				printArgument(stream, params[0], file);
+				printArgument(stream, params[1], file);
+				break;
+			case 1:
+				stream << "SHORT_OP_ACQUIRE ";
+				printArgument(stream, params[0], file);
+				break;
+			case 2:
+				stream << "SHORT_OP_RELEASE ";
+				printArgument(stream, params[0], file);
+				break;
+			case 3:
+				stream << "SHORT_OP_SUBCALL ";
+				printArgument(stream, params[0], file, true); // Subroutine
+				printArgument(stream, params[1], file); // Caller ID
+				break;
+		}
+		return;
+	}
+
+	enum { ImmNone=0, ImmFirst=0x1, ImmLast=0x2, ImmBoth=0x3 } isImmediate = ImmNone;
+
+	stream << Interpreter::nameForOpcode(instruction.opcode) << " ";
+
+	// Special cases
+	switch (instruction.opcode)
+	{
+		case 0x11: // OP_CMP
+		case 0x12: // OP_TST
+			printComp(stream, instruction.flags);
+			break;
+		case 0x1C: // OP_SET
+		case 0x30: // OP_SETIN
+		case 0x32: // OP_GETIN
+		case 0x33: // OP_GETOUT
+			isImmediate = ImmLast;
+			break;
+		case 0x21: // OP_STRCAT
+		case 0x2B: // OP_FINCLUMPIMMED
+		case 0x2E: // OP_SUBCALL
+		case 0x28: // OP_SYSCALL
+		case 0x31: // OP_SETOUT
+			isImmediate = ImmFirst;
+			break;
+		case 0x26: // OP_BRCMP
+		case 0x27: // OP_BRTST
+			printComp(stream, instruction.flags);
+			break;
+		case 0x2A: // OP_FINCLUMP
+			isImmediate = ImmBoth;
+			break;
+	}
+
+	unsigned first = 0;
+	if (DecodedProgram::isBranch(instruction.opcode) && instruction.operandCount > 0)
+	{
+		// The offset is already resolved to the instruction it goes to.
+		stream << "-> ";
+		if (params[0] < program.getInstructionCount()) stream << "pc " << params[0] << " ";
+		else stream << "end ";
+		first = 1;
+	}
+
+	const unsigned count = instruction.operandCount;
+	for (unsigned i = first; i < count; i++)
+		printArgument(stream, params[i], file, (i == 0 && (isImmediate & ImmFirst)) || (i == (count-1) && (isImmediate & ImmLast)));
+}
+
+void writeJSONString(std::ostream &stream, const std::string &string)
+{
+	stream << "\"";
+	for (std::string::const_iterator iter = string.begin(); iter != string.end(); ++iter)
+	{
+		if (*iter == '"' || *iter == '\\') stream << '\\' << *iter;
+		else if (unsigned(*iter) < 0x20)
+		{
+			char escaped[8];
+			sprintf(escaped, "\\u%04x", unsigned(*iter));
+			stream << escaped;
+		}
+		else stream << *iter;
+	}
+	stream << "\"";
+}
+
+Summary summarize(const RXEFile *file, const DecodedProgram &program, const ControlFlowGraph &graph)
+{
+	Summary summary;
+	summary.instructions = program.getInstructionCount();
+	summary.clumps = file->getClumpCount();
+	summary.blocks = graph.getBlockCount();
+	summary.unreachableBlocks = graph.getUnreachableCount();
+	summary.loops = unsigned(graph.getLoops().size());
+	summary.pollingLoops = 0;
+	summary.busiestLoopCost = 0;
+	for (unsigned i = 0; i < graph.getLoops().size(); i++)
+	{
+		const ControlFlowGraph::Loop &loop = graph.getLoops()[i];
+		if (loop.isPolling) summary.pollingLoops++;
+		else summary.busiestLoopCost = std::max(summary.busiestLoopCost, loop.cost);
+	}
+	summary.verifierErrors = unsigned(RXEVerifier(file, &program).getErrors().size());
+	summary.cost = 0;
+	summary.weightedCost = 0;
+	for (unsigned i = 0; i < file->getClumpCount(); i++)
+	{
+		summary.cost += graph.getCostForClump(i);
+		summary.weightedCost += graph.getWeightedCostForClump(i);
+	}
+	return summary;
+}
+
+Summary summarize(const std::string &filename)
+{
+	Summary summary = Summary();
+	try
+	{
+		RXEFile file(filename.c_str());
+		DecodedProgram program(&file);
+		ControlFlowGraph graph(&file, &program);
+		summary = summarize(&file, program, graph);
+	}
+	catch (std::exception &e)
+	{
+		summary.error = e.what();
+	}
+	summary.filename = filename;
+	return summary;
+}
+
+void writeSummaryJSON(std::ostream &stream, const Summary &summary, const char *indent)
+{
+	stream << indent << "\"file\": ";
+	writeJSONString(stream, summary.filename);
+	if (!summary.error.empty())
+	{
+		stream << "," << std::endl << indent << "\"error\": ";
+		writeJSONString(stream, summary.error);
+		return;
+	}
+	stream << "," << std::endl;
+	stream << indent << "\"instructions\": " << summary.instructions << "," << std::endl;
+	stream << indent << "\"clumps\": " << summary.clumps << "," << std::endl;
+	stream << indent << "\"blocks\": " << summary.blocks << "," << std::endl;
+	stream << indent << "\"unreachableBlocks\": " << summary.unreachableBlocks << "," << std::endl;
+	stream << indent << "\"loops\": " << summary.loops << "," << std::endl;
+	stream << indent << "\"pollingLoops\": " << summary.pollingLoops << "," << std::endl;
+	stream << indent << "\"verified\": " << (summary.verifierErrors == 0 ? "true" : "false") << "," << std::endl;
+	stream << indent << "\"verifierErrors\": " << summary.verifierErrors << "," << std::endl;
+	stream << indent << "\"cost\": " << summary.cost << "," << std::endl;
+	stream << indent << "\"weightedCost\": " << summary.weightedCost << "," << std::endl;
+	stream << indent << "\"busiestLoopCost\": " << summary.busiestLoopCost;
+}
+
+bool isDirectory(const std::string &path)
+{
+#ifdef _WIN32
+	DWORD attributes = GetFileAttributesA(path.c_str());
+	return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+#else
+	struct stat info;
+	return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+#endif
+}
+
+bool isProgramName(const std::string &name)
+{
+	if (name.size() < 4) return false;
+	std::string extension = name.substr(name.size() - 4);
+	for (unsigned i = 0; i < extension.size(); i++)
+		extension[i] = char(tolower(extension[i]));
+	return extension == ".rxe";
+}
+
+void findPrograms(const std::string &path, std::vector<std::string> &programs)
+{
+	if (!isDirectory(path))
+	{
+		programs.push_back(path);
+		return;
+	}
+
+	// Sorted, so that the results come out in the same order every time.
+	std::vector<std::string> names;
+#ifdef _WIN32
+	WIN32_FIND_DATAA data;
+	HANDLE find = FindFirstFileA((path + "\\*").c_str(), &data);
+	if (find == INVALID_HANDLE_VALUE) return;
+	do
+		names.push_back(data.cFileName);
+	while (FindNextFileA(find, &data));
+	FindClose(find);
+	const char separator = '\\';
+#else
+	DIR *directory = opendir(path.c_str());
+	if (!directory) return;
+	while (struct dirent *entry = readdir(directory))
+		names.push_back(entry->d_name);
+	closedir(directory);
+	const char separator = '/';
+#endif
+	std::sort(names.begin(), names.end());
+
+	for (std::vector<std::string>::const_iterator iter = names.begin(); iter != names.end(); ++iter)
+	{
+		if (*iter == "." || *iter == "..") continue;
+		std::string child = path + separator + *iter;
+		if (isDirectory(child)) findPrograms(child, programs);
+		else if (isProgramName(*iter)) programs.push_back(child);
+	}
+}
+
+int scan(int argc, char *argv[])
+{
+	bool json = false;
+	unsigned threadCount = 0;
+	std::vector<std::string> programs;
+	for (int i = 0; i < argc; i++)
+	{
+		unsigned value;
+		if (strcmp(argv[i], "--json") == 0)
+			json = true;
+		else if (sscanf(argv[i], "--jobs=%u", &value) == 1)
+			threadCount = value;
+		else if (argv[i][0] != '-')
+			findPrograms(argv[i], programs);
+		else
+			printUsageAndExit();
+	}
+
+	// Every task writes only its own entry.
+	std::vector<Summary> summaries(programs.size());
+	{
+		ThreadPool pool(threadCount);
+		for (unsigned i = 0; i < programs.size(); i++)
+		{
+			Summary *summary = &summaries[i];
+			const std::string *filename = &programs[i];
+			pool.submit([summary, filename]() { *summary = summarize(*filename); });
+		}
+		pool.waitUntilDone();
 	}
-	std::cout << " ";
+
+	int result = 0;
+	if (json)
+	{
+		std::cout << "[";
+		for (unsigned i = 0; i < summaries.size(); i++)
+		{
+			std::cout << (i > 0 ? "," : "") << std::endl << "\t{" << std::endl;
+			writeSummaryJSON(std::cout, summaries[i], "\t\t");
+			std::cout << std::endl << "\t}";
+			if (!summaries[i].error.empty()) result = 1;
+		}
+		std::cout << std::endl << "]" << std::endl;
+		return result;
+	}
+
+	std::cout << "instr\tclumps\tblocks\tunreach\tloops\tpolling\tverified\tcost\tweighted\tbusiest\tfile" << std::endl;
+	for (unsigned i = 0; i < summaries.size(); i++)
+	{
+		const Summary &summary = summaries[i];
+		if (!summary.error.empty())
+		{
+			std::cout << "error: " << summary.error << "\t\t\t\t\t\t\t\t\t\t" << summary.filename << std::endl;
+			result = 1;
+			continue;
+		}
+		std::cout << summary.instructions << "\t" << summary.clumps << "\t" << summary.blocks << "\t";
+		std::cout << summary.unreachableBlocks << "\t" << summary.loops << "\t" << summary.pollingLoops << "\t";
+		std::cout << (summary.verifierErrors == 0 ? "yes" : "no") << "\t\t" << summary.cost << "\t";
+		std::cout << summary.weightedCost << "\t\t" << summary.busiestLoopCost << "\t" << summary.filename << std::endl;
+	}
+	return result;
+}
+
+int translate(const char *inputFilename, const char *outputFilename)
+{
+	try
+	{
+		RXEFile file(inputFilename);
+		DecodedProgram program(&file);
+		RXETranslator translator(&file, &program);
+
+		std::ofstream output(outputFilename);
+		if (!output) throw std::runtime_error("Could not write output file.");
+		translator.write(output, inputFilename);
+
+		std::cout << "Translated " << translator.getTranslatedCount() << " of " << program.getInstructionCount() << " instructions." << std::endl;
+	}
+	catch (std::runtime_error &e)
+	{
+		std::cerr << "Error translating " << inputFilename << ": " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+int profile(int argc, char *argv[])
+{
+	bool json = false;
+	float seconds = 60.0f;
+	const char *inputFilename = 0;
+	for (int i = 0; i < argc; i++)
+	{
+		float value;
+		if (strcmp(argv[i], "--json") == 0)
+			json = true;
+		else if (sscanf(argv[i], "--time=%f", &value) == 1 && value > 0.0f)
+			seconds = value;
+		else if (argv[i][0] != '-' && !inputFilename)
+			inputFilename = argv[i];
+		else
+			printUsageAndExit();
+	}
+	if (!inputFilename) printUsageAndExit();
+
+	Environment *arena = HeadlessRun::createDefaultArena();
+	int result = 0;
+	try
+	{
+		HeadlessRun run(inputFilename, arena);
+		std::vector<HeadlessRun::Sample> noTrace;
+		run.run(seconds, 0.0f, noTrace);
+
+		const InterpreterProfile *profile = run.getContext()->getProfile();
+		if (!profile)
+		{
+			std::cerr << "RXEAnalyzer was compiled without INTERPRETER_PROFILING." << std::endl;
+			result = 1;
+		}
+		else if (json)
+			profile->writeJSON(std::cout);
+		else
+			profile->writeText(std::cout);
+	}
+	catch (std::runtime_error &e)
+	{
+		std::cerr << "Error profiling " << inputFilename << ": " << e.what() << std::endl;
+		result = 1;
+	}
+	delete arena;
+	return result;
+}
+
+int describeAsJSON(const RXEFile *file, const char *filename)
+{
+	DecodedProgram program(file);
+	ControlFlowGraph graph(file, &program);
+	Summary summary = summarize(file, program, graph);
+	summary.filename = filename;
+
+	std::cout << "{" << std::endl;
+	writeSummaryJSON(std::cout, summary, "\t");
+	std::cout << "," << std::endl << "\t\"controlFlow\": ";
+	graph.writeJSON(std::cout);
+	std::cout << "}" << std::endl;
+	return 0;
 }
 
 int main(int argc, char *argv[])
 {
-	if (argc != 2) printUsageAndExit();
-	
+	if (argc == 4 && strcmp(argv[1], "--translate") == 0)
+		return translate(argv[2], argv[3]);
+	if (argc >= 3 && strcmp(argv[1], "--profile") == 0)
+		return profile(argc - 2, argv + 2);
+	if (argc >= 3 && strcmp(argv[1], "--scan") == 0)
+		return scan(argc - 2, argv + 2);
+	bool json = argc == 3 && strcmp(argv[1], "--json") == 0;
+	if (argc != 2 && !json) printUsageAndExit();
+	const char *filename = argv[argc - 1];
+
 	RXEFile *file;
-	
+
 	try
 	{
-		file = new RXEFile(argv[1]);
+		file = new RXEFile(filename);
 	}
-	catch (std::runtime_error a)
+	catch (std::runtime_error &a)
 	{
-		std::cerr << "Error opening file " << argv[1] << ": " << a.what() << std::endl;
+		std::cerr << "Error opening file " << filename << ": " << a.what() << std::endl;
 		exit(-1);
 	}
-	
+
+	if (json)
+	{
+		int result = describeAsJSON(file, filename);
+		delete file;
+		return result;
+	}
+
 	// Print out the static header data.
 	std::cout << "-- Static data --" << std::endl;
 	std::cout << "DSTOC Count:            " << file->getDSTOCCount() << std::endl;
@@ -91,146 +545,90 @@ int main(int argc, char *argv[])
 	std::cout << "Dope Vector Offset:     " << file->getDopeVectorOffset() << std::endl;
 	std::cout << "Clump Count:            " << file->getClumpCount() << std::endl;
 	std::cout << "Code Word Count:        " << file->getCodeWordCount() << std::endl;
-	
+
+	DecodedProgram program(file);
+	PollingLoops pollingLoops(file, &program);
+	RXEVerifier verifier(file, &program);
+	std::cout << "Instruction Count:      " << program.getInstructionCount() << std::endl;
+	std::cout << "Polling Loops:          " << pollingLoops.getCount() << std::endl;
+	std::cout << "Verified:               " << (verifier.isValid() ? "yes" : "no") << std::endl;
+
+	for (unsigned i = 0; i < verifier.getErrors().size(); i++)
+		std::cout << "\t" << verifier.getErrors()[i] << std::endl;
+
 	// Create memory
-	VMMemory *memory = new VMMemory(file);
-	
-	// Print out DSTOC and contents
-	std::cout << std::endl;
-	std::cout << "-- DSTOC --" << std::endl;
-	std::cout << "entry\ttype\tflags\tdesc\tcontents" << std::endl;
-	for (unsigned i = 0; i < file->getDSTOCCount(); i++)
-	{
-		std::cout << i << ":  \t" << file->nameForType(file->getTypeAtDSTOCIndex(i));
-		std::cout << "\t" << file->getFlagsAtDSTOCIndex(i) << "\t\t" << file->getDataDescriptorAtDSTOCIndex(i);
-		if (file->getTypeAtDSTOCIndex(i) != RXEFile::TC_CLUSTER)
-			std::cout << "\t\t" << memory->getScalarValue(i);
-		std::cout << std::endl;
+	VMMemory *memory = 0;
+	try
+	{
+		memory = new VMMemory(file);
 	}
-	
-	// Print out dope vectors
-	std::cout << std::endl;
-	std::cout << "-- Dope Vectors --" << std::endl;
-	std::cout << "entry\toffset\tsize\tcount\tlink" << std::endl;
-	for (unsigned i = 0; i < memory->getArrayLength(0); i++)
+	catch (std::runtime_error &e)
 	{
-		std::cout << i << ":\t\t";
-//		std::cout << memory->getArrayLength(i) << "\t\t";
+		std::cout << std::endl << "Memory can not be set up: " << e.what() << std::endl;
+	}
+
+	if (memory)
+	{
+		// Print out DSTOC and contents
+		std::cout << std::endl;
+		std::cout << "-- DSTOC --" << std::endl;
+		std::cout << "entry\ttype\tflags\tdesc\tcontents" << std::endl;
+		for (unsigned i = 0; i < file->getDSTOCCount(); i++)
+		{
+			std::cout << i << ":  \t" << file->nameForType(file->getTypeAtDSTOCIndex(i));
+			std::cout << "\t" << file->getFlagsAtDSTOCIndex(i) << "\t\t" << file->getDataDescriptorAtDSTOCIndex(i);
+			if (file->getTypeAtDSTOCIndex(i) != RXEFile::TC_CLUSTER)
+				std::cout << "\t\t" << memory->getScalarValue(i);
+			std::cout << std::endl;
+		}
+
+		// Print out dope vectors
 		std::cout << std::endl;
+		std::cout << "-- Dope Vectors --" << std::endl;
+		std::cout << "entry\toffset\tsize\tcount\tlink" << std::endl;
+		for (unsigned i = 0; i < memory->getDopeVectorCount(); i++)
+		{
+			VMMemory::ArrayLayout layout = memory->getArrayLayout(i);
+			std::cout << i << ":\t\t";
+			std::cout << layout.offset << "\t" << layout.elementSize << "\t" << layout.elementCount << "\t";
+			if (layout.link == 0xFFFF) std::cout << "-";
+			else std::cout << layout.link;
+			std::cout << std::endl;
+		}
 	}
-	
+
 	// Print out clump data
 	std::cout << std::endl;
 	std::cout << "-- Clump data --" << std::endl;
-	std::cout << "entry\tfc\tcs\tdependents" << std::endl;
+	std::cout << "entry\tfc\tcs\tpc\tdependents" << std::endl;
 	for (unsigned i = 0; i < file->getClumpCount(); i++)
 	{
 		std::cout << i << ":\t\t";
 		std::cout << file->getFireCountForClump(i) << "\t";
 		std::cout << file->getCodeStartForClump(i) << "\t";
+		std::cout << program.getStartForClump(i) << "\t";
 		for (unsigned j = 0; j < file->getDependentCountForClump(i); j++)
-			std::cout << file->getDependentsForClump(i)[j];
+			std::cout << (j > 0 ? " " : "") << unsigned(file->getDependentsForClump(i)[j]);
 		std::cout << std::endl;
 	}
-	
+
 	// Print out code
 	std::cout << std::endl;
 	std::cout << "-- Code --" << std::endl;
 	std::cout << "pc\tword\tDisassembled" << std::endl;
-	const uint16_t *code = file->getCode();
-	unsigned codeWord = 0;
-	unsigned instruction = 0;
-	while (codeWord < file->getCodeWordCount())
+	for (unsigned i = 0; i < program.getInstructionCount(); i++)
 	{
-		std::cout << instruction << "\t" << codeWord << "\t\t";
-		if (code[codeWord] & (1 << 11))
-		{
-			// Short format
-			unsigned opcode = (code[codeWord] & 0x0700) >> 8;
-			int argDiff = (int8_t) (code[codeWord] & 0xFF);
-			switch(opcode)
-			{
-				case 0:
-					std::cout << "SHORT_OP_MOV ";
-					printArgument(argDiff + code[codeWord + 1], file);
-					printArgument(code[codeWord + 1], file);
-					codeWord += 2;
-					break;
-				case 1:
-					std::cout << "SHORT_OP_ACQUIRE ";
-					printArgument(argDiff, file);
-					codeWord += 1;
-					break;
-				case 2:
-					std::cout << "SHORT_OP_RELEASE ";
-					printArgument(argDiff, file);
-					codeWord += 1;
-					break;
-				case 3:
-					std::cout << "SHORT_OP_SUBCALL ";
-					printArgument(argDiff + code[codeWord + 1], file, true); // Subroutine
-					printArgument(code[codeWord + 1], file); // Caller ID
-					codeWord += 2;
-					break;
-			}
-		}
-		else
-		{
-			// Long format
-			unsigned opcode = code[codeWord] & 0x00FF;
-			// You’d think it’d be the other way around, but Lego’s documentation
-			// tries to account for endianess and gets it all wrong.
-			unsigned size = (code[codeWord] & 0xF000) >> 12;
-			unsigned flags = (code[codeWord] & 0x0F00) >> 8;
-			
-			enum { ImmNone=0, ImmFirst=0x1, ImmLast=0x2, ImmBoth=0x3 } isImmediate = ImmNone;
-			
-			std::cout << Interpreter::nameForOpcode(opcode) << " ";
-			
-			// Special cases
-			switch (opcode)
-			{
-				case 0x11: // OP_CMP
-				case 0x12: // OP_TST
-					printComp(flags);
-					break;
-				case 0x1C: // OP_SET
-				case 0x30: // OP_SETIN
-				case 0x32: // OP_GETIN
-				case 0x33: // OP_GETOUT
-					isImmediate = ImmLast;
-					break;
-				case 0x21: // OP_STRCAT
-				case 0x25: // OP_JMP
-				case 0x2B: // OP_FINCLUMPIMMED
-				case 0x2E: // OP_SUBCALL
-				case 0x28: // OP_SYSCALL
-				case 0x31: // OP_SETOUT
-					isImmediate = ImmFirst;
-					break;
-				case 0x26: // OP_BRCMP
-				case 0x27: // OP_BRTST
-					printComp(flags);
-					isImmediate = ImmFirst;
-					break;
-				case 0x2A: // OP_FINCLUMP
-					isImmediate = ImmBoth;
-					break;
-			}
-			if (size == 0xE) size = code[codeWord+1];
-			size /= 2;
-			
-			for (unsigned i = 1; i < size; i++)
-				printArgument(code[codeWord+i], file, (i == 1 && (isImmediate & ImmFirst)) || (i == (size-1) && (isImmediate & ImmLast)));
-			
-			codeWord += size;
-		}
-		instruction += 1;
+		printInstruction(std::cout, file, program, i);
 		std::cout << std::endl;
 	}
-	
+
+	// Print out control flow
+	std::cout << std::endl;
+	ControlFlowGraph graph(file, &program);
+	graph.writeText(std::cout);
+
 	delete memory;
 	delete file;
-	
+
 	return 0;
-}
\ No newline at end of file
+}
@@ -10,14 +10,62 @@
 #include "RXEFile.h"
 
 #include <fstream>
+#include <istream>
+#include <streambuf>
 
 #include "ByteOrder.h"
 
+namespace
+{
+	// Lets the stream based reading code work on data that is already in
+	// memory (for example mapped by the RXEFileCache) without copying it.
+	class MemoryStreamBuffer : public std::streambuf
+	{
+	public:
+		MemoryStreamBuffer(const char *data, size_t length)
+		{
+			char *start = const_cast<char *>(data);
+			setg(start, start, start + length);
+		}
+		
+	protected:
+		virtual pos_type seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode which)
+		{
+			char *target;
+			if (direction == std::ios_base::beg) target = eback() + offset;
+			else if (direction == std::ios_base::cur) target = gptr() + offset;
+			else target = egptr() + offset;
+			
+			if (target < eback() || target > egptr()) return pos_type(off_type(-1));
+			setg(eback(), target, egptr());
+			return pos_type(target - eback());
+		}
+		
+		virtual pos_type seekpos(pos_type position, std::ios_base::openmode which)
+		{
+			return seekoff(off_type(position), std::ios_base::beg, which);
+		}
+	};
+}
+
 RXEFile::RXEFile(const char *filename) throw(std::runtime_error)
 {
 	std::ifstream file(filename, std::ios::binary);
 	if (!file) throw std::runtime_error("Could not open RXE file.");
 	
+	read(file);
+}
+
+RXEFile::RXEFile(const void *data, size_t length) throw(std::runtime_error)
+{
+	MemoryStreamBuffer buffer(reinterpret_cast<const char *>(data), length);
+	std::istream stream(&buffer);
+	
+	read(stream);
+}
+
+void RXEFile::read(std::istream &file) throw(std::runtime_error)
+{
 	// Read Header Data
 	char formatstring[16];
 	char expectedFormatString[16] = {'M', 'i', 'n', 'd', 's', 't', 'o', 'r', 'm', 's', 'N', 'X', 'T', 0, 0, 5 };
@@ -83,6 +131,7 @@ RXEFile::RXEFile(const char *filename) throw(std::runtime_error)
 		file.read(reinterpret_cast<char *>(clumpData[i].dependents), clumpData[i].dependentCount);
 		if (!file.good()) throw std::runtime_error("Unexpected end of file (in clump dependents data).");
 	}
+	delete [] clumpDataBytes;
 	
 	// Next up: Actual code.
 	code = new uint16_t [codeWordCount];
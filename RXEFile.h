@@ -8,6 +8,7 @@
  *
  */
 
+#include <iosfwd>
 #include <stdexcept>
 #include <stdint.h>
 
@@ -21,8 +22,9 @@
  * 3. The actual executable bytecode.
  * 
  * It is an immutable object, you cannot alter it once all data has been loaded.
- * There ought to be no problem accessing it in parallel from multiple threads,
- * but this is not done in this program.
+ * It can be read in parallel from multiple threads, which the batch runner
+ * does, and is shared between all users of the same program through the
+ * RXEFileCache.
  */
 
 #ifdef _MSC_VER
@@ -70,6 +72,11 @@ class RXEFile
 	uint8_t *defaultData;
 	ClumpData *clumpData;
 	uint16_t *code;
+	
+	void read(std::istream &file) throw(std::runtime_error);
+	
+	RXEFile(const RXEFile &);
+	RXEFile &operator=(const RXEFile &);
 public:
 	/*!
 	 * @abstract A datatype used in the dataspace table of contents (DSTOC)
@@ -125,6 +132,15 @@ public:
 	 */
 	RXEFile(const char *filename) throw(std::runtime_error);
 	
+	/*!
+	 * @abstract Constructs an RXE File object from data in memory.
+	 * @param data The contents of an RXE file. They are copied, the data can
+	 * be released after this method returns.
+	 * @param length The length of data in bytes.
+	 * @throws std::runtime_error if the data is corrupt in some way.
+	 */
+	RXEFile(const void *data, size_t length) throw(std::runtime_error);
+	
 	/*!
 	 * @abstract Destructor
 	 */
@@ -0,0 +1,226 @@
+/*
+ *  RXEFileCache.cpp
+ *  mindstormssimulation
+ *
+ *  Created by agent on 18.10.26
+ *  Copyright 2026 RWTH Aachen University All rights reserved.
+ *
+ */
+
+#include "RXEFileCache.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "RXEFile.h"
+
+namespace
+{
+	// The contents of a file, mapped into memory for as long as the object
+	// exists.
+	class MappedFile
+	{
+#ifdef _WIN32
+		HANDLE file;
+		HANDLE mapping;
+#else
+		int file;
+#endif
+		const void *data;
+		uint64_t length;
+
+		MappedFile(const MappedFile &);
+		MappedFile &operator=(const MappedFile &);
+
+	public:
+		MappedFile(const char *path, uint64_t size) throw(std::runtime_error);
+		~MappedFile();
+
+		const void *getData() const { return data; }
+		uint64_t getLength() const { return length; }
+	};
+
+#ifdef _WIN32
+	MappedFile::MappedFile(const char *path, uint64_t size) throw(std::runtime_error)
+	: mapping(NULL), data(NULL), length(size)
+	{
+		file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE) throw std::runtime_error("Could not open RXE file.");
+		if (length == 0) return;
+
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping) data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if (!data)
+		{
+			if (mapping) CloseHandle(mapping);
+			CloseHandle(file);
+			throw std::runtime_error("Could not map RXE file.");
+		}
+	}
+
+	MappedFile::~MappedFile()
+	{
+		if (data) UnmapViewOfFile(data);
+		if (mapping) CloseHandle(mapping);
+		CloseHandle(file);
+	}
+#else
+	MappedFile::MappedFile(const char *path, uint64_t size) throw(std::runtime_error)
+	: data(NULL), length(size)
+	{
+		file = open(path, O_RDONLY);
+		if (file < 0) throw std::runtime_error("Could not open RXE file.");
+		if (length == 0) return;
+
+		void *mapped = mmap(NULL, size_t(length), PROT_READ, MAP_PRIVATE, file, 0);
+		if (mapped == MAP_FAILED)
+		{
+			close(file);
+			throw std::runtime_error("Could not map RXE file.");
+		}
+		data = mapped;
+	}
+
+	MappedFile::~MappedFile()
+	{
+		if (data) munmap(const_cast<void *>(data), size_t(length));
+		close(file);
+	}
+#endif
+
+	// FNV-1a, 64 bit. Only used to find programs that might be the same
+	// file; two files with the same hash are compared byte for byte before
+	// they are shared.
+	uint64_t hashData(const void *data, uint64_t length)
+	{
+		const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data);
+		uint64_t hash = 14695981039346656037ULL;
+		for (uint64_t i = 0; i < length; i++)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ULL;
+		}
+		return hash;
+	}
+
+	std::string canonicalPath(const char *filename) throw(std::runtime_error)
+	{
+#ifdef _WIN32
+		char buffer[_MAX_PATH];
+		if (!_fullpath(buffer, filename, sizeof(buffer))) throw std::runtime_error("Could not open RXE file.");
+#else
+		char buffer[PATH_MAX];
+		if (!realpath(filename, buffer)) throw std::runtime_error("Could not open RXE file.");
+#endif
+		return std::string(buffer);
+	}
+}
+
+RXEFileCache RXEFileCache::sharedInstance;
+
+RXEFileCache *RXEFileCache::sharedCache()
+{
+	return &sharedInstance;
+}
+
+RXEFileCache::Program *RXEFileCache::findOrLoad(const char *path, uint64_t size) throw(std::runtime_error)
+{
+	MappedFile mapped(path, size);
+	uint64_t hash = hashData(mapped.getData(), mapped.getLength());
+
+	const uint8_t *data = reinterpret_cast<const uint8_t *>(mapped.getData());
+	for (std::vector<Program *>::iterator iter = programs.begin(); iter != programs.end(); ++iter)
+		if ((*iter)->contentHash == hash && (*iter)->size == size && memcmp(&(*iter)->contents[0], data, size_t(size)) == 0)
+			return *iter;
+
+	Program *program = new Program;
+	program->contentHash = hash;
+	program->size = size;
+	program->contents.assign(data, data + size_t(size));
+	program->references = 0;
+	try
+	{
+		program->file = new RXEFile(mapped.getData(), size_t(mapped.getLength()));
+	}
+	catch (std::runtime_error &)
+	{
+		delete program;
+		throw;
+	}
+	programs.push_back(program);
+	return program;
+}
+
+const RXEFile *RXEFileCache::acquire(const char *filename) throw(std::runtime_error)
+{
+	if (!filename) throw std::runtime_error("Filename is NULL");
+
+	std::string path = canonicalPath(filename);
+	struct stat status;
+	if (stat(path.c_str(), &status) != 0) throw std::runtime_error("Could not open RXE file.");
+	int64_t modificationTime = int64_t(status.st_mtime);
+	uint64_t size = uint64_t(status.st_size);
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	std::map<std::string, PathEntry>::iterator found = paths.find(path);
+	Program *program;
+	if (found != paths.end() && found->second.modificationTime == modificationTime && found->second.size == size)
+		program = found->second.program;
+	else
+	{
+		program = findOrLoad(path.c_str(), size);
+
+		PathEntry entry;
+		entry.modificationTime = modificationTime;
+		entry.size = size;
+		entry.program = program;
+		paths[path] = entry;
+	}
+
+	program->references++;
+	return program->file;
+}
+
+void RXEFileCache::release(const RXEFile *file)
+{
+	if (!file) return;
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	for (std::vector<Program *>::iterator iter = programs.begin(); iter != programs.end(); ++iter)
+	{
+		Program *program = *iter;
+		if (program->file != file) continue;
+
+		if (--program->references > 0) return;
+
+		for (std::map<std::string, PathEntry>::iterator path = paths.begin(); path != paths.end(); )
+		{
+			if (path->second.program == program) paths.erase(path++);
+			else ++path;
+		}
+		programs.erase(iter);
+		delete program->file;
+		delete program;
+		return;
+	}
+}
+
+unsigned RXEFileCache::getProgramCount()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return unsigned(programs.size());
+}
@@ -0,0 +1,92 @@
+#pragma once
+/*
+ *  RXEFileCache.h
+ *  mindstormssimulation
+ *
+ *  Created by agent on 18.10.26
+ *  Copyright 2026 RWTH Aachen University All rights reserved.
+ *
+ */
+
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class RXEFile;
+
+/*!
+ * @abstract Process-wide cache of loaded programs.
+ * @discussion Loading the same program several times, for example for
+ * several robots or runs, gives the same RXEFile every time, so it is only
+ * parsed once and its code and DSTOC exist only once in memory. Files are
+ * found by their canonical path. If the modification time or size of a file
+ * has changed since it was loaded, it is read again (through a memory
+ * mapping, where the platform supports it) and identified by its contents,
+ * so a program that was only copied or touched is still shared.
+ * Programs that are still in use stay unchanged even if the file changes.
+ *
+ * The cache is reference counted: Every acquire has to be matched by a
+ * release, and the RXEFile is deleted with its last release. All methods
+ * can be called from any thread.
+ */
+class RXEFileCache
+{
+	struct Program
+	{
+		RXEFile *file;
+		uint64_t contentHash;
+		uint64_t size;
+		// A copy of the file, to tell files with the same hash apart.
+		std::vector<uint8_t> contents;
+		unsigned references;
+	};
+
+	struct PathEntry
+	{
+		int64_t modificationTime;
+		uint64_t size;
+		Program *program;
+	};
+
+	std::vector<Program *> programs;
+	std::map<std::string, PathEntry> paths;
+	std::mutex mutex;
+
+	static RXEFileCache sharedInstance;
+
+	RXEFileCache() {}
+	RXEFileCache(const RXEFileCache &);
+	RXEFileCache &operator=(const RXEFileCache &);
+
+	Program *findOrLoad(const char *path, uint64_t size) throw(std::runtime_error);
+
+public:
+	/*!
+	 * @abstract The cache used by everything in this process.
+	 */
+	static RXEFileCache *sharedCache();
+
+	/*!
+	 * @abstract Returns a loaded program, loading it if necessary.
+	 * @param filename The name of the RXE file.
+	 * @result The program. Owned by the cache; call release when done.
+	 * @throws std::runtime_error If the file can not be opened or is not a
+	 * valid RXE file.
+	 */
+	const RXEFile *acquire(const char *filename) throw(std::runtime_error);
+
+	/*!
+	 * @abstract Gives back a program returned by acquire.
+	 * @param file The program. It must not be used after this call. NULL is
+	 * ignored.
+	 */
+	void release(const RXEFile *file);
+
+	/*!
+	 * @abstract Number of different programs that are loaded right now.
+	 */
+	unsigned getProgramCount();
+};
@@ -0,0 +1,215 @@
+/*
+ *  RXETranslator.cpp
+ *  mindstormssimulation
+ *
+ *  Created by agent on 18.10.26
+ *  Copyright 2026 RWTH Aachen University All rights reserved.
+ *
+ */
+
+#include "RXETranslator.h"
+
+#include <ostream>
+#include <sstream>
+
+#include "DecodedProgram.h"
+#include "Interpreter.h"
+#include "InterpreterOpcodes.h"
+#include "NativeCode.h"
+#include "RXEFile.h"
+#include "RXEVerifier.h"
+
+RXETranslator::RXETranslator(const RXEFile *aFile, const DecodedProgram *aProgram) throw(std::runtime_error)
+: file(aFile), program(aProgram), pollingLoops(aFile, aProgram), translatedCount(0)
+{
+	RXEVerifier verifier(file, program);
+	if (!verifier.isValid())
+		throw std::runtime_error("Program did not pass verification: " + verifier.getErrors().front());
+}
+
+std::string RXETranslator::slot(unsigned entry) const
+{
+	std::ostringstream stream;
+	stream << "s[" << entry << "]";
+	return stream.str();
+}
+
+std::string RXETranslator::store(unsigned entry, const std::string &value) const
+{
+	// The same conversion that VMMemory::setScalarValue does, but with the
+	// type known in advance.
+	std::string converted;
+	switch (file->getTypeAtDSTOCIndex(entry))
+	{
+		case RXEFile::TC_UBYTE: converted = "(int32_t) (uint8_t) (" + value + ")"; break;
+		case RXEFile::TC_SBYTE: converted = "(int32_t) (int8_t) (" + value + ")"; break;
+		case RXEFile::TC_UWORD: converted = "(int32_t) (uint16_t) (" + value + ")"; break;
+		case RXEFile::TC_SWORD: converted = "(int32_t) (int16_t) (" + value + ")"; break;
+		case RXEFile::TC_FLOAT: converted = "(int32_t) (float) (" + value + ")"; break;
+		default: converted = "(int32_t) (" + value + ")"; break;
+	}
+	return "\t" + slot(entry) + " = " + converted + ";\n";
+}
+
+std::string RXETranslator::comparison(unsigned mode, const std::string &a, const std::string &b) const
+{
+	static const char *const operators[] = { "<", ">", "<=", ">=", "==", "!=" };
+	if (mode >= sizeof(operators)/sizeof(operators[0])) return std::string();
+	return "(" + a + " " + operators[mode] + " " + b + ")";
+}
+
+std::string RXETranslator::target(unsigned index) const
+{
+	if (index >= program->getInstructionCount()) return "end";
+	std::ostringstream stream;
+	stream << "i" << index;
+	return stream.str();
+}
+
+bool RXETranslator::isScalar(unsigned entry) const
+{
+	RXEFile::dstocType type = file->getTypeAtDSTOCIndex(entry);
+	return type != RXEFile::TC_VOID && type != RXEFile::TC_CLUSTER && type != RXEFile::TC_ARRAY;
+}
+
+bool RXETranslator::writeInstruction(std::ostream &stream, unsigned index) const
+{
+	const DecodedProgram::Instruction &instruction = program->getInstruction(index);
+	const uint16_t *params = instruction.operands;
+
+	// The interpreter parks clumps in polling loops, see PollingLoops.
+	if (pollingLoops.closesLoop(index)) return false;
+	
+	// Arithmetic is done on unsigned values where it could overflow, which
+	// gives the same wrapped result as the interpreter without relying on
+	// undefined behaviour. Division by -1 is negation for the same reason.
+	std::string code;
+	switch (instruction.handler)
+	{
+		case HANDLER_OP_ADD:
+			code = store(params[0], "(uint32_t) " + slot(params[1]) + " + (uint32_t) " + slot(params[2]));
+			break;
+		case HANDLER_OP_SUB:
+			code = store(params[0], "(uint32_t) " + slot(params[1]) + " - (uint32_t) " + slot(params[2]));
+			break;
+		case HANDLER_OP_NEG:
+			code = store(params[0], "0u - (uint32_t) " + slot(params[1]));
+			break;
+		case HANDLER_OP_MUL:
+			code = store(params[0], "(uint32_t) " + slot(params[1]) + " * (uint32_t) " + slot(params[2]));
+			break;
+		case HANDLER_OP_DIV:
+			code = store(params[0], slot(params[2]) + " == 0 ? 0 : " + slot(params[2]) + " == -1 ? (int32_t) (0u - (uint32_t) " + slot(params[1]) + ") : " + slot(params[1]) + " / " + slot(params[2]));
+			break;
+		case HANDLER_OP_MOD:
+			code = store(params[0], slot(params[2]) + " == 0 || " + slot(params[2]) + " == -1 ? 0 : " + slot(params[1]) + " % " + slot(params[2]));
+			break;
+		case HANDLER_OP_NOT:
+			code = store(params[0], "!" + slot(params[1]));
+			break;
+		case HANDLER_OP_CMP:
+		{
+			std::string condition = comparison(instruction.flags, slot(params[1]), slot(params[2]));
+			if (condition.empty()) return false;
+			code = store(params[0], condition);
+			break;
+		}
+		case HANDLER_OP_TST:
+		{
+			std::string condition = comparison(instruction.flags, slot(params[1]), "0");
+			if (condition.empty()) return false;
+			code = store(params[0], condition);
+			break;
+		}
+		case HANDLER_OP_MOV:
+			// Anything but scalars is up to the interpreter.
+			if (!isScalar(params[0]) || !isScalar(params[1])) return false;
+			code = store(params[0], slot(params[1]));
+			break;
+		case HANDLER_OP_SET:
+		{
+			std::ostringstream value;
+			value << params[1];
+			code = store(params[0], value.str());
+			break;
+		}
+		case HANDLER_OP_JMP:
+			stream << "\tgoto " << target(params[0]) << ";\n";
+			return true;
+		case HANDLER_OP_BRCMP:
+		case HANDLER_OP_BRTST:
+		{
+			std::string second = instruction.handler == HANDLER_OP_BRCMP ? slot(params[2]) : std::string("0");
+			std::string condition = comparison(instruction.flags, slot(params[1]), second);
+			if (condition.empty()) return false;
+			stream << "\tif " << condition << " goto " << target(params[0]) << ";\n";
+			break;
+		}
+		default:
+			return false;
+	}
+
+	stream << code;
+	if (instruction.next != index + 1)
+		stream << "\tgoto " << target(instruction.next) << ";\n";
+	return true;
+}
+
+void RXETranslator::write(std::ostream &stream, const std::string &programName)
+{
+	const unsigned count = program->getInstructionCount();
+
+	// Translate first, so the header can say how much was translated.
+	std::ostringstream body;
+	translatedCount = 0;
+	for (unsigned i = 0; i < count; i++)
+	{
+		const DecodedProgram::Instruction &instruction = program->getInstruction(i);
+		for (unsigned clump = 0; clump < file->getClumpCount(); clump++)
+			if (program->getStartForClump(clump) == i)
+				body << "\n\t// Clump " << clump << "\n";
+
+		body << "i" << i << ": // " << Interpreter::nameForOpcode(instruction.opcode) << ", word " << instruction.codeOffset << "\n";
+		body << "\tif (executed >= maxInstructions) { state->instruction = " << i << "; return executed; }\n";
+		body << "\texecuted++;\n";
+
+		if (writeInstruction(body, i))
+		{
+			translatedCount++;
+			continue;
+		}
+
+		// Hand it to the interpreter. It may continue anywhere.
+		body << "\tif (state->executeInInterpreter(state->interpreter, " << i << ", &next)) { state->instruction = next; return executed; }\n";
+		body << "\tgoto dispatch;\n";
+	}
+
+	stream << "/*\n";
+	stream << " * Translated from " << programName << " by RXEAnalyzer --translate.\n";
+	stream << " * " << translatedCount << " of " << count << " instructions run natively, the rest in the interpreter.\n";
+	stream << " * Compile into a shared library with the simulator's sources on the\n";
+	stream << " * include path, e.g. c++ -O2 -shared -fPIC -I<simulator> program.cpp -o program.so\n";
+	stream << " */\n\n";
+	stream << "#include \"NativeCodeInterface.h\"\n\n";
+
+	stream << "RXE_NATIVE_EXPORT const uint32_t rxe_native_version = RXE_NATIVE_VERSION;\n";
+	stream << "RXE_NATIVE_EXPORT const uint64_t rxe_native_program_hash = 0x" << std::hex << NativeCode::hashForProgram(file) << std::dec << "ULL;\n\n";
+
+	stream << "RXE_NATIVE_EXPORT uint32_t rxe_native_execute(struct RXENativeState *state, uint32_t maxInstructions)\n";
+	stream << "{\n";
+	stream << "\tint32_t *const s = state->slots;\n";
+	stream << "\tuint32_t executed = 0;\n";
+	stream << "\tuint32_t next = state->instruction;\n\n";
+	stream << "dispatch:\n";
+	stream << "\tswitch (next)\n";
+	stream << "\t{\n";
+	for (unsigned i = 0; i < count; i++)
+		stream << "\t\tcase " << i << ": goto i" << i << ";\n";
+	stream << "\t\tdefault: goto end;\n";
+	stream << "\t}\n";
+	stream << body.str();
+	stream << "\nend:\n";
+	stream << "\tstate->instruction = " << count << ";\n";
+	stream << "\treturn executed;\n";
+	stream << "}\n";
+}
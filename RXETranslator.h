@@ -0,0 +1,74 @@
+#pragma once
+/*
+ *  RXETranslator.h
+ *  mindstormssimulation
+ *
+ *  Created by agent on 18.10.26
+ *  Copyright 2026 RWTH Aachen University All rights reserved.
+ *
+ */
+
+#include <iosfwd>
+#include <stdexcept>
+#include <string>
+
+#include "PollingLoops.h"
+
+class DecodedProgram;
+class RXEFile;
+
+/*!
+ * @abstract Translates a program into C++ source.
+ * @discussion The result is one function, as described in
+ * NativeCodeInterface.h, in which every instruction is a label. Instructions
+ * that only work on scalars (arithmetic, comparisons, OP_MOV and OP_SET of
+ * scalars and branches) become plain statements on the memory slots, with
+ * the conversion to the type of the destination spelled out, and branches
+ * become gotos. Everything else is handed back to the interpreter,
+ * instruction by instruction, and execution continues wherever it left off.
+ * That includes the branches that close a PollingLoops loop, since the
+ * interpreter parks the clump there.
+ * Counting instructions and stopping at the budget works exactly like in the
+ * interpreter, so a translated program behaves the same, down to the memory
+ * contents after each slice.
+ *
+ * Compiled into a shared library, the source is loaded with NativeCode.
+ * Only programs that pass the RXEVerifier can be translated, since the
+ * translated code does not check its operands.
+ */
+class RXETranslator
+{
+	const RXEFile *file;
+	const DecodedProgram *program;
+	PollingLoops pollingLoops;
+	unsigned translatedCount;
+
+	std::string slot(unsigned entry) const;
+	std::string store(unsigned entry, const std::string &value) const;
+	std::string comparison(unsigned mode, const std::string &a, const std::string &b) const;
+	std::string target(unsigned index) const;
+	bool isScalar(unsigned entry) const;
+
+	// Writes the translation of an instruction, if it has one, and returns
+	// whether it did.
+	bool writeInstruction(std::ostream &stream, unsigned index) const;
+
+public:
+	/*!
+	 * @abstract Prepares the translation of a program.
+	 * @param file The program.
+	 * @param program The program decoded from that file.
+	 * @throws std::runtime_error If the program does not pass the RXEVerifier.
+	 */
+	RXETranslator(const RXEFile *file, const DecodedProgram *program) throw(std::runtime_error);
+
+	/*!
+	 * @abstract Writes the C++ source.
+	 * @param stream Where to write it.
+	 * @param programName Name of the program, for a comment at the top.
+	 */
+	void write(std::ostream &stream, const std::string &programName);
+
+	/*! Number of instructions translated directly by the last write. */
+	unsigned getTranslatedCount() const { return translatedCount; }
+};
@@ -0,0 +1,187 @@
+/*
+ *  RXEVerifier.cpp
+ *  mindstormssimulation
+ *
+ *  Created by agent on 18.10.26
+ *  Copyright 2026 RWTH Aachen University All rights reserved.
+ *
+ */
+
+#include "RXEVerifier.h"
+
+#include <sstream>
+
+#include "DecodedProgram.h"
+#include "Interpreter.h"
+#include "InterpreterOpcodes.h"
+#include "RXEFile.h"
+
+namespace
+{
+	const char *const operandsForHandler[HANDLER_COUNT] = {
+#define INTERPRETER_OPERANDS(name, opcode, handler, operands) operands,
+		INTERPRETER_OPCODES(INTERPRETER_OPERANDS)
+#undef INTERPRETER_OPERANDS
+		"."
+	};
+	
+	// NOT_A_DS_ID in the firmware.
+	const unsigned notAnEntry = 0xFFFF;
+}
+
+RXEVerifier::RXEVerifier(const RXEFile *aFile, const DecodedProgram *aProgram)
+: file(aFile), program(aProgram)
+{
+	for (unsigned i = 0; i < program->getInstructionCount(); i++)
+		verifyInstruction(i);
+	verifyClumps();
+}
+
+void RXEVerifier::addError(unsigned index, const std::string &message)
+{
+	const DecodedProgram::Instruction &instruction = program->getInstruction(index);
+	std::ostringstream stream;
+	stream << "Word " << instruction.codeOffset << " (" << Interpreter::nameForOpcode(instruction.opcode) << "): " << message;
+	errors.push_back(stream.str());
+}
+
+bool RXEVerifier::isReadable(unsigned entry) const
+{
+	if (entry >= file->getDSTOCCount()) return false;
+	RXEFile::dstocType type = file->getTypeAtDSTOCIndex(entry);
+	return type != RXEFile::TC_VOID && type != RXEFile::TC_CLUSTER;
+}
+
+bool RXEVerifier::isWritable(unsigned entry) const
+{
+	return isReadable(entry) && file->getTypeAtDSTOCIndex(entry) != RXEFile::TC_ARRAY;
+}
+
+void RXEVerifier::verifyInstruction(unsigned index)
+{
+	const DecodedProgram::Instruction &instruction = program->getInstruction(index);
+	if (instruction.opcode == DecodedProgram::invalidOpcode)
+	{
+		addError(index, "Instruction can not be decoded");
+		return;
+	}
+	if (instruction.handler == HANDLER_INVALID)
+	{
+		addError(index, "Unknown opcode");
+		return;
+	}
+	
+	const char *operands = operandsForHandler[instruction.handler];
+	const unsigned count = instruction.operandCount;
+	unsigned current = 0;
+	for (const char *kind = operands; *kind; kind++)
+	{
+		if (*kind == '.')
+			return;
+		
+		unsigned checkFrom = current;
+		unsigned step = 1;
+		unsigned offsetInStep = 0;
+		char checkAs = *kind;
+		if (*kind == '*')
+		{
+			checkAs = kind[-1];
+			current = count;
+		}
+		else if (*kind == 'p')
+		{
+			if ((count - current) % 2 != 0)
+			{
+				addError(index, "Property operands are not in pairs");
+				return;
+			}
+			checkAs = 'r';
+			step = 2;
+			offsetInStep = 1;
+			current = count;
+		}
+		else
+		{
+			if (current >= count)
+			{
+				addError(index, "Too few operands");
+				return;
+			}
+			current++;
+		}
+		
+		for (unsigned i = checkFrom + offsetInStep; i < current; i += step)
+		{
+			unsigned operand = instruction.operands[i];
+			std::ostringstream problem;
+			switch (checkAs)
+			{
+				case 'r':
+					if (!isReadable(operand)) problem << "Operand " << i << " is not a readable entry (" << operand << ")";
+					break;
+				case 'o':
+					if (operand != notAnEntry && !isReadable(operand)) problem << "Operand " << i << " is not a readable entry (" << operand << ")";
+					break;
+				case 'w':
+					if (!isWritable(operand)) problem << "Operand " << i << " is not a writable entry (" << operand << ")";
+					break;
+				case 'a':
+					if (operand >= file->getDSTOCCount() || file->getTypeAtDSTOCIndex(operand) != RXEFile::TC_ARRAY)
+						problem << "Operand " << i << " is not an array (" << operand << ")";
+					break;
+				case 'd':
+					if (operand >= file->getDSTOCCount()) problem << "Operand " << i << " is not a DSTOC entry (" << operand << ")";
+					break;
+				case 'n':
+					if (operand != 2 * (1 + count)) problem << "Size operand " << operand << " does not match instruction size " << 2 * (1 + count);
+					break;
+				case 'b':
+				{
+					// The decoded program maps all invalid targets to the end,
+					// so look at the original offset.
+					int target = int(instruction.codeOffset) + int16_t(file->getCode()[instruction.codeOffset + 1]);
+					if (operand >= program->getInstructionCount() && target != int(file->getCodeWordCount()))
+						problem << "Branch target " << target << " is not the start of an instruction";
+					break;
+				}
+				case 'c':
+					if (operand >= file->getClumpCount()) problem << "Operand " << i << " is not a clump (" << operand << ")";
+					break;
+				case 'm':
+					if (operand >= file->getDSTOCCount() || file->getTypeAtDSTOCIndex(operand) != RXEFile::TC_MUTEX)
+						problem << "Operand " << i << " is not a mutex (" << operand << ")";
+					break;
+				default:
+					break;
+			}
+			if (!problem.str().empty())
+				addError(index, problem.str());
+		}
+	}
+	
+	if (current != count)
+		addError(index, "Too many operands");
+}
+
+void RXEVerifier::verifyClumps()
+{
+	for (unsigned i = 0; i < file->getClumpCount(); i++)
+	{
+		if (program->getStartForClump(i) >= program->getInstructionCount())
+		{
+			std::ostringstream problem;
+			problem << "Clump " << i << " does not start at an instruction (word " << file->getCodeStartForClump(i) << ")";
+			errors.push_back(problem.str());
+		}
+		for (unsigned j = 0; j < file->getDependentCountForClump(i); j++)
+		{
+			unsigned dependent = file->getDependentsForClump(i)[j];
+			if (dependent >= file->getClumpCount())
+			{
+				std::ostringstream problem;
+				problem << "Clump " << i << " has a dependent that does not exist (" << dependent << ")";
+				errors.push_back(problem.str());
+			}
+		}
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+/*
+ *  RXEVerifier.h
+ *  mindstormssimulation
+ *
+ *  Created by agent on 18.10.26
+ *  Copyright 2026 RWTH Aachen University All rights reserved.
+ *
+ */
+
+#include <string>
+#include <vector>
+
+class DecodedProgram;
+class RXEFile;
+
+/*!
+ * @abstract Checks a program before it runs.
+ * @discussion Goes over every instruction of a decoded program once and
+ * checks that it can be executed safely: The opcode has to be known and the
+ * instruction complete, the operands have to fit what the handler expects
+ * (as described in InterpreterOpcodes.h), that is the right number of them,
+ * DSTOC entries that exist and have a suitable type, branches to the start of
+ * an instruction and existing clumps. The clump records are checked as well.
+ *
+ * The Interpreter runs programs that pass without checking operands again.
+ * Programs that do not pass still run, with all checks, exactly as before;
+ * the errors found here explain why.
+ */
+class RXEVerifier
+{
+	const RXEFile *file;
+	const DecodedProgram *program;
+	std::vector<std::string> errors;
+
+	void addError(unsigned index, const std::string &message);
+	void verifyInstruction(unsigned index);
+	void verifyClumps();
+
+	bool isReadable(unsigned entry) const;
+	bool isWritable(unsigned entry) const;
+
+public:
+	/*!
+	 * @abstract Verifies a program.
+	 * @param file The RXE file.
+	 * @param program The program decoded from that file.
+	 */
+	RXEVerifier(const RXEFile *file, const DecodedProgram *program);
+
+	/*! Whether the program passed. */
+	bool isValid() const { return errors.empty(); }
+
+	/*! Descriptions of everything that is wrong, in order of the code. */
+	const std::vector<std::string> &getErrors() const { return errors; }
+};
@@ -0,0 +1,42 @@
+#pragma once
+/*
+ *  RandomGenerator.h
+ *  mindstormssimulation
+ *
+ *  Created by agent on 18.10.26
+ *  Copyright 2026 RWTH Aachen University All rights reserved.
+ *
+ */
+
+#include <stdint.h>
+
+/*!
+ * @abstract A pseudo random number generator with its own state.
+ * @discussion Unlike rand(), every generator has its own sequence, so runs on
+ * different threads can not disturb each other, and the same seed gives the
+ * same numbers on every platform. Every seed, 0 included, starts a sequence of
+ * its own. The numbers come from SplitMix64.
+ */
+class RandomGenerator
+{
+	uint64_t state;
+
+public:
+	RandomGenerator(unsigned seed = 0) : state(seed) {}
+
+	/*! Starts the sequence for the given seed over. */
+	void setSeed(unsigned seed) { state = seed; }
+
+	/*! The next number, from the whole range of uint32_t. */
+	uint32_t next()
+	{
+		state += 0x9E3779B97F4A7C15ULL;
+		uint64_t z = state;
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		return uint32_t((z ^ (z >> 31)) >> 32);
+	}
+
+	/*! The next number, from 0 to limit - 1. limit must not be 0. */
+	unsigned nextBelow(unsigned limit) { return next() % limit; }
+};
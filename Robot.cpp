@@ -12,20 +12,24 @@
 #include <cmath>
 
 #include "Simulation.h"
+
+// Headless builds have no sound, and hence never get a speaker.
+#ifndef SIMULATOR_HEADLESS
 #include "SoundController.h"
 #include "RobotSpeaker.h"
+#endif
+
+const float Robot::trackWidth = 0.825f*2.0f;
+
+const float4 Robot::standard2DBoundingBox[4] = {
+	float4(1.0,    0.0f, -0.9f),
+	float4(1.0,    0.0f,  0.9f),
+	float4(-0.85f, 0.0f,  0.9f),
+	float4(-0.85f, 0.0f, -0.9f)
+};
 
 namespace
 {
-	const float trackWidth = 0.825f*2.0f;
-	
-	const float4 standard2DBoundingBox[4] = {
-		float4(1.0,    0.0f, -0.9f),
-		float4(1.0,    0.0f,  0.9f),
-		float4(-0.85f, 0.0f,  0.9f),
-		float4(-0.85f, 0.0f, -0.9f)
-	};
-	
 	const float4 touchSensor2DBoundingBox[4] = {
 		float4(0.45f,  0.0f, -0.125f),
 		float4(0.45f,  0.0f,  0.125f),
@@ -51,6 +55,7 @@ Robot::Robot(Simulation *aSimulation)
 : simulation(aSimulation)
 {
 	yaw = 0;
+	lastYaw = 0;
 	
 	position.w = float4(10, 0, 10);
 	leftMotor = 0;
@@ -72,6 +77,10 @@ Robot::Robot(Simulation *aSimulation)
 	setSensorType(3, Ultrasound);
 	sensors[3].isPointedDown = false;
 	
+	// Nothing has been measured before the first update.
+	for (unsigned i = 0; i < 4; i++)
+		sensors[i].value = 0.0f;
+	
 	speaker = NULL;
 	lifted = false;
 	
@@ -89,48 +98,56 @@ Robot::~Robot()
 
 void Robot::setSpeaker(RobotSpeaker *aSpeaker)
 {
+#ifndef SIMULATOR_HEADLESS
 	if (speaker)
 	{
 		delete speaker;
 		speaker = NULL;
 	}
+#endif
 	
 	speaker = aSpeaker;
 }
 
-void Robot::updatePhysics(float timedelta) throw()
+bool Robot::turnMotors(float timedelta, float &deltaLeft, float &deltaRight) throw()
 {
 	if (!simulation) // Purely client robot.
-		return;
+		return false;
 	
 	lastPosition = position;
+	lastYaw = yaw;
 	
 	// Update speed data
 	setLeftTrackSpeed(motors[leftMotor].getSpeed() * wheelDiameter);
 	setRightTrackSpeed(motors[rightMotor].getSpeed() * wheelDiameter);	
 	
-	if (!lifted)
-	{
-		// Move according to position
-		float deltaSleft = motors[leftMotor].turn(timedelta) * (float(M_PI) / 360.0f) * wheelDiameter;
-		float deltaSright = motors[rightMotor].turn(timedelta) * (float(M_PI) / 360.0f) * wheelDiameter;
-		
-		float deltaStotal = (deltaSleft + deltaSright) * 0.5f;
-		
-		float deltaYaw = std::atan((deltaSleft - deltaSright) / trackWidth);
-		
-		yaw = fmodf(yaw + deltaYaw, 2.0f * float(M_PI));
-		
-		matrix newPosition(matrix::rotation(float4(0, 1, 0, 0), yaw));
-		newPosition.w = position.w + position.x * deltaStotal;
-		setPosition(newPosition);
-	}
-	else
+	if (lifted)
 	{
 		// Turn according to speed
 		rotate(liftedTurnSpeed * timedelta);
+		return false;
 	}
+	
+	deltaLeft = motors[leftMotor].turn(timedelta) * (float(M_PI) / 360.0f) * wheelDiameter;
+	deltaRight = motors[rightMotor].turn(timedelta) * (float(M_PI) / 360.0f) * wheelDiameter;
+	return true;
+}
+
+void Robot::setDrivenPosition(float newYaw, const matrix &newPosition, const float4 *newOBB, const float4 *newAABB) throw()
+{
+	yaw = newYaw;
+	position = newPosition;
+	for (unsigned i = 0; i < 4; i++)
+		obb[i] = newOBB[i];
+	aabb[0] = newAABB[0];
+	aabb[1] = newAABB[1];
+}
 
+void Robot::updateSensors() throw()
+{
+	if (!simulation) // Purely client robot.
+		return;
+	
 	// Update sensor readings
 	for (unsigned i = 0; i < 4; i++)
 	{
@@ -167,7 +184,12 @@ void Robot::updatePhysics(float timedelta) throw()
 		}
 		else if (sensors[i].type == Sound)
 		{
-			sensors[i].value = speaker->getSoundController()->noiseLevelAtPoint(sensorLocation.w) * noiseLevelScale;
+#ifndef SIMULATOR_HEADLESS
+			if (speaker)
+				sensors[i].value = speaker->getSoundController()->noiseLevelAtPoint(sensorLocation.w) * noiseLevelScale;
+			else
+#endif
+				sensors[i].value = 0.0f;
 		}
 		else if (sensors[i].type == Ultrasound)
 		{
@@ -182,7 +204,9 @@ void Robot::updatePhysics(float timedelta) throw()
 		}		
 	}
 	
+#ifndef SIMULATOR_HEADLESS
 	if (speaker) speaker->update();
+#endif
 }
 
 bool Robot::touchHitByRay(const ray4 &ray, float &length, float scaleFactor) const throw()
@@ -244,6 +268,28 @@ void Robot::rotate(float radians) throw()
 	setPosition(newPosition);
 }
 
+matrix Robot::getPositionDuringStep(float fraction, float &yawThen) const throw()
+{
+	// Turn the short way round, as yaw wraps around at a full turn.
+	const float fullTurn = 2.0f * float(M_PI);
+	float turn = fmodf(yaw - lastYaw, fullTurn);
+	if (turn > float(M_PI)) turn -= fullTurn;
+	else if (turn < -float(M_PI)) turn += fullTurn;
+	
+	yawThen = fmodf(lastYaw + turn * fraction, fullTurn);
+	matrix result(matrix::rotation(float4(0, 1, 0, 0), yawThen));
+	result.w = lastPosition.w + (position.w - lastPosition.w) * fraction;
+	return result;
+}
+
+void Robot::moveBackInStep(float fraction) throw()
+{
+	float yawThen;
+	matrix newPosition = getPositionDuringStep(fraction, yawThen);
+	yaw = yawThen;
+	setPosition(newPosition);
+}
+
 void Robot::setFlagColor(const float *color) throw()
 {
 	memcpy(flagColor, color, sizeof(float [3]));
@@ -255,11 +301,15 @@ const float *Robot::getFlagColor() const throw()
 
 void Robot::playTone(unsigned frequency, unsigned durationInMilliseconds, bool repeats, float gain)
 {
+#ifndef SIMULATOR_HEADLESS
 	if (speaker) speaker->playTone(frequency, durationInMilliseconds, repeats, gain);
+#endif
 }
 void Robot::playFile(const char *filename, bool repeats, float gain)
 {
+#ifndef SIMULATOR_HEADLESS
 	if (speaker) speaker->playFile(filename, repeats, gain);
+#endif
 }
 
 void Robot::setSensorType(unsigned sensor, Robot::SensorType type) throw(std::invalid_argument)
@@ -33,6 +33,7 @@ private:
 	matrix lastPosition; // To avoid tunnelling. Used to find how much the robot moved in the last step
 	
 	float yaw;
+	float lastYaw; // The yaw at lastPosition
 	
 	Motor motors[3];
 	unsigned leftMotor;
@@ -86,13 +87,37 @@ public:
 	// TODO: Not very nicely implemented.
 	void setSpeaker(RobotSpeaker *aSpeaker);
 	
+	/*! Distance between the tracks. */
+	static const float trackWidth;
+	/*! The outline of the robot in the xz plane, relative to its position. */
+	static const float4 standard2DBoundingBox[4];
+	
+	/*!
+	 * @abstract Starts updating the physics.
+	 * @discussion Turns the motors according to their speed settings. A robot
+	 * that is lifted is turned here, but does not drive. The Simulation then
+	 * moves all driving robots at once and tells them where they are with
+	 * setDrivenPosition, before calling updateSensors.
+	 * @param timedelta The time that has passed since the last time the
+	 * physics were updated.
+	 * @param deltaLeft Set to the distance the left track moved.
+	 * @param deltaRight Set to the distance the right track moved.
+	 * @result Whether the robot drives, that is whether it needs to be moved
+	 * by the tracks.
+	 */
+	bool turnMotors(float timedelta, float &deltaLeft, float &deltaRight) throw();
+	
+	/*!
+	 * @abstract Sets where the tracks moved the robot.
+	 * @discussion Like setPosition, but with the bounding boxes already known.
+	 */
+	void setDrivenPosition(float yaw, const matrix &position, const float4 *obb, const float4 *aabb) throw();
+	
 	/*!
-	 * @abstract Updates the physics
-	 * @discussion Moves the robot according to its speed settings.
-	 * @param timedelta The time that has passed since the last time updatePhsics
-	 * was called.
+	 * @abstract Finishes updating the physics.
+	 * @discussion Updates the sensor readings for the robot's new position.
 	 */
-	void updatePhysics(float timedelta) throw();
+	void updateSensors() throw();
 	
 	/*!
 	 * @abstract Hit detection
@@ -221,8 +246,27 @@ public:
 	float getRightTrackSpeed() const throw();
 	
 	const matrix &getPosition() const throw() { return position; }
+	float getYaw() const throw() { return yaw; }
 	const matrix &getLastPosition() const throw() { return lastPosition; }
 	
+	/*!
+	 * @abstract Where the robot was at some point during the last step.
+	 * @discussion Position and yaw are interpolated between where the robot
+	 * was when turnMotors was last called and where it is now.
+	 * @param fraction 0 for the start of the step, 1 for now.
+	 * @param yawThen Set to the yaw at that point.
+	 * @result The position at that point.
+	 */
+	matrix getPositionDuringStep(float fraction, float &yawThen) const throw();
+	
+	/*!
+	 * @abstract Puts the robot back to where it was at some point during the
+	 * last step.
+	 * @discussion Sets the position and the yaw that getPositionDuringStep
+	 * returns.
+	 */
+	void moveBackInStep(float fraction) throw();
+	
 	const float4 *getOrientedBoundingBox() const throw() { return obb; }
 	const float4 *getAxisAlignedBoundingBox() const throw() { return aabb; }
 	
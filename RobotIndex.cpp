@@ -0,0 +1,282 @@
+/*
+ *  RobotIndex.cpp
+ *  mindstormssimulation
+ *
+ *  Created by agent on 18.10.26
+ *  Copyright 2026 RWTH Aachen University All rights reserved.
+ *
+ */
+
+#include "RobotIndex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "Vec4.h"
+
+namespace
+{
+	// Bucket coordinates are kept within this, so that huge or infinite
+	// boxes do not overflow.
+	const int maxBucket = 1 << 14;
+
+	const unsigned minimumListCount = 64;
+
+	// A robot usually touches up to four buckets; have about twice as many
+	// lists as that.
+	const unsigned listsPerRobot = 8;
+}
+
+RobotIndex::RobotIndex(float aBucketSize)
+: bucketSize(aBucketSize), boundsAreValid(false), currentMark(0)
+{
+	lists.resize(minimumListCount);
+	listMask = minimumListCount - 1;
+}
+
+int RobotIndex::bucketForCoordinate(float coordinate) const
+{
+	float bucket = std::floor(coordinate / bucketSize);
+	if (!(bucket > float(-maxBucket))) return -maxBucket;
+	if (bucket > float(maxBucket)) return maxBucket;
+	return int(bucket);
+}
+
+RobotIndex::Entry RobotIndex::bucketsForAABB(const float4 *aabb) const
+{
+	Entry buckets;
+	buckets.minX = bucketForCoordinate(aabb[0].x);
+	buckets.maxX = bucketForCoordinate(aabb[1].x);
+	buckets.minZ = bucketForCoordinate(aabb[0].z);
+	buckets.maxZ = bucketForCoordinate(aabb[1].z);
+	buckets.isListed = true;
+	return buckets;
+}
+
+std::vector<unsigned> &RobotIndex::listForBucket(int x, int z)
+{
+	unsigned hash = (unsigned(x) * 73856093u) ^ (unsigned(z) * 19349663u);
+	return lists[hash & listMask];
+}
+
+const std::vector<unsigned> &RobotIndex::listForBucket(int x, int z) const
+{
+	unsigned hash = (unsigned(x) * 73856093u) ^ (unsigned(z) * 19349663u);
+	return lists[hash & listMask];
+}
+
+void RobotIndex::list(unsigned robot)
+{
+	const Entry &entry = entries[robot];
+	for (int x = entry.minX; x <= entry.maxX; x++)
+		for (int z = entry.minZ; z <= entry.maxZ; z++)
+			listForBucket(x, z).push_back(robot);
+}
+
+void RobotIndex::unlist(unsigned robot)
+{
+	// The order within a list does not matter, so take the last element's
+	// place.
+	const Entry &entry = entries[robot];
+	for (int x = entry.minX; x <= entry.maxX; x++)
+	{
+		for (int z = entry.minZ; z <= entry.maxZ; z++)
+		{
+			std::vector<unsigned> &bucketList = listForBucket(x, z);
+			std::vector<unsigned>::iterator found = std::find(bucketList.begin(), bucketList.end(), robot);
+			*found = bucketList.back();
+			bucketList.pop_back();
+		}
+	}
+}
+
+void RobotIndex::resizeLists()
+{
+	unsigned count = minimumListCount;
+	while (count < entries.size() * listsPerRobot)
+		count *= 2;
+	if (count == lists.size()) return;
+
+	lists.clear();
+	lists.resize(count);
+	listMask = count - 1;
+	for (unsigned i = 0; i < entries.size(); i++)
+		if (entries[i].isListed) list(i);
+}
+
+void RobotIndex::updateBounds() const
+{
+	if (boundsAreValid) return;
+
+	bounds.minX = maxBucket;
+	bounds.maxX = -maxBucket;
+	bounds.minZ = maxBucket;
+	bounds.maxZ = -maxBucket;
+	bounds.isListed = false;
+	for (std::vector<Entry>::const_iterator iter = entries.begin(); iter != entries.end(); ++iter)
+	{
+		if (!iter->isListed) continue;
+		bounds.minX = std::min(bounds.minX, iter->minX);
+		bounds.maxX = std::max(bounds.maxX, iter->maxX);
+		bounds.minZ = std::min(bounds.minZ, iter->minZ);
+		bounds.maxZ = std::max(bounds.maxZ, iter->maxZ);
+		bounds.isListed = true;
+	}
+	boundsAreValid = true;
+}
+
+void RobotIndex::beginQuery() const
+{
+	currentMark++;
+	if (currentMark == 0)
+	{
+		std::fill(marks.begin(), marks.end(), 0);
+		currentMark = 1;
+	}
+}
+
+void RobotIndex::addCandidates(int x, int z, std::vector<unsigned> &result) const
+{
+	const std::vector<unsigned> &bucketList = listForBucket(x, z);
+	for (std::vector<unsigned>::const_iterator iter = bucketList.begin(); iter != bucketList.end(); ++iter)
+	{
+		// Skip robots found already, and those in other buckets that share
+		// the list.
+		const Entry &entry = entries[*iter];
+		if (marks[*iter] == currentMark) continue;
+		if (x < entry.minX || x > entry.maxX || z < entry.minZ || z > entry.maxZ) continue;
+
+		marks[*iter] = currentMark;
+		result.push_back(*iter);
+	}
+}
+
+void RobotIndex::clear()
+{
+	entries.clear();
+	marks.clear();
+	lists.clear();
+	lists.resize(minimumListCount);
+	listMask = minimumListCount - 1;
+	boundsAreValid = false;
+}
+
+void RobotIndex::update(unsigned robot, const float4 *aabb)
+{
+	if (robot >= entries.size())
+	{
+		Entry unlisted = { 0, 0, 0, 0, false };
+		entries.resize(robot + 1, unlisted);
+		marks.resize(robot + 1, 0);
+		resizeLists();
+	}
+
+	Entry buckets = bucketsForAABB(aabb);
+	Entry &entry = entries[robot];
+	if (entry.isListed && entry.minX == buckets.minX && entry.maxX == buckets.maxX && entry.minZ == buckets.minZ && entry.maxZ == buckets.maxZ)
+		return;
+
+	if (entry.isListed) unlist(robot);
+	entry = buckets;
+	list(robot);
+	boundsAreValid = false;
+}
+
+void RobotIndex::findInBox(const float4 *aabb, std::vector<unsigned> &result) const
+{
+	result.clear();
+	beginQuery();
+
+	Entry buckets = bucketsForAABB(aabb);
+	if (buckets.minX > buckets.maxX || buckets.minZ > buckets.maxZ) return;
+
+	// For boxes larger than the world, it is faster to look at every robot.
+	if ((buckets.maxX - buckets.minX + 1) * (buckets.maxZ - buckets.minZ + 1) > int(entries.size()))
+	{
+		for (unsigned i = 0; i < entries.size(); i++)
+		{
+			const Entry &entry = entries[i];
+			if (!entry.isListed) continue;
+			if (entry.maxX < buckets.minX || entry.minX > buckets.maxX || entry.maxZ < buckets.minZ || entry.minZ > buckets.maxZ) continue;
+			result.push_back(i);
+		}
+		return;
+	}
+
+	for (int x = buckets.minX; x <= buckets.maxX; x++)
+		for (int z = buckets.minZ; z <= buckets.maxZ; z++)
+			addCandidates(x, z, result);
+	std::sort(result.begin(), result.end());
+}
+
+void RobotIndex::findAlongRay(const ray4 &ray, std::vector<unsigned> &result) const
+{
+	result.clear();
+	updateBounds();
+	if (!bounds.isListed) return;
+	beginQuery();
+
+	const float4 start = ray.start();
+	const float4 direction = ray.direction();
+	const float infinity = std::numeric_limits<float>::infinity();
+
+	// Clip the ray to the buckets that have robots in them.
+	float tStart = 0.0f;
+	float tEnd = 1.0f;
+	const float startXZ[2] = { start.x, start.z };
+	const float directionXZ[2] = { direction.x, direction.z };
+	const float lower[2] = { float(bounds.minX) * bucketSize, float(bounds.minZ) * bucketSize };
+	const float upper[2] = { float(bounds.maxX + 1) * bucketSize, float(bounds.maxZ + 1) * bucketSize };
+	for (unsigned axis = 0; axis < 2; axis++)
+	{
+		if (directionXZ[axis] == 0.0f)
+		{
+			if (startXZ[axis] < lower[axis] || startXZ[axis] > upper[axis]) return;
+			continue;
+		}
+		float tLower = (lower[axis] - startXZ[axis]) / directionXZ[axis];
+		float tUpper = (upper[axis] - startXZ[axis]) / directionXZ[axis];
+		tStart = std::max(tStart, std::min(tLower, tUpper));
+		tEnd = std::min(tEnd, std::max(tLower, tUpper));
+	}
+	if (tStart > tEnd) return;
+
+	// Walk through the buckets on the way, always to the one whose border is
+	// crossed next.
+	int x = std::min(std::max(bucketForCoordinate(start.x + tStart * direction.x), bounds.minX), bounds.maxX);
+	int z = std::min(std::max(bucketForCoordinate(start.z + tStart * direction.z), bounds.minZ), bounds.maxZ);
+	const int stepX = direction.x > 0.0f ? 1 : -1;
+	const int stepZ = direction.z > 0.0f ? 1 : -1;
+	float tNextX = infinity, tDeltaX = infinity;
+	float tNextZ = infinity, tDeltaZ = infinity;
+	if (direction.x != 0.0f)
+	{
+		tNextX = (float(x + (stepX > 0 ? 1 : 0)) * bucketSize - start.x) / direction.x;
+		tDeltaX = bucketSize / std::fabs(direction.x);
+	}
+	if (direction.z != 0.0f)
+	{
+		tNextZ = (float(z + (stepZ > 0 ? 1 : 0)) * bucketSize - start.z) / direction.z;
+		tDeltaZ = bucketSize / std::fabs(direction.z);
+	}
+
+	while (true)
+	{
+		addCandidates(x, z, result);
+
+		if (tNextX < tNextZ)
+		{
+			if (tNextX > tEnd) break;
+			x += stepX;
+			tNextX += tDeltaX;
+		}
+		else
+		{
+			if (tNextZ > tEnd) break;
+			z += stepZ;
+			tNextZ += tDeltaZ;
+		}
+		if (x < bounds.minX || x > bounds.maxX || z < bounds.minZ || z > bounds.maxZ) break;
+	}
+}
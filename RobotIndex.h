@@ -0,0 +1,113 @@
+#pragma once
+/*
+ *  RobotIndex.h
+ *  mindstormssimulation
+ *
+ *  Created by agent on 18.10.26
+ *  Copyright 2026 RWTH Aachen University All rights reserved.
+ *
+ */
+
+#include <vector>
+
+union float4;
+class ray4;
+
+/*!
+ * @abstract Finds the robots that may be in some part of the world, without
+ * looking at all of them.
+ * @discussion The xz plane is divided into square buckets. Every robot is
+ * listed in each bucket its axis aligned bounding box touches. Buckets are
+ * found by hashing their coordinates into a table of lists, so robots outside
+ * of the environment need no special treatment; buckets that share a list
+ * only cost a few more comparisons.
+ *
+ * Queries only find candidates: every robot whose bounding box could touch
+ * the area asked for, and possibly a few more. The exact test is up to the
+ * caller.
+ *
+ * Robots are identified by their index in the Simulation. When a robot's
+ * bounding box changes, update has to be called. It only changes the lists if
+ * the robot now touches different buckets, which for robots driving around is
+ * rare, so calling it for every robot in every step is cheap.
+ */
+class RobotIndex
+{
+	struct Entry
+	{
+		// Buckets touched, inclusive.
+		int minX;
+		int maxX;
+		int minZ;
+		int maxZ;
+		bool isListed;
+	};
+
+	float bucketSize;
+	std::vector<Entry> entries;
+	std::vector<std::vector<unsigned> > lists;
+	unsigned listMask;
+
+	// The buckets touched by any robot, to clip rays to. Only computed when
+	// needed.
+	mutable bool boundsAreValid;
+	mutable Entry bounds;
+
+	// For each robot, the last query that found it, so that robots in several
+	// buckets are only reported once.
+	mutable std::vector<unsigned> marks;
+	mutable unsigned currentMark;
+
+	int bucketForCoordinate(float coordinate) const;
+	Entry bucketsForAABB(const float4 *aabb) const;
+	std::vector<unsigned> &listForBucket(int x, int z);
+	const std::vector<unsigned> &listForBucket(int x, int z) const;
+
+	void list(unsigned robot);
+	void unlist(unsigned robot);
+	void resizeLists();
+	void updateBounds() const;
+
+	void beginQuery() const;
+	void addCandidates(int x, int z, std::vector<unsigned> &result) const;
+
+public:
+	/*!
+	 * @abstract Creates an empty index.
+	 * @param bucketSize Length of the sides of a bucket. Best about the size
+	 * of a robot; larger means more candidates, smaller more lists to keep
+	 * up to date.
+	 */
+	RobotIndex(float bucketSize);
+
+	/*!
+	 * @abstract Forgets all robots.
+	 * @discussion Needed when robots are removed from the Simulation, since
+	 * that changes the indices of the others.
+	 */
+	void clear();
+
+	/*!
+	 * @abstract Adds a robot or tells the index where it is now.
+	 * @param robot Index of the robot. Robots that are not added yet are
+	 * never found.
+	 * @param aabb The robot's axis aligned bounding box, minimum first.
+	 */
+	void update(unsigned robot, const float4 *aabb);
+
+	/*!
+	 * @abstract Finds the robots that may touch a box.
+	 * @param aabb The box, minimum first.
+	 * @param result Set to the candidates, in ascending order.
+	 */
+	void findInBox(const float4 *aabb, std::vector<unsigned> &result) const;
+
+	/*!
+	 * @abstract Finds the robots that may be hit by a ray.
+	 * @discussion Only the ray's path in the xz plane is considered.
+	 * @param ray The ray, from its start to its end.
+	 * @param result Set to the candidates, roughly in the order in which the
+	 * ray reaches them.
+	 */
+	void findAlongRay(const ray4 &ray, std::vector<unsigned> &result) const;
+};
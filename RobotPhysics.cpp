@@ -0,0 +1,121 @@
+/*
+ *  RobotPhysics.cpp
+ *  mindstormssimulation
+ *
+ *  Created by agent on 18.10.26
+ *  Copyright 2026 RWTH Aachen University All rights reserved.
+ *
+ */
+
+#include "RobotPhysics.h"
+
+#include <cmath>
+
+#include "Robot.h"
+
+RobotPhysics::RobotPhysics()
+: count(0)
+{
+}
+
+void RobotPhysics::clear() throw()
+{
+	groups.clear();
+	translations.clear();
+	count = 0;
+}
+
+RobotPhysics::Group::Group()
+: yaw(0.0f), x(0.0f), z(0.0f), headingX(0.0f), headingZ(0.0f), deltaLeft(0.0f), deltaRight(0.0f), cosYaw(0.0f), sinYaw(0.0f)
+{
+	for (unsigned i = 0; i < 4; i++)
+		cornerX[i] = cornerZ[i] = float4(0.0f);
+}
+
+unsigned RobotPhysics::add(float yaw, const matrix &position, float deltaLeft, float deltaRight)
+{
+	unsigned lane = count % 4;
+	if (lane == 0)
+	{
+		groups.push_back(Group());
+	}
+
+	Group &group = groups.back();
+	group.yaw[lane] = yaw;
+	group.x[lane] = position.w.x;
+	group.z[lane] = position.w.z;
+	group.headingX[lane] = position.x.x;
+	group.headingZ[lane] = position.x.z;
+	group.deltaLeft[lane] = deltaLeft;
+	group.deltaRight[lane] = deltaRight;
+	translations.push_back(position.w);
+	return count++;
+}
+
+void RobotPhysics::integrate() throw()
+{
+	const float4 trackWidth(Robot::trackWidth);
+	const float fullTurn = 2.0f * float(M_PI);
+
+	for (std::vector<Group>::iterator group = groups.begin(); group != groups.end(); ++group)
+	{
+		float4 deltaTotal = (group->deltaLeft + group->deltaRight) * 0.5f;
+		float4 turnSlope = (group->deltaLeft - group->deltaRight) / trackWidth;
+		for (unsigned lane = 0; lane < 4; lane++)
+		{
+			float yaw = fmodf(group->yaw[lane] + std::atan(turnSlope[lane]), fullTurn);
+			group->yaw[lane] = yaw;
+			group->cosYaw[lane] = std::cos(yaw);
+			group->sinYaw[lane] = std::sin(yaw);
+		}
+
+		// Move along the old heading.
+		group->x += group->headingX.scaled(deltaTotal);
+		group->z += group->headingZ.scaled(deltaTotal);
+
+		// The new heading is the x axis of the rotation about y, which is
+		// (cos, 0, -sin); its z axis is (sin, 0, cos). Then the corners of the
+		// outline, as the position matrix transforms them.
+		group->headingX = group->cosYaw;
+		group->headingZ = -group->sinYaw;
+		for (unsigned i = 0; i < 4; i++)
+		{
+			const float4 &corner = Robot::standard2DBoundingBox[i];
+			group->cornerX[i] = group->cosYaw * corner.x + (group->sinYaw * corner.z + group->x);
+			group->cornerZ[i] = group->cosYaw * corner.z + group->z - group->sinYaw * corner.x;
+		}
+	}
+}
+
+float RobotPhysics::getYaw(unsigned index) const throw()
+{
+	return groups[index / 4].yaw[index % 4];
+}
+
+matrix RobotPhysics::getPosition(unsigned index) const throw()
+{
+	const Group &group = groups[index / 4];
+	const unsigned lane = index % 4;
+
+	float4 translation = translations[index];
+	translation.x = group.x[lane];
+	translation.z = group.z[lane];
+
+	return matrix(float4(group.cosYaw[lane], 0.0f, group.headingZ[lane], 0.0f),
+				  float4(0.0f, 1.0f, 0.0f, 0.0f),
+				  float4(group.sinYaw[lane], 0.0f, group.cosYaw[lane], 0.0f),
+				  translation);
+}
+
+void RobotPhysics::getBoundingBoxes(unsigned index, float4 *obb, float4 *aabb) const throw()
+{
+	const Group &group = groups[index / 4];
+	const unsigned lane = index % 4;
+	const float4 &translation = translations[index];
+
+	for (unsigned i = 0; i < 4; i++)
+		obb[i] = float4(group.cornerX[i][lane], translation.y, group.cornerZ[i][lane], translation.w);
+
+	aabb[0] = obb[0].min(obb[1].min(obb[2].min(obb[3])));
+	aabb[1] = obb[0].max(obb[1].max(obb[2].max(obb[3])));
+}
@@ -0,0 +1,100 @@
+#pragma once
+/*
+ *  RobotPhysics.h
+ *  mindstormssimulation
+ *
+ *  Created by agent on 18.10.26
+ *  Copyright 2026 RWTH Aachen University All rights reserved.
+ *
+ */
+
+#include <vector>
+
+#include "Vec4.h"
+
+/*!
+ * @abstract Moves many driving robots at once.
+ * @discussion The Simulation adds the state of every robot that drives in a
+ * step: its yaw, its position and how far each track moved. integrate then
+ * turns and moves all of them, and finds their bounding boxes. The robots
+ * are stored four to a group, each value of the four in one float4, so that
+ * everything except the trigonometric functions works on four robots at once.
+ * Those are not vectorized; they use the standard library for each robot.
+ * The rotation about y is then written out directly, which differs from
+ * matrix::rotation only in that the latter normalizes the axis, so that its
+ * results can be off in the last bit.
+ *
+ * The Robot objects stay the owners of their state; this is only where it is
+ * while they are moved.
+ */
+class RobotPhysics
+{
+	struct Group
+	{
+		float4 yaw;
+		// The translation and the direction the robot is facing, that is
+		// the x axis of its position matrix.
+		float4 x;
+		float4 z;
+		float4 headingX;
+		float4 headingZ;
+		// Distance each track moved in this step.
+		float4 deltaLeft;
+		float4 deltaRight;
+
+		// The new rotation.
+		float4 cosYaw;
+		float4 sinYaw;
+
+		float4 cornerX[4];
+		float4 cornerZ[4];
+
+		// Everything zero, also in lanes no robot uses.
+		Group();
+	};
+
+	std::vector<Group> groups;
+	std::vector<float4> translations;
+	unsigned count;
+
+public:
+	RobotPhysics();
+
+	/*! Removes all robots, keeping the memory for them. */
+	void clear() throw();
+
+	/*!
+	 * @abstract Adds a robot that drives in this step.
+	 * @param yaw The robot's current yaw, in radians.
+	 * @param position The robot's current position.
+	 * @param deltaLeft How far the left track moved.
+	 * @param deltaRight How far the right track moved.
+	 * @result The index of the robot in the store.
+	 */
+	unsigned add(float yaw, const matrix &position, float deltaLeft, float deltaRight);
+	unsigned size() const throw() { return count; }
+
+	/*!
+	 * @abstract Moves all robots.
+	 * @discussion The same differential drive as the robots always had: The
+	 * robot turns by the arc tangent of the difference of the tracks over the
+	 * track width, and moves the average of the tracks along the direction it
+	 * faced before turning.
+	 */
+	void integrate() throw();
+
+	/*!
+	 * @methodgroup Results
+	 * Only valid after integrate.
+	 */
+
+	float getYaw(unsigned index) const throw();
+	matrix getPosition(unsigned index) const throw();
+	/*!
+	 * @abstract The bounding boxes of a robot at its new position.
+	 * @param index The robot.
+	 * @param obb Set to the four corners of the oriented bounding box.
+	 * @param aabb Set to the minimum and maximum of the axis aligned one.
+	 */
+	void getBoundingBoxes(unsigned index, float4 *obb, float4 *aabb) const throw();
+};
@@ -0,0 +1,1486 @@
+/*
+ *  SelfTest.cpp
+ *  mindstormssimulation
+ *
+ *  Created by agent on 18.10.26
+ *  Copyright 2026 RWTH Aachen University All rights reserved.
+ *
+ */
+
+#include "SelfTest.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "CollisionBatch.h"
+#include "DecodedProgram.h"
+#include "Environment.h"
+#include "ExecutionContext.h"
+#include "HeadlessRun.h"
+#include "Interpreter.h"
+#include "InterpreterOpcodes.h"
+#include "NativeCode.h"
+#include "PollingLoops.h"
+#include "Robot.h"
+#include "RXEFile.h"
+#include "RXETranslator.h"
+#include "Simulation.h"
+#include "System.h"
+#include "TickSource.h"
+#include "Vec4.h"
+#include "VMDiagnostics.h"
+#include "VMMemory.h"
+
+namespace
+{
+	// The opcodes by their names, for writing programs.
+	enum Opcode
+	{
+#define SELF_TEST_OPCODE(name, opcode, handler, operands) name = opcode,
+		INTERPRETER_OPCODES(SELF_TEST_OPCODE)
+#undef SELF_TEST_OPCODE
+	};
+
+	unsigned checkCount = 0;
+	unsigned failureCount = 0;
+
+	void check(bool condition, const char *test, const char *description)
+	{
+		checkCount++;
+		if (condition) return;
+		failureCount++;
+		printf("FAIL\t%s\t%s\n", test, description);
+	}
+
+	void appendLittleEndian(std::vector<uint8_t> &bytes, uint32_t value, unsigned size)
+	{
+		for (unsigned i = 0; i < size; i++)
+			bytes.push_back(uint8_t(value >> (8 * i)));
+	}
+
+	unsigned alignedTo(unsigned value, unsigned alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	/*
+	 * An RXE file written in memory, with only the data space entries and
+	 * clumps a check needs. Everything is laid out the way the NXT compilers
+	 * do it, so that VMMemory reads it like any other file.
+	 */
+	class TestProgram
+	{
+		struct Entry
+		{
+			uint8_t type;
+			uint8_t flags;
+			uint16_t descriptor;
+		};
+		struct Array
+		{
+			unsigned elementSize;
+			std::vector<uint8_t> contents;
+		};
+
+		std::vector<Entry> entries;
+		std::vector<uint8_t> staticDefaults;
+		unsigned staticSize;
+		std::vector<Array> arrays;
+		struct Clump
+		{
+			unsigned fireCount;
+			uint16_t start;
+			std::vector<uint8_t> dependents;
+		};
+
+		std::vector<uint16_t> code;
+		std::vector<Clump> clumps;
+
+		unsigned addStaticEntry(RXEFile::dstocType type, uint32_t value)
+		{
+			unsigned size = unsigned(RXEFile::getSizeOfType(type));
+			staticSize = alignedTo(staticSize, size);
+			Entry entry = { uint8_t(type), 0, uint16_t(staticSize) };
+			entries.push_back(entry);
+			appendLittleEndian(staticDefaults, value, size);
+			staticSize += size;
+			return unsigned(entries.size() - 1);
+		}
+
+	public:
+		TestProgram() : staticSize(0) {}
+
+		/*! Adds a scalar with a default value and returns its DSTOC index. */
+		unsigned addScalar(RXEFile::dstocType type, int32_t value)
+		{
+			return addStaticEntry(type, uint32_t(value));
+		}
+
+		/*! Adds an array with the given bytes as contents. */
+		unsigned addArray(RXEFile::dstocType elementType, const std::vector<uint8_t> &contents)
+		{
+			// Dope vector 0 is the list of dope vectors itself.
+			Array array = { unsigned(RXEFile::getSizeOfType(elementType)), contents };
+			arrays.push_back(array);
+			unsigned index = addStaticEntry(RXEFile::TC_ARRAY, unsigned(arrays.size()));
+			Entry element = { uint8_t(elementType), 0, 0 };
+			entries.push_back(element);
+			return index;
+		}
+
+		/*! Adds a long format instruction to the clump added last. */
+		void addInstruction(unsigned opcode, const std::vector<uint16_t> &operands, unsigned flags = 0)
+		{
+			code.push_back(uint16_t((2 * (1 + operands.size())) << 12 | flags << 8 | opcode));
+			code.insert(code.end(), operands.begin(), operands.end());
+		}
+
+		/*! Starts a clump at the current end of the code and returns its
+		 * index. It starts once it has been fired fireCount times. */
+		unsigned addClump(unsigned fireCount = 0)
+		{
+			Clump clump = { fireCount, uint16_t(code.size()), std::vector<uint8_t>() };
+			clumps.push_back(clump);
+			return unsigned(clumps.size() - 1);
+		}
+
+		/*! Adds a clump that OP_FINCLUMP of the given clump can fire. */
+		void addDependent(unsigned clump, unsigned dependent) { clumps[clump].dependents.push_back(uint8_t(dependent)); }
+
+		/*! Current length of the code, in words. */
+		unsigned getCodeLength() const { return unsigned(code.size()); }
+
+		/*! Operand for a branch added next that goes to the given word. */
+		uint16_t branchTo(unsigned target) const { return uint16_t(int(target) - int(code.size())); }
+
+		RXEFile *create() const
+		{
+			const unsigned dopeVectorCount = unsigned(arrays.size() + 1);
+			const unsigned dopeVectorSize = 10;
+			const unsigned dynamicStart = alignedTo(staticSize, 4);
+
+			// The dope vectors, then the contents of each array, all in
+			// data space offsets.
+			std::vector<uint8_t> dynamicData;
+			std::vector<unsigned> offsets(dopeVectorCount, dynamicStart);
+			unsigned end = alignedTo(dynamicStart + dopeVectorCount * dopeVectorSize, 4);
+			for (unsigned i = 1; i < dopeVectorCount; i++)
+			{
+				offsets[i] = end;
+				end = alignedTo(end + unsigned(arrays[i - 1].contents.size()), 4);
+			}
+			for (unsigned i = 0; i < dopeVectorCount; i++)
+			{
+				unsigned elementSize = i == 0 ? dopeVectorSize : arrays[i - 1].elementSize;
+				unsigned elementCount = i == 0 ? dopeVectorCount : unsigned(arrays[i - 1].contents.size()) / elementSize;
+				appendLittleEndian(dynamicData, offsets[i], 2);
+				appendLittleEndian(dynamicData, elementSize, 2);
+				appendLittleEndian(dynamicData, elementCount, 2);
+				appendLittleEndian(dynamicData, 0xFFFF, 2);
+				appendLittleEndian(dynamicData, i + 1 < dopeVectorCount ? i + 1 : 0xFFFF, 2);
+			}
+			for (unsigned i = 1; i < dopeVectorCount; i++)
+			{
+				dynamicData.resize(offsets[i] - dynamicStart, 0);
+				dynamicData.insert(dynamicData.end(), arrays[i - 1].contents.begin(), arrays[i - 1].contents.end());
+			}
+			dynamicData.resize(end - dynamicStart, 0);
+
+			std::vector<uint8_t> file;
+			const char format[16] = { 'M', 'i', 'n', 'd', 's', 't', 'o', 'r', 'm', 's', 'N', 'X', 'T', 0, 0, 5 };
+			file.insert(file.end(), format, format + sizeof(format));
+			appendLittleEndian(file, unsigned(entries.size()), 2);
+			appendLittleEndian(file, end, 2);
+			appendLittleEndian(file, dynamicStart, 2);
+			appendLittleEndian(file, unsigned(staticDefaults.size() + dynamicData.size()), 2);
+			appendLittleEndian(file, unsigned(staticDefaults.size()), 2);
+			appendLittleEndian(file, unsigned(dynamicData.size()), 2);
+			appendLittleEndian(file, 0, 2);
+			appendLittleEndian(file, dopeVectorCount - 1, 2);
+			appendLittleEndian(file, dynamicStart, 2);
+			appendLittleEndian(file, unsigned(clumps.size()), 2);
+			appendLittleEndian(file, unsigned(code.size()), 2);
+			for (unsigned i = 0; i < entries.size(); i++)
+			{
+				file.push_back(entries[i].type);
+				file.push_back(entries[i].flags);
+				appendLittleEndian(file, entries[i].descriptor, 2);
+			}
+			file.insert(file.end(), staticDefaults.begin(), staticDefaults.end());
+			file.insert(file.end(), dynamicData.begin(), dynamicData.end());
+			if (file.size() % 2 != 0) file.push_back(0);
+			for (unsigned i = 0; i < clumps.size(); i++)
+			{
+				file.push_back(uint8_t(clumps[i].fireCount));
+				file.push_back(uint8_t(clumps[i].dependents.size()));
+				appendLittleEndian(file, clumps[i].start, 2);
+			}
+			for (unsigned i = 0; i < clumps.size(); i++)
+				file.insert(file.end(), clumps[i].dependents.begin(), clumps[i].dependents.end());
+			for (unsigned i = 0; i < code.size(); i++)
+				appendLittleEndian(file, code[i], 2);
+
+			return new RXEFile(&file[0], file.size());
+		}
+	};
+
+	// Operands of an instruction, written as Operands()(a)(b).
+	struct Operands : std::vector<uint16_t>
+	{
+		Operands &operator()(unsigned operand)
+		{
+			push_back(uint16_t(operand));
+			return *this;
+		}
+	};
+
+	const unsigned notAnEntry = 0xFFFF;
+
+	std::vector<uint8_t> bytes(const char *values)
+	{
+		return std::vector<uint8_t>(values, values + strlen(values));
+	}
+
+	std::string arrayContents(VMMemory &memory, unsigned entry)
+	{
+		std::string contents;
+		for (unsigned i = 0; i < memory.getArrayLength(entry); i++)
+			contents += char(memory.getArrayElement(entry, i));
+		return contents;
+	}
+
+	void testMisalignedBranch()
+	{
+		const char *test = "misaligned branch";
+
+		// A jump to the second word of the move after it.
+		TestProgram source;
+		unsigned from = source.addScalar(RXEFile::TC_SLONG, 1);
+		unsigned to = source.addScalar(RXEFile::TC_SLONG, 0);
+		source.addClump();
+		source.addInstruction(OP_JMP, Operands()(3));
+		source.addInstruction(OP_MOV, Operands()(to)(from));
+		source.addInstruction(OP_FINCLUMP, Operands()(notAnEntry)(notAnEntry));
+
+		RXEFile *file = source.create();
+		{
+			VMMemory memory(file);
+			System system(&memory);
+			Interpreter interpreter(file, &memory, &system);
+
+			VMDiagnostics::Event event;
+			VMDiagnostics *diagnostics = interpreter.getDiagnostics();
+			check(diagnostics->pop(event), test, "is reported when the program is loaded");
+			check(event.code == VMDiagnostics::Fault && event.word == 0 && event.clump == 0, test, "is reported as a fault of the branch");
+			check(diagnostics->describe(event).find("branch into middle of instruction") != std::string::npos, test, "is described as such");
+			check(!diagnostics->pop(event), test, "is reported once");
+		}
+		delete file;
+	}
+
+	void testArraySubset()
+	{
+		const char *test = "array subset";
+
+		TestProgram source;
+		unsigned letters = source.addArray(RXEFile::TC_UBYTE, bytes("abcdef"));
+		unsigned subset = source.addArray(RXEFile::TC_UBYTE, bytes(""));
+		unsigned rest = source.addArray(RXEFile::TC_UBYTE, bytes("x"));
+		unsigned past = source.addArray(RXEFile::TC_UBYTE, bytes("x"));
+		unsigned built = source.addArray(RXEFile::TC_UBYTE, bytes(""));
+		unsigned two = source.addScalar(RXEFile::TC_SLONG, 2);
+		unsigned three = source.addScalar(RXEFile::TC_SLONG, 3);
+		unsigned hundred = source.addScalar(RXEFile::TC_SLONG, 100);
+		unsigned dash = source.addScalar(RXEFile::TC_UBYTE, '-');
+		source.addClump();
+		source.addInstruction(OP_ARRSUBSET, Operands()(subset)(letters)(two)(three));
+		source.addInstruction(OP_ARRSUBSET, Operands()(rest)(letters)(two)(notAnEntry));
+		source.addInstruction(OP_ARRSUBSET, Operands()(past)(letters)(hundred)(notAnEntry));
+		source.addInstruction(OP_ARRBUILD, Operands()(12)(built)(dash)(subset)(dash));
+		source.addInstruction(OP_ARRSUBSET, Operands()(letters)(letters)(three)(hundred));
+		source.addInstruction(OP_FINCLUMP, Operands()(notAnEntry)(notAnEntry));
+
+		RXEFile *file = source.create();
+		{
+			VMMemory memory(file);
+			System system(&memory);
+			Interpreter interpreter(file, &memory, &system);
+			check(interpreter.isVerified(), test, "passes verification");
+			check(interpreter.run(100) == Interpreter::Stopped, test, "runs to the end");
+
+			check(arrayContents(memory, subset) == "cde", test, "copies a range");
+			check(arrayContents(memory, rest) == "cdef", test, "copies the rest without a count");
+			check(arrayContents(memory, past) == "", test, "is empty when starting past the end");
+			check(arrayContents(memory, built) == "-cde-", test, "array build appends arrays");
+			check(arrayContents(memory, letters) == "def", test, "works in place");
+
+			memory.copyRange(subset, letters, 1, 1);
+			check(arrayContents(memory, subset) == "e", test, "VMMemory copies a single element");
+		}
+		delete file;
+	}
+
+	// Bytes of a string with its terminator, as the compilers store it.
+	std::vector<uint8_t> text(const char *value)
+	{
+		return std::vector<uint8_t>(value, value + strlen(value) + 1);
+	}
+
+	// What arrayContents returns for a terminated string.
+	std::string terminated(const char *value)
+	{
+		return std::string(value) + '\0';
+	}
+
+	void testStrings()
+	{
+		const char *test = "strings";
+
+		TestProgram source;
+		unsigned hello = source.addArray(RXEFile::TC_UBYTE, text("hello"));
+		unsigned comma = source.addArray(RXEFile::TC_UBYTE, text(", "));
+		unsigned world = source.addArray(RXEFile::TC_UBYTE, text("world"));
+		unsigned empty = source.addArray(RXEFile::TC_UBYTE, text(""));
+		unsigned nothing = source.addArray(RXEFile::TC_UBYTE, bytes(""));
+		unsigned unterminated = source.addArray(RXEFile::TC_UBYTE, bytes("abc"));
+		unsigned joined = source.addArray(RXEFile::TC_UBYTE, text(""));
+		unsigned joinedEmpty = source.addArray(RXEFile::TC_UBYTE, text("x"));
+		unsigned joinedUnterminated = source.addArray(RXEFile::TC_UBYTE, text(""));
+		unsigned doubled = source.addArray(RXEFile::TC_UBYTE, text("ab"));
+		unsigned negative = source.addScalar(RXEFile::TC_SLONG, -123);
+		unsigned minimum = source.addScalar(RXEFile::TC_SLONG, int32_t(0x80000000u));
+		unsigned maximum = source.addScalar(RXEFile::TC_ULONG, int32_t(0xFFFFFFFFu));
+		unsigned zero = source.addScalar(RXEFile::TC_SLONG, 0);
+		unsigned negativeText = source.addArray(RXEFile::TC_UBYTE, text(""));
+		unsigned minimumText = source.addArray(RXEFile::TC_UBYTE, text(""));
+		unsigned maximumText = source.addArray(RXEFile::TC_UBYTE, text(""));
+		unsigned zeroText = source.addArray(RXEFile::TC_UBYTE, text("old text"));
+		unsigned numbers = source.addArray(RXEFile::TC_UBYTE, text("x -42.5 rest"));
+		unsigned digits = source.addArray(RXEFile::TC_UBYTE, bytes("12"));
+		unsigned fallback = source.addScalar(RXEFile::TC_SLONG, 99);
+		unsigned parsed[4];
+		unsigned past[4];
+		for (unsigned i = 0; i < 4; i++)
+		{
+			parsed[i] = source.addScalar(RXEFile::TC_SLONG, -1);
+			past[i] = source.addScalar(RXEFile::TC_SLONG, -1);
+		}
+		unsigned three = source.addScalar(RXEFile::TC_SLONG, 3);
+		unsigned seven = source.addScalar(RXEFile::TC_SLONG, 7);
+		unsigned ten = source.addScalar(RXEFile::TC_SLONG, 10);
+		unsigned hundred = source.addScalar(RXEFile::TC_SLONG, 100);
+		unsigned tail = source.addArray(RXEFile::TC_UBYTE, text(""));
+		unsigned clipped = source.addArray(RXEFile::TC_UBYTE, text(""));
+		unsigned pastEnd = source.addArray(RXEFile::TC_UBYTE, text("x"));
+		unsigned emptySubset = source.addArray(RXEFile::TC_UBYTE, text("x"));
+
+		source.addClump();
+		source.addInstruction(OP_STRCAT, Operands()(12)(joined)(hello)(comma)(world));
+		source.addInstruction(OP_STRCAT, Operands()(10)(joinedEmpty)(empty)(nothing));
+		source.addInstruction(OP_STRCAT, Operands()(10)(joinedUnterminated)(unterminated)(hello));
+		source.addInstruction(OP_STRCAT, Operands()(10)(doubled)(doubled)(doubled));
+		source.addInstruction(OP_NUMTOSTRING, Operands()(negativeText)(negative));
+		source.addInstruction(OP_NUMTOSTRING, Operands()(minimumText)(minimum));
+		source.addInstruction(OP_NUMTOSTRING, Operands()(maximumText)(maximum));
+		source.addInstruction(OP_NUMTOSTRING, Operands()(zeroText)(zero));
+		source.addInstruction(OP_STRINGTONUM, Operands()(parsed[0])(past[0])(numbers)(notAnEntry)(fallback));
+		source.addInstruction(OP_STRINGTONUM, Operands()(parsed[1])(past[1])(numbers)(seven)(fallback));
+		source.addInstruction(OP_STRINGTONUM, Operands()(parsed[2])(past[2])(empty)(notAnEntry)(notAnEntry));
+		source.addInstruction(OP_STRINGTONUM, Operands()(parsed[3])(past[3])(digits)(notAnEntry)(fallback));
+		source.addInstruction(OP_STRSUBSET, Operands()(tail)(hello)(three)(notAnEntry));
+		source.addInstruction(OP_STRSUBSET, Operands()(clipped)(hello)(three)(hundred));
+		source.addInstruction(OP_STRSUBSET, Operands()(pastEnd)(hello)(ten)(three));
+		source.addInstruction(OP_STRSUBSET, Operands()(emptySubset)(nothing)(notAnEntry)(notAnEntry));
+		source.addInstruction(OP_FINCLUMP, Operands()(notAnEntry)(notAnEntry));
+
+		RXEFile *file = source.create();
+		{
+			VMMemory memory(file);
+			System system(&memory);
+			Interpreter interpreter(file, &memory, &system);
+			check(interpreter.isVerified(), test, "passes verification");
+			check(interpreter.run(100) == Interpreter::Stopped, test, "runs to the end");
+
+			check(arrayContents(memory, joined) == terminated("hello, world"), test, "strcat joins strings");
+			check(arrayContents(memory, joinedEmpty) == terminated(""), test, "strcat of empty strings is empty");
+			check(arrayContents(memory, joinedUnterminated) == terminated("abchello"), test, "strcat takes all of a string without terminator");
+			check(arrayContents(memory, doubled) == terminated("abab"), test, "strcat can append a string to itself");
+
+			check(arrayContents(memory, negativeText) == terminated("-123"), test, "numtostring writes negative numbers");
+			check(arrayContents(memory, minimumText) == terminated("-2147483648"), test, "numtostring writes the smallest int");
+			check(arrayContents(memory, maximumText) == terminated("4294967295"), test, "numtostring writes unsigned numbers as such");
+			check(arrayContents(memory, zeroText) == terminated("0"), test, "numtostring replaces a longer string");
+
+			check(memory.getScalarValue(parsed[0]) == -42 && memory.getScalarValue(past[0]) == 7, test, "stringtonum skips to the number and drops the fraction");
+			check(memory.getScalarValue(parsed[1]) == 99 && memory.getScalarValue(past[1]) == 12, test, "stringtonum gives the default without a number");
+			check(memory.getScalarValue(parsed[2]) == 0 && memory.getScalarValue(past[2]) == 0, test, "stringtonum of an empty string is 0");
+			check(memory.getScalarValue(parsed[3]) == 12 && memory.getScalarValue(past[3]) == 2, test, "stringtonum reads a string without terminator");
+
+			check(arrayContents(memory, tail) == terminated("lo"), test, "strsubset copies the rest without a length");
+			check(arrayContents(memory, clipped) == terminated("lo"), test, "strsubset stops at the end of the string");
+			check(arrayContents(memory, pastEnd) == terminated(""), test, "strsubset past the end is empty");
+			check(arrayContents(memory, emptySubset) == terminated(""), test, "strsubset of an empty array is empty");
+		}
+		delete file;
+	}
+
+	// Whether the array holds the pattern that fillArray writes, after the
+	// given prefix.
+	bool hasPattern(VMMemory &memory, unsigned entry, const std::string &prefix, unsigned length)
+	{
+		if (memory.getArrayLength(entry) != length) return false;
+		if (arrayContents(memory, entry).compare(0, prefix.size(), prefix) != 0) return false;
+		for (unsigned i = unsigned(prefix.size()); i < length; i++)
+			if (memory.getArrayElement(entry, i) != int32_t(i % 251)) return false;
+		return true;
+	}
+
+	void fillArray(VMMemory &memory, unsigned entry, unsigned start)
+	{
+		for (unsigned i = start; i < memory.getArrayLength(entry); i++)
+			memory.setArrayElement(entry, i, int32_t(i % 251));
+	}
+
+	void testArrayPool()
+	{
+		const char *test = "array pool";
+
+		TestProgram source;
+		unsigned first = source.addArray(RXEFile::TC_UBYTE, bytes("abc"));
+		unsigned second = source.addArray(RXEFile::TC_UBYTE, bytes("defg"));
+		unsigned third = source.addArray(RXEFile::TC_UBYTE, bytes("hi"));
+		source.addClump();
+		source.addInstruction(OP_FINCLUMP, Operands()(notAnEntry)(notAnEntry));
+
+		RXEFile *file = source.create();
+		{
+			VMMemory memory(file);
+			const unsigned firstArray = unsigned(memory.getScalarValue(first));
+			const unsigned thirdArray = unsigned(memory.getScalarValue(third));
+			const unsigned startOffset = memory.getArrayLayout(firstArray).offset;
+
+			// Growing an array that is not the last one moves it to the end.
+			memory.setArrayLength(first, 10000);
+			fillArray(memory, first, 3);
+			VMMemory::ArrayLayout moved = memory.getArrayLayout(firstArray);
+			check(moved.offset != startOffset && moved.elementCount == 10000, test, "growing moves an array");
+			check(moved.link == 0xFFFF && memory.getArrayLayout(thirdArray).link == firstArray, test, "a moved array is last in the list");
+			check(hasPattern(memory, first, "abc", 10000), test, "a moved array keeps its contents");
+			check(arrayContents(memory, second) == "defg" && arrayContents(memory, third) == "hi", test, "moving leaves the other arrays alone");
+			check(memory.getPoolStatistics().fragmentedBytes > 0, test, "moving leaves a hole");
+
+			// Leave the hole, free the first array, then ask for more than is
+			// left at the end, but not more than there is in total.
+			memory.setArrayLength(third, 10000);
+			fillArray(memory, third, 2);
+			memory.setArrayLength(first, 0);
+			const unsigned thirdOffset = memory.getArrayLayout(thirdArray).offset;
+			const unsigned holes = memory.getPoolStatistics().fragmentedBytes;
+			memory.setArrayLength(second, 14000);
+			VMMemory::PoolStatistics statistics = memory.getPoolStatistics();
+			check(statistics.compactionCount == 1, test, "compacts when the end is reached");
+			// Only the place the growing array left behind is free again.
+			check(statistics.fragmentedBytes < holes && statistics.fragmentedBytes <= 4, test, "compacting closes the holes");
+			check(statistics.highWaterMark >= statistics.endBytes && statistics.endBytes <= statistics.poolSize, test, "stays within the pool");
+			check(memory.getArrayLayout(thirdArray).offset < thirdOffset, test, "compacting moves arrays down");
+			check(hasPattern(memory, third, "hi", 10000), test, "compacted arrays keep their contents");
+			check(arrayContents(memory, second).compare(0, 4, "defg") == 0, test, "an array growing while compacting keeps its contents");
+
+			// More than the whole pool can never fit.
+			bool outOfMemory = false;
+			try
+			{
+				memory.setArrayLength(first, statistics.poolSize);
+			}
+			catch (std::runtime_error &)
+			{
+				outOfMemory = true;
+			}
+			check(outOfMemory, test, "running out of the pool is an error");
+			check(memory.getArrayLength(first) == 0 && hasPattern(memory, third, "hi", 10000), test, "running out of the pool changes nothing");
+		}
+		delete file;
+	}
+
+	void testReload()
+	{
+		const char *test = "reload";
+
+		// Changes a value and makes one array grow and move.
+		TestProgram source;
+		unsigned value = source.addScalar(RXEFile::TC_SLONG, 5);
+		unsigned changed = source.addScalar(RXEFile::TC_SLONG, 42);
+		unsigned letters = source.addArray(RXEFile::TC_UBYTE, bytes("abc"));
+		unsigned built = source.addArray(RXEFile::TC_UBYTE, bytes(""));
+		unsigned two = source.addScalar(RXEFile::TC_SLONG, 2);
+		source.addClump();
+		source.addInstruction(OP_MOV, Operands()(value)(changed));
+		source.addInstruction(OP_ARRBUILD, Operands()(10)(built)(letters)(letters));
+		source.addInstruction(OP_ARRSUBSET, Operands()(letters)(built)(two)(notAnEntry));
+		source.addInstruction(OP_FINCLUMP, Operands()(notAnEntry)(notAnEntry));
+
+		RXEFile *file = source.create();
+		{
+			VMMemory initial(file);
+			ExecutionContext context(file);
+			for (unsigned run = 0; run < 2; run++)
+			{
+				check(context.getMemory()->findDifference(initial) == ~0u, test, "starts in the initial state");
+				context.runInstructions(100);
+				check(context.getWakeTick() == ~0u, test, "runs to the end");
+
+				VMMemory copy(*context.getMemory());
+				check(copy.getScalarValue(value) == 42, test, "changes a value");
+				check(arrayContents(copy, letters) == "cabc" && arrayContents(copy, built) == "abcabc", test, "changes the arrays");
+				copy.setArrayElement(letters, 0, 'x');
+				check(context.getMemory()->findDifference(copy) == letters, test, "a copy of the memory is independent");
+
+				copy.restore(initial);
+				check(copy.findDifference(initial) == ~0u && arrayContents(copy, letters) == "abc" && arrayContents(copy, built) == "", test, "restoring gives the initial state");
+
+				context.reload();
+			}
+		}
+		delete file;
+	}
+
+	// Translates the program, compiles it with the C++ compiler in $CXX (or
+	// c++) into a temporary library, and loads that. Returns NULL and says
+	// why if there is no compiler.
+	NativeCode *compileNativeCode(const RXEFile *file, const DecodedProgram &program, unsigned &translatedCount)
+	{
+#ifdef _WIN32
+		printf("SKIP\tnative code\tcompiling is not supported on Windows\n");
+		return NULL;
+#else
+		char directory[] = "/tmp/rxeselftestXXXXXX";
+		if (!mkdtemp(directory))
+		{
+			printf("SKIP\tnative code\tcould not create a temporary directory\n");
+			return NULL;
+		}
+		const std::string source = std::string(directory) + "/program.cpp";
+		const std::string library = NativeCode::libraryPathForProgram(std::string(directory) + "/program.rxe");
+
+		RXETranslator translator(file, &program);
+		{
+			std::ofstream stream(source.c_str());
+			translator.write(stream, "self test");
+		}
+		translatedCount = translator.getTranslatedCount();
+
+		// NativeCodeInterface.h is next to this file.
+		std::string sourceDirectory(__FILE__);
+		size_t slash = sourceDirectory.find_last_of('/');
+		sourceDirectory = slash == std::string::npos ? "." : sourceDirectory.substr(0, slash);
+		const char *compiler = getenv("CXX");
+		std::string command = std::string(compiler ? compiler : "c++") + " -O1 -shared -fPIC -I\"" + sourceDirectory + "\" \"" + source + "\" -o \"" + library + "\" 2>/dev/null";
+
+		NativeCode *code = NULL;
+		if (system(command.c_str()) != 0)
+			printf("SKIP\tnative code\tcould not compile with %s\n", compiler ? compiler : "c++");
+		else
+		{
+			try
+			{
+				code = new NativeCode(library.c_str(), file);
+			}
+			catch (std::runtime_error &e)
+			{
+				check(false, "native code", e.what());
+			}
+		}
+
+		// The library stays loaded after it is deleted.
+		remove(library.c_str());
+		remove(source.c_str());
+		rmdir(directory);
+		return code;
+#endif
+	}
+
+	void testNativeCode()
+	{
+		const char *test = "native code";
+
+		// Arithmetic at the limits, a loop, and an instruction the
+		// translation hands back to the interpreter.
+		TestProgram source;
+		unsigned minimum = source.addScalar(RXEFile::TC_SLONG, int32_t(0x80000000u));
+		unsigned minusOne = source.addScalar(RXEFile::TC_SLONG, -1);
+		unsigned zero = source.addScalar(RXEFile::TC_SLONG, 0);
+		unsigned one = source.addScalar(RXEFile::TC_SLONG, 1);
+		unsigned seven = source.addScalar(RXEFile::TC_SLONG, 7);
+		unsigned twenty = source.addScalar(RXEFile::TC_SLONG, 20);
+		unsigned quotient = source.addScalar(RXEFile::TC_SLONG, 1);
+		unsigned remainder = source.addScalar(RXEFile::TC_SLONG, 1);
+		unsigned byZero = source.addScalar(RXEFile::TC_SLONG, 1);
+		unsigned counter = source.addScalar(RXEFile::TC_SLONG, 0);
+		unsigned sum = source.addScalar(RXEFile::TC_SLONG, 1);
+		unsigned part = source.addScalar(RXEFile::TC_SLONG, 0);
+		unsigned truncated = source.addScalar(RXEFile::TC_UBYTE, 0);
+		unsigned letters = source.addArray(RXEFile::TC_UBYTE, bytes("ab"));
+		unsigned built = source.addArray(RXEFile::TC_UBYTE, bytes(""));
+		source.addClump();
+		source.addInstruction(OP_DIV, Operands()(quotient)(minimum)(minusOne));
+		source.addInstruction(OP_MOD, Operands()(remainder)(minimum)(minusOne));
+		source.addInstruction(OP_DIV, Operands()(byZero)(seven)(zero));
+		const unsigned loop = source.getCodeLength();
+		source.addInstruction(OP_ADD, Operands()(counter)(counter)(one));
+		source.addInstruction(OP_MUL, Operands()(sum)(sum)(seven));
+		source.addInstruction(OP_ADD, Operands()(sum)(sum)(counter));
+		source.addInstruction(OP_MOD, Operands()(part)(sum)(seven));
+		source.addInstruction(OP_MOV, Operands()(truncated)(sum));
+		source.addInstruction(OP_ARRBUILD, Operands()(10)(built)(letters)(letters));
+		source.addInstruction(OP_BRCMP, Operands()(source.branchTo(loop))(counter)(twenty), 0);
+		source.addInstruction(OP_FINCLUMP, Operands()(notAnEntry)(notAnEntry));
+
+		RXEFile *file = source.create();
+		{
+			VMMemory interpretedMemory(file);
+			System interpretedSystem(&interpretedMemory);
+			Interpreter interpreted(file, &interpretedMemory, &interpretedSystem);
+			check(interpreted.isVerified(), test, "the program passes verification");
+			check(interpreted.run(10000) == Interpreter::Stopped, test, "the interpreter runs to the end");
+			check(interpretedMemory.getScalarValue(quotient) == int32_t(0x80000000u), test, "the smallest int divided by -1 wraps around");
+			check(interpretedMemory.getScalarValue(remainder) == 0, test, "the smallest int modulo -1 is 0");
+			check(interpretedMemory.getScalarValue(byZero) == 0, test, "division by zero gives 0");
+
+			unsigned translatedCount = 0;
+			DecodedProgram program(file);
+			NativeCode *code = compileNativeCode(file, program, translatedCount);
+			if (code)
+			{
+				VMMemory nativeMemory(file);
+				System nativeSystem(&nativeMemory);
+				Interpreter native(file, &nativeMemory, &nativeSystem);
+				native.setNativeCode(code->getExecuteFunction());
+				check(translatedCount > 0 && translatedCount < program.getInstructionCount(), test, "runs partly natively");
+				check(native.run(10000) == Interpreter::Stopped, test, "runs to the end");
+				check(nativeMemory.findDifference(interpretedMemory) == ~0u, test, "ends with the same memory as the interpreter");
+				native.setNativeCode(NULL);
+				delete code;
+			}
+		}
+		delete file;
+	}
+
+	void testQuantum()
+	{
+		const char *test = "quantum";
+
+		// Two clumps that count forever, two instructions per round.
+		TestProgram source;
+		unsigned one = source.addScalar(RXEFile::TC_SLONG, 1);
+		unsigned first = source.addScalar(RXEFile::TC_SLONG, 0);
+		unsigned second = source.addScalar(RXEFile::TC_SLONG, 0);
+		const unsigned counters[2] = { first, second };
+		for (unsigned i = 0; i < 2; i++)
+		{
+			source.addClump();
+			const unsigned loop = source.getCodeLength();
+			source.addInstruction(OP_ADD, Operands()(counters[i])(counters[i])(one));
+			source.addInstruction(OP_JMP, Operands()(source.branchTo(loop)));
+		}
+
+		RXEFile *file = source.create();
+		{
+			VMMemory memory(file);
+			System system(&memory);
+			Interpreter interpreter(file, &memory, &system);
+			check(interpreter.isVerified(), test, "passes verification");
+
+			interpreter.run(20);
+			check(memory.getScalarValue(first) == 10 && memory.getScalarValue(second) == 0, test, "the first clump runs for 20 instructions");
+			interpreter.run(20);
+			check(memory.getScalarValue(first) == 10 && memory.getScalarValue(second) == 10, test, "then the second one");
+			interpreter.run(30);
+			check(memory.getScalarValue(first) == 20 && memory.getScalarValue(second) == 15, test, "the turns carry over between calls");
+			for (unsigned i = 0; i < 10; i++)
+				interpreter.step();
+			check(memory.getScalarValue(first) == 20 && memory.getScalarValue(second) == 20, test, "single steps take turns the same way");
+		}
+		delete file;
+	}
+
+	void testMutex()
+	{
+		const char *test = "mutex";
+
+		// Clump 0 holds the mutex for a while. Clumps 1 to 3 then each take a
+		// number while they have it, but clump 1 only asks after the others.
+		TestProgram source;
+		unsigned mutex = source.addScalar(RXEFile::TC_MUTEX, 0);
+		unsigned zero = source.addScalar(RXEFile::TC_SLONG, 0);
+		unsigned one = source.addScalar(RXEFile::TC_SLONG, 1);
+		unsigned hundred = source.addScalar(RXEFile::TC_SLONG, 100);
+		unsigned holding = source.addScalar(RXEFile::TC_SLONG, 0);
+		unsigned delay = source.addScalar(RXEFile::TC_SLONG, 0);
+		unsigned ticket = source.addScalar(RXEFile::TC_SLONG, 0);
+		unsigned turns[3];
+		for (unsigned i = 0; i < 3; i++)
+			turns[i] = source.addScalar(RXEFile::TC_SLONG, 0);
+
+		source.addClump();
+		source.addInstruction(OP_ACQUIRE, Operands()(mutex));
+		unsigned loop = source.getCodeLength();
+		source.addInstruction(OP_ADD, Operands()(holding)(holding)(one));
+		source.addInstruction(OP_BRCMP, Operands()(source.branchTo(loop))(holding)(hundred), 0);
+		source.addInstruction(OP_RELEASE, Operands()(mutex));
+		source.addInstruction(OP_FINCLUMP, Operands()(notAnEntry)(notAnEntry));
+		for (unsigned i = 0; i < 3; i++)
+		{
+			source.addClump();
+			if (i == 0)
+			{
+				loop = source.getCodeLength();
+				source.addInstruction(OP_ADD, Operands()(delay)(delay)(one));
+				source.addInstruction(OP_BRCMP, Operands()(source.branchTo(loop))(delay)(hundred), 0);
+			}
+			source.addInstruction(OP_ACQUIRE, Operands()(mutex));
+			source.addInstruction(OP_ADD, Operands()(ticket)(ticket)(one));
+			source.addInstruction(OP_ADD, Operands()(turns[i])(ticket)(zero));
+			source.addInstruction(OP_RELEASE, Operands()(mutex));
+			source.addInstruction(OP_FINCLUMP, Operands()(notAnEntry)(notAnEntry));
+		}
+
+		RXEFile *file = source.create();
+		{
+			VMMemory memory(file);
+			System system(&memory);
+			Interpreter interpreter(file, &memory, &system);
+			check(interpreter.isVerified(), test, "passes verification");
+			check(interpreter.run(10000) == Interpreter::Stopped, test, "every clump gets the mutex");
+			check(memory.getScalarValue(turns[1]) == 1 && memory.getScalarValue(turns[2]) == 2 && memory.getScalarValue(turns[0]) == 3, test, "waiting clumps get it in the order they asked");
+			check(memory.getScalarValue(mutex) == int32_t(0xFFFFFFFFu), test, "is free at the end");
+		}
+		delete file;
+	}
+
+	void testFireCounts()
+	{
+		const char *test = "fire counts";
+
+		// Clump 2 depends on clumps 0 and 1, which finish one after another.
+		TestProgram source;
+		unsigned one = source.addScalar(RXEFile::TC_SLONG, 1);
+		unsigned runs = source.addScalar(RXEFile::TC_SLONG, 0);
+		for (unsigned i = 0; i < 2; i++)
+		{
+			unsigned clump = source.addClump();
+			source.addDependent(clump, 2);
+			source.addInstruction(OP_FINCLUMP, Operands()(0)(0));
+		}
+		source.addClump(2);
+		source.addInstruction(OP_ADD, Operands()(runs)(runs)(one));
+		source.addInstruction(OP_FINCLUMP, Operands()(notAnEntry)(notAnEntry));
+
+		RXEFile *file = source.create();
+		{
+			VMMemory memory(file);
+			System system(&memory);
+			Interpreter interpreter(file, &memory, &system);
+			check(interpreter.isVerified(), test, "passes verification");
+
+			interpreter.run(1);
+			check(memory.getScalarValue(runs) == 0 && !interpreter.isStopped(), test, "one finished predecessor is not enough");
+			check(interpreter.run(100) == Interpreter::Stopped, test, "the program ends");
+			check(memory.getScalarValue(runs) == 1, test, "a clump runs once both predecessors finished");
+
+			memory.setScalarValue(runs, 0);
+			interpreter.reset();
+			interpreter.run(100);
+			check(memory.getScalarValue(runs) == 1, test, "fire counts start over after a reset");
+		}
+		delete file;
+	}
+
+	void testSubroutine()
+	{
+		const char *test = "subroutine";
+
+		// Clump 0 calls clump 1 twice and then reads what it did.
+		TestProgram source;
+		unsigned one = source.addScalar(RXEFile::TC_SLONG, 1);
+		unsigned zero = source.addScalar(RXEFile::TC_SLONG, 0);
+		unsigned caller = source.addScalar(RXEFile::TC_UBYTE, 0);
+		unsigned calls = source.addScalar(RXEFile::TC_SLONG, 0);
+		unsigned seen = source.addScalar(RXEFile::TC_SLONG, 0);
+		source.addClump();
+		source.addInstruction(OP_SUBCALL, Operands()(1)(caller));
+		source.addInstruction(OP_SUBCALL, Operands()(1)(caller));
+		source.addInstruction(OP_ADD, Operands()(seen)(calls)(zero));
+		source.addInstruction(OP_FINCLUMP, Operands()(notAnEntry)(notAnEntry));
+		source.addClump(1);
+		source.addInstruction(OP_ADD, Operands()(calls)(calls)(one));
+		source.addInstruction(OP_SUBRET, Operands()(caller));
+
+		RXEFile *file = source.create();
+		{
+			VMMemory memory(file);
+			System system(&memory);
+			Interpreter interpreter(file, &memory, &system);
+			check(interpreter.isVerified(), test, "passes verification");
+
+			// The caller waits while the subroutine runs.
+			interpreter.run(2);
+			check(memory.getScalarValue(calls) == 1 && memory.getScalarValue(caller) == 0, test, "runs in place of the caller");
+			check(interpreter.run(100) == Interpreter::Stopped, test, "the program ends");
+			check(memory.getScalarValue(calls) == 2, test, "starts from the beginning on every call");
+			check(memory.getScalarValue(seen) == 2, test, "returns to the caller after the call");
+		}
+		delete file;
+	}
+
+	void testStop()
+	{
+		const char *test = "stop";
+
+		// Clump 0 stops the program while clump 1 waits for a tick, clump 2
+		// polls the tick and clump 3 counts.
+		TestProgram source;
+		unsigned one = source.addScalar(RXEFile::TC_SLONG, 1);
+		unsigned later = source.addScalar(RXEFile::TC_SLONG, 1000);
+		unsigned hundred = source.addScalar(RXEFile::TC_SLONG, 100);
+		unsigned delay = source.addScalar(RXEFile::TC_SLONG, 0);
+		unsigned tick = source.addScalar(RXEFile::TC_ULONG, 0);
+		unsigned counter = source.addScalar(RXEFile::TC_SLONG, 0);
+		unsigned after = source.addScalar(RXEFile::TC_SLONG, 0);
+
+		source.addClump();
+		unsigned loop = source.getCodeLength();
+		source.addInstruction(OP_ADD, Operands()(delay)(delay)(one));
+		source.addInstruction(OP_BRCMP, Operands()(source.branchTo(loop))(delay)(hundred), 0);
+		source.addInstruction(OP_STOP, Operands()(notAnEntry));
+		source.addClump();
+		source.addInstruction(OP_WAIT, Operands()(notAnEntry)(later));
+		source.addInstruction(OP_ADD, Operands()(after)(after)(one));
+		source.addInstruction(OP_FINCLUMP, Operands()(notAnEntry)(notAnEntry));
+		source.addClump();
+		loop = source.getCodeLength();
+		source.addInstruction(OP_GETTICK, Operands()(tick));
+		source.addInstruction(OP_BRCMP, Operands()(source.branchTo(loop))(tick)(later), 0);
+		source.addInstruction(OP_ADD, Operands()(after)(after)(one));
+		source.addInstruction(OP_FINCLUMP, Operands()(notAnEntry)(notAnEntry));
+		source.addClump();
+		loop = source.getCodeLength();
+		source.addInstruction(OP_ADD, Operands()(counter)(counter)(one));
+		source.addInstruction(OP_JMP, Operands()(source.branchTo(loop)));
+
+		RXEFile *file = source.create();
+		{
+			SimulationClock clock;
+			VMMemory memory(file);
+			System system(&memory);
+			system.setTickSource(&clock);
+			Interpreter interpreter(file, &memory, &system);
+			check(interpreter.isVerified(), test, "passes verification");
+
+			check(interpreter.run(10000) == Interpreter::Stopped && interpreter.isStopped(), test, "ends the program");
+			check(interpreter.waitingUntilTick() == ~0u, test, "no clump waits for a tick any more");
+			int32_t count = memory.getScalarValue(counter);
+			check(count > 0, test, "other clumps ran before");
+
+			clock.advance(2.0f);
+			interpreter.run(10000);
+			check(memory.getScalarValue(counter) == count && memory.getScalarValue(after) == 0, test, "no clump runs afterwards");
+		}
+		delete file;
+	}
+
+	// A tick that moves on by one every time it is read.
+	class SteppingTickSource : public TickSource
+	{
+		mutable unsigned tick;
+
+	public:
+		SteppingTickSource() : tick(0) {}
+		virtual unsigned getTick() const { return tick++; }
+	};
+
+	void testPollingLoops()
+	{
+		const char *test = "polling loops";
+
+		// Clump 0 polls the tick until it reaches 100.
+		TestProgram source;
+		unsigned hundred = source.addScalar(RXEFile::TC_SLONG, 100);
+		unsigned tick = source.addScalar(RXEFile::TC_ULONG, 0);
+		source.addClump();
+		unsigned loop = source.getCodeLength();
+		source.addInstruction(OP_GETTICK, Operands()(tick));
+		source.addInstruction(OP_BRCMP, Operands()(source.branchTo(loop))(tick)(hundred), 0);
+		source.addInstruction(OP_FINCLUMP, Operands()(notAnEntry)(notAnEntry));
+
+		RXEFile *file = source.create();
+		{
+			DecodedProgram program(file);
+			check(PollingLoops(file, &program).getCount() == 1, test, "a loop reading the tick is found");
+
+			SimulationClock clock;
+			VMMemory memory(file);
+			System system(&memory);
+			system.setTickSource(&clock);
+			Interpreter interpreter(file, &memory, &system);
+
+			unsigned executed = 0;
+			check(interpreter.run(1000, ~0u, &executed) == Interpreter::Waiting && executed == 2, test, "parks after one round");
+			check(interpreter.waitingUntilTick() == 0, test, "a parked clump is not waiting for a tick");
+			check(interpreter.run(1000, ~0u, &executed) == Interpreter::Waiting && executed == 2, test, "goes round once more on the next run");
+			clock.advance(1.0f);
+			check(interpreter.run(1000, ~0u, &executed) == Interpreter::Stopped && executed == 3, test, "leaves the loop once the tick has changed");
+
+			// Every round reads a new tick here, so the clump is woken again
+			// within the same run.
+			SteppingTickSource stepping;
+			system.setTickSource(&stepping);
+			interpreter.reset();
+			check(interpreter.run(1000) == Interpreter::Stopped, test, "wakes up on a new tick");
+		}
+		delete file;
+	}
+
+	void testPollingWakesOnOtherClumps()
+	{
+		const char *test = "polling loops";
+
+		// Clump 0 polls a flag that clump 1 sets after counting to 100.
+		TestProgram source;
+		unsigned zero = source.addScalar(RXEFile::TC_SLONG, 0);
+		unsigned one = source.addScalar(RXEFile::TC_SLONG, 1);
+		unsigned hundred = source.addScalar(RXEFile::TC_SLONG, 100);
+		unsigned flag = source.addScalar(RXEFile::TC_SLONG, 0);
+		unsigned copy = source.addScalar(RXEFile::TC_SLONG, 0);
+		unsigned counter = source.addScalar(RXEFile::TC_SLONG, 0);
+		source.addClump();
+		unsigned loop = source.getCodeLength();
+		source.addInstruction(OP_ADD, Operands()(copy)(flag)(zero));
+		source.addInstruction(OP_BRCMP, Operands()(source.branchTo(loop))(copy)(zero), 4);
+		source.addInstruction(OP_FINCLUMP, Operands()(notAnEntry)(notAnEntry));
+		source.addClump();
+		loop = source.getCodeLength();
+		source.addInstruction(OP_ADD, Operands()(counter)(counter)(one));
+		source.addInstruction(OP_BRCMP, Operands()(source.branchTo(loop))(counter)(hundred), 0);
+		source.addInstruction(OP_ADD, Operands()(flag)(one)(zero));
+		source.addInstruction(OP_FINCLUMP, Operands()(notAnEntry)(notAnEntry));
+
+		RXEFile *file = source.create();
+		{
+			DecodedProgram program(file);
+			check(PollingLoops(file, &program).getCount() == 1, test, "only the loop that writes before it reads is polling");
+
+			SimulationClock clock;
+			VMMemory memory(file);
+			System system(&memory);
+			system.setTickSource(&clock);
+			Interpreter interpreter(file, &memory, &system);
+
+			// Without parking, the polling clump would take turns with the
+			// counting one, 20 instructions each.
+			unsigned executed = 0;
+			check(interpreter.run(10000, ~0u, &executed) == Interpreter::Stopped, test, "wakes up when another clump ran");
+			check(executed < 220, test, "does not take turns while parked");
+
+			// A loop that writes memory keeps running, without parking.
+			interpreter.reset();
+			memory.setScalarValue(counter, 0);
+			memory.setScalarValue(flag, 0);
+			check(interpreter.run(50, ~0u, &executed) == Interpreter::BudgetExhausted && executed == 50, test, "a loop that writes memory is not parked");
+		}
+		delete file;
+	}
+
+	// Reports count events with the values 0 to count - 1, each as if it
+	// were the first of its kind, and sets finished, if given, when done.
+	void reportNumbered(VMDiagnostics *diagnostics, unsigned count, std::atomic<bool> *finished)
+	{
+		for (unsigned i = 0; i < count; i++)
+		{
+			diagnostics->report(VMDiagnostics::UnknownSyscall, 0, 0, 1, int32_t(i));
+			diagnostics->resetCounts();
+		}
+		if (finished) finished->store(true);
+	}
+
+	void testDiagnostics()
+	{
+		const char *test = "diagnostics";
+
+		{
+			VMDiagnostics diagnostics;
+			for (unsigned i = 0; i < 100; i++)
+				diagnostics.report(VMDiagnostics::IgnoredInstruction, 7, 0, OP_SQRT);
+			diagnostics.report(VMDiagnostics::IgnoredInstruction, 8, 0, OP_SQRT);
+
+			std::vector<unsigned> counts;
+			VMDiagnostics::Event event;
+			while (diagnostics.pop(event) && event.word == 7)
+				counts.push_back(event.count);
+			const unsigned expected[] = { 1, 2, 4, 8, 16, 32, 64 };
+			check(counts == std::vector<unsigned>(expected, expected + 7), test, "repeated events are passed on at occurrences 1, 2, 4...");
+			check(event.word == 8 && event.count == 1, test, "the same event elsewhere is counted on its own");
+			check(!diagnostics.hasEvents(), test, "is empty once everything was taken");
+		}
+
+		{
+			// The buffer holds 256 events.
+			VMDiagnostics diagnostics;
+			reportNumbered(&diagnostics, 300, NULL);
+			unsigned taken = 0;
+			bool inOrder = true;
+			VMDiagnostics::Event event;
+			while (diagnostics.pop(event))
+				inOrder = inOrder && event.value == int32_t(taken++);
+			check(taken == 256 && inOrder, test, "a full buffer keeps the oldest events in order");
+			check(diagnostics.takeDroppedCount() == 44 && diagnostics.takeDroppedCount() == 0, test, "counts the events that did not fit");
+		}
+
+		{
+			// One thread reports while this one takes them out.
+			const unsigned count = 100000;
+			VMDiagnostics diagnostics;
+			std::atomic<bool> finished(false);
+			std::thread producer(reportNumbered, &diagnostics, count, &finished);
+			unsigned taken = 0;
+			int32_t last = -1;
+			bool inOrder = true;
+			VMDiagnostics::Event event;
+			while (true)
+			{
+				// Everything reported before finished was set is taken after.
+				bool done = finished.load();
+				while (diagnostics.pop(event))
+				{
+					inOrder = inOrder && event.value > last;
+					last = event.value;
+					taken++;
+				}
+				if (done) break;
+			}
+			producer.join();
+			check(inOrder, test, "events taken while reporting arrive in order");
+			check(taken + diagnostics.takeDroppedCount() == count, test, "every event is either taken or counted as dropped");
+		}
+	}
+
+	// The separating axis test for a single pair of boxes, written out one
+	// axis after the other. The batches test four pairs at once and have to
+	// give the same answers.
+	bool boxesOverlapAlongAxis(const float4 *a, const float4 *b, const float4 &axis, float &overlap)
+	{
+		float minA = a[0] * axis, maxA = minA;
+		float minB = b[0] * axis, maxB = minB;
+		for (unsigned i = 1; i < 4; i++)
+		{
+			minA = fminf(a[i] * axis, minA);
+			maxA = fmaxf(a[i] * axis, maxA);
+			minB = fminf(b[i] * axis, minB);
+			maxB = fmaxf(b[i] * axis, maxB);
+		}
+
+		float overlapLeft = maxB - minA;
+		float overlapRight = maxA - minB;
+		overlap = overlapLeft < overlapRight ? -overlapLeft : overlapRight;
+		return fminf(overlapLeft, overlapRight) > 0.0f;
+	}
+
+	bool boxesCollide(const float4 *a, const float4 *b, float4 &resolutionVector)
+	{
+		const float4 axes[4] = {
+			(a[0] - a[1]).normalized(),
+			(a[1] - a[2]).normalized(),
+			(b[0] - b[1]).normalized(),
+			(b[1] - b[2]).normalized()
+		};
+
+		float overlap = 20000000.0f;
+		for (unsigned i = 0; i < 4; i++)
+		{
+			float newOverlap;
+			if (!boxesOverlapAlongAxis(a, b, axes[i], newOverlap)) return false;
+			if (fabsf(newOverlap) < fabsf(overlap))
+			{
+				overlap = newOverlap;
+				resolutionVector = axes[i] * overlap;
+			}
+		}
+		return true;
+	}
+
+	void setRotatedBox(float4 *corners, float x, float z, float width, float length, float angle)
+	{
+		const float4 along(cosf(angle) * length * 0.5f, 0.0f, sinf(angle) * length * 0.5f, 0.0f);
+		const float4 across(-sinf(angle) * width * 0.5f, 0.0f, cosf(angle) * width * 0.5f, 0.0f);
+		const float4 center(x, 0.0f, z);
+		corners[0] = center + along + across;
+		corners[1] = center - along + across;
+		corners[2] = center - along - across;
+		corners[3] = center + along - across;
+	}
+
+	bool sameCollisions(const std::vector<BoxCollision> &collisions, const std::vector<BoxCollision> &expected)
+	{
+		if (collisions.size() != expected.size()) return false;
+		for (size_t i = 0; i < collisions.size(); i++)
+		{
+			if (collisions[i].index != expected[i].index) return false;
+			float4 difference = collisions[i].resolutionVector - expected[i].resolutionVector;
+			if (difference.length() > 0.0001f) return false;
+		}
+		return true;
+	}
+
+	void testCollisionBatch()
+	{
+		const char *test = "collision batch";
+
+		// Six walls and six robots of different sizes, more than one group
+		// of four each, so that the last group is only partly used.
+		AxisAlignedBoxBatch walls;
+		std::vector<float4> wallCorners;
+		OrientedBoxBatch robots;
+		std::vector<float4> robotCorners;
+		for (unsigned i = 0; i < 6; i++)
+		{
+			float4 min(1.3f * float(i), 0.0f, 0.9f * float(i % 3));
+			float4 max = min + float4(1.0f + float(i % 2), 0.0f, 0.5f + float(i % 3), 0.0f);
+			walls.add(min, max);
+			wallCorners.push_back(min);
+			wallCorners.push_back(float4(max.x, 0.0f, min.z));
+			wallCorners.push_back(max);
+			wallCorners.push_back(float4(min.x, 0.0f, max.z));
+
+			float4 corners[4];
+			setRotatedBox(corners, 1.1f * float(i) + 0.4f, 0.7f * float(i % 4) + 0.3f, 0.8f, 1.0f + 0.3f * float(i % 3), 0.45f * float(i));
+			OrientedBox robot;
+			robot.set(corners);
+			robots.add(robot);
+			robotCorners.insert(robotCorners.end(), corners, corners + 4);
+		}
+
+		// Move a box of its own across both, turning it as it goes, and
+		// compare every answer with the one for a single pair.
+		unsigned hits = 0;
+		bool wallsAgree = true;
+		bool robotsAgree = true;
+		std::vector<BoxCollision> collisions;
+		std::vector<BoxCollision> expected;
+		for (unsigned step = 0; step < 300; step++)
+		{
+			float4 corners[4];
+			setRotatedBox(corners, -1.0f + 0.031f * float(step), 0.37f * float(step % 9), 0.9f, 1.6f, 0.13f * float(step));
+			OrientedBox box;
+			box.set(corners);
+
+			collisions.clear();
+			expected.clear();
+			walls.collideWithOrientedBox(box, collisions);
+			for (unsigned i = 0; i < 6; i++)
+			{
+				BoxCollision collision = { i, float4(0.0f) };
+				if (boxesCollide(&wallCorners[4*i], corners, collision.resolutionVector))
+					expected.push_back(collision);
+			}
+			wallsAgree = wallsAgree && sameCollisions(collisions, expected);
+			hits += unsigned(expected.size());
+
+			collisions.clear();
+			expected.clear();
+			robots.collideWithOrientedBox(box, 0, collisions);
+			for (unsigned i = 0; i < 6; i++)
+			{
+				BoxCollision collision = { i, float4(0.0f) };
+				if (boxesCollide(corners, &robotCorners[4*i], collision.resolutionVector))
+					expected.push_back(collision);
+			}
+			robotsAgree = robotsAgree && sameCollisions(collisions, expected);
+			hits += unsigned(expected.size());
+		}
+
+		check(hits > 100, test, "the boxes collide often enough to test");
+		check(wallsAgree, test, "walls give the same result as one pair at a time");
+		check(robotsAgree, test, "robots give the same result as one pair at a time");
+	}
+
+	void testTraceIsFinite()
+	{
+		const char *test = "headless trace";
+
+		// A program that does nothing, so that the sensors are whatever the
+		// simulation makes of them.
+		TestProgram source;
+		source.addClump();
+		source.addInstruction(OP_FINCLUMP, Operands()(notAnEntry)(notAnEntry));
+
+		RXEFile *file = source.create();
+		Environment *environment = HeadlessRun::createDefaultArena();
+		{
+			HeadlessRun run(file, environment);
+			std::vector<HeadlessRun::Sample> trace;
+			run.run(0.5f, 0.1f, trace);
+			check(trace.size() == 6 && trace[0].time == 0.0f, test, "starts with a sample at time 0");
+
+			bool allFinite = true;
+			for (unsigned i = 0; i < trace.size(); i++)
+			{
+				const HeadlessRun::Sample &sample = trace[i];
+				allFinite = allFinite && _finite(sample.time) && _finite(sample.x) && _finite(sample.z) && _finite(sample.heading);
+				for (unsigned j = 0; j < 3; j++)
+					allFinite = allFinite && _finite(sample.motorPower[j]) && _finite(sample.motorRotation[j]);
+				for (unsigned j = 0; j < 4; j++)
+					allFinite = allFinite && _finite(sample.sensors[j]);
+			}
+			check(allFinite, test, "has no NaN or infinite fields");
+		}
+		delete environment;
+		delete file;
+	}
+
+	void testSeeds()
+	{
+		const char *test = "seeds";
+
+		TestProgram source;
+		source.addClump();
+		source.addInstruction(OP_FINCLUMP, Operands()(notAnEntry)(notAnEntry));
+		RXEFile *file = source.create();
+		Environment *environment = HeadlessRun::createDefaultArena();
+		{
+			HeadlessRun zero(file, environment, 0, 0);
+			HeadlessRun one(file, environment, 0, 1);
+			HeadlessRun zeroAgain(file, environment, 0, 0);
+			HeadlessRun::Sample zeroStart = zero.getSample();
+			HeadlessRun::Sample oneStart = one.getSample();
+			HeadlessRun::Sample zeroAgainStart = zeroAgain.getSample();
+			check(zeroStart.x != oneStart.x || zeroStart.z != oneStart.z, test, "seeds 0 and 1 give different start positions");
+			check(zeroStart.x == zeroAgainStart.x && zeroStart.z == zeroAgainStart.z, test, "the same seed gives the same start position");
+		}
+		delete environment;
+		delete file;
+	}
+
+	void testPhysicsSteps()
+	{
+		const char *test = "physics steps";
+
+		Environment *environment = HeadlessRun::createDefaultArena();
+		{
+			Simulation simulation(environment);
+			for (unsigned i = 0; i < 1000; i++)
+				simulation.update(0.01f);
+			check(simulation.getStepCount() == 1000, test, "makes one step for each 0.01 s");
+
+			for (unsigned i = 0; i < 60; i++)
+				simulation.update(1.0f / 60.0f);
+			check(simulation.getStepCount() == 1100, test, "makes 100 steps for 60 frames of 1/60 s");
+
+			simulation.update(2.0f);
+			check(simulation.getStepCount() == 1300, test, "catches up on a long update");
+
+			simulation.setMaximumCatchUpTime(0.5f);
+			simulation.update(2.0f);
+			check(simulation.getStepCount() == 1350, test, "catches up only as far as allowed");
+		}
+
+		TestProgram source;
+		source.addClump();
+		source.addInstruction(OP_FINCLUMP, Operands()(notAnEntry)(notAnEntry));
+		RXEFile *file = source.create();
+		{
+			HeadlessRun run(file, environment);
+			std::vector<HeadlessRun::Sample> trace;
+			run.run(3.0f, 0.0f, trace);
+			check(run.getSimulation()->getStepCount() == 300, test, "makes every step of a headless run");
+		}
+		delete file;
+		delete environment;
+	}
+
+	// Drives a robot at x = 5, facing along x, with the given motor powers
+	// for one step. Returns where it ends up and sets its yaw.
+	matrix driveFast(const Environment &environment, float left, float right, float &yaw)
+	{
+		Simulation simulation(&environment);
+		Robot *robot = new Robot(&simulation);
+		simulation.addRobot(robot);
+		robot->setPosition(matrix::position(float4(5.0f, 0.0f, 12.5f)));
+		robot->getMotor(0)->setPower(left);
+		robot->getMotor(1)->setPower(right);
+		simulation.update(0.01f);
+
+		matrix position = robot->getPosition();
+		yaw = robot->getYaw();
+		simulation.removeRobot(robot);
+		delete robot;
+		return position;
+	}
+
+	void testFastRobotStopsAtWall()
+	{
+		const char *test = "fast robot";
+
+		// At this power, a robot drives about 7 cells in one step.
+		const float power = 20000.0f;
+
+		Environment open(25, 25, 1.0f, 0.75f);
+		Environment walled(25, 25, 1.0f, 0.75f);
+		for (unsigned z = 0; z < 25; z++)
+			walled.setCellIsWall(9, z, true);
+
+		float yaw;
+		matrix position = driveFast(open, power, power, yaw);
+		check(position.w.x > 11.0f, test, "passes the wall's place without a wall");
+		position = driveFast(walled, power, power, yaw);
+		check(position.w.x + Robot::standard2DBoundingBox[0].x <= 9.01f, test, "stops in front of a wall one cell thick");
+
+		// Turning while driving: It is put back to where it was, turned as far
+		// as it was there.
+		float freeYaw;
+		driveFast(open, power, 0.9f * power, freeYaw);
+		position = driveFast(walled, power, 0.9f * power, yaw);
+		check(position.w.x < 9.0f, test, "stops in front of the wall when turning");
+		check(fabsf(yaw) > 0.0f && fabsf(yaw) < 0.9f * fabsf(freeYaw), test, "turns back when put back");
+		matrix rotation = matrix::rotation(float4(0, 1, 0, 0), yaw);
+		check(fabsf(position.x.x - rotation.x.x) < 0.001f && fabsf(position.x.z - rotation.x.z) < 0.001f, test, "faces where its yaw says");
+	}
+
+	void testRayHitsWall()
+	{
+		const char *test = "ray";
+
+		// Cells of 2 units, so that cells and units can not be mixed up. The
+		// wall cell starts at x = 12; the ray starts at x = 3 and is 20
+		// units long.
+		Environment environment(10, 10, 2.0f, 1.0f);
+		environment.setCellIsWall(6, 3, true);
+
+		int x = -1, z = -1;
+		float length = 0.0f;
+		bool hit = environment.getFirstCellOnRay(ray4(float4(3.0f, 0.5f, 7.0f), float4(23.0f, 0.5f, 7.0f)), x, z, length);
+		check(hit && x == 6 && z == 3, test, "finds the wall cell");
+		check(fabsf(length - 9.0f / 20.0f) < 0.01f, test, "returns the distance as fraction of the ray");
+
+		hit = environment.getFirstCellOnRay(ray4(float4(3.0f, 0.5f, 7.0f), float4(43.0f, 0.5f, 7.0f)), x, z, length);
+		check(hit && fabsf(length - 9.0f / 40.0f) < 0.01f, test, "returns a smaller fraction of a longer ray");
+
+		// In the next row, the ray goes on to the border wall at x = 18.
+		hit = environment.getFirstCellOnRay(ray4(float4(3.0f, 0.5f, 9.0f), float4(23.0f, 0.5f, 9.0f)), x, z, length);
+		check(hit && x == 9 && z == 4 && fabsf(length - 15.0f / 20.0f) < 0.01f, test, "goes past walls in other rows");
+	}
+
+	// Puts a robot with its back left corner at x, z and returns how far one
+	// step pushes it out of the walls.
+	float4 pushOutOfWalls(Environment &environment, float x, float z)
+	{
+		Simulation simulation(&environment);
+		Robot *robot = new Robot(&simulation);
+		simulation.addRobot(robot);
+
+		// The robot reaches 0.85 back and 0.9 to each side from its position.
+		float4 start(x + 0.85f, 0.0f, z + 0.9f);
+		robot->setPosition(matrix::position(start));
+		simulation.update(0.01f);
+		float4 moved = robot->getPosition().w - start;
+
+		simulation.removeRobot(robot);
+		delete robot;
+		return moved;
+	}
+
+	void testWallResolution()
+	{
+		const char *test = "walls";
+
+		// A wall along z = 5 from x = 5 on, and one along x = 5 from z = 5 on.
+		// They are stored as two boxes; the corner cell is part of the second.
+		Environment environment(20, 20, 1.0f, 1.0f);
+		for (unsigned i = 5; i < 15; i++)
+		{
+			environment.setCellIsWall(i, 5, true);
+			environment.setCellIsWall(5, i, true);
+		}
+
+		// 0.05 into the long wall only. Every cell pushes the same way.
+		float4 moved = pushOutOfWalls(environment, 9.0f, 5.95f);
+		check(fabsf(moved.x) < 0.002f && fabsf(moved.z - 0.05f) < 0.002f, test, "pushes out of a long wall");
+
+		// 0.1 into the wall at x = 5 and 0.05 into the wall at z = 5. The
+		// robot touches three cells of the wall at x = 5 (the corner one
+		// pushes along z, as it overlaps less that way) and two of the other.
+		// The average over the cells is (0.2, 0.15) / 5, not (0.1, 0.05) / 2
+		// as over the boxes.
+		moved = pushOutOfWalls(environment, 5.9f, 5.95f);
+		check(fabsf(moved.x - 0.04f) < 0.002f && fabsf(moved.z - 0.03f) < 0.002f, test, "averages a corner over its cells");
+	}
+
+	void testUltrasoundDistance()
+	{
+		const char *test = "ultrasound";
+
+		// A wall along x = 15, and a robot looking straight at it.
+		Environment environment(25, 25, 1.0f, 0.75f);
+		for (unsigned z = 0; z < 25; z++)
+			environment.setCellIsWall(15, z, true);
+		Simulation simulation(&environment);
+		Robot *robot = new Robot(&simulation);
+		simulation.addRobot(robot);
+		robot->setSensorAngle(3, 0.0f);
+
+		const float sensorX = 5.0f + robot->getSensorOffset(3);
+		robot->setPosition(matrix::position(float4(5.0f, 0.0f, 12.5f)));
+		simulation.update(0.01f);
+		float near = robot->getSensorValue(3);
+		check(fabsf(near - (15.0f - sensorX) * 5.0f) < 0.5f, test, "reads the distance to a wall");
+
+		robot->setPosition(matrix::position(float4(3.0f, 0.0f, 12.5f)));
+		simulation.update(0.01f);
+		float far = robot->getSensorValue(3);
+		check(fabsf(far - near - 2.0f * 5.0f) < 0.5f, test, "reads more when the wall is further away");
+
+		simulation.removeRobot(robot);
+		delete robot;
+	}
+}
+
+unsigned runSelfTests()
+{
+	checkCount = 0;
+	failureCount = 0;
+
+	testMisalignedBranch();
+	testArraySubset();
+	testStrings();
+	testArrayPool();
+	testReload();
+	testNativeCode();
+	testQuantum();
+	testMutex();
+	testFireCounts();
+	testSubroutine();
+	testStop();
+	testPollingLoops();
+	testPollingWakesOnOtherClumps();
+	testDiagnostics();
+	testCollisionBatch();
+	testTraceIsFinite();
+	testSeeds();
+	testPhysicsSteps();
+	testFastRobotStopsAtWall();
+	testRayHitsWall();
+	testUltrasoundDistance();
+	testWallResolution();
+
+	printf("%u of %u checks passed\n", checkCount - failureCount, checkCount);
+	return failureCount;
+}
@@ -0,0 +1,20 @@
+#pragma once
+/*
+ *  SelfTest.h
+ *  mindstormssimulation
+ *
+ *  Created by agent on 18.10.26
+ *  Copyright 2026 RWTH Aachen University All rights reserved.
+ *
+ */
+
+/*!
+ * @abstract Checks of the simulator that need neither a screen nor files.
+ * @discussion Run with clisimulator --self-test. Programs for the checks are
+ * put together in memory, so the results do not depend on the sample
+ * programs. Each failed check is printed on its own line. The check of
+ * native code compiles a translation with the C++ compiler in $CXX (or c++)
+ * and is skipped, with a line saying so, where that is not possible.
+ * @result The number of checks that failed.
+ */
+unsigned runSelfTests();
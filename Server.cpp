@@ -293,7 +293,7 @@ void Server::setCell(ClientConnection &client, const NetworkPacket *packet)
         memcpy(&backPacket, packet, packet->getNetworkLength());
 		sendAll(backPacket);
 	}
-	catch (std::runtime_error e)
+	catch (std::runtime_error &e)
 	{
 		closeClient(client);
 	}
@@ -15,12 +15,27 @@
 #include <algorithm>
 
 #include "Environment.h"
+#include "RandomGenerator.h"
 #include "Robot.h"
 #include "Vec4.h"
 
 namespace
 {
 	const float robotStartSpace = 5.0f;
+	
+	// A bit more than the diagonal of a robot's bounding box, so that
+	// each robot is in at most four buckets of the RobotIndex.
+	const float robotIndexBucketSize = 3.0f;
+	
+	// The physics always advance by this much, however often update is
+	// called. The same as the steps of headless runs.
+	const unsigned physicsStepMicroseconds = 10000;
+	const float physicsStepTime = float(physicsStepMicroseconds) / 1000000.0f;
+	
+	// Distance between the points at which the center of a moving robot is
+	// tested against walls, in cells. Must be less than the thickness of a
+	// wall.
+	const float sweepSampleSpacing = 0.5f;
 }
 
 const std::pair<float, float> &Simulation::nextPossibleStartingLocation()
@@ -56,19 +71,14 @@ const std::pair<float, float> &Simulation::nextValidStartingLocation()
 bool Simulation::canPlaceRobotInAreaStartingAt(float x, float z) const
 {
 	// First: Check for walls in area
-	unsigned minCellX = unsigned(x / environment->getCellSize());
-	unsigned maxCellX = unsigned((x + robotStartSpace) / environment->getCellSize());
+	int minCellX = int(x / environment->getCellSize());
+	int maxCellX = int((x + robotStartSpace) / environment->getCellSize());
 	
-	unsigned minCellZ = unsigned(z / environment->getCellSize());
-	unsigned maxCellZ = unsigned((z + robotStartSpace) / environment->getCellSize());
+	int minCellZ = int(z / environment->getCellSize());
+	int maxCellZ = int((z + robotStartSpace) / environment->getCellSize());
 	
-	for (unsigned cellX = minCellX; cellX <= maxCellX; cellX++)
-	{
-		for (unsigned cellZ = minCellZ; cellZ <= maxCellZ; cellZ++)
-		{
-			if (environment->getCellIsWall(cellX, cellZ)) return false;
-		}
-	}
+	environment->getWallBoxesInArea(minCellX, maxCellX, minCellZ, maxCellZ, nearbyWalls);
+	if (!nearbyWalls.empty()) return false;
 	
 	// Second: Check for robots in area
 	float4 areaBounds[] = {
@@ -77,98 +87,38 @@ bool Simulation::canPlaceRobotInAreaStartingAt(float x, float z) const
 		float4(x + robotStartSpace, 0, z + robotStartSpace),
 		float4(x + robotStartSpace, 0, z),
 	};
-	float4 unusedResolutionVector;
-	for (std::vector<Robot *>::const_iterator iter = robots.begin(); iter != robots.end(); ++iter)
+	float4 areaAABB[2] = { areaBounds[0], areaBounds[2] };
+	robotIndex.findInBox(areaAABB, nearbyRobots);
+	robotBatch.clear();
+	for (std::vector<unsigned>::const_iterator iter = nearbyRobots.begin(); iter != nearbyRobots.end(); ++iter)
 	{
-		if (orientedBoundingBoxesCollide(areaBounds, (*iter)->getOrientedBoundingBox(), unusedResolutionVector))
-			return false;
+		OrientedBox robotBox;
+		robotBox.set(robots[*iter]->getOrientedBoundingBox());
+		robotBatch.add(robotBox);
 	}
 	
-	return true;
+	OrientedBox areaBox;
+	areaBox.set(areaBounds);
+	collisions.clear();
+	return robotBatch.collideWithOrientedBox(areaBox, 0, collisions) == 0;
 }
 
-bool Simulation::objectsOverlapAlongAxis(const float4 *a, unsigned numA, const float4 *b, unsigned numB, const float4 &axis, float &overlap) throw()
+void Simulation::getWallBoxBounds(const Environment::WallBox &wall, float4 &min, float4 &max) const throw()
 {
-	float minA = std::numeric_limits<float>::infinity(), minB = std::numeric_limits<float>::infinity();
-	float maxA = -std::numeric_limits<float>::infinity(), maxB = -std::numeric_limits<float>::infinity();
-	
-	for (unsigned i = 0; i < numA; i++)
-	{
-		float dot = a[i] * axis;
-		minA = fminf(dot, minA);
-		maxA = fmaxf(dot, maxA);
-	}
-	
-	for (unsigned i = 0; i < numB; i++)
-	{
-		float dot = b[i] * axis;
-		minB = fminf(dot, minB);
-		maxB = fmaxf(dot, maxB);
-	}
-	
-	float overlapLeft = maxB - minA;
-	float overlapRight = maxA - minB;
-	if (overlapLeft < overlapRight) overlap = -overlapLeft;
-	else overlap = overlapRight;
-	
-	return (fminf(overlapLeft, overlapRight) > 0.0f);
+	const float cellSize = environment->getCellSize();
+	min = float4(cellSize * float(wall.minX), 0.0f, cellSize * float(wall.minZ));
+	max = float4(cellSize * float(wall.maxX + 1), 0.0f, cellSize * float(wall.maxZ + 1));
 }
 
-bool Simulation::orientedBoundingBoxesCollide(const float4 *a, const float4 *b, float4 &resolutionVector) throw()
+void Simulation::addNearbyWallsToBatch() const
 {
-	float overlap = 20000000.0f;
-	float newOverlap;
-	float4 direction;
-	
-	direction = (a[0] - a[1]).normalized();
-	if (!objectsOverlapAlongAxis(a, 4, b, 4, direction, newOverlap)) return false;
-	else if (std::fabs(newOverlap) < std::fabs(overlap))
-	{
-		overlap = newOverlap;
-		resolutionVector = direction * overlap;
-	}
-	
-	direction = (a[1] - a[2]).normalized();
-	if (!objectsOverlapAlongAxis(a, 4, b, 4, direction, newOverlap)) return false;
-	else if (std::fabs(newOverlap) < std::fabs(overlap))
-	{
-		overlap = newOverlap;
-		resolutionVector = direction * overlap;
-	}
-	
-	direction = (b[0] - b[1]).normalized();
-	if (!objectsOverlapAlongAxis(a, 4, b, 4, direction, newOverlap)) return false;
-	else if (std::fabs(newOverlap) < std::fabs(overlap))
-	{
-		overlap = newOverlap;
-		resolutionVector = direction * overlap;
-	}
-	
-	direction = (b[1] - b[2]).normalized();
-	if (!objectsOverlapAlongAxis(a, 4, b, 4, direction, newOverlap)) return false;
-	else if (std::fabs(newOverlap) < std::fabs(overlap))
+	wallBatch.clear();
+	for (std::vector<Environment::WallBox>::const_iterator iter = nearbyWalls.begin(); iter != nearbyWalls.end(); ++iter)
 	{
-		overlap = newOverlap;
-		resolutionVector = direction * overlap;
+		float4 wallMin, wallMax;
+		getWallBoxBounds(*iter, wallMin, wallMax);
+		wallBatch.add(wallMin, wallMax);
 	}
-	
-	return true;
-}
-
-bool Simulation::cellCollidesWithRobot(unsigned cellX, unsigned cellZ, const Robot *aRobot, float4 &resolutionVector) const throw(std::range_error)
-{
-	if (!environment->getCellIsWall(cellX, cellZ)) return false;
-	
-	const float cellSize = environment->getCellSize();
-	
-	float4 cellCorners[] = {
-		float4(cellSize * float(cellX), 0.0f, cellSize * float(cellZ)),
-		float4(cellSize * float(cellX+1), 0.0f, cellSize * float(cellZ)),
-		float4(cellSize * float(cellX+1), 0.0f, cellSize * float(cellZ+1)),
-		float4(cellSize * float(cellX), 0.0f, cellSize * float(cellZ+1)),
-	};
-	
-	return orientedBoundingBoxesCollide(cellCorners, aRobot->getOrientedBoundingBox(), resolutionVector);
 }
 
 // Returns false if the result is entirely out of the bounds of the environment
@@ -226,53 +176,54 @@ bool Simulation::testRobotCollidesWithEnvironment(const Robot *aRobot, float4 &r
 	int minX, maxX, minZ, maxZ;
 	if (!getCellsCoveredByAABB(aRobot->getAxisAlignedBoundingBox(), minX, maxX, minZ, maxZ)) return false;
 	
-	const float4 *orientedBoundingBox = aRobot->getOrientedBoundingBox();
+	environment->getWallBoxesInArea(minX, maxX, minZ, maxZ, nearbyWalls);
+	if (nearbyWalls.empty()) return false;
+	
+	addNearbyWallsToBatch();
+	OrientedBox box;
+	box.set(aRobot->getOrientedBoundingBox());
+	
+	// Test collision with the merged walls first. Most of the time, none of
+	// them touches the robot.
+	collisions.clear();
+	if (wallBatch.collideWithOrientedBox(box, collisions) == 0) return false;
+	
+	// The resolution is still averaged over the wall cells the robot touches,
+	// not over the walls, so a long wall pushes as hard as its cells did.
+	// That can not be worked out from the merged walls alone, since the
+	// cells along a wall do not all push the same way, so contacts still
+	// cost a test per cell. Only the cells of walls that touch the robot are
+	// tested, in the same order as before.
+	touchingWalls.clear();
+	for (std::vector<BoxCollision>::const_iterator iter = collisions.begin(); iter != collisions.end(); ++iter)
+		touchingWalls.push_back(nearbyWalls[iter->index]);
 	const float cellSize = environment->getCellSize();
-	
-	// Test collision
+	wallBatch.clear();
 	for (int x = minX; x <= maxX; x++)
 	{
 		for (int z = minZ; z <= maxZ; z++)
 		{
-			if (!environment->getCellIsWall(x, z)) continue;
-			
-			float4 cellCorners[] = {
-				float4(cellSize * float(x), 0.0f, cellSize * float(z)),
-				float4(cellSize * float(x+1), 0.0f, cellSize * float(z)),
-				float4(cellSize * float(x+1), 0.0f, cellSize * float(z+1)),
-				float4(cellSize * float(x), 0.0f, cellSize * float(z+1)),
-			};
-			
-			float4 newResolution;
-			if (orientedBoundingBoxesCollide(cellCorners, orientedBoundingBox, newResolution))
-			{
-				totalResolutions++;
-				resolutionVector += newResolution;
-			}
+			bool isTouchingWall = false;
+			for (std::vector<Environment::WallBox>::const_iterator iter = touchingWalls.begin(); iter != touchingWalls.end() && !isTouchingWall; ++iter)
+				isTouchingWall = unsigned(x) >= iter->minX && unsigned(x) <= iter->maxX && unsigned(z) >= iter->minZ && unsigned(z) <= iter->maxZ;
+			if (!isTouchingWall) continue;
+			wallBatch.add(float4(cellSize * float(x), 0.0f, cellSize * float(z)), float4(cellSize * float(x+1), 0.0f, cellSize * float(z+1)));
 		}
 	}
+	collisions.clear();
+	wallBatch.collideWithOrientedBox(box, collisions);
+	for (std::vector<BoxCollision>::const_iterator iter = collisions.begin(); iter != collisions.end(); ++iter)
+	{
+		totalResolutions++;
+		resolutionVector += iter->resolutionVector;
+	}
 	resolutionVector /= float4(totalResolutions);
 	
 	return totalResolutions != 0.0f;
 }
 
 
-bool Simulation::testRobotsCollide(const Robot *robot1, const Robot *robot2, float4 &resolutionVector) const throw()
-{
-	// Start with basic AABB check
-	// Notice: 0 is min, 1 is max
-	const float4 *aabb1 = robot1->getAxisAlignedBoundingBox();
-	const float4 *aabb2 = robot2->getAxisAlignedBoundingBox();
-	
-	if (aabb1[1].x < aabb2[0].x || aabb2[1].x < aabb1[0].x) return false;
-	if (aabb1[1].z < aabb2[0].z || aabb2[1].z < aabb1[0].z) return false;
-
-	// Okay, collision is not entirely implausible
-	return orientedBoundingBoxesCollide(robot1->getOrientedBoundingBox(), robot2->getOrientedBoundingBox(), resolutionVector);
-}
-
-		  
-Simulation::Simulation(Environment *anEnvironment) : environment(anEnvironment)
+Simulation::Simulation(const Environment *anEnvironment, unsigned seed) : environment(anEnvironment), robotIndex(robotIndexBucketSize), accumulatedMicroseconds(0), maximumAccumulatedMicroseconds(0), stepCount(0)
 {
 	// Initialize the start locations array
 	unsigned xSize, zSize;
@@ -294,10 +245,11 @@ Simulation::Simulation(Environment *anEnvironment) : environment(anEnvironment)
 	}
 	
 	// Now randomize it
+	RandomGenerator random(seed);
 	for (unsigned i = 0; i < numLocationsX*numLocationsZ; i++)
 	{
 		std::pair<float, float> scratch = possibleStartLocations[i];
-		unsigned swapWith = rand() % (numLocationsX*numLocationsZ);
+		unsigned swapWith = random.nextBelow(numLocationsX*numLocationsZ);
 		possibleStartLocations[i] = possibleStartLocations[swapWith];
 		possibleStartLocations[swapWith] = scratch;
 	}
@@ -305,42 +257,168 @@ Simulation::Simulation(Environment *anEnvironment) : environment(anEnvironment)
 	lastStartLocation = possibleStartLocations.begin();
 }
 		  
+void Simulation::updateRobotIndex()
+{
+	for (unsigned i = 0; i < robots.size(); i++)
+		robotIndex.update(i, robots[i]->getAxisAlignedBoundingBox());
+}
+
 void Simulation::update(float timedelta) throw()
 {
-	timedelta = fminf(timedelta, 0.5f); // Prevent times and hence robot movements from getting too large.
+	// Steps of the same length make the results independent of how often
+	// this gets called. What is left over waits for the next call. Rounding
+	// to whole microseconds makes callers that add up the step time
+	// themselves get a step for each, even if their sum drifted a bit.
+	if (timedelta > 0.0f)
+		accumulatedMicroseconds += unsigned(timedelta * 1000000.0f + 0.5f);
+	if (maximumAccumulatedMicroseconds != 0)
+		accumulatedMicroseconds = std::min(accumulatedMicroseconds, maximumAccumulatedMicroseconds);
+	
+	while (accumulatedMicroseconds >= physicsStepMicroseconds)
+	{
+		step(physicsStepTime);
+		accumulatedMicroseconds -= physicsStepMicroseconds;
+		stepCount++;
+	}
+}
+
+void Simulation::setMaximumCatchUpTime(float seconds) throw()
+{
+	maximumAccumulatedMicroseconds = unsigned(seconds * 1000000.0f + 0.5f);
+}
+
+void Simulation::sweepRobotAgainstWalls(Robot *robot) throw()
+{
+	// Follow the center of the robot along the way it moved in this step, at
+	// points close enough to each other that it can not have skipped a wall
+	// between two of them. If the center got into a wall, the robot went
+	// through it, or too deep for the collision test to push it back out on
+	// the right side. Robots that only touch a wall are left to that test.
+	const float4 movement = robot->getPosition().w - robot->getLastPosition().w;
+	const float distance = std::sqrt(movement.x*movement.x + movement.z*movement.z);
+	if (distance <= 0.0f) return;
 	
-	for (std::vector<Robot *>::iterator iter = robots.begin(); iter != robots.end(); ++iter)
-		(*iter)->updatePhysics(timedelta);
+	const float cellSize = environment->getCellSize();
+	const unsigned samples = std::max(1u, unsigned(std::ceil(distance / (sweepSampleSpacing * cellSize))));
+	unsigned sizeX, sizeZ;
+	environment->getSize(sizeX, sizeZ);
 	
-	// Test for collisions
-	unsigned xSize, zSize;
-	environment->getSize(xSize, zSize);
+	for (unsigned sample = 1; sample <= samples; sample++)
+	{
+		float4 center = robot->getLastPosition().w + movement * (float(sample) / float(samples));
+		if (center.x < 0.0f || center.z < 0.0f) continue;
+		unsigned cellX = unsigned(center.x / cellSize);
+		unsigned cellZ = unsigned(center.z / cellSize);
+		if (cellX >= sizeX || cellZ >= sizeZ || !environment->getCellIsWall(cellX, cellZ)) continue;
+		
+		// Put it back, position and rotation, to the last point before where
+		// all of it was free, or where it started.
+		unsigned freeSample = sample - 1;
+		for (; freeSample > 0; freeSample--)
+		{
+			float yaw;
+			matrix position = robot->getPositionDuringStep(float(freeSample) / float(samples), yaw);
+			float4 corners[4];
+			for (unsigned i = 0; i < 4; i++)
+				corners[i] = position * Robot::standard2DBoundingBox[i];
+			if (!boxCollidesWithWalls(corners)) break;
+		}
+		robot->moveBackInStep(float(freeSample) / float(samples));
+		return;
+	}
+}
+
+bool Simulation::boxCollidesWithWalls(const float4 *corners) const throw()
+{
+	int minX, maxX, minZ, maxZ;
+	if (!getCellsCoveredByBox(corners, minX, maxX, minZ, maxZ)) return false;
+	
+	environment->getWallBoxesInArea(minX, maxX, minZ, maxZ, nearbyWalls);
+	if (nearbyWalls.empty()) return false;
+	addNearbyWallsToBatch();
+	OrientedBox box;
+	box.set(corners);
+	collisions.clear();
+	return wallBatch.collideWithOrientedBox(box, collisions) > 0;
+}
+
+void Simulation::step(float timedelta) throw()
+{
+	// Turn the motors of all robots, then move all that drive at once. The
+	// sensors come last, so all of them see the other robots where they are
+	// after this step.
+	physics.clear();
+	drivingRobots.clear();
+	for (unsigned i = 0; i < robots.size(); i++)
+	{
+		float deltaLeft, deltaRight;
+		if (!robots[i]->turnMotors(timedelta, deltaLeft, deltaRight)) continue;
+		
+		physics.add(robots[i]->getYaw(), robots[i]->getPosition(), deltaLeft, deltaRight);
+		drivingRobots.push_back(i);
+	}
+	physics.integrate();
+	for (unsigned i = 0; i < drivingRobots.size(); i++)
+	{
+		float4 obb[4], aabb[2];
+		physics.getBoundingBoxes(i, obb, aabb);
+		robots[drivingRobots[i]]->setDrivenPosition(physics.getYaw(i), physics.getPosition(i), obb, aabb);
+	}
 	
-	for (std::vector<Robot *>::iterator iter = robots.begin(); iter != robots.end(); ++iter)
+	// Robots may also have been moved by hand since the last step.
+	updateRobotIndex();
+	for (unsigned i = 0; i < robots.size(); i++)
+		robots[i]->updateSensors();
+	
+	// The boxes of all robots, kept up to date as they are moved apart.
+	robotBoxes.resize(robots.size());
+	for (unsigned i = 0; i < robots.size(); i++)
+		robotBoxes[i].set(robots[i]->getOrientedBoundingBox());
+	
+	// Test for collisions
+	for (unsigned i = 0; i < robots.size(); i++)
 	{
-		if ((*iter)->isLifted()) continue;
+		Robot *robot = robots[i];
+		if (robot->isLifted()) continue;
 		
 		float4 environmentResolution(0.0f);
 		
-		// Check whether robot tunnelled through anything
-		float4 oldPosition = (*iter)->getLastPosition().w;
-		float4 newPosition = (*iter)->getPosition().w;
-		int x, z;
-		float length;
-		if (environment->getFirstCellOnRay(ray4(oldPosition, newPosition), x, z, length))
-			(*iter)->setPosition((*iter)->getLastPosition());
+		// Check whether robot tunnelled through a wall
+		sweepRobotAgainstWalls(robot);
+		robotIndex.update(i, robot->getAxisAlignedBoundingBox());
 
-		if (testRobotCollidesWithEnvironment(*iter, environmentResolution))
-			(*iter)->moveDirectly(environmentResolution);
+		if (testRobotCollidesWithEnvironment(robot, environmentResolution))
+			robot->moveDirectly(environmentResolution);
+		robotBoxes[i].set(robot->getOrientedBoundingBox());
 		
-		for (std::vector<Robot *>::iterator iter2 = (iter + 1); iter2 != robots.end(); ++iter2)
+		// Every pair once, in order, as the earlier robot.
+		robotIndex.findInBox(robot->getAxisAlignedBoundingBox(), nearbyRobots);
+		robotBatch.clear();
+		batchedRobots.clear();
+		for (std::vector<unsigned>::const_iterator iter = nearbyRobots.begin(); iter != nearbyRobots.end(); ++iter)
 		{
-			if ((*iter2)->isLifted()) continue;
+			if (*iter <= i) continue;
+			if (robots[*iter]->isLifted()) continue;
 			
-			float4 resolutionVector(0.0f);
-			if (!testRobotsCollide(*iter, *iter2, resolutionVector)) continue;
-			(*iter2)->moveDirectly(resolutionVector / 2);
-			(*iter)->moveDirectly(-resolutionVector / 2);
+			robotBatch.add(robotBoxes[*iter]);
+			batchedRobots.push_back(*iter);
+		}
+		
+		// Resolving a collision moves this robot, so the robots after the
+		// first one it collides with have to be tested again.
+		unsigned next = 0;
+		while (next < robotBatch.size())
+		{
+			collisions.clear();
+			if (robotBatch.collideWithOrientedBox(robotBoxes[i], next, collisions) == 0) break;
+			
+			const BoxCollision &collision = collisions.front();
+			unsigned other = batchedRobots[collision.index];
+			robots[other]->moveDirectly(collision.resolutionVector / 2);
+			robotBoxes[other].set(robots[other]->getOrientedBoundingBox());
+			robot->moveDirectly(-collision.resolutionVector / 2);
+			robotBoxes[i].set(robot->getOrientedBoundingBox());
+			next = collision.index + 1;
 		}
 		
 	}
@@ -351,47 +429,46 @@ bool Simulation::objectCollidesWithOthers(const float4 *orientedBoundingBox) con
 	int minX, maxX, minZ, maxZ;
 	if (!getCellsCoveredByBox(orientedBoundingBox, minX, maxX, minZ, maxZ)) return false;
 	
-	const float cellSize = environment->getCellSize();
-	
 	// Test collision
-	for (int x = minX; x <= maxX; x++)
-	{
-		for (int z = minZ; z <= maxZ; z++)
-		{
-			if (!environment->getCellIsWall(x, z)) continue;
-			
-			float4 cellCorners[] = {
-				float4(cellSize * float(x), 0.0f, cellSize * float(z)),
-				float4(cellSize * float(x+1), 0.0f, cellSize * float(z)),
-				float4(cellSize * float(x+1), 0.0f, cellSize * float(z+1)),
-				float4(cellSize * float(x), 0.0f, cellSize * float(z+1)),
-			};
-			
-			float4 ignoredResolution;
-			if (orientedBoundingBoxesCollide(cellCorners, orientedBoundingBox, ignoredResolution)) return true;
-		}
-	}
+	environment->getWallBoxesInArea(minX, maxX, minZ, maxZ, nearbyWalls);
+	addNearbyWallsToBatch();
+	OrientedBox box;
+	box.set(orientedBoundingBox);
+	collisions.clear();
+	if (wallBatch.collideWithOrientedBox(box, collisions) > 0) return true;
 	
 	// Test robot
-	for (std::vector<Robot *>::const_iterator iter = robots.begin(); iter != robots.end(); ++iter)
+	float4 aabb[2] = {
+		orientedBoundingBox[0].min(orientedBoundingBox[1].min(orientedBoundingBox[2].min(orientedBoundingBox[3]))),
+		orientedBoundingBox[0].max(orientedBoundingBox[1].max(orientedBoundingBox[2].max(orientedBoundingBox[3])))
+	};
+	robotIndex.findInBox(aabb, nearbyRobots);
+	robotBatch.clear();
+	for (std::vector<unsigned>::const_iterator iter = nearbyRobots.begin(); iter != nearbyRobots.end(); ++iter)
 	{
-		if ((*iter)->isLifted()) continue;
-		float4 ignoredResolution;
-		if (orientedBoundingBoxesCollide((*iter)->getOrientedBoundingBox(), orientedBoundingBox, ignoredResolution)) return true;
+		const Robot *robot = robots[*iter];
+		if (robot->isLifted()) continue;
+		OrientedBox robotBox;
+		robotBox.set(robot->getOrientedBoundingBox());
+		robotBatch.add(robotBox);
 	}
 	
-	return false;
+	return robotBatch.collideWithOrientedBox(box, 0, collisions) > 0;
 }
 
 void Simulation::addRobot(Robot *aRobot) throw(std::invalid_argument)
 {
 	if (!aRobot) throw std::invalid_argument("Trying to add NULL robot to Simulation");
 	
+	// The new robot has no place yet, so it is only added to the index
+	// once it has one.
+	updateRobotIndex();
 	robots.push_back(aRobot);
 	
 	const std::pair<float, float> &location = nextValidStartingLocation();
 	
 	aRobot->setPosition(matrix::position(float4(location.first, 0.0f, location.second)));
+	robotIndex.update(unsigned(robots.size() - 1), aRobot->getAxisAlignedBoundingBox());
 }
 
 void Simulation::removeRobot(Robot *aRobot)
@@ -400,7 +477,10 @@ void Simulation::removeRobot(Robot *aRobot)
 	{
 		if (*iter == aRobot)
 		{
+			// All robots after this one get a new index.
 			robots.erase(iter);
+			robotIndex.clear();
+			updateRobotIndex();
 			return;
 		}
 	}
@@ -414,13 +494,14 @@ bool Simulation::firstHitOfRay(const ray4 &ray, bool ignoringRobots, float &outH
 	
 	if (!ignoringRobots)
 	{
-		for (std::vector<Robot *>::const_iterator iter = robots.begin(); iter != robots.end(); ++iter)
+		robotIndex.findAlongRay(ray, nearbyRobots);
+		for (std::vector<unsigned>::const_iterator iter = nearbyRobots.begin(); iter != nearbyRobots.end(); ++iter)
 		{
 			float robotDistance;
-			if ((*iter)->hitByRay(ray, robotDistance)) continue;
+			if (!robots[*iter]->hitByRay(ray, robotDistance)) continue;
 			
+			if (!hitAnything || robotDistance < outHit) outHit = robotDistance;
 			hitAnything = true;
-			outHit = fminf(outHit, robotDistance);
 		}
 	}
 	
@@ -444,18 +525,24 @@ bool Simulation::canToggleCellIsWall(unsigned x, unsigned z) throw(std::range_er
 	
 	const float cellSize = environment->getCellSize();
 	
-	float4 cellCorners[] = {
+	float4 cellAABB[2] = {
 		float4(cellSize * float(x), 0.0f, cellSize * float(z)),
-		float4(cellSize * float(x+1), 0.0f, cellSize * float(z)),
-		float4(cellSize * float(x+1), 0.0f, cellSize * float(z+1)),
-		float4(cellSize * float(x), 0.0f, cellSize * float(z+1)),
+		float4(cellSize * float(x+1), 0.0f, cellSize * float(z+1))
 	};
 	
-	float4 resolutionVector;
-	for (std::vector<Robot *>::iterator iter = robots.begin(); iter != robots.end(); ++iter)
+	updateRobotIndex();
+	robotIndex.findInBox(cellAABB, nearbyRobots);
+	
+	wallBatch.clear();
+	wallBatch.add(cellAABB[0], cellAABB[1]);
+	for (std::vector<unsigned>::const_iterator iter = nearbyRobots.begin(); iter != nearbyRobots.end(); ++iter)
 	{
-		if ((*iter)->isLifted()) continue;
-		if (orientedBoundingBoxesCollide(cellCorners, (*iter)->getOrientedBoundingBox(), resolutionVector)) return false;
+		if (robots[*iter]->isLifted()) continue;
+		
+		OrientedBox box;
+		box.set(robots[*iter]->getOrientedBoundingBox());
+		collisions.clear();
+		if (wallBatch.collideWithOrientedBox(box, collisions) > 0) return false;
 	}
 	
 	return true;
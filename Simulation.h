@@ -10,16 +10,51 @@
 #include <stdexcept>
 #include <vector>
 
-class Environment;
+#include "CollisionBatch.h"
+#include "Environment.h"
+#include "RobotIndex.h"
+#include "RobotPhysics.h"
+
 class Robot;
 union float4;
 class ray4;
 
 class Simulation
 {
-	Environment *environment;
+	const Environment *environment;
 	std::vector<Robot *> robots;
 	
+	// Where the robots are, so that collision, touch and ray tests only have
+	// to look at those nearby. Kept up to date at the start of every update
+	// and whenever a robot moved during it.
+	RobotIndex robotIndex;
+	mutable std::vector<unsigned> nearbyRobots;
+	void updateRobotIndex();
+	
+	mutable std::vector<Environment::WallBox> nearbyWalls;
+	mutable std::vector<Environment::WallBox> touchingWalls;
+	
+	// Scratch space for testing many boxes at once.
+	mutable AxisAlignedBoxBatch wallBatch;
+	mutable OrientedBoxBatch robotBatch;
+	std::vector<OrientedBox> robotBoxes;
+	
+	RobotPhysics physics;
+	std::vector<unsigned> drivingRobots;
+	mutable std::vector<unsigned> batchedRobots;
+	mutable std::vector<BoxCollision> collisions;
+	void addNearbyWallsToBatch() const;
+	
+	// Time passed that the physics have not been advanced by yet, and the
+	// most that is kept (0 for no limit), in microseconds.
+	unsigned accumulatedMicroseconds;
+	unsigned maximumAccumulatedMicroseconds;
+	// Physics steps made so far.
+	unsigned stepCount;
+	void step(float timedelta) throw();
+	void sweepRobotAgainstWalls(Robot *robot) throw();
+	bool boxCollidesWithWalls(const float4 *corners) const throw();
+	
 	std::vector<std::pair<float, float> > possibleStartLocations;
 	std::vector<std::pair<float, float> >::iterator lastStartLocation;
 	
@@ -27,49 +62,51 @@ class Simulation
 	const std::pair<float, float> &nextValidStartingLocation();
 	bool canPlaceRobotInAreaStartingAt(float x, float z) const;
 	
-	static bool objectsOverlapAlongAxis(const float4 *a, unsigned numA, const float4 *b, unsigned numB, const float4 &axis, float &overlap) throw();
+	void getWallBoxBounds(const Environment::WallBox &wall, float4 &min, float4 &max) const throw();
 	
 	bool getCellsCoveredByBox(const float4 *corners, int &minX, int &maxX, int &minZ, int &maxZ) const throw();
 	bool getCellsCoveredByAABB(const float4 *corners, int &minX, int &maxX, int &minZ, int &maxZ) const throw();
 	bool testRobotCollidesWithEnvironment(const Robot *aRobt, float4 &resolutionVector) const throw();
-	bool testRobotsCollide(const Robot *robot1, const Robot *robot2, float4 &resolutionVector) const throw();
 	
+public:
 	/*!
-	 * @abstract Checks whether two oriented bounding boxes overlap.
-	 * @discussion A semi-general collision detection method. It assumes that
-	 * (a[0], a[1]) is parallel to (a[2], a[3]) and likewise that (a[1], a[1]) is
-	 * parallel to (a[3], a[0]). Same goes for b.
-	 * @param a The vertices of the first oriented bounding box. At least four.
-	 * @param b The vertices of the other oriented bounding box. At least four.
-	 * @param resolutionVector On exit, If a collision is found, contains the
-	 * shortest vector along which one of the objects is to be moved to stop them
-	 * from colliding.
+	 * @abstract Constructs a simulation.
+	 * @param anEnvironment The arena. Not owned.
+	 * @param seed Picks the order in which robots are given start positions.
+	 * The same seed always gives the same order.
 	 */
-	static bool orientedBoundingBoxesCollide(const float4 *a, const float4 *b, float4 &resolutionVector) throw();
-	
-	/*!
-	 * @abstract Checks whether a robot collides with a particular cell.
-	 * @param cellX Location of the cell.
-	 * @param cellZ Location of the cell.
-	 * @param aRobot The robot to collide with.
-	 * @param resolutionVector On output, if the result is true, contains the
-	 * vector the robots position needs to be altered by to make it cease
-	 * colliding. If not colliding, is undefined.
-	 * @result Whether the robot collides with that particular cell.
-	 * @throws range_error if x or z are out of range
-	 */
-	bool cellCollidesWithRobot(unsigned cellX, unsigned cellZ, const Robot *aRobot, float4 &resolutionVector) const throw(std::range_error);
-	
-public:
-	Simulation(Environment *anEnvironment);
+	Simulation(const Environment *anEnvironment, unsigned seed = 0);
 	
 	void resetRobots();
 	
 	void addRobot(Robot *aRobot) throw(std::invalid_argument);
 	void removeRobot(Robot *aRobot);
 	
+	/*!
+	 * @abstract Advances the simulation.
+	 * @discussion The physics are advanced in steps of a fixed length, as many
+	 * as fit into the time passed, so that robots move the same no matter how
+	 * often this is called. Time that does not make up a full step is kept
+	 * for the next call. Time is counted in whole microseconds, so calls
+	 * with exactly the step time always give one step each.
+	 * @param timedelta The time that has passed since the last call.
+	 */
 	void update(float timedelta) throw();
 	
+	/*!
+	 * @abstract Limits how far the simulation catches up at once.
+	 * @discussion If more time than this has passed when update is called,
+	 * the rest is dropped, and the robots fall behind the programs that
+	 * control them. Useful for the GUI after it stalled; headless runs must
+	 * not set this. There is no limit by default.
+	 * @param seconds The most time to simulate in one update, or 0 for no
+	 * limit.
+	 */
+	void setMaximumCatchUpTime(float seconds) throw();
+	
+	/*! The number of physics steps done so far. */
+	unsigned getStepCount() const throw() { return stepCount; }
+	
 	bool firstHitOfRay(const ray4 &ray, bool ignoringRobots, float &outHit) const throw();
 	
 	void getEnvironmentSize(unsigned &x, unsigned &z) const throw();
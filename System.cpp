@@ -12,10 +12,10 @@
 #include <cmath>
 #include <cstdlib>
 #include <ctime>
-#include <iostream>
 #include <algorithm>
 
 #include "NetworkInterface.h"
+#include "TickSource.h"
 #include "Time.h"
 #include "VMMemory.h"
 
@@ -118,11 +118,12 @@ bool System::sanitizeSoundFilename(unsigned dstocEntry, char *bufferOut)
 	return true;
 }
 
-void System::syscall(unsigned callID, unsigned params)
+bool System::syscall(unsigned callID, unsigned params)
 {
-	if (!networkInterface) return;
+	if (!networkInterface) return true;
 	
 	int returnValue = 0;
+	bool isSupported = true;
 	switch(callID)
 	{
 		case 0x09: // NXTSoundPlayFile
@@ -173,43 +174,43 @@ void System::syscall(unsigned callID, unsigned params)
 		}
 			break;
 		default:
-			std::cout << "Ignoring syscall " << std::hex << callID << std::dec << " (" << nameForSyscall(callID) << ") " << std::endl;
+			isSupported = false;
 			break;
 	}
 	memory->setScalarValue(params+1, returnValue);
+	return isSupported;
 }
 
-void System::setInputConfiguration(unsigned port, unsigned property, unsigned value)
+bool System::setInputConfiguration(unsigned port, unsigned property, unsigned value)
 {
-	if (property == 0x5) // IO_IN_INVALID_DATA
-	{
-		// Setting invalid data. For the real chip, invalid data will return to
-		// true once the changes have been processed. Here, it is always false
-		// because we can process changes (if any) immediately.
-		return;
-	}
-	std::cout << "Set input configuration for port " << port << " property " << property << " (" << nameForInputPartID(property) << ") to 0x" << std::hex << value << std::dec << std::endl;
+	// Setting invalid data. For the real chip, invalid data will return to
+	// true once the changes have been processed. Here, it is always false
+	// because we can process changes (if any) immediately.
+	return property == 0x5; // IO_IN_INVALID_DATA
 }
 
-unsigned System::getInputConfiguration(unsigned port, unsigned property)
+bool System::getInputConfiguration(unsigned port, unsigned property, unsigned &value)
 {
 	if (property == 0x5) // IO_IN_INVALID_DATA
 	{
 		// Reading INVALID_DATA. Here, it is always false because changes are
 		// processed immediately.
-		return 0;
+		value = 0;
+		return true;
 	}
 	else if (property == 0x4 && networkInterface) // IO_IN_SCALED_VAL
 	{
+		value = 0;
 		const Robot *localRobot = networkInterface->getLocalRobot();
-		if (!localRobot) return 0;
+		if (!localRobot) return true;
 		
-		float value = localRobot->getSensorValue(port);
-		value = std::max(std::min(1.0f, value), 0.0f);
-		return unsigned(value*100.0f);
+		float sensorValue = localRobot->getSensorValue(port);
+		sensorValue = std::max(std::min(1.0f, sensorValue), 0.0f);
+		value = unsigned(sensorValue*100.0f);
+		return true;
 	}
-	std::cout << "Asked for value for input configuration for port " << port << " property " << property << " (" << nameForInputPartID(property) << ")" << std::endl;
-	return rand() % 2;
+	value = random.nextBelow(2);
+	return false;
 }
 
 void System::setOutputConfiguration(unsigned port, unsigned property, unsigned value)
@@ -350,6 +351,7 @@ int System::getOutputConfiguration(unsigned port, unsigned property)
 
 unsigned System::getTick()
 {
+	if (tickSource) return tickSource->getTick();
 	return millisecondsSinceStart();
 }
 
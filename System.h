@@ -9,21 +9,27 @@
 
 #include <stdint.h>
 
+#include "RandomGenerator.h"
+
 class NetworkInterface;
+class TickSource;
 class VMMemory;
 
 class System
 {
 	NetworkInterface *networkInterface;
 	VMMemory *memory;
+	TickSource *tickSource;
 	
 	uint8_t lowspeedOutputBuffer[16];
 	int bytesReady;
 	
+	// For the values of unsupported input properties.
+	unsigned randomSeed;
+	RandomGenerator random;
+	
 	// Debug only
-	static const char *nameForInputPartID(unsigned ID);
 	static const char *nameForOutputPartID(unsigned ID);
-	static const char *nameForSyscall(unsigned ID);
 	
 	// Communication (mainly with ultrasound sensor)
 	int CheckLSStatus(int port, int &bytesReady);
@@ -34,18 +40,34 @@ class System
 	bool sanitizeSoundFilename(unsigned dstocEntry, char *bufferOut);
 	
 public:
-	System(VMMemory *someMemory) : networkInterface(0), memory(someMemory) {}
+	System(VMMemory *someMemory) : networkInterface(0), memory(someMemory), tickSource(0), bytesReady(0), randomSeed(0) {}
+	
+	// Forgets all state of the running program, for restarting it.
+	void reset() { bytesReady = 0; random.setSeed(randomSeed); }
+	
+	// Seed for the random values this returns. Starts them over.
+	void setRandomSeed(unsigned seed) { randomSeed = seed; random.setSeed(seed); }
 	
 	void setNetworkInterface(NetworkInterface *anInterface) { networkInterface = anInterface; };
 	
-	// Called by interpreted code
-	void syscall(unsigned callID, unsigned paramClusterDSTOCIndex);
+	// Source for getTick. NULL (the default) means the wall clock. Not owned.
+	void setTickSource(TickSource *aSource) { tickSource = aSource; }
+	
+	// Called by interpreted code. Return false for calls and properties the
+	// simulation does not support, which the interpreter reports.
+	bool syscall(unsigned callID, unsigned paramClusterDSTOCIndex);
 	
-	void setInputConfiguration(unsigned port, unsigned property, unsigned value);
-	unsigned getInputConfiguration(unsigned port, unsigned property);
+	bool setInputConfiguration(unsigned port, unsigned property, unsigned value);
+	// Stores a random value if the property is not supported.
+	bool getInputConfiguration(unsigned port, unsigned property, unsigned &value);
 	
 	void setOutputConfiguration(unsigned port, unsigned property, unsigned value);
 	int getOutputConfiguration(unsigned port, unsigned property);
 	
 	unsigned getTick();
+	
+	// Name of a syscall or input property from the firmware documentation,
+	// for debugging, diagnostics and profiles.
+	static const char *nameForSyscall(unsigned ID);
+	static const char *nameForInputPartID(unsigned ID);
 };
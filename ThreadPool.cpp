@@ -0,0 +1,137 @@
+/*
+ *  ThreadPool.cpp
+ *  mindstormssimulation
+ *
+ *  Created by agent on 18.10.26
+ *  Copyright 2026 RWTH Aachen University All rights reserved.
+ *
+ */
+
+#include "ThreadPool.h"
+
+#include <iostream>
+#include <stdexcept>
+
+ThreadPool::ThreadPool(unsigned threadCount)
+: queued(0), pending(0), nextWorker(0), shuttingDown(false)
+{
+	if (threadCount == 0) threadCount = std::thread::hardware_concurrency();
+	if (threadCount == 0) threadCount = 1;
+
+	for (unsigned i = 0; i < threadCount; i++)
+		workers.push_back(new Worker);
+	for (unsigned i = 0; i < threadCount; i++)
+		threads.push_back(std::thread(&ThreadPool::workerMain, this, i));
+}
+
+ThreadPool::~ThreadPool()
+{
+	waitUntilDone();
+
+	{
+		std::lock_guard<std::mutex> lock(idleMutex);
+		shuttingDown = true;
+	}
+	workAvailable.notify_all();
+
+	for (std::vector<std::thread>::iterator iter = threads.begin(); iter != threads.end(); ++iter)
+		iter->join();
+	for (std::vector<Worker *>::iterator iter = workers.begin(); iter != workers.end(); ++iter)
+		delete *iter;
+}
+
+void ThreadPool::submit(const std::function<void ()> &task)
+{
+	pending++;
+
+	Worker *worker = workers[nextWorker++ % workers.size()];
+	{
+		std::lock_guard<std::mutex> lock(worker->mutex);
+		worker->tasks.push_back(task);
+	}
+
+	// Taking the idle lock, even without changing anything under it, makes
+	// sure that no worker misses the notification between checking queued
+	// and starting to wait.
+	{
+		std::lock_guard<std::mutex> lock(idleMutex);
+		queued++;
+	}
+	workAvailable.notify_one();
+}
+
+bool ThreadPool::takeTask(unsigned index, std::function<void ()> &task)
+{
+	// Own queue first, newest task, since its data is most likely still in
+	// the cache.
+	{
+		Worker *worker = workers[index];
+		std::lock_guard<std::mutex> lock(worker->mutex);
+		if (!worker->tasks.empty())
+		{
+			task = worker->tasks.back();
+			worker->tasks.pop_back();
+			queued--;
+			return true;
+		}
+	}
+
+	// Then steal the oldest task of someone else.
+	for (unsigned i = 1; i < workers.size(); i++)
+	{
+		Worker *victim = workers[(index + i) % workers.size()];
+		std::lock_guard<std::mutex> lock(victim->mutex);
+		if (!victim->tasks.empty())
+		{
+			task = victim->tasks.front();
+			victim->tasks.pop_front();
+			queued--;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void ThreadPool::workerMain(unsigned index)
+{
+	while (true)
+	{
+		std::function<void ()> task;
+		if (!takeTask(index, task))
+		{
+			std::unique_lock<std::mutex> lock(idleMutex);
+			while (queued == 0 && !shuttingDown)
+				workAvailable.wait(lock);
+			if (queued == 0 && shuttingDown)
+				return;
+			continue;
+		}
+
+		try
+		{
+			task();
+		}
+		catch (std::exception &e)
+		{
+			std::cerr << "Exception in worker thread: " << e.what() << std::endl;
+		}
+		catch (...)
+		{
+			std::cerr << "Unknown exception in worker thread" << std::endl;
+		}
+
+		if (--pending == 0)
+		{
+			std::lock_guard<std::mutex> lock(idleMutex);
+			allDone.notify_all();
+		}
+	}
+}
+
+void ThreadPool::waitUntilDone()
+{
+	std::unique_lock<std::mutex> lock(idleMutex);
+	while (pending != 0)
+		allDone.wait(lock);
+}
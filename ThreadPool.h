@@ -0,0 +1,87 @@
+#pragma once
+/*
+ *  ThreadPool.h
+ *  mindstormssimulation
+ *
+ *  Created by agent on 18.10.26
+ *  Copyright 2026 RWTH Aachen University All rights reserved.
+ *
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*!
+ * @abstract A fixed set of worker threads that run submitted tasks.
+ * @discussion Every worker has its own queue. Tasks are handed out to the
+ * queues in turn. A worker takes its newest task first, and when its own
+ * queue is empty, it takes the oldest task from another queue. This keeps
+ * all threads busy when tasks take very different amounts of time, as
+ * simulation runs of different programs do, without a single queue that
+ * all threads fight over.
+ *
+ * Exceptions thrown by tasks are caught and logged; they do not stop the
+ * worker.
+ */
+class ThreadPool
+{
+	struct Worker
+	{
+		std::mutex mutex;
+		std::deque<std::function<void ()> > tasks;
+	};
+
+	std::vector<Worker *> workers;
+	std::vector<std::thread> threads;
+
+	// Tasks that are in a queue and not yet taken by a worker.
+	std::atomic<unsigned> queued;
+	// Tasks that were submitted and are not finished yet.
+	std::atomic<unsigned> pending;
+	std::atomic<unsigned> nextWorker;
+
+	std::mutex idleMutex;
+	std::condition_variable workAvailable;
+	std::condition_variable allDone;
+	bool shuttingDown;
+
+	ThreadPool(const ThreadPool &);
+	ThreadPool &operator=(const ThreadPool &);
+
+	bool takeTask(unsigned worker, std::function<void ()> &task);
+	void workerMain(unsigned worker);
+
+public:
+	/*!
+	 * @abstract Creates the pool and starts its threads.
+	 * @param threadCount The number of threads. If 0, one thread per
+	 * hardware thread is used.
+	 */
+	ThreadPool(unsigned threadCount = 0);
+
+	/*!
+	 * @abstract Waits for all tasks, then stops the threads.
+	 */
+	~ThreadPool();
+
+	/*! The number of worker threads. */
+	unsigned getThreadCount() const { return unsigned(threads.size()); }
+
+	/*!
+	 * @abstract Adds a task.
+	 * @discussion Can be called from any thread, including from inside a
+	 * task.
+	 */
+	void submit(const std::function<void ()> &task);
+
+	/*!
+	 * @abstract Blocks until all submitted tasks have finished.
+	 * @discussion Must not be called from inside a task.
+	 */
+	void waitUntilDone();
+};
@@ -0,0 +1,52 @@
+#pragma once
+/*
+ *  TickSource.h
+ *  mindstormssimulation
+ *
+ *  Created by agent on 18.10.26
+ *  Copyright 2026 RWTH Aachen University All rights reserved.
+ *
+ */
+
+/*!
+ * @abstract Source of the tick seen by robot programs.
+ * @discussion The tick is the time in milliseconds that a robot program sees
+ * through OP_GETTICK, OP_WAIT and the timer syscalls. By default, System uses
+ * the wall clock (millisecondsSinceStart()). A different source can be set
+ * to run programs on simulated time instead.
+ */
+class TickSource
+{
+public:
+	virtual ~TickSource() {}
+
+	/*!
+	 * @abstract The current tick, in milliseconds.
+	 */
+	virtual unsigned getTick() const = 0;
+};
+
+/*!
+ * @abstract A clock that only moves when it is told to.
+ * @discussion Used to run the robot program, motors and physics in lockstep
+ * on simulated time, which can run slower or faster than real time.
+ */
+class SimulationClock : public TickSource
+{
+	double milliseconds;
+
+public:
+	/*!
+	 * @abstract Creates a clock.
+	 * @param startTick The tick at which the clock starts.
+	 */
+	SimulationClock(unsigned startTick = 0) : milliseconds(startTick) {}
+
+	virtual unsigned getTick() const { return unsigned(milliseconds); }
+
+	/*!
+	 * @abstract Moves the clock forward.
+	 * @param seconds The simulated time that has passed.
+	 */
+	void advance(float seconds) { milliseconds += double(seconds) * 1000.0; }
+};
@@ -16,7 +16,7 @@
 #elif defined(__APPLE_CC__)
 #include <CoreFoundation/CoreFoundation.h>
 
-#elif defined(ANDROID_NDK)
+#else /* POSIX, including Android */
 #include <time.h>
 
 #endif /* Platform */
@@ -28,8 +28,8 @@ static DWORD startTime;
 #elif defined(__APPLE_CC__)
 static CFAbsoluteTime startTime;
 
-#elif defined(ANDROID_NDK)
-static long startTime;
+#else
+static struct timespec startTime;
 
 #endif
 
@@ -39,10 +39,8 @@ void startTimeCount()
 	startTime = GetTickCount();
 #elif defined(__APPLE_CC__)
 	startTime = CFAbsoluteTimeGetCurrent();
-#elif defined(ANDROID_NDK)
-	struct timespec now;
-	clock_gettime(CLOCK_MONOTONIC, &now);
-	startTime = (now.tv_sec*1000 + now.tv_nsec/1000000000);
+#else
+	clock_gettime(CLOCK_MONOTONIC, &startTime);
 #endif
 }
 
@@ -57,9 +55,9 @@ unsigned millisecondsSinceStart()
 #elif defined(__APPLE_CC__)
 	CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
 	return (unsigned) ((now - startTime)*1000.0f);
-#elif defined(ANDROID_NDK)
+#else
 	struct timespec now;
 	clock_gettime(CLOCK_MONOTONIC, &now);
-	return (now.tv_sec*1000 + now.tv_nsec/1000000000) - startTime;
+	return (unsigned) ((now.tv_sec - startTime.tv_sec)*1000 + (now.tv_nsec - startTime.tv_nsec)/1000000);
 #endif
 }
\ No newline at end of file
@@ -0,0 +1,163 @@
+/*
+ *  VMDiagnostics.cpp
+ *  mindstormssimulation
+ *
+ *  Created by agent on 18.10.26
+ *  Copyright 2026 RWTH Aachen University All rights reserved.
+ *
+ */
+
+#include "VMDiagnostics.h"
+
+#include <ostream>
+#include <sstream>
+
+#include "Interpreter.h"
+#include "RXEFile.h"
+#include "System.h"
+
+namespace
+{
+	const unsigned noMessage = 0xFFFF;
+	const unsigned noClump = 0xFF;
+}
+
+VMDiagnostics::VMDiagnostics()
+: writeIndex(0), readIndex(0), droppedCount(0), messageCount(0)
+{
+	resetCounts();
+}
+
+void VMDiagnostics::resetCounts()
+{
+	for (unsigned i = 0; i < seenSize; i++)
+		seen[i].count = 0;
+	untrackedCount = 0;
+}
+
+uint32_t VMDiagnostics::countOccurrence(uint32_t key, uint32_t word)
+{
+	uint32_t hash = (key * 2654435761u) ^ (word * 2246822519u);
+	for (unsigned i = 0; i < seenProbes; i++)
+	{
+		Seen &entry = seen[(hash + i) % seenSize];
+		if (entry.count == 0)
+		{
+			entry.key = key;
+			entry.word = word;
+			entry.count = 1;
+			return 1;
+		}
+		if (entry.key == key && entry.word == word)
+			return ++entry.count;
+	}
+	return ++untrackedCount;
+}
+
+void VMDiagnostics::push(const Event &event)
+{
+	unsigned write = writeIndex.load(std::memory_order_relaxed);
+	if (write - readIndex.load(std::memory_order_acquire) == capacity)
+	{
+		droppedCount.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	events[write % capacity] = event;
+	writeIndex.store(write + 1, std::memory_order_release);
+}
+
+void VMDiagnostics::report(Code code, unsigned word, unsigned clump, unsigned argument, int32_t value)
+{
+	// Only the 1st, 2nd, 4th... time.
+	uint32_t count = countOccurrence((uint32_t(code) << 16) | (argument & 0xFFFF), word);
+	if ((count & (count - 1)) != 0) return;
+
+	Event event;
+	event.code = uint8_t(code);
+	event.clump = uint8_t(clump < noClump ? clump : noClump);
+	event.argument = uint16_t(argument);
+	event.word = word;
+	event.value = value;
+	event.count = count;
+	push(event);
+}
+
+void VMDiagnostics::reportFault(unsigned word, unsigned clump, const char *message)
+{
+	unsigned count = messageCount.load(std::memory_order_relaxed);
+	unsigned index = noMessage;
+	for (unsigned i = 0; i < count && index == noMessage; i++)
+		if (messages[i] == message) index = i;
+	if (index == noMessage && count < maxMessages)
+	{
+		messages[count] = message;
+		messageCount.store(count + 1, std::memory_order_release);
+		index = count;
+	}
+	report(Fault, word, clump, index);
+}
+
+bool VMDiagnostics::pop(Event &event)
+{
+	unsigned read = readIndex.load(std::memory_order_relaxed);
+	if (read == writeIndex.load(std::memory_order_acquire)) return false;
+	event = events[read % capacity];
+	readIndex.store(read + 1, std::memory_order_release);
+	return true;
+}
+
+std::string VMDiagnostics::describe(const Event &event) const
+{
+	std::ostringstream stream;
+	stream << "word " << event.word;
+	if (event.clump != noClump) stream << ", clump " << unsigned(event.clump);
+	stream << ": ";
+
+	const unsigned port = event.argument >> 8;
+	const unsigned property = event.argument & 0xFF;
+	switch (event.code)
+	{
+		case IgnoredInstruction:
+			stream << Interpreter::nameForOpcode(event.argument) << " is not implemented, skipped";
+			break;
+		case IgnoredMove:
+			stream << "OP_MOV from " << RXEFile::nameForType(RXEFile::dstocType(event.argument >> 8));
+			stream << " to " << RXEFile::nameForType(RXEFile::dstocType(event.argument & 0xFF)) << " is not supported, skipped";
+			break;
+		case UnknownSyscall:
+			stream << "syscall 0x" << std::hex << event.argument << std::dec << " (" << System::nameForSyscall(event.argument) << ") is not supported, skipped";
+			break;
+		case IgnoredInputConfiguration:
+			stream << "setting input property " << property << " (" << System::nameForInputPartID(property) << ") of port " << port;
+			stream << " to 0x" << std::hex << uint32_t(event.value) << std::dec << " is not supported, ignored";
+			break;
+		case UnknownInputConfiguration:
+			stream << "input property " << property << " (" << System::nameForInputPartID(property) << ") of port " << port << " is not simulated, read a random value";
+			break;
+		case Fault:
+			if (event.argument < messageCount.load(std::memory_order_acquire)) stream << messages[event.argument];
+			else stream << "fault";
+			break;
+		default:
+			stream << "unknown event " << unsigned(event.code);
+			break;
+	}
+
+	if (event.count > 1) stream << " (" << event.count << " times)";
+	return stream.str();
+}
+
+void VMDiagnostics::writeEvents(std::ostream &stream, const std::string &prefix)
+{
+	// All at once, so lines from different programs do not get mixed up.
+	std::ostringstream lines;
+	Event event;
+	while (pop(event))
+		lines << prefix << describe(event) << "\n";
+	unsigned dropped = takeDroppedCount();
+	if (dropped > 0)
+		lines << prefix << dropped << " more were dropped\n";
+
+	stream << lines.str();
+	stream.flush();
+}
@@ -0,0 +1,160 @@
+#pragma once
+/*
+ *  VMDiagnostics.h
+ *  mindstormssimulation
+ *
+ *  Created by agent on 18.10.26
+ *  Copyright 2026 RWTH Aachen University All rights reserved.
+ *
+ */
+
+#include <atomic>
+#include <iosfwd>
+#include <string>
+#include <stdint.h>
+
+/*!
+ * @abstract Things a running program did that the simulator could not do.
+ * @discussion Unimplemented instructions, unknown syscalls, unsupported
+ * sensor settings and faults do not stop a program, but someone should know
+ * about them. Printing a line every time is not an option, since they often
+ * happen inside loops; one program could flood the output and spend all its
+ * time waiting for it.
+ *
+ * Instead, the interpreter reports them here as small coded events, without
+ * any formatting, locking or allocation. The same event from the same
+ * instruction is only passed on the 1st, 2nd, 4th, 8th... time, with the
+ * number of times it happened so far. Events go into a ring buffer with one
+ * producer, the thread running the program, and one consumer, which takes
+ * them out at its own pace and turns them into text. If the consumer falls
+ * behind, new events are dropped and counted.
+ */
+class VMDiagnostics
+{
+public:
+	enum Code
+	{
+		/*! An instruction that is not implemented and was skipped. The
+		 * argument is the opcode. */
+		IgnoredInstruction,
+		/*! An OP_MOV between types that can not be moved. The argument is
+		 * the source type in the upper and the destination type in the lower
+		 * byte. */
+		IgnoredMove,
+		/*! A syscall that is not supported. The argument is its ID. */
+		UnknownSyscall,
+		/*! OP_SETIN of a property that the simulation does not model. The
+		 * argument is the port in the upper and the property in the lower
+		 * byte; the value is what was written. */
+		IgnoredInputConfiguration,
+		/*! OP_GETIN of a property that the simulation does not model, which
+		 * was answered with a random value. The argument is as for
+		 * IgnoredInputConfiguration. */
+		UnknownInputConfiguration,
+		/*! An instruction raised an error. The argument identifies the
+		 * message, see describe. */
+		Fault
+	};
+
+	struct Event
+	{
+		uint8_t code;
+		/*! The clump that ran the instruction, or 0xFF if unknown. */
+		uint8_t clump;
+		uint16_t argument;
+		/*! Offset of the instruction in the code, in words. */
+		uint32_t word;
+		int32_t value;
+		/*! How often this has happened so far. */
+		uint32_t count;
+	};
+
+private:
+	// Ring buffer. The producer only writes writeIndex, the consumer only
+	// readIndex; both only ever grow, so their difference is the number of
+	// events in the buffer.
+	static const unsigned capacity = 256;
+	Event events[capacity];
+	std::atomic<unsigned> writeIndex;
+	std::atomic<unsigned> readIndex;
+	std::atomic<unsigned> droppedCount;
+
+	// Only used by the producer: How often each event was reported. Events
+	// that find no place are counted together.
+	static const unsigned seenSize = 64;
+	static const unsigned seenProbes = 8;
+	struct Seen
+	{
+		uint32_t key;
+		uint32_t word;
+		uint32_t count;
+	};
+	Seen seen[seenSize];
+	uint32_t untrackedCount;
+
+	// Messages of faults. Written once by the producer before the count
+	// makes them visible, never changed afterwards.
+	static const unsigned maxMessages = 32;
+	std::string messages[maxMessages];
+	std::atomic<unsigned> messageCount;
+
+	VMDiagnostics(const VMDiagnostics &);
+	VMDiagnostics &operator=(const VMDiagnostics &);
+
+	uint32_t countOccurrence(uint32_t key, uint32_t word);
+	void push(const Event &event);
+
+public:
+	VMDiagnostics();
+
+	/*!
+	 * @methodgroup Producer
+	 */
+
+	/*!
+	 * @abstract Reports an event.
+	 * @discussion Only to be called by the thread running the program.
+	 * Never blocks.
+	 */
+	void report(Code code, unsigned word, unsigned clump, unsigned argument, int32_t value = 0);
+
+	/*!
+	 * @abstract Reports a fault with its message.
+	 * @discussion Only to be called by the thread running the program. Only
+	 * the first few different messages are kept.
+	 */
+	void reportFault(unsigned word, unsigned clump, const char *message);
+
+	/*!
+	 * @abstract Forgets how often each event happened.
+	 * @discussion For when the program is restarted. Only to be called by the
+	 * thread running the program.
+	 */
+	void resetCounts();
+
+	/*!
+	 * @methodgroup Consumer
+	 */
+
+	/*! Whether there are events to take. */
+	bool hasEvents() const { return writeIndex.load(std::memory_order_acquire) != readIndex.load(std::memory_order_relaxed) || droppedCount.load(std::memory_order_relaxed) != 0; }
+
+	/*!
+	 * @abstract Takes the oldest event.
+	 * @result false if there was none.
+	 */
+	bool pop(Event &event);
+
+	/*! Number of events dropped since the last call, because the buffer was full. */
+	unsigned takeDroppedCount() { return droppedCount.exchange(0, std::memory_order_relaxed); }
+
+	/*! A description of an event for people. */
+	std::string describe(const Event &event) const;
+
+	/*!
+	 * @abstract Takes all events and writes them as text.
+	 * @param stream Where to write them, one line each.
+	 * @param prefix Written at the start of every line.
+	 */
+	void writeEvents(std::ostream &stream, const std::string &prefix);
+};
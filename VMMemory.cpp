@@ -9,13 +9,39 @@
 
 #include "VMMemory.h"
 
+#include <algorithm>
 #include <cstring>
+#include <vector>
 
 #include "ByteOrder.h"
 #include "RXEFile.h"
 
 namespace
 {
+	// Size of the NXT firmware's memory pool, which holds static data and
+	// arrays.
+	const unsigned nxtPoolSize = 32768;
+	
+	// End of the memory manager list, NOT_A_DS_ID in the firmware.
+	const unsigned noArray = 0xFFFF;
+	
+	// Like the firmware, keep all arrays 4-byte aligned.
+	unsigned alignedSize(unsigned size)
+	{
+		return (size + 3) & ~3u;
+	}
+	
+	// Room a growing string gets: half as much again as it needs, but at
+	// least this much.
+	const unsigned minimumStringCapacity = 16;
+	
+	// Longest text of an int32_t or uint32_t, "-2147483648".
+	const unsigned maxNumberLength = 11;
+	
+	bool isDigit(char character)
+	{
+		return character >= '0' && character <= '9';
+	}
 }
 
 int32_t VMMemory::getScalar(RXEFile::dstocType type, const void *memoryLocation) const throw(std::invalid_argument)
@@ -88,9 +114,45 @@ void VMMemory::setScalar(RXEFile::dstocType type, void *memoryLocation, int32_t
 	
 }
 
-VMMemory::VMMemory(const RXEFile *file) : programData(file)
+VMMemory::SlotDescriptor VMMemory::descriptorForType(RXEFile::dstocType type)
+{
+	SlotDescriptor descriptor;
+	descriptor.shift = 0;
+	descriptor.flags = SlotReadable | SlotWritable;
+	switch (type)
+	{
+		case RXEFile::TC_UBYTE: descriptor.shift = 24; break;
+		case RXEFile::TC_SBYTE: descriptor.shift = 24; descriptor.flags |= SlotSigned; break;
+		case RXEFile::TC_UWORD: descriptor.shift = 16; break;
+		case RXEFile::TC_SWORD: descriptor.shift = 16; descriptor.flags |= SlotSigned; break;
+		case RXEFile::TC_ULONG: break;
+		case RXEFile::TC_SLONG: descriptor.flags |= SlotSigned; break;
+		case RXEFile::TC_MUTEX: break;
+		case RXEFile::TC_FLOAT: descriptor.flags |= SlotFloat; break;
+			
+			// The dope vector number of an array can be read, but not changed.
+		case RXEFile::TC_ARRAY: descriptor.shift = 16; descriptor.flags = SlotReadable; break;
+			
+			// Clusters and voids are not values at all.
+		default: descriptor.flags = 0; break;
+	}
+	return descriptor;
+}
+
+void VMMemory::throwForInvalidAccess(unsigned entry, bool write) const throw(std::range_error, std::invalid_argument)
 {
-	memory = new uint8_t [programData->getStaticSize()];
+	if (entry >= slotCount) throw std::range_error("Not a DSTOC entry");
+	if (write) throw std::invalid_argument("Invalid DSTOC type used for set");
+	throw std::invalid_argument("Invalid DSTOC type used for get");
+}
+
+VMMemory::VMMemory(const RXEFile *file) throw(std::runtime_error) : programData(file)
+{
+	// Build the static data as it is laid out in the file first, then convert
+	// it into slots. The packed form is not needed after that.
+	unsigned staticSize = programData->getStaticSize();
+	uint8_t *memory = new uint8_t [staticSize];
+	memset(memory, 0, staticSize);
 	
 	// Find default value
 	unsigned lastDefaultValuesEntry = 0;
@@ -138,6 +200,24 @@ VMMemory::VMMemory(const RXEFile *file) : programData(file)
 		}
 	}
 	
+	slotCount = programData->getDSTOCCount();
+	slots = new int32_t [slotCount];
+	slotDescriptors = new SlotDescriptor [slotCount];
+	for (unsigned i = 0; i < slotCount; i++)
+	{
+		RXEFile::dstocType type = programData->getTypeAtDSTOCIndex(i);
+		slotDescriptors[i] = descriptorForType(type);
+		slots[i] = 0;
+		
+		// Entries that describe array elements have offsets relative to the
+		// element, not to the static data. They get a slot anyway, just like
+		// they could be read before, but only if it is inside the data.
+		unsigned offset = programData->getDataDescriptorAtDSTOCIndex(i);
+		if ((slotDescriptors[i].flags & SlotReadable) && offset + programData->getSizeOfType(type) <= staticSize)
+			slots[i] = getScalar(type, memory + offset);
+	}
+	delete [] memory;
+	
 	// Prepare dynamic vectors
 	
 	// Difference in size between static data on the file and static data in memory.
@@ -147,51 +227,258 @@ VMMemory::VMMemory(const RXEFile *file) : programData(file)
 	// to find the array data.
 	const uint8_t *arrayStartPoint = programData->getDefaultData() - staticSizeDiff;
 	
+	const DopeVector *fileDopeVectors = (const DopeVector *) (arrayStartPoint + programData->getDopeVectorOffset());
+	arrayCount = SwapU16LittleToHost(fileDopeVectors[0].elementCount);
+	if (arrayCount == 0)
+	{
+		delete [] slots;
+		delete [] slotDescriptors;
+		throw std::runtime_error("No dope vectors");
+	}
+	
+	// Lay the arrays out in the order of the file's memory manager list. Any
+	// that are not on the list (which would be a broken file) go at the end.
+	std::vector<unsigned> order;
+	std::vector<bool> placed(arrayCount, false);
+	for (unsigned i = programData->getMemoryManagerHead(); i < arrayCount && !placed[i]; i = SwapU16LittleToHost(fileDopeVectors[i].linkIndex))
+	{
+		order.push_back(i);
+		placed[i] = true;
+	}
+	for (unsigned i = 0; i < arrayCount; i++)
+		if (!placed[i]) order.push_back(i);
+	
+	std::vector<unsigned> offsets(arrayCount);
+	unsigned initialSize = 0;
+	for (unsigned i = 0; i < arrayCount; i++)
+	{
+		offsets[order[i]] = initialSize;
+		initialSize += alignedSize(SwapU16LittleToHost(fileDopeVectors[order[i]].elementSize) * SwapU16LittleToHost(fileDopeVectors[order[i]].elementCount));
+	}
+	
+	// The firmware's pool also holds the static data, so that is not
+	// available for arrays.
+	poolSize = staticSize < nxtPoolSize ? nxtPoolSize - staticSize : 0;
+	if (initialSize > poolSize)
+	{
+		delete [] slots;
+		delete [] slotDescriptors;
+		throw std::runtime_error("Arrays do not fit in memory");
+	}
+	pool = new char [poolSize];
+	poolEnd = initialSize;
+	highWaterMark = initialSize;
+	compactionCount = 0;
 	
-	DopeVector *fileDopeVectors = (DopeVector *) (arrayStartPoint + programData->getDopeVectorOffset());
+	for (unsigned i = 0; i < arrayCount; i++)
+	{
+		unsigned byteSize = SwapU16LittleToHost(fileDopeVectors[i].elementSize) * SwapU16LittleToHost(fileDopeVectors[i].elementCount);
+		if (byteSize > 0)
+			memcpy(pool + offsets[i], arrayStartPoint + SwapU16LittleToHost(fileDopeVectors[i].offset), byteSize);
+	}
 	
-	// Prepare for resizing of dynamic vectors
-	arrays = new char * [fileDopeVectors[0].elementCount];
-    uint16_t arrayCount = SwapU16LittleToHost(fileDopeVectors[0].elementCount);
+	// The copied dope vectors still have the offsets and links from the file.
+	dopeVectors = reinterpret_cast<DopeVector *> (pool + offsets[0]);
+	listHead = noArray;
+	listTail = noArray;
 	for (unsigned i = 0; i < arrayCount; i++)
 	{
-        uint16_t elementCount = SwapU16LittleToHost(fileDopeVectors[i].elementCount);
-		if (elementCount == 0)
+		setArrayOffset(order[i], offsets[order[i]]);
+		appendArray(order[i]);
+	}
+}
+
+VMMemory::VMMemory(const VMMemory &original)
+: programData(original.programData), slotCount(original.slotCount), poolSize(original.poolSize), arrayCount(original.arrayCount)
+{
+	slots = new int32_t [slotCount];
+	slotDescriptors = new SlotDescriptor [slotCount];
+	memcpy(slotDescriptors, original.slotDescriptors, slotCount * sizeof(SlotDescriptor));
+	pool = new char [poolSize];
+	
+	restore(original);
+}
+
+VMMemory::~VMMemory()
+{
+	delete [] slots;
+	delete [] slotDescriptors;
+	delete [] pool;
+}
+
+void VMMemory::restore(const VMMemory &snapshot) throw(std::invalid_argument)
+{
+	if (snapshot.programData != programData) throw std::invalid_argument("Snapshot is for a different program");
+	
+	memcpy(slots, snapshot.slots, slotCount * sizeof(int32_t));
+	
+	// Everything after the end of the last array is unused.
+	memcpy(pool, snapshot.pool, snapshot.poolEnd);
+	dopeVectors = reinterpret_cast<DopeVector *> (pool + (reinterpret_cast<const char *> (snapshot.dopeVectors) - snapshot.pool));
+	poolEnd = snapshot.poolEnd;
+	listHead = snapshot.listHead;
+	listTail = snapshot.listTail;
+	highWaterMark = snapshot.highWaterMark;
+	compactionCount = snapshot.compactionCount;
+}
+
+unsigned VMMemory::findDifference(const VMMemory &other) const throw(std::invalid_argument)
+{
+	if (other.programData != programData) throw std::invalid_argument("Memory is for a different program");
+	
+	for (unsigned i = 0; i < slotCount; i++)
+	{
+		if (slots[i] != other.slots[i]) return i;
+		
+		// Entries for arrays inside of other arrays only describe the type
+		// and need not hold a valid dope vector. Their contents are part of
+		// the outer array.
+		if (programData->getTypeAtDSTOCIndex(i) != RXEFile::TC_ARRAY || unsigned(slots[i]) >= arrayCount) continue;
+		
+		ArrayView mine = getArrayView(i);
+		ArrayView theirs = other.getArrayView(i);
+		if (mine.length != theirs.length || mine.elementSize != theirs.elementSize) return i;
+		if (memcmp(mine.data, theirs.data, mine.length * mine.elementSize) != 0) return i;
+	}
+	return ~0u;
+}
+
+unsigned VMMemory::arrayOffset(unsigned dopeVector) const
+{
+	return SwapU16LittleToHost(dopeVectors[dopeVector].offset);
+}
+
+unsigned VMMemory::arrayLink(unsigned dopeVector) const
+{
+	return SwapU16LittleToHost(dopeVectors[dopeVector].linkIndex);
+}
+
+unsigned VMMemory::arrayByteSize(unsigned dopeVector) const
+{
+	return SwapU16LittleToHost(dopeVectors[dopeVector].elementSize) * SwapU16LittleToHost(dopeVectors[dopeVector].elementCount);
+}
+
+void VMMemory::setArrayOffset(unsigned dopeVector, unsigned offset)
+{
+	dopeVectors[dopeVector].offset = SwapU16HostToLittle(uint16_t(offset));
+}
+
+void VMMemory::setArrayLink(unsigned dopeVector, unsigned link)
+{
+	dopeVectors[dopeVector].linkIndex = SwapU16HostToLittle(uint16_t(link));
+}
+
+void VMMemory::unlinkArray(unsigned dopeVector)
+{
+	unsigned previous = noArray;
+	for (unsigned i = listHead; i != dopeVector; i = arrayLink(i))
+		previous = i;
+	
+	unsigned next = arrayLink(dopeVector);
+	if (previous == noArray) listHead = next;
+	else setArrayLink(previous, next);
+	if (listTail == dopeVector) listTail = previous;
+}
+
+void VMMemory::appendArray(unsigned dopeVector)
+{
+	setArrayLink(dopeVector, noArray);
+	if (listTail == noArray) listHead = dopeVector;
+	else setArrayLink(listTail, dopeVector);
+	listTail = dopeVector;
+}
+
+void VMMemory::compactPool()
+{
+	unsigned end = 0;
+	for (unsigned i = listHead; i != noArray; )
+	{
+		// Read everything first: If this is array 0, moving it moves the dope
+		// vectors themselves.
+		unsigned next = arrayLink(i);
+		unsigned offset = arrayOffset(i);
+		unsigned byteSize = arrayByteSize(i);
+		if (offset != end)
 		{
-			arrays[i] = NULL;
+			memmove(pool + end, pool + offset, byteSize);
+			if (i == 0) dopeVectors = reinterpret_cast<DopeVector *> (pool + end);
+			setArrayOffset(i, end);
 		}
-		else
+		end += alignedSize(byteSize);
+		i = next;
+	}
+	poolEnd = end;
+	compactionCount++;
+}
+
+void VMMemory::resizeArrayStorage(unsigned dopeVector, unsigned newByteLength, unsigned reservedByteLength) throw(std::runtime_error)
+{
+	unsigned needed = alignedSize(newByteLength);
+	
+	// Room to grow is only taken while the pool has enough of it; it is
+	// given up again when compacting.
+	unsigned reserved = std::max(needed, alignedSize(reservedByteLength));
+	
+	// The last array can simply grow or shrink.
+	if (dopeVector == listTail)
+	{
+		if (arrayOffset(dopeVector) + reserved > poolSize)
+			reserved = needed;
+		if (arrayOffset(dopeVector) + needed > poolSize)
 		{
-            uint16_t elementSize = SwapU16LittleToHost(fileDopeVectors[i].elementSize);
-            uint16_t offset = SwapU16LittleToHost(fileDopeVectors[i].offset);
-			arrays[i] = reinterpret_cast<char *>(malloc(elementSize * elementCount));
-			memcpy(arrays[i], arrayStartPoint + offset, elementSize * elementCount);
+			compactPool();
+			if (arrayOffset(dopeVector) + needed > poolSize) throw std::runtime_error("Out of memory for arrays");
 		}
+		poolEnd = arrayOffset(dopeVector) + reserved;
+		highWaterMark = std::max(highWaterMark, poolEnd);
+		return;
 	}
 	
-	dopeVectors = reinterpret_cast<DopeVector *> (arrays[0]);
+	// Any other array stays where it is if it fits before the next one.
+	if (arrayOffset(dopeVector) + newByteLength <= arrayOffset(arrayLink(dopeVector)))
+		return;
+	
+	// Otherwise it moves to the end.
+	if (poolEnd + reserved > poolSize)
+	{
+		compactPool();
+		reserved = needed;
+		if (poolEnd + needed > poolSize) throw std::runtime_error("Out of memory for arrays");
+	}
+	unsigned newOffset = poolEnd;
+	memcpy(pool + newOffset, pool + arrayOffset(dopeVector), std::min(arrayByteSize(dopeVector), newByteLength));
+	if (dopeVector == 0) dopeVectors = reinterpret_cast<DopeVector *> (pool + newOffset);
+	setArrayOffset(dopeVector, newOffset);
+	unlinkArray(dopeVector);
+	appendArray(dopeVector);
+	poolEnd = newOffset + reserved;
+	highWaterMark = std::max(highWaterMark, poolEnd);
 }
 
-VMMemory::~VMMemory()
+VMMemory::PoolStatistics VMMemory::getPoolStatistics() const
 {
-	delete [] memory;
-	unsigned numArrays = dopeVectors[0].elementCount;
-	for (unsigned i = 0; i < numArrays; i++)
-		delete [] arrays[i];
-	delete [] arrays;
+	PoolStatistics statistics;
+	statistics.poolSize = poolSize;
+	statistics.usedBytes = 0;
+	for (unsigned i = listHead; i != noArray; i = arrayLink(i))
+		statistics.usedBytes += alignedSize(arrayByteSize(i));
+	statistics.endBytes = poolEnd;
+	statistics.fragmentedBytes = poolEnd - statistics.usedBytes;
+	statistics.highWaterMark = highWaterMark;
+	statistics.compactionCount = compactionCount;
+	return statistics;
 }
 
-int32_t VMMemory::getScalarValue(unsigned entry) const throw(std::range_error, std::invalid_argument)
-{
-	if (entry >= programData->getDSTOCCount()) throw std::range_error("Not a DSTOC entry");
-	RXEFile::dstocType type = programData->getTypeAtDSTOCIndex(entry);
-	return getScalar(type, memory + programData->getDataDescriptorAtDSTOCIndex(entry));
-}
-void VMMemory::setScalarValue(unsigned entry, int32_t newValue) throw(std::range_error, std::invalid_argument)
+VMMemory::ArrayLayout VMMemory::getArrayLayout(unsigned dopeVector) const throw(std::range_error)
 {
-	if (entry >= programData->getDSTOCCount()) throw std::range_error("Not a DSTOC entry");
-	RXEFile::dstocType type = programData->getTypeAtDSTOCIndex(entry);	
-	setScalar(type, memory + programData->getDataDescriptorAtDSTOCIndex(entry), newValue);
+	if (dopeVector >= arrayCount) throw std::range_error("Not a dope vector");
+	
+	ArrayLayout layout;
+	layout.offset = arrayOffset(dopeVector);
+	layout.elementSize = SwapU16LittleToHost(dopeVectors[dopeVector].elementSize);
+	layout.elementCount = SwapU16LittleToHost(dopeVectors[dopeVector].elementCount);
+	layout.link = arrayLink(dopeVector);
+	return layout;
 }
 
 int32_t VMMemory::getArrayElement(unsigned arrayDSTOC, unsigned arrayIndex)
@@ -209,7 +496,7 @@ int32_t VMMemory::getArrayElement(unsigned arrayDSTOC, unsigned arrayIndex)
 	// Get size of an element.
 	unsigned size = SwapU16LittleToHost(dopeVectors[dopeVector].elementSize);
 	
-	return getScalar(elementType, &(arrays[dopeVector][size*arrayIndex]));
+	return getScalar(elementType, arrayData(dopeVector) + size*arrayIndex);
 }
 
 void VMMemory::setArrayElement(unsigned dstocEntry, unsigned arrayIndex, int32_t newValue)
@@ -228,7 +515,7 @@ void VMMemory::setArrayElement(unsigned dstocEntry, unsigned arrayIndex, int32_t
 	unsigned size = SwapU16LittleToHost(dopeVectors[dopeVector].elementSize);
 	
 	// Set element
-	setScalar(elementType, &(arrays[dopeVector][size*arrayIndex]), newValue);
+	setScalar(elementType, arrayData(dopeVector) + size*arrayIndex, newValue);
 }
 
 unsigned VMMemory::getArrayLength(unsigned dstocEntry) const
@@ -238,7 +525,7 @@ unsigned VMMemory::getArrayLength(unsigned dstocEntry) const
 	return SwapU16LittleToHost(dopeVectors[getScalarValue(dstocEntry)].elementCount);
 }
 
-void VMMemory::setArrayLength(unsigned dstocEntry, unsigned newLength)
+void VMMemory::setArrayLength(unsigned dstocEntry, unsigned newLength) throw(std::range_error, std::runtime_error)
 {
 	if (dstocEntry >= programData->getDSTOCCount()) throw std::range_error("Not a DSTOC entry");
 	
@@ -248,7 +535,7 @@ void VMMemory::setArrayLength(unsigned dstocEntry, unsigned newLength)
 	if (newLength == SwapU16LittleToHost(dopeVectors[dopeVector].elementCount)) return;
 	
 	unsigned newByteLength = newLength * SwapU16LittleToHost(dopeVectors[dopeVector].elementSize);
-	arrays[dopeVector] = reinterpret_cast<char *>(realloc(arrays[dopeVector], newByteLength));
+	resizeArrayStorage(dopeVector, newByteLength);
 	dopeVectors[dopeVector].elementCount = SwapU16HostToLittle(newLength);
 }
 
@@ -258,5 +545,300 @@ void *VMMemory::getArrayData(unsigned dstocEntry)
 	
 	int32_t dopeVector = getScalarValue(dstocEntry);
 	
-	return arrays[dopeVector];
+	return arrayData(dopeVector);
+}
+
+bool VMMemory::ArrayView::isPlain() const
+{
+	switch (elementType)
+	{
+		case RXEFile::TC_UBYTE:
+		case RXEFile::TC_SBYTE:
+		case RXEFile::TC_UWORD:
+		case RXEFile::TC_SWORD:
+		case RXEFile::TC_ULONG:
+		case RXEFile::TC_SLONG:
+		case RXEFile::TC_FLOAT:
+			return true;
+		default:
+			return false;
+	}
+}
+
+VMMemory::ArrayView VMMemory::getArrayView(unsigned dstocEntry) const throw(std::range_error)
+{
+	if (dstocEntry >= programData->getDSTOCCount()) throw std::range_error("Not a DSTOC entry");
+	
+	ArrayView view;
+	view.dopeVector = getScalarValue(dstocEntry);
+	view.elementType = programData->getTypeAtDSTOCIndex(dstocEntry + 1);
+	view.elementSize = SwapU16LittleToHost(dopeVectors[view.dopeVector].elementSize);
+	view.length = SwapU16LittleToHost(dopeVectors[view.dopeVector].elementCount);
+	view.data = arrayData(view.dopeVector);
+	return view;
+}
+
+VMMemory::ArrayView VMMemory::resizeArray(unsigned dstocEntry, unsigned newLength) throw(std::range_error, std::runtime_error)
+{
+	setArrayLength(dstocEntry, newLength);
+	return getArrayView(dstocEntry);
+}
+
+bool VMMemory::isArrayEntry(unsigned dstocEntry) const
+{
+	return dstocEntry < programData->getDSTOCCount() && programData->getTypeAtDSTOCIndex(dstocEntry) == RXEFile::TC_ARRAY;
+}
+
+void VMMemory::copyElements(const ArrayView &dest, unsigned destIndex, const ArrayView &source, unsigned start, unsigned count)
+{
+	if (dest.elementType == source.elementType && dest.elementSize == source.elementSize && source.isPlain())
+	{
+		// The same array, when building from itself, so the parts may overlap.
+		if (count > 0)
+			memmove(dest.data + destIndex*dest.elementSize, source.data + start*source.elementSize, count * source.elementSize);
+		return;
+	}
+	
+	// Different types, convert each element.
+	for (unsigned i = 0; i < count; i++)
+	{
+		int32_t value = -1;
+		if (source.elementType != RXEFile::TC_VOID && source.elementType != RXEFile::TC_CLUSTER)
+			value = getScalar(source.elementType, source.data + (start + i)*source.elementSize);
+		setScalar(dest.elementType, dest.data + (destIndex + i)*dest.elementSize, value);
+	}
+}
+
+void VMMemory::copyArray(unsigned destEntry, unsigned sourceEntry)
+{
+	copyRange(destEntry, sourceEntry, 0, getArrayView(sourceEntry).length);
+}
+
+void VMMemory::copyRange(unsigned destEntry, unsigned sourceEntry, unsigned start, unsigned count)
+{
+	ArrayView source = getArrayView(sourceEntry);
+	start = std::min(start, source.length);
+	count = std::min(count, source.length - start);
+	
+	if (getArrayView(destEntry).dopeVector == source.dopeVector)
+	{
+		// Move the part to the front first, shrinking keeps it there.
+		if (start > 0) copyElements(source, 0, source, start, count);
+		resizeArray(destEntry, count);
+		return;
+	}
+	
+	// Resizing may move the source, so look it up again.
+	ArrayView dest = resizeArray(destEntry, count);
+	source = getArrayView(sourceEntry);
+	copyElements(dest, 0, source, start, count);
+}
+
+void VMMemory::fillArray(unsigned dstocEntry, unsigned count, int32_t value)
+{
+	ArrayView dest = resizeArray(dstocEntry, count);
+	if (count == 0) return;
+	
+	// Convert the value once, then copy its bytes over the rest of the array,
+	// doubling the copied part each time.
+	setScalar(dest.elementType, dest.data, value);
+	if (dest.elementSize == 1)
+	{
+		memset(dest.data + 1, dest.data[0], count - 1);
+		return;
+	}
+	
+	unsigned totalBytes = count * dest.elementSize;
+	unsigned filledBytes = dest.elementSize;
+	while (filledBytes < totalBytes)
+	{
+		unsigned copyBytes = std::min(filledBytes, totalBytes - filledBytes);
+		memcpy(dest.data + filledBytes, dest.data, copyBytes);
+		filledBytes += copyBytes;
+	}
+}
+
+void VMMemory::buildArray(unsigned dstocEntry, const uint16_t *sourceEntries, unsigned count)
+{
+	unsigned length = 0;
+	for (unsigned i = 0; i < count; i++)
+		length += isArrayEntry(sourceEntries[i]) ? getArrayView(sourceEntries[i]).length : 1;
+	
+	// Resizing may move the sources, so they are looked up afterwards.
+	ArrayView dest = resizeArray(dstocEntry, length);
+	unsigned next = 0;
+	for (unsigned i = 0; i < count; i++)
+	{
+		if (isArrayEntry(sourceEntries[i]))
+		{
+			ArrayView source = getArrayView(sourceEntries[i]);
+			unsigned sourceLength = std::min(source.length, length - next);
+			copyElements(dest, next, source, 0, sourceLength);
+			next += sourceLength;
+		}
+		else
+			setScalar(dest.elementType, dest.data + (next++)*dest.elementSize, getScalarValue(sourceEntries[i]));
+	}
+}
+
+VMMemory::ArrayView VMMemory::getByteArrayView(unsigned dstocEntry) const throw(std::range_error, std::invalid_argument)
+{
+	ArrayView view = getArrayView(dstocEntry);
+	if (view.elementType != RXEFile::TC_UBYTE && view.elementType != RXEFile::TC_SBYTE)
+		throw std::invalid_argument("Not a string or byte array");
+	return view;
+}
+
+VMMemory::ArrayView VMMemory::resizeByteArray(unsigned dstocEntry, unsigned newLength) throw(std::range_error, std::invalid_argument, std::runtime_error)
+{
+	ArrayView view = getByteArrayView(dstocEntry);
+	if (newLength == view.length) return view;
+	
+	unsigned reserved = 0;
+	if (newLength > view.length) reserved = std::max(newLength + newLength / 2, minimumStringCapacity);
+	resizeArrayStorage(view.dopeVector, newLength, reserved);
+	dopeVectors[view.dopeVector].elementCount = SwapU16HostToLittle(uint16_t(newLength));
+	
+	view.length = newLength;
+	view.data = arrayData(view.dopeVector);
+	return view;
+}
+
+unsigned VMMemory::stringLength(const ArrayView &view)
+{
+	const void *end = memchr(view.data, 0, view.length);
+	if (!end) return view.length;
+	return unsigned(static_cast<const char *> (end) - view.data);
+}
+
+void VMMemory::setString(unsigned dstocEntry, const char *text, unsigned length)
+{
+	ArrayView dest = resizeByteArray(dstocEntry, length + 1);
+	memcpy(dest.data, text, length);
+	dest.data[length] = 0;
+}
+
+void VMMemory::copyBytes(unsigned destEntry, unsigned sourceEntry, unsigned start, unsigned length, bool terminate)
+{
+	const unsigned newLength = length + (terminate ? 1 : 0);
+	ArrayView source = getByteArrayView(sourceEntry);
+	if (getByteArrayView(destEntry).dopeVector == source.dopeVector)
+	{
+		// Move the part to the front first, shrinking keeps it there.
+		memmove(source.data, source.data + start, length);
+		ArrayView dest = resizeByteArray(destEntry, newLength);
+		if (terminate) dest.data[length] = 0;
+		return;
+	}
+	
+	// Resizing may move the source, so look it up again.
+	ArrayView dest = resizeByteArray(destEntry, newLength);
+	source = getByteArrayView(sourceEntry);
+	if (length > 0) memcpy(dest.data, source.data + start, length);
+	if (terminate) dest.data[length] = 0;
+}
+
+void VMMemory::setStringToNumber(unsigned dstocEntry, int32_t value, bool isUnsigned)
+{
+	// Digits are written from the back.
+	char buffer[maxNumberLength];
+	char *end = buffer + maxNumberLength;
+	char *start = end;
+	
+	const bool isNegative = !isUnsigned && value < 0;
+	uint32_t magnitude = isNegative ? 0u - uint32_t(value) : uint32_t(value);
+	do
+	{
+		*--start = char('0' + magnitude % 10);
+		magnitude /= 10;
+	} while (magnitude != 0);
+	if (isNegative) *--start = '-';
+	
+	setString(dstocEntry, start, unsigned(end - start));
+}
+
+bool VMMemory::parseNumber(unsigned sourceEntry, unsigned offset, int32_t &value, unsigned &indexPast) const
+{
+	ArrayView source = getByteArrayView(sourceEntry);
+	const unsigned length = stringLength(source);
+	const char *text = source.data;
+	
+	unsigned index = offset;
+	while (index < length && !isDigit(text[index]) && !((text[index] == '-' || text[index] == '+') && index + 1 < length && isDigit(text[index + 1])))
+		index++;
+	if (index >= length)
+	{
+		indexPast = length;
+		return false;
+	}
+	
+	const bool isNegative = text[index] == '-';
+	if (!isDigit(text[index])) index++;
+	
+	// Overflows wrap around, like in the firmware.
+	uint32_t magnitude = 0;
+	for (; index < length && isDigit(text[index]); index++)
+		magnitude = magnitude * 10 + uint32_t(text[index] - '0');
+	
+	// Numbers are integers here, so the fraction is dropped.
+	if (index + 1 < length && text[index] == '.' && isDigit(text[index + 1]))
+	{
+		for (index++; index < length && isDigit(text[index]); index++)
+			;
+	}
+	
+	value = int32_t(isNegative ? 0u - magnitude : magnitude);
+	indexPast = index;
+	return true;
+}
+
+void VMMemory::concatenateStrings(unsigned destEntry, const uint16_t *sourceEntries, unsigned count)
+{
+	// Where the destination is also a source, it is read from its old data,
+	// which stays at its start when resizing.
+	const unsigned destDopeVector = getByteArrayView(destEntry).dopeVector;
+	const unsigned destLength = stringLength(getByteArrayView(destEntry));
+	unsigned totalLength = 0;
+	for (unsigned i = 0; i < count; i++)
+	{
+		ArrayView source = getByteArrayView(sourceEntries[i]);
+		totalLength += source.dopeVector == destDopeVector ? destLength : stringLength(source);
+	}
+	
+	ArrayView dest = resizeByteArray(destEntry, totalLength + 1);
+	
+	// Going from the back, every part is written behind all copies of the
+	// old destination that are still to be read, since each of those comes
+	// before it in the result and is just as long. If the destination is the
+	// first source, it is not moved at all.
+	unsigned end = totalLength;
+	for (unsigned i = count; i-- > 0; )
+	{
+		ArrayView source = getByteArrayView(sourceEntries[i]);
+		unsigned length = destLength;
+		if (source.dopeVector != destDopeVector) length = stringLength(source);
+		else source.data = dest.data;
+		end -= length;
+		if (source.data != dest.data + end)
+			memmove(dest.data + end, source.data, length);
+	}
+	dest.data[totalLength] = 0;
+}
+
+void VMMemory::copySubstring(unsigned destEntry, unsigned sourceEntry, unsigned start, unsigned length)
+{
+	const unsigned available = stringLength(getByteArrayView(sourceEntry));
+	start = std::min(start, available);
+	length = std::min(length, available - start);
+	copyBytes(destEntry, sourceEntry, start, length, true);
+}
+
+void VMMemory::copyStringToBytes(unsigned destEntry, unsigned sourceEntry)
+{
+	copyBytes(destEntry, sourceEntry, 0, stringLength(getByteArrayView(sourceEntry)), false);
+}
+
+void VMMemory::copyBytesToString(unsigned destEntry, unsigned sourceEntry)
+{
+	copyBytes(destEntry, sourceEntry, 0, getByteArrayView(sourceEntry).length, true);
 }
@@ -1,3 +1,4 @@
+#pragma once
 /*
  *  VMMemory.h
  *  mindstormssimulation
@@ -30,16 +31,56 @@ class VMMemory
 	const RXEFile *programData;
 	
 	// Stores the global scalars (which includes the dope vector numbers for
-	// arrays, but not the arrays themselves)
-	uint8_t *memory;
+	// arrays, but not the arrays themselves). Unlike in the file, where each
+	// value has its own size and byte order, every DSTOC entry gets a 32-bit
+	// slot in host byte order here, holding the value as getScalarValue
+	// returns it. Reading is thus a single load; the conversion to the actual
+	// type happens once, when storing.
+	int32_t *slots;
+	unsigned slotCount;
+	
+	// How to store into a slot, computed from the DSTOC type at load time.
+	// Shifting left and then right by shift (arithmetic for signed types)
+	// narrows a value to the size of the type, exactly like a cast would.
+	enum SlotFlags
+	{
+		SlotReadable = 1 << 0,
+		SlotWritable = 1 << 1,
+		SlotSigned = 1 << 2,
+		SlotFloat = 1 << 3
+	};
+	struct SlotDescriptor
+	{
+		uint8_t shift;
+		uint8_t flags;
+	};
+	SlotDescriptor *slotDescriptors;
+	
+	static SlotDescriptor descriptorForType(RXEFile::dstocType type);
+	
+	VMMemory &operator=(const VMMemory &);
+	static int32_t narrowToSlot(SlotDescriptor descriptor, int32_t value)
+	{
+		// Floats only hold integers here, so storing one means rounding to
+		// float precision.
+		if (descriptor.flags & SlotFloat) return int32_t(float(value));
+		
+		uint32_t shifted = uint32_t(value) << descriptor.shift;
+		if (descriptor.flags & SlotSigned) return int32_t(shifted) >> descriptor.shift;
+		return int32_t(shifted >> descriptor.shift);
+	}
+	
+	// Throws the exceptions for a failed access. Kept out of line, so the
+	// checks in the inline accessors stay small.
+	void throwForInvalidAccess(unsigned entry, bool write) const throw(std::range_error, std::invalid_argument);
 	
 	// Meta-data for vectors, called Dope Vector by the Lego documentation for
 	// some reason. In that documentation, a Dope Vector is an entry here, while
 	// the entire array is the Dope Vector Array. Notice that this is a vector
-	// itself, dopeVectors is aliased to arrays[0]. All fields except elementSize
-	// and elementCount are unused and only included for compatibility with the
-	// file format.. The actual data is contained in the entry of arrays with the
-	// same index, i.e. the data for dopeVectors[i] is in arrays[i]
+	// itself, dopeVectors is aliased to the data of array 0. As in the
+	// firmware, offset is where the array's data starts in the pool, and
+	// linkIndex is the next array in the pool, or noArray for the last one.
+	// unused is only included for compatibility with the file format.
 #ifdef _MSC_VER
 #pragma pack (push, 1)
 #endif
@@ -56,14 +97,105 @@ class VMMemory
 #endif
 	DopeVector *dopeVectors;
 	
-	// This actually contains the data.
-	char **arrays;
+	// All array data lives in one pool, like in the firmware's memory
+	// manager. Arrays are kept in a linked list, through linkIndex, in the
+	// order of their offsets. New space is only ever taken from the end; an
+	// array that grows is moved there unless it already is the last one. The
+	// holes this leaves are closed by compacting when the end is reached. If
+	// that does not help either, the program is out of memory, just as it
+	// would be on the NXT.
+	char *pool;
+	unsigned poolSize;
+	unsigned poolEnd;
+	unsigned arrayCount;
+	unsigned listHead;
+	unsigned listTail;
+	unsigned highWaterMark;
+	unsigned compactionCount;
+	
+	// Access to the dope vector fields, which are stored little endian.
+	unsigned arrayOffset(unsigned dopeVector) const;
+	unsigned arrayLink(unsigned dopeVector) const;
+	unsigned arrayByteSize(unsigned dopeVector) const;
+	void setArrayOffset(unsigned dopeVector, unsigned offset);
+	void setArrayLink(unsigned dopeVector, unsigned link);
+	char *arrayData(unsigned dopeVector) const { return pool + arrayOffset(dopeVector); }
+	
+	void unlinkArray(unsigned dopeVector);
+	void appendArray(unsigned dopeVector);
+	void compactPool();
+	void resizeArrayStorage(unsigned dopeVector, unsigned newByteLength, unsigned reservedByteLength = 0) throw(std::runtime_error);
 	
 	// Primitive methods to access any value, casting from/to the internal type.
 	int32_t getScalar(RXEFile::dstocType type, const void *memoryLocation) const throw (std::invalid_argument);
 	void setScalar(RXEFile::dstocType type, void *memoryLocation, int32_t newValue) throw (std::invalid_argument);
 	
+	// Everything needed to work on the contents of an array, looked up once
+	// for a whole operation instead of once per element.
+	struct ArrayView
+	{
+		unsigned dopeVector;
+		RXEFile::dstocType elementType;
+		unsigned elementSize;
+		unsigned length;
+		char *data;
+		
+		// Whether the elements are plain numbers, which can be copied as
+		// bytes. Not true for clusters or arrays of arrays.
+		bool isPlain() const;
+	};
+	ArrayView getArrayView(unsigned dstocEntry) const throw(std::range_error);
+	ArrayView resizeArray(unsigned dstocEntry, unsigned newLength) throw(std::range_error, std::runtime_error);
+	bool isArrayEntry(unsigned dstocEntry) const;
+	// Copies count elements of source, starting at start, to dest, starting
+	// at destIndex, converting them if needed. Both must have room for them.
+	void copyElements(const ArrayView &dest, unsigned destIndex, const ArrayView &source, unsigned start, unsigned count);
+	
+	// Strings are arrays of bytes. These check that the array is one, and
+	// resizing leaves room after it to grow, so that appending to a string
+	// again and again does not have to move it every time.
+	ArrayView getByteArrayView(unsigned dstocEntry) const throw(std::range_error, std::invalid_argument);
+	ArrayView resizeByteArray(unsigned dstocEntry, unsigned newLength) throw(std::range_error, std::invalid_argument, std::runtime_error);
+	static unsigned stringLength(const ArrayView &view);
+	void setString(unsigned dstocEntry, const char *text, unsigned length);
+	void copyBytes(unsigned destEntry, unsigned sourceEntry, unsigned start, unsigned length, bool terminate);
+	
 public:
+	/*!
+	 * @abstract Usage of the array pool.
+	 */
+	struct PoolStatistics
+	{
+		/*! Bytes available for arrays in total. */
+		unsigned poolSize;
+		/*! Bytes used by array data right now. */
+		unsigned usedBytes;
+		/*! Bytes up to the end of the last array, including holes. */
+		unsigned endBytes;
+		/*! Bytes in holes between arrays, which compaction would regain.
+		 * Includes the room strings keep to grow. */
+		unsigned fragmentedBytes;
+		/*! The largest endBytes so far. */
+		unsigned highWaterMark;
+		/*! How often the pool had to be compacted. */
+		unsigned compactionCount;
+	};
+	
+	/*!
+	 * @abstract Where an array is in the pool, as its dope vector says.
+	 */
+	struct ArrayLayout
+	{
+		/*! Start of the array's data in the pool, in bytes. */
+		unsigned offset;
+		/*! Size of one element in bytes. */
+		unsigned elementSize;
+		/*! Number of elements. */
+		unsigned elementCount;
+		/*! The dope vector of the next array in the pool, or 0xFFFF. */
+		unsigned link;
+	};
+	
 	/*!
 	 * @methodgroup Creating and destroying
 	 */
@@ -74,14 +206,47 @@ public:
 	 * default data and the Dataspace Table of Contents (DSTOC) and has to exist
 	 * for the entire time the memory does. The memory does not take ownership
 	 * of the file, you have to delete it yourself after destroying the memory.
+	 * @throws std::runtime_error If the arrays of the file do not fit in the
+	 * pool.
 	 */
-	VMMemory(const RXEFile *file);
+	VMMemory(const RXEFile *file) throw(std::runtime_error);
+	
+	/*!
+	 * @abstract Copies a memory.
+	 * @discussion This is much faster than creating a memory from the file
+	 * again. Taking a copy right after creating a memory gives a snapshot of
+	 * the program's initial state, which can be used to start the program
+	 * again (with restore) or to start more copies of it. The copy uses the
+	 * same file as the original.
+	 * @param original The memory to copy.
+	 */
+	VMMemory(const VMMemory &original);
 	
 	/*!
 	 * @abstract Destructor
 	 */
 	~VMMemory();
 	
+	/*!
+	 * @abstract Sets all values and arrays to those of a snapshot.
+	 * @param snapshot A copy of a memory for the same file.
+	 * @throws std::invalid_argument If the snapshot is for a different file.
+	 */
+	void restore(const VMMemory &snapshot) throw(std::invalid_argument);
+	
+	/*!
+	 * @abstract Finds where two memories for the same file differ.
+	 * @discussion Compares the values of all entries and the contents of all
+	 * arrays. Used to check that two ways of running a program give the same
+	 * result.
+	 * @param other Another memory for the same file.
+	 * @result The first DSTOC entry whose value or array contents differ, or
+	 * ~0u if there is none.
+	 * @throws std::invalid_argument If the other memory is for a different
+	 * file.
+	 */
+	unsigned findDifference(const VMMemory &other) const throw(std::invalid_argument);
+	
 	/*!
 	 * @methodgroup Scalar value manipulation
 	 */
@@ -96,7 +261,19 @@ public:
 	 * @throws std::invalid_argument if the type of the entry is one that cannot
 	 * be read, that is cluster or void.
 	 */	
-	int32_t getScalarValue(unsigned entry) const throw(std::range_error, std::invalid_argument);
+	int32_t getScalarValue(unsigned entry) const throw(std::range_error, std::invalid_argument)
+	{
+		if (entry >= slotCount || !(slotDescriptors[entry].flags & SlotReadable))
+			throwForInvalidAccess(entry, false);
+		return slots[entry];
+	}
+	
+	/*!
+	 * @abstract Gets the value of a memory location without any checks.
+	 * @discussion Only for entries that are known to exist and to be
+	 * readable, like the operands of a program that passed the RXEVerifier.
+	 */
+	int32_t getScalarValueUnchecked(unsigned entry) const { return slots[entry]; }
 	
 	/*!
 	 * @abstract Sets a new value for a memory location
@@ -109,7 +286,30 @@ public:
 	 * @throws std::invalid_argument if the type of the entry is one that cannot
 	 * be written, that is array, cluster or void.
 	 */
-	void setScalarValue(unsigned entry, int32_t newValue) throw(std::range_error, std::invalid_argument);
+	void setScalarValue(unsigned entry, int32_t newValue) throw(std::range_error, std::invalid_argument)
+	{
+		if (entry >= slotCount || !(slotDescriptors[entry].flags & SlotWritable))
+			throwForInvalidAccess(entry, true);
+		slots[entry] = narrowToSlot(slotDescriptors[entry], newValue);
+	}
+	
+	/*!
+	 * @abstract Sets a new value for a memory location without any checks.
+	 * @discussion Only for entries that are known to exist and to be
+	 * writable, like the operands of a program that passed the RXEVerifier.
+	 */
+	void setScalarValueUnchecked(unsigned entry, int32_t newValue)
+	{
+		slots[entry] = narrowToSlot(slotDescriptors[entry], newValue);
+	}
+	
+	/*!
+	 * @abstract The slots of all entries, for translated code.
+	 * @discussion One int32_t per DSTOC entry, holding what getScalarValue
+	 * returns. Values stored here have to be converted to the type of the
+	 * entry already, like setScalarValue does.
+	 */
+	int32_t *getSlots() { return slots; }
 	
 	/*!
 	 * @methodgroup Array manipulation
@@ -128,8 +328,10 @@ public:
 	 * @param dstocEntry The array identifier. NOT the Dope Vector, but the value
 	 * passed as an argument to opcodes.
 	 * @param newLength The new length for the array (not bytes, elements).
+	 * @throws std::runtime_error If there is not enough memory left in the
+	 * pool.
 	 */
-	void setArrayLength(unsigned dstocEntry, unsigned newLength);
+	void setArrayLength(unsigned dstocEntry, unsigned newLength) throw(std::range_error, std::runtime_error);
 	
 	/*!
 	 * @abstract Returns an array element.
@@ -163,4 +365,129 @@ public:
 	 * @result The data of the array.
 	 */
 	void *getArrayData(unsigned dstocEntry);
+	
+	/*!
+	 * @methodgroup Bulk array operations
+	 */
+	/*!
+	 * @abstract Makes one array a copy of another.
+	 * @discussion The destination gets the length of the source. If both have
+	 * the same plain element type, the data is copied in one go, otherwise
+	 * each element is converted like with setArrayElement.
+	 * @param destEntry The array to change.
+	 * @param sourceEntry The array to copy.
+	 */
+	void copyArray(unsigned destEntry, unsigned sourceEntry);
+	
+	/*!
+	 * @abstract Makes one array a copy of part of another.
+	 * @discussion The elements are copied like with copyArray. The part is
+	 * cut off where the source ends, so the destination may end up shorter
+	 * than count, or empty. Source and destination may be the same array.
+	 * @param destEntry The array to change.
+	 * @param sourceEntry The array to copy from.
+	 * @param start Index of the first element to copy.
+	 * @param count The number of elements to copy.
+	 */
+	void copyRange(unsigned destEntry, unsigned sourceEntry, unsigned start, unsigned count);
+	
+	/*!
+	 * @abstract Sets the length of an array and all its elements to one value.
+	 * @discussion The value is converted to the element type only once.
+	 * @param dstocEntry The array to change.
+	 * @param count The new length.
+	 * @param value The value for all elements.
+	 */
+	void fillArray(unsigned dstocEntry, unsigned count, int32_t value);
+	
+	/*!
+	 * @abstract Sets an array to the values of a list of scalars and arrays.
+	 * @discussion Scalars become one element, arrays add all their elements,
+	 * copied like with copyArray.
+	 * @param dstocEntry The array to change.
+	 * @param sourceEntries The scalars and arrays that become the elements,
+	 * in order.
+	 * @param count The number of entries in sourceEntries.
+	 */
+	void buildArray(unsigned dstocEntry, const uint16_t *sourceEntries, unsigned count);
+	
+	/*!
+	 * @methodgroup String operations
+	 * @discussion Strings are arrays of bytes with a 0 at the end, which
+	 * counts towards the length of the array. Text after an earlier 0 is
+	 * ignored. Arrays with elements of any other size throw
+	 * std::invalid_argument. None of these allocate; the strings live in the
+	 * pool like all other arrays.
+	 */
+	
+	/*!
+	 * @abstract Sets a string to the decimal digits of a number.
+	 * @param dstocEntry The string to change.
+	 * @param value The number.
+	 * @param isUnsigned Whether to treat value as an uint32_t.
+	 */
+	void setStringToNumber(unsigned dstocEntry, int32_t value, bool isUnsigned);
+	
+	/*!
+	 * @abstract Reads a number from a string.
+	 * @discussion Skips everything up to the first digit, or sign directly
+	 * before a digit. Only integers are supported; digits after a decimal
+	 * point are skipped.
+	 * @param sourceEntry The string to read.
+	 * @param offset Where to start in the string.
+	 * @param value Set to the number, if one was found.
+	 * @param indexPast Set to the index after the number, or the length of
+	 * the string if there was none.
+	 * @result Whether there was a number.
+	 */
+	bool parseNumber(unsigned sourceEntry, unsigned offset, int32_t &value, unsigned &indexPast) const;
+	
+	/*!
+	 * @abstract Sets a string to several others, one after the other.
+	 * @discussion The destination may be one of the sources, any number of
+	 * times. If it is the first, the others are appended in place.
+	 * @param destEntry The string to change.
+	 * @param sourceEntries The strings to join.
+	 * @param count The number of strings.
+	 */
+	void concatenateStrings(unsigned destEntry, const uint16_t *sourceEntries, unsigned count);
+	
+	/*!
+	 * @abstract Sets a string to a part of another.
+	 * @discussion The part is cut to what the source has.
+	 * @param destEntry The string to change. May be the source.
+	 * @param sourceEntry The string to copy from.
+	 * @param start Index of the first character to copy.
+	 * @param length Number of characters to copy.
+	 */
+	void copySubstring(unsigned destEntry, unsigned sourceEntry, unsigned start, unsigned length);
+	
+	/*!
+	 * @abstract Sets a byte array to the characters of a string, without the
+	 * 0 at the end.
+	 */
+	void copyStringToBytes(unsigned destEntry, unsigned sourceEntry);
+	
+	/*!
+	 * @abstract Sets a string to all bytes of a byte array, with a 0 added.
+	 */
+	void copyBytesToString(unsigned destEntry, unsigned sourceEntry);
+	
+	/*!
+	 * @abstract How much of the array pool is used.
+	 */
+	PoolStatistics getPoolStatistics() const;
+	
+	/*!
+	 * @abstract Number of dope vectors.
+	 * @discussion The first one describes the dope vector array itself.
+	 */
+	unsigned getDopeVectorCount() const { return arrayCount; }
+	
+	/*!
+	 * @abstract Where an array is and how large it is.
+	 * @param dopeVector The index of the dope vector. NOT the DSTOC entry.
+	 * @throws std::range_error If there is no such dope vector.
+	 */
+	ArrayLayout getArrayLayout(unsigned dopeVector) const throw(std::range_error);
 };
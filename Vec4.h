@@ -224,9 +224,26 @@ union float4
 #endif
 	}
 	
-	float4 operator*(float s) const { return float4(x*s, y*s, z*s, w*s); }
+	float4 operator*(float s) const
+	{
+#ifdef __SSE__
+		return _mm_mul_ps(v, _mm_set1_ps(s));
+#else
+		return float4(x*s, y*s, z*s, w*s);
+#endif
+	}
 	float4 operator/(float s) const { return *this * (1.0f/s); }
 	
+	// Component-wise product; operator* with another float4 is the dot product.
+	float4 scaled(const float4 &other) const
+	{
+#ifdef __SSE__
+		return _mm_mul_ps(v, other.v);
+#else
+		return float4(x*other.x, y*other.y, z*other.z, w*other.w);
+#endif
+	}
+	
 	float operator*(const float4 &other) const { return x*other.x + y*other.y + z*other.z + w*other.w; }
 	
 	void operator*=(float s)
@@ -15,7 +15,9 @@ LOCAL_SRC_FILES := \
 	AndroidSoundBuffer.cpp \
 	AndroidSoundController.cpp \
 	../../Client.cpp \
+	../../CollisionBatch.cpp \
 	../../Controller.cpp \
+	../../DecodedProgram.cpp \
 	../../Drawer.cpp \
 	../../Environment.cpp \
 	../../EnvironmentDrawer.cpp \
@@ -29,15 +31,22 @@ LOCAL_SRC_FILES := \
 	../../Interpreter_LogicalInstructions.cpp \
 	../../Interpreter_MathInstructions.cpp \
 	../../Interpreter_SystemIOInstructions.cpp \
+	../../InterpreterProfile.cpp \
 	../../Model.cpp \
 	../../Motor.cpp \
+	../../NativeCode.cpp \
 	../../NetworkConstants.cpp \
 	../../NetworkInterface.cpp \
 	../../NetworkPacket.cpp \
+	../../PollingLoops.cpp \
+	../../RobotIndex.cpp \
+	../../RobotPhysics.cpp \
 	../../RXEFile.cpp \
 	../../Robot.cpp \
 	../../RobotDrawer.cpp \
 	../../RobotTouchHandler.cpp \
+	../../RXEFileCache.cpp \
+	../../RXEVerifier.cpp \
 	../../SensorConfigurationScreen.cpp \
 	../../Server.cpp \
 	../../ServerBrowser.cpp \
@@ -55,6 +64,7 @@ LOCAL_SRC_FILES := \
 	../../UIView.cpp \
 	../../UserDefaults.cpp \
 	../../UserInterface.cpp \
+	../../VMDiagnostics.cpp \
 	../../VMMemory.cpp \
 	../../Vec4.cpp \
 
@@ -51,7 +51,7 @@ SoundBuffer *SoundController::bufferWithFilename(const std::string &filename) th
 		{
 			buffer = new SoundBuffer(filename.c_str());
 		}
-		catch (std::exception e)
+		catch (std::exception &e)
 		{
 			buffer = NULL;
 		}
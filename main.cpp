@@ -24,6 +24,8 @@ namespace
 	
 	unsigned actualWindowWidth = defaultWindowWidth;
 	unsigned actualWindowHeight = defaultWindowHeight;
+	
+	const unsigned targetFrameMilliseconds = 1000 / 60;
 }
 
 void initVideo(const char* filename)
@@ -122,6 +124,29 @@ void keyUp(const SDL_Event &event)
 }
 
 
+void sleepUntilTicks(unsigned frameEnd)
+{
+	// Sleep for the rest of the frame, but if the robot program is waiting
+	// and wakes up in between, give it its slice right then instead of at the
+	// start of the next frame.
+	while (true)
+	{
+		unsigned now = SDL_GetTicks();
+		if (now >= frameEnd) return;
+		
+		unsigned delay = frameEnd - now;
+		unsigned untilWake = controller->getMillisecondsUntilRobotWakes();
+		if (untilWake == 0 || untilWake >= delay)
+		{
+			SDL_Delay(delay);
+			return;
+		}
+		
+		SDL_Delay(untilWake);
+		controller->runRobotProgramSlice();
+	}
+}
+
 void runLoop()
 {
 	unsigned oldTime = SDL_GetTicks();
@@ -174,9 +199,10 @@ void runLoop()
 			controller->update(delta);
 			controller->draw();
 			
-			float targetDelta = 1.0f/60.0f;
-			float delay = targetDelta - delta;
-			if (delay > 0) SDL_Delay((unsigned) ( delay * 1000.0f) );
+			// Based on the start of this frame, not on the length of the last
+			// one, which included its sleep.
+			if (!controller->getRunsAsFastAsPossible())
+				sleepUntilTicks(newTime + targetFrameMilliseconds);
 			
 			SDL_GL_SwapBuffers();
 		}
@@ -203,6 +229,8 @@ extern "C" int main (int argc, char * argv[])
 	port[0] = 0;
 	bool robotUIOnServer = false;
 	bool noAutoDiscovery = false;
+	float timeWarp = 1.0f;
+	bool asFastAsPossible = false;
 	
 	Controller::NetworkMode mode = Controller::LetUserChoose;
 	unsigned flags = 0;
@@ -210,6 +238,7 @@ extern "C" int main (int argc, char * argv[])
 	for (int i = 1; i < argc; i++)
 	{
 		unsigned width, height;
+		float warp;
 		char serverTempString[255];
 		if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "-?") == 0)
 		{
@@ -221,6 +250,8 @@ extern "C" int main (int argc, char * argv[])
 			printf("\n\t-p=,--port=\tPort (default 10412) to connect to/of server");
 			printf("\n\t--robotUIOnServer Only valid for clients: Stuff like picking up and IO configuration is handled by server.\nOnly one such robot is allowed per server, and only if the server does not have a robot of its own.");	
 			printf("\n\t--noAutodiscovery Only valid for server: Do not respond to autodiscovery messages. This means clients have to know the port and IP address of a server to connect to it.");
+			printf("\n\t--timeWarp=\tRun the robot and physics on simulated time, this many times faster than real time (default 1)");
+			printf("\n\t--fast\tRun the robot and physics on simulated time, as fast as possible");
 			printf("\n\t--\tStop scanning for arguments.");
 		}
 		else if (sscanf(argv[i], "--width=%u", &width) == 1 || sscanf(argv[i], "-w=%u", &width) == 1)
@@ -240,6 +271,10 @@ extern "C" int main (int argc, char * argv[])
 			noAutoDiscovery = true;
 		else if (strcmp(argv[i], "--robotUIOnServer") == 0)
 			robotUIOnServer = true;
+		else if (sscanf(argv[i], "--timeWarp=%f", &warp) == 1 && warp > 0.0f)
+			timeWarp = warp;
+		else if (strcmp(argv[i], "--fast") == 0)
+			asFastAsPossible = true;
 		else if (strcmp(argv[i], "--") == 0)
 		{
 			if (argc > (i+1)) filename = argv[i+1];
@@ -258,6 +293,7 @@ extern "C" int main (int argc, char * argv[])
 		flags |= Controller::ServerFlagNoBroadcast;
 	
 	controller = new Controller(mode, flags, filename, server[0] ? server : NULL, port[0] ? port : NULL);
+	controller->setTimeWarp(timeWarp, asFastAsPossible);
 
 #ifdef _WIN32
 	// Get own path